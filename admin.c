@@ -0,0 +1,364 @@
+/* admin.c - Heavyweight administrative commands (DUMP, MEMORY) */
+#include "admin.h"   // Own header for configuration and prototypes
+#include "main.h"    // struct client, send_to_client, logging macros
+#include "workers.h" // struct job, workers_submit
+#include "tree.h"    // root, node_iter_t, node_path
+#include "mvcc.h"    // mvcc_snapshot_open, mvcc_visible
+#include "value.h"   // value_dup
+#include "packed.h"  // struct packed, packed_at
+#include "region.h"  // struct region, region_totals
+#include "vlog.h"    // vlog_close_fds
+#include "util.h"    // now_ns, write_all
+
+const char *admin_dump_dir = ".";
+
+/**
+ * @brief A heavyweight command in flight. The event loop forks a child at the moment the
+ * command runs: the child inherits a copy-on-write image of the whole tree, so it reads
+ * a consistent view without locks while the event loop keeps writing, and reports back
+ * through a pipe. A worker collects the report and reaps the child; the event loop only
+ * sends the reply.
+ */
+struct admin_job
+{
+    struct job job;    // Job header (must be first)
+    const char *name;  // Command name for the log
+    pid_t pid;         // The child producing the report
+    int fd;            // Read end of the pipe from the child
+    int status;        // The child's wait status
+    struct reply out;  // The report (the whole reply, prompt included)
+    uint64_t start_ns; // When the command was issued
+};
+
+/**
+ * @brief Worker side: reads the child's report until the child closes the pipe, then reaps it.
+ */
+static void admin_run(struct job *job)
+{
+    struct admin_job *a = (struct admin_job *)job;
+    char buf[BUFFER_SIZE];
+    ssize_t n;
+
+    while ((n = read(a->fd, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            break;
+        }
+        reply_append(&a->out, buf, (size_t)n);
+    }
+    close(a->fd);
+
+    while (waitpid(a->pid, &a->status, 0) == -1 && errno == EINTR)
+    {
+    }
+}
+
+/**
+ * @brief Event-loop side: sends the report (or an error) and frees the job.
+ */
+static void admin_done(struct job *job)
+{
+    struct admin_job *a = (struct admin_job *)job;
+    bool ok = WIFEXITED(a->status) && WEXITSTATUS(a->status) == 0 && !a->out.failed && a->out.len > 0;
+
+    info_log("%s: child %d finished in %.3f ms (worker %.3f ms)%s", a->name, (int)a->pid,
+             (now_ns() - a->start_ns) / 1e6, job->run_ns / 1e6, ok ? "" : ", failed");
+    if (job->client != NULL)
+    {
+        if (ok)
+        {
+            send_bytes_to_client(job->client, a->out.data, a->out.len);
+        }
+        else
+        {
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "ERR: %s failed. Check server logs.\n> ", a->name);
+            send_to_client(job->client, response);
+        }
+    }
+    reply_free(&a->out);
+    free(a);
+}
+
+/**
+ * @brief Forks the child that produces a report and hands the wait to a worker.
+ *
+ * @param client The connection receiving the reply.
+ * @param name Command name for the log and error replies.
+ * @param report Composes the reply in the child.
+ * @return 0 if the command is under way, -1 if it could not be started (nothing was sent).
+ */
+static int admin_launch(struct client *client, const char *name, void (*report)(struct reply *out))
+{
+    if (!workers_accepting())
+    {
+        return -1;
+    }
+
+    struct admin_job *a = (struct admin_job *)calloc(1, sizeof(*a));
+    if (a == NULL)
+    {
+        return -1;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+    {
+        error_log("%s: pipe failed: %s", name, strerror(errno));
+        free(a);
+        return -1;
+    }
+
+    a->start_ns = now_ns();
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        error_log("%s: fork failed: %s", name, strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        free(a);
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        // Child: keep only the pipe (and the value log, see vlog.h), so client sockets close
+        // when the server closes them.
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        if (fds[1] != 3)
+        {
+            dup2(fds[1], 3);
+        }
+        vlog_close_fds(4);
+
+        struct reply out;
+        reply_init(&out);
+        report(&out);
+        int rc = (out.failed || write_all(3, out.data, out.len) == -1) ? 1 : 0;
+        _exit(rc); // Skip atexit handlers and the parent's buffered stdout.
+    }
+
+    close(fds[1]);
+    a->job.run = admin_run;
+    a->job.done = admin_done;
+    a->name = name;
+    a->pid = pid;
+    a->fd = fds[0];
+    reply_init(&a->out);
+    workers_submit(&a->job, client); // Cannot fail: workers_accepting() was checked above.
+    debug_log("%s: started child %d", name, (int)pid);
+    return 0;
+}
+
+/**
+ * @brief DUMP report (child): writes every visible key as a replayable SET line to a new
+ * file in admin_dump_dir.
+ */
+static void dump_report(struct reply *out)
+{
+    char file[PATH_MAX_LEN + 64];
+    snprintf(file, sizeof(file), "%s/memodb-%lld-%d.dump", admin_dump_dir, (long long)time(NULL), (int)getpid());
+
+    FILE *f = fopen(file, "w");
+    if (f == NULL)
+    {
+        reply_printf(out, "ERR: Cannot create '%s': %s\n> ", file, strerror(errno));
+        return;
+    }
+
+    uint64_t snapshot = mvcc_snapshot_open();
+    uint64_t paths = 0, keys = 0;
+    char path[PATH_MAX_LEN];
+    node_iter_t it;
+    Node *n;
+
+    node_iter_init(&it, &root.node, false);
+    while ((n = node_iter_next(&it)) != NULL)
+    {
+        uint64_t before = keys;
+        node_path(n, path, sizeof(path));
+
+        for (Leaf *leaf = n->east; leaf != NULL; leaf = leaf->east)
+        {
+            Leaf *visible = mvcc_visible(leaf, snapshot);
+            char *value = visible ? value_dup(visible) : NULL;
+            if (value != NULL)
+            {
+                fprintf(f, "SET %s %s %s\n", path, (char *)leaf->key, value);
+                free(value);
+                keys++;
+            }
+        }
+
+        Leaf view;
+        for (unsigned i = 0; packed_at(n, i, &view) != NULL; i++)
+        {
+            char *value = value_dup(&view);
+            if (value != NULL)
+            {
+                fprintf(f, "SET %s %s %s\n", path, (char *)view.key, value);
+                free(value);
+                keys++;
+            }
+        }
+        paths += (keys > before);
+    }
+
+    long bytes = ftell(f);
+    if (ferror(f) | fclose(f))
+    {
+        reply_printf(out, "ERR: Writing '%s' failed: %s\n> ", file, strerror(errno));
+        unlink(file);
+        return;
+    }
+    reply_printf(out, "OK: dumped %llu paths, %llu keys to %s (%ld bytes)\n> ", (unsigned long long)paths,
+                 (unsigned long long)keys, file, bytes);
+}
+
+/**
+ * @brief One file's footprint, for the MEMORY ranking.
+ */
+struct file_usage
+{
+    char path[PATH_MAX_LEN]; // The file
+    uint32_t keys;           // Keys (leaves, tombstones included, or packed entries)
+    size_t bytes;            // Node, indexes, packed buffer, region and out-of-region leaves
+};
+
+/**
+ * @brief Bytes held by an index's bucket array.
+ */
+static size_t index_bytes(const struct hindex *idx)
+{
+    return idx->buckets ? ((size_t)idx->mask + 1) * sizeof(struct hlink *) : 0;
+}
+
+/**
+ * @brief MEMORY report (child): totals per structure and the files using the most memory.
+ */
+static void memory_report(struct reply *out)
+{
+    struct file_usage top[ADMIN_TOP_FILES];
+    unsigned ntop = 0;
+    uint64_t paths = 0, keys = 0, shared = 0, compressed = 0, cold = 0, packed_files = 0;
+    size_t node_bytes = 0, index_total = 0, packed_bytes = 0, leaf_bytes = 0;
+    size_t key_bytes = 0, value_bytes = 0, stored_bytes = 0;
+    node_iter_t it;
+    Node *n;
+
+    node_iter_init(&it, &root.node, false);
+    while ((n = node_iter_next(&it)) != NULL)
+    {
+        size_t bytes = sizeof(Node) + index_bytes(&n->children) + index_bytes(&n->keys);
+        paths++;
+        node_bytes += sizeof(Node);
+        index_total += index_bytes(&n->children) + index_bytes(&n->keys);
+
+        for (Leaf *leaf = n->east; leaf != NULL; leaf = leaf->east)
+        {
+            key_bytes += strlen((char *)leaf->key);
+            value_bytes += (size_t)leaf->size;
+            stored_bytes += (leaf->flags & LeafCold) ? 0 : (size_t)leaf->stored_size;
+            shared += (leaf->flags & LeafShared) != 0;
+            compressed += (leaf->flags & LeafCompressed) != 0;
+            cold += (leaf->flags & LeafCold) != 0;
+            if (n->region == NULL)
+            {
+                // Outside a region, the leaf and (unless shared or cold) its value are separate allocations.
+                size_t own = sizeof(Leaf) + ((leaf->flags & (LeafShared | LeafCold)) ? 0 : (size_t)leaf->stored_size);
+                leaf_bytes += own;
+                bytes += own;
+            }
+        }
+
+        Leaf view;
+        for (unsigned i = 0; packed_at(n, i, &view) != NULL; i++)
+        {
+            key_bytes += strlen((char *)view.key);
+            value_bytes += (size_t)view.size;
+            stored_bytes += (size_t)view.size;
+        }
+        if (n->packed != NULL)
+        {
+            size_t size = sizeof(struct packed) + n->packed->cap;
+            packed_files++;
+            packed_bytes += size;
+            bytes += size;
+        }
+        if (n->region != NULL)
+        {
+            bytes += n->region->reserved;
+        }
+        keys += n->nleaves;
+
+        // Keep the ADMIN_TOP_FILES largest, biggest first.
+        unsigned pos = ntop;
+        while (pos > 0 && top[pos - 1].bytes < bytes)
+        {
+            pos--;
+        }
+        if (pos < ADMIN_TOP_FILES)
+        {
+            if (ntop < ADMIN_TOP_FILES)
+            {
+                ntop++;
+            }
+            memmove(&top[pos + 1], &top[pos], (ntop - 1 - pos) * sizeof(top[0]));
+            node_path(n, top[pos].path, sizeof(top[pos].path));
+            top[pos].keys = n->nleaves;
+            top[pos].bytes = bytes;
+        }
+    }
+
+    size_t reserved, live;
+    region_totals(&reserved, &live);
+
+    reply_printf(out, "OK: memory report\n");
+    reply_printf(out, "  Paths: %llu (nodes %zu bytes, indexes %zu bytes)\n", (unsigned long long)paths,
+                 node_bytes, index_total);
+    reply_printf(out,
+                 "  Keys: %llu (keys %zu bytes, values %zu bytes raw / %zu stored in memory, compressed=%llu "
+                 "shared=%llu cold=%llu)\n",
+                 (unsigned long long)keys, key_bytes, value_bytes, stored_bytes, (unsigned long long)compressed,
+                 (unsigned long long)shared, (unsigned long long)cold);
+    reply_printf(out, "  Leaves outside regions: %zu bytes\n", leaf_bytes);
+    reply_printf(out, "  Regions: reserved %zu bytes, live %zu bytes\n", reserved, live);
+    reply_printf(out, "  Packed: %llu files, %zu bytes\n", (unsigned long long)packed_files, packed_bytes);
+    reply_printf(out, "  Largest files:\n");
+    for (unsigned i = 0; i < ntop; i++)
+    {
+        reply_printf(out, "    %s keys=%u bytes=%zu\n", top[i].path, top[i].keys, top[i].bytes);
+    }
+    reply_printf(out, "> ");
+}
+
+/**
+ * @brief Implements the DUMP command: writes every key to a new file in the dump directory
+ * as SET commands that rebuild the database when replayed. The dump reflects the moment
+ * the command ran; the reply, with the file name, goes out when it is written.
+ *
+ * @param client The connection receiving the reply.
+ * @return 0 if the dump is under way, -1 if it could not be started (nothing was sent).
+ */
+int admin_dump(struct client *client)
+{
+    return admin_launch(client, "DUMP", dump_report);
+}
+
+/**
+ * @brief Implements the MEMORY command: reports where memory goes (per structure, and the
+ * files using the most) as of the moment the command ran.
+ *
+ * @param client The connection receiving the reply.
+ * @return 0 if the report is under way, -1 if it could not be started (nothing was sent).
+ */
+int admin_memory(struct client *client)
+{
+    return admin_launch(client, "MEMORY", memory_report);
+}
@@ -0,0 +1,17 @@
+/* admin.h - Heavyweight administrative commands (DUMP, MEMORY) */
+#ifndef ADMIN_H
+#define ADMIN_H
+
+#include <stddef.h> // size_t
+
+// Configuration constants
+#define ADMIN_TOP_FILES 10 // Largest files listed by MEMORY
+
+struct client;
+
+extern const char *admin_dump_dir; // Directory DUMP writes to (--dump-dir, default ".")
+
+int admin_dump(struct client *client);
+int admin_memory(struct client *client);
+
+#endif /* ADMIN_H */
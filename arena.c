@@ -0,0 +1,280 @@
+/* arena.c - Huge-page backed arena allocator for tree structures and values */
+#include "arena.h" // Own header for configuration and prototypes
+#include "numa.h"  // numa_bind_local
+
+#include <stdio.h>    // snprintf, fopen, perror
+#include <stdlib.h>   // malloc, free, realloc
+#include <string.h>   // strcmp, strncmp
+#include <sys/mman.h> // mmap, munmap, madvise
+
+arena_mode_t arena_mode = ARENA_HUGE;
+
+/**
+ * @brief Bookkeeping for one mapped chunk (kept outside the chunk itself).
+ */
+struct arena_chunk
+{
+    uint8_t *base;     // Start of the 2 MB mapping
+    chunk_kind_t kind; // How the chunk is backed
+    int node;          // NUMA node the chunk is bound to, -1 for first-touch placement
+};
+
+/**
+ * @brief Global arena state. The server is single-threaded, so no locking is needed.
+ */
+static struct
+{
+    struct arena_chunk *chunks;       // All chunks ever mapped
+    size_t nchunks;                   // Chunks in use
+    size_t chunks_cap;                // Capacity of `chunks`
+    uint8_t *bump;                    // Next free byte in the newest chunk
+    uint8_t *bump_end;                // End of the newest chunk
+    void *free_lists[ARENA_CLASSES];  // Intrusive free list per size class
+    size_t in_use;                    // Bytes handed out (rounded to size classes)
+    size_t large_in_use;              // Bytes handed out through the malloc fallback
+    size_t chunks_by_kind[3];         // Chunk count per chunk_kind_t
+} arena;
+
+/**
+ * @brief Selects the arena mode by name ("huge", "thp" or "malloc").
+ * Must be called before the first allocation.
+ * @return 0 on success, -1 on an unknown name.
+ */
+int arena_set_mode(const char *name)
+{
+    if (strcmp(name, "huge") == 0)
+    {
+        arena_mode = ARENA_HUGE;
+    }
+    else if (strcmp(name, "thp") == 0)
+    {
+        arena_mode = ARENA_THP;
+    }
+    else if (strcmp(name, "malloc") == 0)
+    {
+        arena_mode = ARENA_MALLOC;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the name of the current arena mode.
+ */
+const char *arena_mode_name(void)
+{
+    static const char *names[] = {"huge", "thp", "malloc"};
+    return names[arena_mode];
+}
+
+/**
+ * @brief Maps one chunk, preferring huge pages.
+ * @param kind Receives how the chunk ended up being backed.
+ * @return The chunk base (2 MB aligned), or NULL if the kernel refused the mapping.
+ */
+static uint8_t *map_chunk(chunk_kind_t *kind)
+{
+#ifdef MAP_HUGETLB
+    if (arena_mode == ARENA_HUGE)
+    {
+        // Explicit huge pages only work when the admin reserved some (vm.nr_hugepages).
+        void *p = mmap(NULL, ARENA_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+        {
+            *kind = CHUNK_HUGETLB;
+            return (uint8_t *)p;
+        }
+    }
+#endif
+
+    // Over-map so the chunk can be aligned to a huge-page boundary, then trim.
+    size_t len = ARENA_CHUNK_SIZE * 2;
+    uint8_t *raw = (uint8_t *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == (uint8_t *)MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    uint8_t *base = (uint8_t *)(((uintptr_t)raw + ARENA_CHUNK_SIZE - 1) & ~(uintptr_t)(ARENA_CHUNK_SIZE - 1));
+    size_t head = (size_t)(base - raw);
+    size_t tail = len - head - ARENA_CHUNK_SIZE;
+    if (head)
+    {
+        munmap(raw, head);
+    }
+    if (tail)
+    {
+        munmap(base + ARENA_CHUNK_SIZE, tail);
+    }
+
+    *kind = CHUNK_PLAIN;
+#ifdef MADV_HUGEPAGE
+    if (madvise(base, ARENA_CHUNK_SIZE, MADV_HUGEPAGE) == 0)
+    {
+        *kind = CHUNK_THP;
+    }
+#endif
+    return base;
+}
+
+/**
+ * @brief Maps a new chunk and makes it the bump-allocation target.
+ * @return 0 on success, -1 on failure.
+ */
+static int add_chunk(void)
+{
+    if (arena.nchunks == arena.chunks_cap)
+    {
+        size_t cap = arena.chunks_cap ? arena.chunks_cap * 2 : 16;
+        struct arena_chunk *chunks = (struct arena_chunk *)realloc(arena.chunks, cap * sizeof(*chunks));
+        if (chunks == NULL)
+        {
+            return -1;
+        }
+        arena.chunks = chunks;
+        arena.chunks_cap = cap;
+    }
+
+    chunk_kind_t kind;
+    uint8_t *base = map_chunk(&kind);
+    if (base == NULL)
+    {
+        perror("ERROR: Failed to map arena chunk");
+        return -1;
+    }
+
+    arena.chunks[arena.nchunks].base = base;
+    arena.chunks[arena.nchunks].kind = kind;
+    // Keep the chunk on the allocating thread's node even if another thread touches it first.
+    arena.chunks[arena.nchunks].node = numa_bind_local(base, ARENA_CHUNK_SIZE);
+    arena.nchunks++;
+    arena.chunks_by_kind[kind]++;
+    arena.bump = base;
+    arena.bump_end = base + ARENA_CHUNK_SIZE;
+    return 0;
+}
+
+/**
+ * @brief Allocates memory for a tree structure or value.
+ * Small requests are served from per-size-class free lists or by bumping through
+ * huge-page chunks, so nodes, leaves and values end up packed into few TLB entries.
+ *
+ * @param size Requested size in bytes (the same size must be passed to arena_free).
+ * @return Pointer to uninitialized memory, or NULL on failure.
+ */
+void *arena_alloc(size_t size)
+{
+    if (arena_mode == ARENA_MALLOC || size == 0 || size > ARENA_MAX_SMALL)
+    {
+        void *p = malloc(size);
+        if (p != NULL)
+        {
+            arena.large_in_use += size;
+        }
+        return p;
+    }
+
+    size_t cls = (size - 1) / ARENA_GRANULE;
+    size_t rounded = (cls + 1) * ARENA_GRANULE;
+
+    void *p = arena.free_lists[cls];
+    if (p != NULL)
+    {
+        arena.free_lists[cls] = *(void **)p; // Pop the free list.
+    }
+    else
+    {
+        if (arena.bump == NULL || arena.bump + rounded > arena.bump_end)
+        {
+            // The tail of the old chunk (< ARENA_MAX_SMALL bytes) is simply left unused.
+            if (add_chunk() != 0)
+            {
+                return NULL;
+            }
+        }
+        p = arena.bump;
+        arena.bump += rounded;
+    }
+
+    arena.in_use += rounded;
+    return p;
+}
+
+/**
+ * @brief Returns memory obtained from arena_alloc.
+ * @param ptr The pointer returned by arena_alloc (NULL is ignored).
+ * @param size The size that was passed to arena_alloc.
+ */
+void arena_free(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    if (arena_mode == ARENA_MALLOC || size == 0 || size > ARENA_MAX_SMALL)
+    {
+        arena.large_in_use -= size;
+        free(ptr);
+        return;
+    }
+
+    size_t cls = (size - 1) / ARENA_GRANULE;
+    *(void **)ptr = arena.free_lists[cls]; // Push onto the free list.
+    arena.free_lists[cls] = ptr;
+    arena.in_use -= (cls + 1) * ARENA_GRANULE;
+}
+
+/**
+ * @brief Returns the bytes currently handed out (size classes plus the malloc fallback).
+ */
+size_t arena_bytes_in_use(void)
+{
+    return arena.in_use + arena.large_in_use;
+}
+
+/**
+ * @brief Reads a size field (in kB) from /proc/self/smaps_rollup.
+ * @return The value in kB, or 0 if unavailable.
+ */
+static unsigned long smaps_kb(const char *field)
+{
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    unsigned long kb = 0;
+    size_t len = strlen(field);
+
+    if (f == NULL)
+    {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        if (strncmp(line, field, len) == 0 && line[len] == ':')
+        {
+            kb = strtoul(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+/**
+ * @brief Formats arena usage and huge-page backing for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int arena_stats(char *buf, size_t cap)
+{
+    return snprintf(buf, cap,
+                    "  Arena: mode=%s chunks=%zu (hugetlb=%zu thp=%zu plain=%zu) reserved=%zu in_use=%zu "
+                    "large=%zu bytes process_huge: anon=%lu kB hugetlb=%lu kB\n",
+                    arena_mode_name(), arena.nchunks, arena.chunks_by_kind[CHUNK_HUGETLB],
+                    arena.chunks_by_kind[CHUNK_THP], arena.chunks_by_kind[CHUNK_PLAIN],
+                    arena.nchunks * ARENA_CHUNK_SIZE, arena.in_use, arena.large_in_use,
+                    smaps_kb("AnonHugePages"), smaps_kb("Private_Hugetlb"));
+}
@@ -0,0 +1,47 @@
+/* arena.h - Huge-page backed arena allocator for tree structures and values */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint8_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define ARENA_CHUNK_SIZE (2UL * 1024 * 1024) // One chunk = one 2 MB huge page on x86-64
+#define ARENA_GRANULE 16                     // Size-class granularity in bytes
+#define ARENA_MAX_SMALL 2048                 // Larger requests go straight to malloc
+#define ARENA_CLASSES (ARENA_MAX_SMALL / ARENA_GRANULE)
+
+/**
+ * @brief Where arena chunks come from.
+ * ARENA_HUGE tries explicit huge pages (MAP_HUGETLB), then transparent huge pages
+ * (madvise(MADV_HUGEPAGE) on 2 MB aligned chunks), then plain anonymous memory.
+ * ARENA_MALLOC bypasses the arena entirely (the "without" side of the benchmark).
+ */
+typedef enum
+{
+    ARENA_HUGE,  // Huge pages where available, with fallbacks (default)
+    ARENA_THP,   // Transparent huge pages only (skip MAP_HUGETLB)
+    ARENA_MALLOC // Plain malloc/free
+} arena_mode_t;
+
+/**
+ * @brief How a chunk ended up being backed.
+ */
+typedef enum
+{
+    CHUNK_HUGETLB, // Explicit huge page (MAP_HUGETLB)
+    CHUNK_THP,     // Regular mapping advised with MADV_HUGEPAGE
+    CHUNK_PLAIN    // Regular mapping, no huge-page hint accepted
+} chunk_kind_t;
+
+extern arena_mode_t arena_mode;
+
+int arena_set_mode(const char *name);
+const char *arena_mode_name(void);
+void *arena_alloc(size_t size);
+void arena_free(void *ptr, size_t size);
+size_t arena_bytes_in_use(void);
+int arena_stats(char *buf, size_t cap);
+
+#endif /* ARENA_H */
@@ -0,0 +1,399 @@
+/* bench.c - Lookup latency benchmark for the MemoDB tree (run with `make bench`) */
+#include "tree.h"  // Tree structures and lookup functions
+#include "arena.h" // Arena modes and statistics
+#include "hash.h"  // hash_init
+#include "mvcc.h"  // MVCC_LATEST
+#include "packed.h" // packed_set (small-file encoding)
+#include "value.h" // value_store, value_dup
+#include "lsm.h"   // The lsm engine (mixed workloads)
+#include "util.h"  // now_ns
+
+#include <dirent.h> // Cleaning up the lsm directory
+
+// Benchmark defaults
+#define BENCH_FILES 500      // Number of file nodes under the root
+#define BENCH_KEYS 200       // Keys per file
+#define BENCH_LOOKUPS 20000  // Timed lookups
+#define BENCH_VALUE_LEN 64   // Value size in bytes
+#define BENCH_BATCHES 5000   // Timed MGET-style batches (LOOKUP_BATCH_GROUP keys of one file each)
+#define BENCH_SMALL_FILES 10000 // Small files whose memory is compared packed vs. as leaves
+#define BENCH_SMALL_KEYS 8      // Keys per small file
+#define BENCH_SMALL_VALUE 16    // Value size in small files
+#define BENCH_MIXED_FILES 100   // Files of the mixed workloads
+#define BENCH_MIXED_KEYS 200000 // Distinct keys, spread over the files
+#define BENCH_MIXED_OPS 200000  // Timed operations per workload
+#define BENCH_MIXED_VALUE 100   // Value size in the mixed workloads
+
+/**
+ * @brief xorshift64 PRNG, so runs are reproducible across modes.
+ */
+static uint64_t next_rand(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/**
+ * @brief Times BENCH_BATCHES batches of random keys of random files, looked up either one
+ * after another (find_leaf_at) or together (find_leaves_batch).
+ * @return Mean nanoseconds per key.
+ */
+static double bench_batches(Node **nodes, int files, int keys, uint64_t *rng, bool batched, int *misses)
+{
+    char names[LOOKUP_BATCH_GROUP][32];
+    const char *batch[LOOKUP_BATCH_GROUP];
+    Leaf *out[LOOKUP_BATCH_GROUP];
+    Leaf views[LOOKUP_BATCH_GROUP];
+    uint64_t total = 0;
+
+    for (int b = 0; b < BENCH_BATCHES; b++)
+    {
+        Node *node = nodes[next_rand(rng) % files];
+        for (int i = 0; i < LOOKUP_BATCH_GROUP; i++)
+        {
+            snprintf(names[i], sizeof(names[i]), "key%d", (int)(next_rand(rng) % keys));
+            batch[i] = names[i];
+        }
+
+        uint64_t start = now_ns();
+        if (batched)
+        {
+            find_leaves_batch(node, batch, LOOKUP_BATCH_GROUP, MVCC_LATEST, out, views);
+        }
+        else
+        {
+            for (int i = 0; i < LOOKUP_BATCH_GROUP; i++)
+            {
+                out[i] = find_leaf_at(node, batch[i], MVCC_LATEST);
+            }
+        }
+        total += now_ns() - start;
+
+        for (int i = 0; i < LOOKUP_BATCH_GROUP; i++)
+        {
+            *misses += (out[i] == NULL);
+        }
+    }
+    return (double)total / ((double)BENCH_BATCHES * LOOKUP_BATCH_GROUP);
+}
+
+/**
+ * @brief Fills BENCH_SMALL_FILES files of BENCH_SMALL_KEYS keys each, either packed or
+ * as one Leaf per key, and empties the tree again.
+ * @return Bytes of tree memory per key (nodes, indexes, leaves and values).
+ */
+static double bench_small_files(bool packed)
+{
+    uint8_t value[BENCH_SMALL_VALUE];
+    char name[32], key[32];
+    size_t before = arena_bytes_in_use();
+
+    memset(value, 's', sizeof(value));
+    for (int f = 0; f < BENCH_SMALL_FILES; f++)
+    {
+        snprintf(name, sizeof(name), "small%d", f);
+        Node *node = create_node(&root.node, (int8_t *)name);
+        for (int k = 0; node != NULL && k < BENCH_SMALL_KEYS; k++)
+        {
+            snprintf(key, sizeof(key), "field%d", k);
+            if (packed)
+            {
+                packed_set(node, key, value, sizeof(value), 1);
+            }
+            else
+            {
+                create_leaf((Tree *)node, (uint8_t *)key, value, sizeof(value));
+            }
+        }
+    }
+
+    double per_key = (double)(arena_bytes_in_use() - before) / (BENCH_SMALL_FILES * BENCH_SMALL_KEYS);
+    free_tree(&root);
+    return per_key;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief A mixed workload: the share of GETs and SETs (the rest are DELs).
+ */
+struct mix
+{
+    const char *name;
+    int get_pct;
+    int set_pct;
+};
+
+/**
+ * @brief Runs one GET, SET or DEL against the tree (as db_get/db_set/db_del do, minus
+ * the server) or against the lsm engine.
+ */
+static void mixed_op(bool lsm, Node *node, const path_t *path, const char *key, const char *value, int op)
+{
+    uint16_t len = (uint16_t)strlen(value);
+    if (lsm)
+    {
+        if (op == 0)
+        {
+            free(lsm_get(path, key));
+        }
+        else if (op == 1)
+        {
+            lsm_set(path, key, value);
+        }
+        else
+        {
+            lsm_del(path, key);
+        }
+        return;
+    }
+
+    Leaf *leaf = find_leaf_at(node, key, MVCC_LATEST);
+    if (op == 0)
+    {
+        free(leaf ? value_dup(leaf) : NULL);
+    }
+    else if (op == 1)
+    {
+        if (leaf)
+        {
+            value_store(leaf, (const uint8_t *)value, len);
+        }
+        else
+        {
+            create_leaf((Tree *)node, (uint8_t *)key, (uint8_t *)value, len);
+        }
+    }
+    else if (leaf)
+    {
+        unlink_leaf(node, leaf);
+        free_leaf(leaf);
+    }
+}
+
+/**
+ * @brief Loads BENCH_MIXED_KEYS keys, then times BENCH_MIXED_OPS random operations of
+ * each mix, on the tree or on the lsm engine.
+ * @param lat BENCH_MIXED_OPS latencies (scratch).
+ * @param mean, p99 Receive the mean and 99th percentile of each mix, in nanoseconds.
+ */
+static void bench_mixed_run(bool lsm, const struct mix *mixes, int nmixes, uint64_t *lat, double *mean, uint64_t *p99)
+{
+    Node *nodes[BENCH_MIXED_FILES];
+    path_t paths[BENCH_MIXED_FILES];
+    char name[32], key[32], value[BENCH_MIXED_VALUE + 1];
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+    for (int f = 0; f < BENCH_MIXED_FILES; f++)
+    {
+        snprintf(name, sizeof(name), "mixed%d", f);
+        nodes[f] = lsm ? NULL : create_node(&root.node, (int8_t *)name);
+        path_parse(&paths[f], name);
+    }
+    memset(value, 'm', BENCH_MIXED_VALUE);
+    value[BENCH_MIXED_VALUE] = '\0';
+    for (int k = 0; k < BENCH_MIXED_KEYS; k++)
+    {
+        snprintf(key, sizeof(key), "key%d", k);
+        mixed_op(lsm, nodes[k % BENCH_MIXED_FILES], &paths[k % BENCH_MIXED_FILES], key, value, 1);
+    }
+
+    for (int m = 0; m < nmixes; m++)
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < BENCH_MIXED_OPS; i++)
+        {
+            int k = (int)(next_rand(&rng) % BENCH_MIXED_KEYS);
+            int pct = (int)(next_rand(&rng) % 100);
+            int op = pct < mixes[m].get_pct ? 0 : pct < mixes[m].get_pct + mixes[m].set_pct ? 1 : 2;
+            snprintf(key, sizeof(key), "key%d", k);
+
+            uint64_t start = now_ns();
+            mixed_op(lsm, nodes[k % BENCH_MIXED_FILES], &paths[k % BENCH_MIXED_FILES], key, value, op);
+            lat[i] = now_ns() - start;
+            total += lat[i];
+        }
+        qsort(lat, BENCH_MIXED_OPS, sizeof(uint64_t), cmp_u64);
+        mean[m] = (double)total / BENCH_MIXED_OPS;
+        p99[m] = lat[BENCH_MIXED_OPS * 99 / 100];
+    }
+}
+
+/**
+ * @brief Compares the in-memory tree with the lsm engine (in a scratch directory under
+ * `dir`) on read-heavy, balanced and write-heavy workloads.
+ */
+static int bench_mixed(const char *dir)
+{
+    static const struct mix mixes[] = {{"read-heavy", 90, 9}, {"balanced", 50, 45}, {"write-heavy", 10, 80}};
+    enum { NMIXES = sizeof(mixes) / sizeof(mixes[0]) };
+    double mean[2][NMIXES];
+    uint64_t p99[2][NMIXES];
+    char scratch[PATH_MAX_LEN];
+
+    snprintf(scratch, sizeof(scratch), "%s/memodb-bench-XXXXXX", dir);
+    uint64_t *lat = (uint64_t *)malloc(BENCH_MIXED_OPS * sizeof(uint64_t));
+    if (lat == NULL || mkdtemp(scratch) == NULL)
+    {
+        perror("mixed");
+        free(lat);
+        return 1;
+    }
+
+    bench_mixed_run(false, mixes, NMIXES, lat, mean[0], p99[0]);
+    free_tree(&root);
+
+    lsm_dir = scratch;
+    if (lsm_init() != 0)
+    {
+        free(lat);
+        return 1;
+    }
+    bench_mixed_run(true, mixes, NMIXES, lat, mean[1], p99[1]);
+    char stats[1024];
+    lsm_stats(stats, sizeof(stats));
+    lsm_shutdown();
+
+    for (int m = 0; m < NMIXES; m++)
+    {
+        printf("mixed %-11s (%d%% GET %d%% SET %d%% DEL, %d keys): memory=%.0f ns/op p99=%llu ns  "
+               "lsm=%.0f ns/op p99=%llu ns\n",
+               mixes[m].name, mixes[m].get_pct, mixes[m].set_pct, 100 - mixes[m].get_pct - mixes[m].set_pct,
+               BENCH_MIXED_KEYS, mean[0][m], (unsigned long long)p99[0][m], mean[1][m],
+               (unsigned long long)p99[1][m]);
+    }
+    printf("%s", stats);
+
+    // Remove the scratch directory.
+    DIR *d = opendir(scratch);
+    struct dirent *de;
+    char file[PATH_MAX_LEN + 256];
+    while (d != NULL && (de = readdir(d)) != NULL)
+    {
+        if (de->d_name[0] != '.')
+        {
+            snprintf(file, sizeof(file), "%s/%s", scratch, de->d_name);
+            unlink(file);
+        }
+    }
+    if (d != NULL)
+    {
+        closedir(d);
+    }
+    rmdir(scratch);
+    free(lat);
+    return 0;
+}
+
+/**
+ * Usage: memodb_bench [huge|thp|malloc] [files] [keys]
+ *        memodb_bench mixed [directory]
+ */
+int main(int argc, const char *argv[])
+{
+    const char *mode = argc > 1 ? argv[1] : "huge";
+    int files = argc > 2 ? atoi(argv[2]) : BENCH_FILES;
+    int keys = argc > 3 ? atoi(argv[3]) : BENCH_KEYS;
+    uint8_t value[BENCH_VALUE_LEN];
+    char name[64], key[64];
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+    bool mixed = strcmp(mode, "mixed") == 0;
+    if (!mixed && (arena_set_mode(mode) != 0 || files <= 0 || keys <= 0))
+    {
+        fprintf(stderr, "Usage: %s [huge|thp|malloc] [files] [keys]\n       %s mixed [directory]\n", argv[0],
+                argv[0]);
+        return 1;
+    }
+
+    hash_init();
+    root.node.tag = TagRoot;
+    snprintf((char *)root.node.path, sizeof(root.node.path), "root");
+    if (mixed)
+    {
+        return bench_mixed(argc > 2 ? argv[2] : "/tmp");
+    }
+    memset(value, 'v', sizeof(value));
+
+    Node **nodes = (Node **)calloc(files, sizeof(Node *));
+    if (nodes == NULL)
+    {
+        perror("calloc");
+        return 1;
+    }
+    for (int f = 0; f < files; f++)
+    {
+        snprintf(name, sizeof(name), "file%d", f);
+        nodes[f] = create_node(&root.node, (int8_t *)name);
+    }
+
+    // Insert key-major so each file's leaves are spread across memory, as in a live server.
+    for (int k = 0; k < keys; k++)
+    {
+        snprintf(key, sizeof(key), "key%d", k);
+        for (int f = 0; f < files; f++)
+        {
+            if (create_leaf((Tree *)nodes[f], (uint8_t *)key, value, sizeof(value)) == NULL)
+            {
+                perror("create_leaf");
+                return 1;
+            }
+        }
+    }
+
+    uint64_t *lat = (uint64_t *)malloc(BENCH_LOOKUPS * sizeof(uint64_t));
+    uint64_t total = 0;
+    int misses = 0;
+    if (lat == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+
+    for (int i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        snprintf(name, sizeof(name), "file%d", (int)(next_rand(&rng) % files));
+        snprintf(key, sizeof(key), "key%d", (int)(next_rand(&rng) % keys));
+
+        uint64_t start = now_ns();
+        Leaf *leaf = find_leaf_linear((int8_t *)name, (int8_t *)key);
+        lat[i] = now_ns() - start;
+
+        total += lat[i];
+        misses += (leaf == NULL);
+    }
+
+    qsort(lat, BENCH_LOOKUPS, sizeof(uint64_t), cmp_u64);
+
+    int batch_misses = 0;
+    double sequential = bench_batches(nodes, files, keys, &rng, false, &batch_misses);
+    double batched = bench_batches(nodes, files, keys, &rng, true, &batch_misses);
+
+    char stats[512];
+    arena_stats(stats, sizeof(stats));
+    printf("mode=%-6s files=%d keys=%d lookups=%d mean=%.0f ns p50=%llu ns p99=%llu ns misses=%d\n%s",
+           mode, files, keys, BENCH_LOOKUPS, (double)total / BENCH_LOOKUPS,
+           (unsigned long long)lat[BENCH_LOOKUPS / 2], (unsigned long long)lat[BENCH_LOOKUPS * 99 / 100],
+           misses, stats);
+    printf("multi-key: batches=%d x %d keys sequential=%.0f ns/key batched=%.0f ns/key misses=%d\n",
+           BENCH_BATCHES, LOOKUP_BATCH_GROUP, sequential, batched, batch_misses);
+
+    free(lat);
+    free(nodes);
+    uint64_t drop_start = now_ns();
+    free_tree(&root);
+    printf("drop: %d files x %d keys in %.2f ms\n", files, keys, (double)(now_ns() - drop_start) / 1e6);
+
+    double as_leaves = bench_small_files(false);
+    double as_packed = bench_small_files(true);
+    printf("small files: %d x %d keys (%d-byte values) leaves=%.0f bytes/key packed=%.0f bytes/key\n",
+           BENCH_SMALL_FILES, BENCH_SMALL_KEYS, BENCH_SMALL_VALUE, as_leaves, as_packed);
+    return 0;
+}
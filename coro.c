@@ -0,0 +1,155 @@
+/* coro.c - Stackless coroutines for long-running client commands */
+#include "coro.h" // Own header for configuration and prototypes
+#include "main.h" // struct client, resume_client
+
+/**
+ * @brief Suspended commands, run round-robin one step each per loop iteration.
+ */
+static struct
+{
+    struct coro *head;  // Next coroutine to step
+    struct coro *tail;  // Last coroutine of the queue
+    size_t active;      // Coroutines in the queue
+    uint64_t launched;  // Commands started
+    uint64_t suspended; // Commands that needed more than one step
+    uint64_t steps;     // Steps run
+    uint32_t longest;   // Most steps one command took
+} coros;
+
+static void enqueue(struct coro *co)
+{
+    co->next = NULL;
+    if (coros.tail != NULL)
+    {
+        coros.tail->next = co;
+    }
+    else
+    {
+        coros.head = co;
+    }
+    coros.tail = co;
+    coros.active++;
+}
+
+static struct coro *dequeue(void)
+{
+    struct coro *co = coros.head;
+    if (co != NULL)
+    {
+        coros.head = co->next;
+        if (coros.head == NULL)
+        {
+            coros.tail = NULL;
+        }
+        coros.active--;
+    }
+    return co;
+}
+
+/**
+ * @brief Runs one step and updates the counters.
+ */
+static int step(struct coro *co)
+{
+    int rc = co->step(co);
+    co->steps++;
+    coros.steps++;
+    if (rc == CORO_DONE && co->steps > coros.longest)
+    {
+        coros.longest = co->steps;
+    }
+    return rc;
+}
+
+/**
+ * @brief Starts a command: runs its first step right away, so short commands finish
+ * without a detour through the queue, and suspends it if work is left.
+ *
+ * @param co The command's coroutine (`step` and `release` set).
+ * @param client The connection it belongs to.
+ * @return 0 if the command already finished (its state is released), 1 if it was suspended.
+ */
+int coro_launch(struct coro *co, struct client *client)
+{
+    co->client = client;
+    co->steps = 0;
+    coros.launched++;
+
+    if (step(co) == CORO_DONE)
+    {
+        co->release(co);
+        return 0;
+    }
+    coros.suspended++;
+    client->coro = co;
+    enqueue(co);
+    return 1;
+}
+
+/**
+ * @brief Returns true if some command is suspended (the loop must not sleep then).
+ */
+bool coro_active(void)
+{
+    return coros.active > 0;
+}
+
+/**
+ * @brief Gives every suspended command one step. A command that finishes releases its
+ * connection, which then runs the commands that queued up behind it. Commands launched
+ * meanwhile get their next step on the following call.
+ */
+void coro_run(void)
+{
+    for (size_t n = coros.active; n > 0 && coros.head != NULL; n--)
+    {
+        struct coro *co = dequeue();
+        if (step(co) == CORO_YIELD)
+        {
+            enqueue(co);
+            continue;
+        }
+
+        struct client *client = co->client;
+        client->coro = NULL;
+        co->release(co);
+        resume_client(client);
+    }
+}
+
+/**
+ * @brief Abandons a suspended command (its connection is going away).
+ */
+void coro_cancel(struct coro *co)
+{
+    struct coro **link = &coros.head;
+    struct coro *prev = NULL;
+
+    while (*link != NULL && *link != co)
+    {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    if (*link == co)
+    {
+        *link = co->next;
+        if (coros.tail == co)
+        {
+            coros.tail = prev;
+        }
+        coros.active--;
+    }
+    co->client->coro = NULL;
+    co->release(co);
+}
+
+/**
+ * @brief Formats coroutine counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int coro_stats(char *buf, size_t cap)
+{
+    return snprintf(buf, cap, "  Commands: suspended_now=%zu launched=%llu resumable=%llu steps=%llu longest=%u steps\n",
+                    coros.active, (unsigned long long)coros.launched, (unsigned long long)coros.suspended,
+                    (unsigned long long)coros.steps, coros.longest);
+}
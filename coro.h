@@ -0,0 +1,40 @@
+/* coro.h - Stackless coroutines for long-running client commands */
+#ifndef CORO_H
+#define CORO_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint32_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define CORO_STEP_WORK 4096 // Work per step: keys listed, or nodes plus keys freed
+
+// Step results
+#define CORO_DONE 0  // The command finished (its reply is queued)
+#define CORO_YIELD 1 // More work left: run another step on the next loop iteration
+
+struct client;
+
+/**
+ * @brief A command that runs a step at a time. The command's state lives in a structure
+ * that embeds `struct coro` as its first member, so a step is a plain function resuming
+ * from that state (no separate stack). Between steps the event loop serves other clients;
+ * the owning connection reads no further commands until this one is done, so replies
+ * keep their order.
+ */
+struct coro
+{
+    int (*step)(struct coro *co);     // Runs one step; returns CORO_DONE or CORO_YIELD
+    void (*release)(struct coro *co); // Frees the state (after CORO_DONE, or when cancelled)
+    struct client *client;            // Connection the command came from
+    struct coro *next;                // Run queue link
+    uint32_t steps;                   // Steps run so far
+};
+
+int coro_launch(struct coro *co, struct client *client);
+bool coro_active(void);
+void coro_run(void);
+void coro_cancel(struct coro *co);
+int coro_stats(char *buf, size_t cap);
+
+#endif /* CORO_H */
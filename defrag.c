@@ -0,0 +1,193 @@
+/* defrag.c - Incremental defragmentation of file regions in idle time */
+#include "defrag.h" // Own header for configuration and prototypes
+#include "main.h"   // Logging macros
+#include "tree.h"   // root, node_iter_t, relocate_leaves
+#include "region.h" // region_waste, region_totals
+#include "mvcc.h"   // mvcc_idle, mvcc_snapshots_open
+#include "util.h"   // now_ns
+
+#ifdef __GLIBC__
+#include <malloc.h> // malloc_trim
+#endif
+
+/**
+ * @brief State of the current pass and counters for the `stats` command.
+ */
+static struct
+{
+    node_iter_t it;          // Position of the walk in the tree
+    uint64_t generation;     // tree_generation the position is valid for
+    bool running;            // A pass has started and not finished yet
+    size_t settled_waste;    // Dead region bytes when the last pass finished
+    double before;           // Fragmentation when the current pass started
+    uint32_t pass_files;     // Files rebuilt by the current pass
+    size_t pass_reclaimed;   // Bytes returned by the current pass
+    uint64_t pass_ns;        // Time spent in the current pass so far
+    uint64_t passes;         // Passes finished
+    uint64_t files;          // Files rebuilt by all passes
+    uint64_t reclaimed;      // Bytes returned by all passes
+    double last_before;      // Fragmentation when the last finished pass started...
+    double last_after;       // ...and when it finished
+    uint64_t last_ns;        // Time the last finished pass spent, over all its slices
+} defrag = {.last_before = 1.0, .last_after = 1.0};
+
+/**
+ * @brief Returns region bytes reserved per byte in use (1.0 means perfectly dense).
+ */
+static double fragmentation(size_t *waste)
+{
+    size_t reserved, live;
+    region_totals(&reserved, &live);
+    if (waste != NULL)
+    {
+        *waste = reserved - live;
+    }
+    return live ? (double)reserved / (double)live : 1.0;
+}
+
+/**
+ * @brief Returns true if a file's region is worth rebuilding.
+ */
+static bool fragmented(const Node *node)
+{
+    size_t waste = region_waste(node->region);
+    return waste >= DEFRAG_MIN_WASTE && waste * 100 >= node->region->reserved * DEFRAG_WASTE_PERCENT;
+}
+
+/**
+ * @brief Returns true if the defrag task has work: a pass is under way,
+ * or regions gained enough dead space since the last pass to make a new one worthwhile.
+ * Nothing can be moved while MVCC versions, tombstones or snapshots exist, so then nothing is pending.
+ */
+bool defrag_pending(void)
+{
+    if (!mvcc_idle() || mvcc_snapshots_open())
+    {
+        return false;
+    }
+    if (defrag.running)
+    {
+        return true;
+    }
+
+    size_t reserved, live;
+    region_totals(&reserved, &live);
+    size_t waste = reserved - live;
+    if (waste < defrag.settled_waste)
+    {
+        defrag.settled_waste = waste; // Files were dropped or compacted on write since.
+    }
+    return waste >= defrag.settled_waste + DEFRAG_MIN_WASTE && waste * 100 >= reserved * DEFRAG_WASTE_PERCENT;
+}
+
+/**
+ * @brief Ends the current pass and reports the fragmentation it left behind.
+ */
+static void finish_pass(void)
+{
+    defrag.last_before = defrag.before;
+    defrag.last_after = fragmentation(&defrag.settled_waste);
+    defrag.last_ns = defrag.pass_ns;
+    defrag.passes++;
+    defrag.running = false;
+
+#ifdef __GLIBC__
+    if (defrag.pass_reclaimed > 0)
+    {
+        malloc_trim(0); // Region blocks above ARENA_MAX_SMALL came from malloc.
+    }
+#endif
+
+    info_log("Defrag: pass %llu rebuilt %u files, reclaimed %zu bytes, fragmentation %.2f -> %.2f (%llu us)",
+             (unsigned long long)defrag.passes, defrag.pass_files, defrag.pass_reclaimed, defrag.last_before,
+             defrag.last_after, (unsigned long long)(defrag.last_ns / 1000));
+}
+
+/**
+ * @brief Runs one slice of the defrag pass: walks files from where the previous slice
+ * stopped and rebuilds fragmented regions until the walk ends or the budget is spent.
+ * The clock is read after every rebuild and every DEFRAG_CHECK_NODES nodes, so a slice
+ * overruns its budget by at most one file.
+ *
+ * @param budget_ns Time the slice may take.
+ * @return Number of files rebuilt in this slice.
+ */
+int defrag_cycle(uint64_t budget_ns)
+{
+    if (!defrag_pending())
+    {
+        return 0;
+    }
+
+    uint64_t start = now_ns();
+    if (!defrag.running)
+    {
+        defrag.running = true;
+        defrag.before = fragmentation(NULL);
+        defrag.pass_files = 0;
+        defrag.pass_reclaimed = 0;
+        defrag.pass_ns = 0;
+        defrag.generation = tree_generation - 1; // Forces the walk to start below.
+    }
+    if (defrag.generation != tree_generation)
+    {
+        // First slice, or a DROP freed nodes the saved position may point into.
+        node_iter_init(&defrag.it, &root.node, false);
+        defrag.generation = tree_generation;
+    }
+
+    int rebuilt = 0;
+    unsigned visited = 0;
+    Node *n;
+    while ((n = node_iter_next(&defrag.it)) != NULL)
+    {
+        if (fragmented(n))
+        {
+            size_t before = n->region->reserved;
+            int rc = relocate_leaves(n);
+            if (rc == 1)
+            {
+                size_t after = n->region ? n->region->reserved : 0;
+                defrag.pass_reclaimed += before - after;
+                defrag.pass_files++;
+                defrag.reclaimed += before - after;
+                defrag.files++;
+                rebuilt++;
+            }
+            else if (rc < 0)
+            {
+                debug_log("Defrag: out of memory rebuilding '%s', skipped", (char *)n->path);
+            }
+            visited = DEFRAG_CHECK_NODES; // A rebuild may have been long: check the clock now.
+        }
+
+        if (++visited >= DEFRAG_CHECK_NODES)
+        {
+            visited = 0;
+            if (now_ns() - start >= budget_ns)
+            {
+                defrag.pass_ns += now_ns() - start;
+                return rebuilt; // Resume from here in the next slice.
+            }
+        }
+    }
+
+    defrag.pass_ns += now_ns() - start;
+    finish_pass();
+    return rebuilt;
+}
+
+/**
+ * @brief Formats defrag counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int defrag_stats(char *buf, size_t cap)
+{
+    return snprintf(buf, cap,
+                    "  Defrag: state=%s passes=%llu files=%llu reclaimed=%llu bytes fragmentation=%.2f "
+                    "last_pass: %.2f -> %.2f in %llu us\n",
+                    defrag.running ? "running" : "idle", (unsigned long long)defrag.passes,
+                    (unsigned long long)defrag.files, (unsigned long long)defrag.reclaimed,
+                    fragmentation(NULL), defrag.last_before, defrag.last_after,
+                    (unsigned long long)(defrag.last_ns / 1000));
+}
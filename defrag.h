@@ -0,0 +1,30 @@
+/* defrag.h - Incremental defragmentation of file regions in idle time */
+#ifndef DEFRAG_H
+#define DEFRAG_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define DEFRAG_BUDGET_NS 1000000 // Time spent per slice (1 ms)
+#define DEFRAG_MIN_WASTE 4096    // Regions with less dead space are left alone...
+#define DEFRAG_WASTE_PERCENT 25  // ...and so are regions less than this much dead
+#define DEFRAG_CHECK_NODES 64    // Nodes visited between two clock reads
+
+/*
+ * Writes only compact a file's region once more than half of it is dead (see
+ * compact_leaves), which keeps the write path cheap but leaves many files between 25%
+ * and 50% fragmented. An idle-priority background task (see tasks.h) walks the tree a
+ * slice at a time while clients leave the loop alone and rebuilds those regions too
+ * (relocate_leaves moves the leaves and values and fixes the leaf list and key index).
+ * A slice never runs longer than its budget; the walk resumes where it stopped, and
+ * restarts if a DROP freed nodes in between. Each finished pass logs the fragmentation (bytes reserved in
+ * regions per byte in use) before and after.
+ */
+
+bool defrag_pending(void);
+int defrag_cycle(uint64_t budget_ns);
+int defrag_stats(char *buf, size_t cap);
+
+#endif /* DEFRAG_H */
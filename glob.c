@@ -0,0 +1,245 @@
+/* glob.c - Server-side evaluation of path patterns (GETGLOB) */
+#include "glob.h"  // Own header for the walk structure and prototypes
+#include "mvcc.h"  // MVCC_LATEST
+#include "value.h" // value_dup
+#include "table.h" // table_nth, table_get
+
+static uint64_t next_cursor; // Last cursor id handed out
+
+/**
+ * @brief Matches a name against a pattern where `*` matches any run of characters
+ * and `?` matches exactly one. Iterative, with single-star backtracking, so it runs in
+ * O(len(pattern) * len(name)) at worst and never recurses.
+ *
+ * @return True if the whole name matches.
+ */
+bool glob_match(const char *pattern, const char *name)
+{
+    const char *star = NULL;  // Last '*' seen in the pattern
+    const char *retry = NULL; // Position in `name` to retry from after that '*'
+
+    while (*name)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            retry = name;
+        }
+        else if (*pattern == '?' || *pattern == *name)
+        {
+            pattern++;
+            name++;
+        }
+        else if (star != NULL)
+        {
+            pattern = star + 1; // Let the last '*' swallow one more character.
+            name = ++retry;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+/**
+ * @brief First candidate for segment `level` below `parent`.
+ */
+static Node *first_candidate(struct glob_walk *w, Node *parent, uint16_t level)
+{
+    return w->literal[level] ? find_child(parent, w->seg[level]) : parent->first_child;
+}
+
+/**
+ * @brief Prepares a walk: splits the pattern into segments and resolves its literal prefix.
+ *
+ * @param w The walk to initialize.
+ * @param pattern A '/'-separated path pattern; segments may contain '*' and '?'.
+ * @param key The key to read at every matching path.
+ * @return 0 on success, -1 if the pattern is empty or too deep.
+ */
+int glob_walk_start(struct glob_walk *w, const char *pattern, const char *key)
+{
+    char *saveptr;
+
+    memset(w, 0, sizeof(*w));
+    snprintf(w->text, sizeof(w->text), "%s", pattern);
+    snprintf(w->pattern, sizeof(w->pattern), "%s", pattern);
+    snprintf(w->key, sizeof(w->key), "%s", key);
+
+    for (char *s = strtok_r(w->pattern, "/", &saveptr); s != NULL; s = strtok_r(NULL, "/", &saveptr))
+    {
+        if (w->nseg == GLOB_MAX_SEGMENTS)
+        {
+            return -1;
+        }
+        w->literal[w->nseg] = (strpbrk(s, "*?") == NULL);
+        w->seg[w->nseg++] = s;
+    }
+    if (w->nseg == 0)
+    {
+        return -1;
+    }
+
+    // Resolve the literal prefix directly: no need to walk anything above the first wildcard.
+    w->base_node = &root.node;
+    while (w->base < w->nseg && w->literal[w->base] && w->base_node != NULL)
+    {
+        w->base_node = find_child(w->base_node, w->seg[w->base]);
+        w->base++;
+    }
+
+    w->level = w->base;
+    w->done = (w->base_node == NULL);
+    if (!w->done && w->base < w->nseg)
+    {
+        w->at[w->level] = first_candidate(w, w->base_node, w->level);
+    }
+    w->generation = tree_generation;
+    w->cursor = ++next_cursor;
+    return 0;
+}
+
+/**
+ * @brief Appends one "path: value" line if the key exists at the matched node.
+ * @return 1 if a line was appended, 0 otherwise.
+ */
+static int emit_match(struct glob_walk *w, Node *node, struct reply *out)
+{
+    Leaf view;
+    Leaf *leaf = node_read(node, w->key, MVCC_LATEST, &view);
+    if (leaf == NULL || leaf->value == NULL)
+    {
+        return 0;
+    }
+
+    char path[512];
+    char *value = value_dup(leaf);
+    if (value == NULL)
+    {
+        return 0;
+    }
+    node_path(node, path, sizeof(path));
+    reply_printf(out, "%s: %s\n", path, value);
+    free(value);
+    return 1;
+}
+
+/**
+ * @brief Appends a "path: value" line for every attached table whose path matches the
+ * pattern and holds the key. Tables have no nodes, so the walk itself never reaches them.
+ * @return Number of lines appended.
+ */
+static int emit_tables(struct glob_walk *w, struct reply *out)
+{
+    struct table *t;
+    const char *path;
+    int matches = 0;
+
+    for (unsigned i = 0; (path = table_nth(i, &t)) != NULL; i++)
+    {
+        char segs[PATH_MAX_LEN];
+        char *saveptr;
+        uint16_t level = 0;
+        bool match = true;
+        snprintf(segs, sizeof(segs), "%s", path);
+        for (char *s = strtok_r(segs, "/", &saveptr); s != NULL && match; s = strtok_r(NULL, "/", &saveptr))
+        {
+            match = (level < w->nseg && glob_match(w->seg[level], s));
+            level++;
+        }
+
+        const char *value;
+        uint16_t len;
+        if (match && level == w->nseg && table_get(t, w->key, &value, &len))
+        {
+            reply_printf(out, "%s: %.*s\n", path, (int)len, value);
+            matches++;
+        }
+    }
+    return matches;
+}
+
+/**
+ * @brief Advances the candidate of the current segment to the next sibling
+ * (a literal segment has a single candidate).
+ */
+static void advance(struct glob_walk *w)
+{
+    Node *n = w->at[w->level];
+    w->at[w->level] = w->literal[w->level] ? NULL : n->next_sibling;
+}
+
+/**
+ * @brief Runs the walk for at most GLOB_STEP_NODES nodes or GLOB_STEP_MATCHES matches.
+ * Nodes created between steps may or may not be seen; nodes that exist for the whole
+ * walk are seen exactly once; attached tables are matched in the step that ends the walk.
+ * A DROP between steps invalidates the walk (its position might point at freed nodes),
+ * which is detected through tree_generation.
+ *
+ * @param w The walk.
+ * @param out Reply receiving one "path: value" line per match.
+ * @return Number of matches appended, or -1 if the tree changed shape under the walk.
+ */
+int glob_walk_step(struct glob_walk *w, struct reply *out)
+{
+    uint32_t budget = GLOB_STEP_NODES;
+    int matches = 0;
+
+    if (w->generation != tree_generation)
+    {
+        return -1;
+    }
+
+    if (!w->done && w->base == w->nseg)
+    {
+        // Fully literal pattern: the prefix is the only candidate.
+        matches += emit_match(w, w->base_node, out);
+        w->done = true;
+    }
+
+    while (!w->done && budget > 0 && matches < GLOB_STEP_MATCHES)
+    {
+        Node *n = w->at[w->level];
+        if (n == NULL)
+        {
+            // Candidates for this segment exhausted: back up one segment.
+            if (w->level == w->base)
+            {
+                w->done = true;
+                break;
+            }
+            w->level--;
+            advance(w);
+            continue;
+        }
+
+        budget--;
+        if (!w->literal[w->level] && !glob_match(w->seg[w->level], (char *)n->path))
+        {
+            advance(w);
+        }
+        else if (w->level + 1 == w->nseg)
+        {
+            matches += emit_match(w, n, out);
+            advance(w);
+        }
+        else
+        {
+            w->level++; // Descend into the matching node.
+            w->at[w->level] = first_candidate(w, n, w->level);
+        }
+    }
+
+    if (w->done && !w->tables)
+    {
+        matches += emit_tables(w, out); // Tables have no nodes: the step that ends the walk adds them.
+        w->tables = true;
+    }
+    return matches;
+}
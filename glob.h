@@ -0,0 +1,44 @@
+/* glob.h - Server-side evaluation of path patterns (GETGLOB) */
+#ifndef GLOB_H
+#define GLOB_H
+
+#include "tree.h"  // Node, Leaf
+#include "reply.h" // struct reply
+
+#include <stdint.h>  // uint64_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define GLOB_MAX_SEGMENTS 128 // Deepest pattern accepted (a 256-byte path has at most 128 segments)
+#define GLOB_STEP_NODES 4096  // Nodes examined per GETGLOB call before the walk yields
+#define GLOB_STEP_MATCHES 256 // Matches returned per GETGLOB call before the walk yields
+
+/**
+ * @brief A resumable walk over the tree for one pattern and key.
+ * The walk is a depth-first search pruned by the pattern: `at[i]` is the candidate node
+ * for segment i, so the whole position is a handful of pointers and resuming is O(1).
+ * Literal segments are resolved through the child index instead of being scanned.
+ */
+struct glob_walk
+{
+    uint64_t cursor;                 // Id handed to the client to resume this walk (0 = none)
+    uint64_t generation;             // tree_generation when the walk last ran
+    char text[256];                  // Path pattern as given (to validate resumed calls)
+    char pattern[256];               // Path pattern, NUL-separated into segments
+    char key[128];                   // Key read at every matching path
+    char *seg[GLOB_MAX_SEGMENTS];    // Pattern segments (point into `pattern`)
+    bool literal[GLOB_MAX_SEGMENTS]; // Segment has no wildcards
+    uint16_t nseg;                   // Number of segments
+    uint16_t base;                   // Segments resolved up front (the literal prefix)
+    uint16_t level;                  // Segment currently being matched
+    bool done;                       // Walk exhausted
+    bool tables;                     // Attached tables matched (after the tree, see emit_tables)
+    Node *base_node;                 // Node at the end of the literal prefix
+    Node *at[GLOB_MAX_SEGMENTS];     // Current candidate per segment
+};
+
+bool glob_match(const char *pattern, const char *name);
+int glob_walk_start(struct glob_walk *w, const char *pattern, const char *key);
+int glob_walk_step(struct glob_walk *w, struct reply *out);
+
+#endif /* GLOB_H */
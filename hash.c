@@ -0,0 +1,41 @@
+/* hash.c - Per-process hash seed and random salts for the indexes */
+#include "hash.h" // Own header for the hash functions and prototypes
+
+#include <sys/random.h> // getrandom
+#include <time.h>       // clock_gettime
+#include <unistd.h>     // getpid
+
+uint64_t hash_seed = 0x2d358dccaa6c78a5ULL; // Replaced by hash_init before the first insert
+
+static uint64_t rng_state; // splitmix64 state for hash_random
+
+/**
+ * @brief Draws the hash seed and the salt generator state from the kernel.
+ * Must run before anything is hashed into a table (the tables don't rehash on a new seed).
+ * Falls back to the clock and pid if getrandom is unavailable.
+ */
+void hash_init(void)
+{
+    uint64_t seed[2];
+
+    if (getrandom(seed, sizeof(seed), 0) != (ssize_t)sizeof(seed))
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        seed[0] = hash_mix((uint64_t)ts.tv_nsec ^ HASH_P2, (uint64_t)ts.tv_sec ^ HASH_P3);
+        seed[1] = hash_mix(seed[0] ^ (uint64_t)getpid(), HASH_P0);
+    }
+    hash_seed = seed[0];
+    rng_state = seed[1];
+}
+
+/**
+ * @brief Returns a fresh pseudo-random 64-bit value (splitmix64), used for index salts.
+ */
+uint64_t hash_random(void)
+{
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
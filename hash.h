@@ -0,0 +1,124 @@
+/* hash.h - Hash functions shared by the caches and indexes */
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+#include <string.h> // memcpy
+
+// Mixing constants (from wyhash)
+#define HASH_P0 0xa0761d6478bd642fULL
+#define HASH_P1 0xe7037ed1a0b428dbULL
+#define HASH_P2 0x8ebc6af09c88c6e3ULL
+#define HASH_P3 0x589965cc75374cc3ULL
+
+/*
+ * Every hash that picks a bucket from client-controlled bytes (path segments, keys, values)
+ * is keyed with `hash_seed`, drawn from the kernel at start-up. Without the seed a client
+ * cannot predict which names share a bucket, so it cannot build long chains on purpose.
+ */
+extern uint64_t hash_seed; // Per-process random seed used by hash_bytes (see hash_init)
+
+void hash_init(void);
+uint64_t hash_random(void);
+
+/**
+ * @brief 64x64->128 multiply, folded back to 64 bits. The core of the mixing.
+ */
+static inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t hash_read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hash_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Seeded 64-bit hash over a byte range (wyhash-style: a few 128-bit multiplies
+ * per 16 bytes, so short keys and paths hash in a handful of cycles).
+ */
+static inline uint64_t hash_seeded(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t a, b;
+
+    seed ^= hash_mix(seed ^ HASH_P0, HASH_P1);
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            a = (hash_read32(p) << 32) | hash_read32(p + ((len >> 3) << 2));
+            b = (hash_read32(p + len - 4) << 32) | hash_read32(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            uint64_t s1 = seed, s2 = seed;
+            do
+            {
+                seed = hash_mix(hash_read64(p) ^ HASH_P1, hash_read64(p + 8) ^ seed);
+                s1 = hash_mix(hash_read64(p + 16) ^ HASH_P2, hash_read64(p + 24) ^ s1);
+                s2 = hash_mix(hash_read64(p + 32) ^ HASH_P3, hash_read64(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= s1 ^ s2;
+        }
+        while (i > 16)
+        {
+            seed = hash_mix(hash_read64(p) ^ HASH_P1, hash_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_read64(p + i - 16);
+        b = hash_read64(p + i - 8);
+    }
+
+    a ^= HASH_P1;
+    b ^= seed;
+    __uint128_t r = (__uint128_t)a * b;
+    return hash_mix((uint64_t)r ^ HASH_P0 ^ len, (uint64_t)(r >> 64) ^ HASH_P1);
+}
+
+/**
+ * @brief Hashes a byte range with the per-process seed.
+ */
+static inline uint64_t hash_bytes(const void *data, size_t len)
+{
+    return hash_seeded(data, len, hash_seed);
+}
+
+/**
+ * @brief Combines a running hash with the hash of the next component
+ * (path prefixes, (path, key) pairs). Order-sensitive.
+ */
+static inline uint64_t hash_combine(uint64_t h, uint64_t next)
+{
+    return hash_mix(h ^ HASH_P2, next ^ HASH_P3);
+}
+
+#endif /* HASH_H */
@@ -0,0 +1,269 @@
+/* hotcache.c - Per-thread read replicas of hot keys */
+#include "hotcache.h" // Own header for configuration and prototypes
+#include "hash.h"     // hash_bytes
+
+#include <stdlib.h> // calloc
+#include <string.h> // memcpy, memcmp, strlen
+#include <stdio.h>  // snprintf
+
+/**
+ * @brief A single replicated value.
+ * The name holds the normalized file path and the key separated by a NUL byte,
+ * so that a hash collision can never serve the wrong value.
+ */
+struct hot_entry
+{
+    uint64_t hash;               // Hash of (file, key), 0 when the slot is empty
+    uint32_t version;            // Shared version stamp observed when the replica was filled
+    uint16_t name_len;           // Bytes used in `name`
+    uint16_t size;               // Value size in bytes
+    char name[HOT_NAME_MAX];     // "file\0key"
+    char value[HOT_VALUE_MAX + 1]; // Replicated value (null-terminated)
+};
+
+/**
+ * @brief Per-thread replica cache and hot-key detector.
+ * Allocated lazily by the owning thread, so first-touch places it in core-local memory.
+ */
+struct hot_cache
+{
+    struct hot_entry entries[HOT_CACHE_SLOTS]; // Direct-mapped replica slots
+    uint8_t heat[HOT_VERSION_SLOTS];           // Saturating read counters (decayed periodically)
+    uint32_t reads_since_decay;                // Reads recorded since the last halving
+    uint64_t hits;                             // Reads served from a replica
+    uint64_t misses;                           // Reads that had to walk the tree
+    uint64_t fills;                            // Replicas created or refreshed
+    uint64_t stale;                            // Replicas rejected because their version changed
+};
+
+// Shared version stamps, bumped by writers. Aligned so the array starts on a cache line.
+static uint32_t g_hot_versions[HOT_VERSION_SLOTS] __attribute__((aligned(64)));
+
+// Each thread gets its own cache; NULL until the thread first reads through the cache.
+static _Thread_local struct hot_cache *t_hot_cache = NULL;
+
+/**
+ * @brief Returns the calling thread's cache, allocating it on first use.
+ * @return Pointer to the cache, or NULL if allocation failed (caching is then skipped).
+ */
+static struct hot_cache *thread_cache(void)
+{
+    if (t_hot_cache == NULL)
+    {
+        t_hot_cache = (struct hot_cache *)calloc(1, sizeof(struct hot_cache));
+    }
+    return t_hot_cache;
+}
+
+/**
+ * @brief Builds the "file\0key" name used to identify an entry.
+ * Leading, trailing and repeated slashes are dropped from the file path so that
+ * "a/b", "/a/b" and "a//b/" (which all resolve to the same Node) share one entry.
+ *
+ * @param file The file path as given by the client.
+ * @param key The key.
+ * @param out Output buffer of at least HOT_NAME_MAX bytes.
+ * @return Number of bytes written (including the separating NUL), or 0 if it doesn't fit.
+ */
+static uint16_t build_name(const char *file, const char *key, char *out)
+{
+    size_t len = 0;
+    size_t key_len = strlen(key);
+
+    for (const char *p = file; *p; p++)
+    {
+        if (*p == '/' && (len == 0 || out[len - 1] == '/'))
+        {
+            continue; // Skip leading and repeated slashes.
+        }
+        if (len >= HOT_NAME_MAX - 1)
+        {
+            return 0;
+        }
+        out[len++] = *p;
+    }
+    if (len > 0 && out[len - 1] == '/')
+    {
+        len--; // Drop a trailing slash.
+    }
+
+    if (len + 1 + key_len > HOT_NAME_MAX)
+    {
+        return 0;
+    }
+    out[len++] = '\0';
+    memcpy(out + len, key, key_len);
+    return (uint16_t)(len + key_len);
+}
+
+/**
+ * @brief Hashes a (file, key) pair from the file's precomputed path hash (path_hash()).
+ * Never returns 0, which marks an empty slot.
+ */
+uint64_t hot_key_hash(uint64_t path_hash, const char *key)
+{
+    uint64_t h = hash_combine(path_hash, hash_bytes(key, strlen(key)));
+    return h ? h : 1;
+}
+
+/**
+ * @brief Reads the shared version stamp for a hash.
+ * Readers must take the stamp BEFORE reading the value from the tree; a concurrent
+ * write then bumps the stamp afterwards and the replica is rejected on its next use.
+ */
+uint32_t hot_version(uint64_t hash)
+{
+    return __atomic_load_n(&g_hot_versions[hash & (HOT_VERSION_SLOTS - 1)], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Records a read of a key in the calling thread's heat counters.
+ * @param hash The (file, key) hash.
+ * @return True if the key is now considered hot and should be replicated.
+ */
+bool hot_cache_record(uint64_t hash)
+{
+    struct hot_cache *c = thread_cache();
+    if (c == NULL)
+    {
+        return false;
+    }
+
+    // Age every counter periodically so keys that cooled down stop being replicated.
+    if (++c->reads_since_decay >= HOT_DECAY_INTERVAL)
+    {
+        for (size_t i = 0; i < HOT_VERSION_SLOTS; i++)
+        {
+            c->heat[i] >>= 1;
+        }
+        c->reads_since_decay = 0;
+    }
+
+    uint8_t *heat = &c->heat[hash & (HOT_VERSION_SLOTS - 1)];
+    if (*heat < UINT8_MAX)
+    {
+        (*heat)++;
+    }
+    return *heat >= HOT_KEY_THRESHOLD;
+}
+
+/**
+ * @brief Looks up a replica in the calling thread's cache.
+ *
+ * @param hash The (file, key) hash.
+ * @param file The file path.
+ * @param key The key.
+ * @param size Receives the value size on a hit.
+ * @return Pointer to the thread-local replica (valid until the next fill), or NULL on a miss.
+ */
+const char *hot_cache_lookup(uint64_t hash, const char *file, const char *key, uint16_t *size)
+{
+    struct hot_cache *c = thread_cache();
+    if (c == NULL)
+    {
+        return NULL;
+    }
+
+    struct hot_entry *e = &c->entries[hash & (HOT_CACHE_SLOTS - 1)];
+    if (e->hash != hash)
+    {
+        c->misses++;
+        return NULL;
+    }
+
+    char name[HOT_NAME_MAX];
+    uint16_t name_len = build_name(file, key, name);
+    if (name_len != e->name_len || memcmp(name, e->name, name_len) != 0)
+    {
+        c->misses++;
+        return NULL;
+    }
+
+    if (e->version != hot_version(hash))
+    {
+        // The key was written since this replica was taken; drop it.
+        e->hash = 0;
+        c->stale++;
+        c->misses++;
+        return NULL;
+    }
+
+    c->hits++;
+    *size = e->size;
+    return e->value;
+}
+
+/**
+ * @brief Stores a replica of a hot key in the calling thread's cache.
+ * Values larger than HOT_VALUE_MAX are not replicated.
+ *
+ * @param hash The (file, key) hash.
+ * @param version The stamp returned by hot_version() before the value was read.
+ * @param file The file path.
+ * @param key The key.
+ * @param value The value read from the tree.
+ * @param size The value size in bytes.
+ */
+void hot_cache_fill(uint64_t hash, uint32_t version, const char *file, const char *key,
+                    const char *value, uint16_t size)
+{
+    struct hot_cache *c = thread_cache();
+    if (c == NULL || size > HOT_VALUE_MAX)
+    {
+        return;
+    }
+
+    struct hot_entry *e = &c->entries[hash & (HOT_CACHE_SLOTS - 1)];
+    uint16_t name_len = build_name(file, key, e->name);
+    if (name_len == 0)
+    {
+        e->hash = 0; // Name too long to cache.
+        return;
+    }
+
+    e->hash = hash;
+    e->version = version;
+    e->name_len = name_len;
+    e->size = size;
+    memcpy(e->value, value, size);
+    e->value[size] = '\0';
+    c->fills++;
+}
+
+/**
+ * @brief Invalidates every replica of a key on every thread by bumping its version stamp.
+ * Called by writers (`db_set`, `db_del`).
+ */
+void hot_cache_invalidate(uint64_t hash)
+{
+    __atomic_fetch_add(&g_hot_versions[hash & (HOT_VERSION_SLOTS - 1)], 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Invalidates every replica on every thread. Used when a whole subtree
+ * (`DROP`) disappears at once and hashing each removed key isn't worth it.
+ */
+void hot_cache_invalidate_all(void)
+{
+    for (size_t i = 0; i < HOT_VERSION_SLOTS; i++)
+    {
+        __atomic_fetch_add(&g_hot_versions[i], 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief Formats the calling thread's cache counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int hot_cache_stats(char *buf, size_t cap)
+{
+    struct hot_cache *c = t_hot_cache;
+    uint64_t hits = c ? c->hits : 0;
+    uint64_t misses = c ? c->misses : 0;
+
+    return snprintf(buf, cap,
+                    "  Hot cache: hits=%llu misses=%llu fills=%llu stale=%llu hit_rate=%.1f%%\n",
+                    (unsigned long long)hits, (unsigned long long)misses,
+                    (unsigned long long)(c ? c->fills : 0), (unsigned long long)(c ? c->stale : 0),
+                    (hits + misses) ? 100.0 * (double)hits / (double)(hits + misses) : 0.0);
+}
@@ -0,0 +1,37 @@
+/* hotcache.h - Per-thread read replicas of hot keys */
+#ifndef HOTCACHE_H
+#define HOTCACHE_H
+
+#include <stdint.h>  // uint64_t, uint32_t
+#include <stddef.h>  // size_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define HOT_CACHE_SLOTS 128        // Replica entries per thread (power of two)
+#define HOT_VERSION_SLOTS 4096     // Shared version stamps used for invalidation (power of two)
+#define HOT_KEY_THRESHOLD 8        // Reads within one decay window before a key counts as hot
+#define HOT_DECAY_INTERVAL 16384   // Reads between halvings of the per-thread heat counters
+#define HOT_VALUE_MAX 512          // Largest value (in bytes) that is replicated
+#define HOT_NAME_MAX (256 + 128)   // Room for "file\0key" (MAX_FILENAME_LEN + MAX_KEY_LEN)
+
+/*
+ * How it works:
+ * - Every (file, key) pair hashes to one of HOT_VERSION_SLOTS shared version stamps.
+ *   `db_set` and `db_del` bump the stamp of the pair they modify.
+ * - Each thread keeps its own heat counters and its own replica cache. Reads only ever
+ *   write to thread-local memory; the shared stamps are read-mostly, so a celebrity key
+ *   stays in the shared state of every core's cache instead of bouncing between them.
+ * - A replica is served only while its recorded stamp still equals the shared stamp.
+ */
+
+uint64_t hot_key_hash(uint64_t path_hash, const char *key);
+uint32_t hot_version(uint64_t hash);
+bool hot_cache_record(uint64_t hash);
+const char *hot_cache_lookup(uint64_t hash, const char *file, const char *key, uint16_t *size);
+void hot_cache_fill(uint64_t hash, uint32_t version, const char *file, const char *key,
+                    const char *value, uint16_t size);
+void hot_cache_invalidate(uint64_t hash);
+void hot_cache_invalidate_all(void);
+int hot_cache_stats(char *buf, size_t cap);
+
+#endif /* HOTCACHE_H */
@@ -0,0 +1,169 @@
+/* index.c - Intrusive chained hash index with salted buckets and chain-length monitoring */
+#include "index.h" // Own header for the index structures and prototypes
+
+#include <stdio.h>  // snprintf
+#include <stdlib.h> // calloc, free
+
+/**
+ * @brief Counters over all indexes, reported by the `stats` command.
+ */
+static struct
+{
+    uint64_t grows;         // Doublings
+    uint64_t resalts;       // Rebuilds with a new salt after a long chain
+    uint64_t gave_up;       // Long chains left alone after HINDEX_MAX_RESALTS re-salts
+    uint32_t longest_chain; // Longest chain seen on insert
+} istats;
+
+/**
+ * @brief Moves every entry into a new bucket array of `nbuckets` buckets under `salt`.
+ * @return 0 on success, -1 on allocation failure (the index is left as it was).
+ */
+static int rebuild(struct hindex *idx, uint32_t nbuckets, uint64_t salt)
+{
+    struct hlink **buckets = (struct hlink **)calloc(nbuckets, sizeof(*buckets));
+    if (buckets == NULL)
+    {
+        return -1;
+    }
+
+    uint32_t mask = nbuckets - 1;
+    for (uint32_t i = 0; idx->buckets != NULL && i <= idx->mask; i++)
+    {
+        struct hlink *link = idx->buckets[i];
+        while (link != NULL)
+        {
+            struct hlink *next = link->next;
+            uint32_t b = (uint32_t)hash_mix(link->hash ^ salt, HASH_P1) & mask;
+            link->next = buckets[b];
+            buckets[b] = link;
+            link = next;
+        }
+    }
+
+    free(idx->buckets);
+    idx->buckets = buckets;
+    idx->mask = mask;
+    idx->salt = salt;
+    return 0;
+}
+
+/**
+ * @brief Adds an entry (with `link->hash` set) to an index. The index doubles at load
+ * factor 1; if the entry's chain still exceeds HINDEX_MAX_CHAIN, the index is rebuilt
+ * under a fresh random salt. Chains that survive several re-salts consist of entries
+ * whose full 64-bit hashes collide, which a per-process random seed makes infeasible to
+ * produce on purpose; lookups compare the full hash first, so they stay cheap even then.
+ *
+ * @return 0 on success, -1 if the index couldn't be created (nothing was inserted).
+ */
+int hindex_insert(struct hindex *idx, struct hlink *link)
+{
+    if (idx->buckets == NULL)
+    {
+        if (rebuild(idx, HINDEX_MIN_BUCKETS, hash_random()) != 0)
+        {
+            return -1;
+        }
+    }
+    else if (idx->count + 1 > idx->mask + 1 && rebuild(idx, (idx->mask + 1) * 2, idx->salt) == 0)
+    {
+        idx->resalts = 0;
+        istats.grows++;
+    }
+    // A failed doubling is harmless: chains just get a little longer.
+
+    uint32_t b = hindex_slot(idx, link->hash);
+    link->next = idx->buckets[b];
+    idx->buckets[b] = link;
+    idx->count++;
+
+    // Monitor the chain we just extended (the walk is capped, so this is O(1)).
+    uint32_t chain = 0;
+    for (struct hlink *l = idx->buckets[b]; l != NULL && chain <= HINDEX_MAX_CHAIN; l = l->next)
+    {
+        chain++;
+    }
+    if (chain > istats.longest_chain)
+    {
+        istats.longest_chain = chain;
+    }
+    if (chain > HINDEX_MAX_CHAIN)
+    {
+        if (idx->resalts < HINDEX_MAX_RESALTS && rebuild(idx, idx->mask + 1, hash_random()) == 0)
+        {
+            idx->resalts++;
+            istats.resalts++;
+        }
+        else
+        {
+            istats.gave_up++;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Removes an entry from an index (a no-op if it isn't there).
+ */
+void hindex_remove(struct hindex *idx, struct hlink *link)
+{
+    if (idx->buckets == NULL)
+    {
+        return;
+    }
+    struct hlink **pp = &idx->buckets[hindex_slot(idx, link->hash)];
+    while (*pp != NULL && *pp != link)
+    {
+        pp = &(*pp)->next;
+    }
+    if (*pp == link)
+    {
+        *pp = link->next;
+        idx->count--;
+    }
+}
+
+/**
+ * @brief Puts `link` in place of `old` (an entry that has been copied to a new address,
+ * `link->next` included) without re-bucketing anything.
+ */
+void hindex_replace(struct hindex *idx, struct hlink *old, struct hlink *link)
+{
+    if (idx->buckets == NULL)
+    {
+        return;
+    }
+    struct hlink **pp = &idx->buckets[hindex_slot(idx, old->hash)];
+    while (*pp != NULL && *pp != old)
+    {
+        pp = &(*pp)->next;
+    }
+    if (*pp == old)
+    {
+        *pp = link;
+    }
+}
+
+/**
+ * @brief Frees an index's buckets (the entries are untouched) and resets it.
+ */
+void hindex_free(struct hindex *idx)
+{
+    free(idx->buckets);
+    idx->buckets = NULL;
+    idx->mask = 0;
+    idx->count = 0;
+    idx->resalts = 0;
+}
+
+/**
+ * @brief Formats index counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int hindex_stats(char *buf, size_t cap)
+{
+    return snprintf(buf, cap, "  Indexes: grows=%llu resalts=%llu gave_up=%llu longest_chain=%u (limit %d)\n",
+                    (unsigned long long)istats.grows, (unsigned long long)istats.resalts,
+                    (unsigned long long)istats.gave_up, istats.longest_chain, HINDEX_MAX_CHAIN);
+}
@@ -0,0 +1,65 @@
+/* index.h - Intrusive chained hash index with salted buckets and chain-length monitoring */
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "hash.h" // hash_mix
+
+#include <stddef.h>  // size_t, offsetof
+#include <stdint.h>  // uint64_t, uint32_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define HINDEX_MIN_BUCKETS 8  // Bucket count of a new index (power of two)
+#define HINDEX_MAX_CHAIN 8    // Longest chain tolerated before the index is re-salted
+#define HINDEX_MAX_RESALTS 4  // Re-salts allowed per size (beyond that, chains hold true collisions)
+
+/**
+ * @brief Link embedded in every indexed entry (a Node in its parent's child index,
+ * a Leaf in its node's key index, a shared value in the dedup table).
+ */
+struct hlink
+{
+    struct hlink *next; // Next entry in the same bucket
+    uint64_t hash;      // Full 64-bit hash of the entry's name (compared before the name itself)
+};
+
+/**
+ * @brief A chained hash index. Buckets are chosen from the entry hash mixed with a
+ * per-index random salt, so even if bucket collisions are somehow engineered against one
+ * index, re-salting it scatters them again without rehashing any names.
+ */
+struct hindex
+{
+    struct hlink **buckets; // Bucket array, NULL until the first insert
+    uint32_t mask;          // Bucket count minus one
+    uint32_t count;         // Number of entries
+    uint64_t salt;          // Mixed into bucket selection; replaced when chains grow too long
+    uint8_t resalts;        // Re-salts since the last resize
+};
+
+// Recovers the entry that embeds a struct hlink.
+#define hlink_entry(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+/**
+ * @brief Bucket of a hash in an index (the index must have buckets).
+ */
+static inline uint32_t hindex_slot(const struct hindex *idx, uint64_t hash)
+{
+    return (uint32_t)hash_mix(hash ^ idx->salt, HASH_P1) & idx->mask;
+}
+
+/**
+ * @brief First entry of the chain a hash falls into (NULL for an empty index).
+ */
+static inline struct hlink *hindex_head(const struct hindex *idx, uint64_t hash)
+{
+    return idx->buckets ? idx->buckets[hindex_slot(idx, hash)] : NULL;
+}
+
+int hindex_insert(struct hindex *idx, struct hlink *link);
+void hindex_remove(struct hindex *idx, struct hlink *link);
+void hindex_replace(struct hindex *idx, struct hlink *old, struct hlink *link);
+void hindex_free(struct hindex *idx);
+int hindex_stats(char *buf, size_t cap);
+
+#endif /* INDEX_H */
@@ -0,0 +1,640 @@
+/* loader.c - Read-through loading of missing keys from a backing store */
+#include "loader.h"   // Own header for configuration and prototypes
+#include "main.h"     // struct client, g_server, send_get_reply, resume_client_later, db_set, db_del
+#include "tree.h"     // find_leaf_path
+#include "hotcache.h" // hot_key_hash
+#include "util.h"     // now_ns
+
+#include <sys/un.h> // struct sockaddr_un
+
+const char *loader_socket;
+uint32_t loader_ttl;
+
+/**
+ * @brief One key being loaded: in the in-flight table (for coalescing) and in the FIFO
+ * of requests sent (replies arrive in that order).
+ */
+struct load
+{
+    struct load *hash_next;      // Chain of the in-flight table
+    struct load *next;           // Next request sent
+    struct client *waiters;      // Clients parked on the key (linked through client->load_next)
+    uint64_t hash;               // hot_key_hash of path and key
+    uint64_t started_ns;         // When the request was queued
+    path_t path;                 // The file
+    char file[MAX_FILENAME_LEN]; // The file as the first client wrote it (for replies)
+    char key[MAX_KEY_LEN];       // The key
+};
+
+/**
+ * @brief A loaded key that expires (--loader-ttl). `seq` is the commit sequence number the
+ * load stored the value with: a key written since then is no longer the loaded value and
+ * is left alone.
+ */
+struct expiry
+{
+    uint64_t deadline_ns; // Monotonic time the key expires
+    uint64_t seq;         // Commit sequence number of the loaded value
+    char *key;            // Points into `text`, after the path
+    char text[];          // Normalized path, NUL, key, NUL
+};
+
+static struct
+{
+    int fd;                             // Connection to the loader (-1 if none)
+    bool broken;                        // Write failed while serving a client; handled by the next loader_cycle
+    uint64_t retry_ns;                  // No reconnect before this monotonic time
+    struct reply out;                   // Requests not written yet
+    size_t out_pos;                     // Bytes of `out` already written
+    bool want_write;                    // EPOLLOUT is enabled
+    char in[2 * BUFFER_SIZE];           // Reply bytes not parsed yet
+    size_t in_len;                      // Bytes in `in`
+    struct load *table[LOADER_BUCKETS]; // In-flight loads by hash
+    struct load *head, *tail;           // In-flight loads in request order
+    size_t inflight;                    // Loads in the FIFO
+    struct expiry **heap;               // Loaded keys by deadline (binary min-heap)
+    size_t nheap, heap_cap;             // Entries used and allocated
+    uint64_t requests;                  // Loads sent
+    uint64_t coalesced;                 // Misses that joined a load already in flight
+    uint64_t loaded;                    // Loads answered with a value
+    uint64_t absent;                    // Loads answered NONE
+    uint64_t failed;                    // Loads answered with an error or lost with the connection
+    uint64_t timeouts;                  // Connections dropped because a load took too long
+    uint64_t unavailable;               // Misses failed without asking (no connection, table full)
+    uint64_t expired;                   // Loaded keys removed by their TTL
+} ldr = {.fd = -1};
+
+static void reply_failed(struct client *client, const char *file, const char *key)
+{
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response), "ERR: Could not load key '%s' of file '%s' from the backing store.\n> ",
+             key, file);
+    send_to_client(client, response);
+}
+
+/**
+ * @brief Unparks the clients waiting on a load (already out of the table and the FIFO),
+ * answers them from the tree (or with an error) and frees the load.
+ */
+static void finish_load(struct load *load, bool failed)
+{
+    struct client *client = load->waiters;
+    while (client != NULL)
+    {
+        struct client *next = client->load_next;
+        client->load = NULL;
+        client->load_next = NULL;
+        if (failed)
+        {
+            reply_failed(client, load->file, load->key);
+        }
+        else
+        {
+            send_get_reply(client, &load->path, load->file, load->key, true);
+        }
+        resume_client_later(client); // Runs more of its commands once the event batch is done.
+        client = next;
+    }
+    free(load);
+}
+
+static void loader_close(void);
+
+static void unlink_load(struct load *load)
+{
+    struct load **p = &ldr.table[load->hash & (LOADER_BUCKETS - 1)];
+    while (*p != load)
+    {
+        p = &(*p)->hash_next;
+    }
+    *p = load->hash_next;
+}
+
+/**
+ * @brief Gives up on every load in flight (their clients get an error and resume) and
+ * closes the connection; misses fail right away for LOADER_RETRY_MS. Never called while
+ * a client's command runs (it would resume that client inside itself): failures found
+ * there only set `broken`.
+ */
+static void loader_fail(const char *why)
+{
+    error_log("Loader: %s; failing %zu loads", why, ldr.inflight);
+    ldr.retry_ns = now_ns() + LOADER_RETRY_MS * 1000000ULL;
+
+    // Detach everything and close first: the resumed clients may miss again.
+    struct load *load = ldr.head;
+    ldr.head = ldr.tail = NULL;
+    ldr.inflight = 0;
+    memset(ldr.table, 0, sizeof(ldr.table));
+    loader_close();
+    while (load != NULL)
+    {
+        struct load *next = load->next;
+        ldr.failed++;
+        finish_load(load, true);
+        load = next;
+    }
+}
+
+static void loader_close(void)
+{
+    if (ldr.fd >= 0)
+    {
+        epoll_ctl(g_server->epoll_fd, EPOLL_CTL_DEL, ldr.fd, NULL);
+        close(ldr.fd);
+        ldr.fd = -1;
+    }
+    ldr.broken = false;
+    ldr.want_write = false;
+    reply_free(&ldr.out);
+    ldr.out_pos = 0;
+    ldr.in_len = 0;
+}
+
+/**
+ * @brief Connects to the loader if there is no connection (and the retry delay is over).
+ * @return 0 if connected, -1 otherwise.
+ */
+static int loader_connect(void)
+{
+    if (ldr.fd >= 0)
+    {
+        return ldr.broken ? -1 : 0;
+    }
+    if (now_ns() < ldr.retry_ns)
+    {
+        return -1;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(loader_socket) >= sizeof(addr.sun_path))
+    {
+        error_log("Loader: socket path too long: %s", loader_socket);
+        ldr.retry_ns = UINT64_MAX;
+        return -1;
+    }
+    strcpy(addr.sun_path, loader_socket);
+
+    // A local connect completes (or fails) at once, even on a non-blocking socket.
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        error_log("Loader: cannot connect to %s: %s", loader_socket, strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        ldr.retry_ns = now_ns() + LOADER_RETRY_MS * 1000000ULL;
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(g_server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        error_log("epoll_ctl ADD (loader) failed: %s", strerror(errno));
+        close(fd);
+        ldr.retry_ns = now_ns() + LOADER_RETRY_MS * 1000000ULL;
+        return -1;
+    }
+    ldr.fd = fd;
+    reply_init(&ldr.out);
+    info_log("Loader: connected to %s", loader_socket);
+    return 0;
+}
+
+/**
+ * @brief Writes queued requests; whatever the socket doesn't take waits for EPOLLOUT.
+ * @return 0 on success, -1 if the connection failed (errno is set).
+ */
+static int loader_flush(void)
+{
+    while (ldr.out_pos < ldr.out.len)
+    {
+        ssize_t n = send(ldr.fd, ldr.out.data + ldr.out_pos, ldr.out.len - ldr.out_pos, MSG_NOSIGNAL);
+        if (n == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return -1;
+        }
+        ldr.out_pos += (size_t)n;
+    }
+
+    if (ldr.out_pos == ldr.out.len)
+    {
+        ldr.out.len = 0; // Everything went out: start over at the front.
+        ldr.out_pos = 0;
+    }
+    bool want_write = ldr.out_pos < ldr.out.len;
+    if (want_write != ldr.want_write)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+        ev.data.fd = ldr.fd;
+        epoll_ctl(g_server->epoll_fd, EPOLL_CTL_MOD, ldr.fd, &ev);
+        ldr.want_write = want_write;
+    }
+    return 0;
+}
+
+/**
+ * @brief Answers a GET that missed from the backing store. The client is parked until
+ * the key arrives (its reply then comes from send_get_reply); if a load of the key is
+ * already in flight it just waits for that one. Failures are answered right away.
+ *
+ * @param client The client whose GET missed.
+ * @param path The parsed file.
+ * @param file The file as the client wrote it (for the reply).
+ * @param key The key.
+ */
+void loader_fetch(struct client *client, const path_t *path, const char *file, const char *key)
+{
+    uint64_t hash = hot_key_hash(path_hash(path), key);
+    struct load *load = ldr.table[hash & (LOADER_BUCKETS - 1)];
+    while (load != NULL && (load->hash != hash || strcmp(load->path.buf, path->buf) != 0 || strcmp(load->key, key) != 0))
+    {
+        load = load->hash_next;
+    }
+
+    if (load != NULL)
+    {
+        ldr.coalesced++; // Single-flight: wait for the request already sent.
+    }
+    else
+    {
+        if (ldr.inflight >= LOADER_MAX_INFLIGHT || loader_connect() != 0 ||
+            (load = (struct load *)malloc(sizeof(*load))) == NULL)
+        {
+            ldr.unavailable++;
+            reply_failed(client, file, key);
+            return;
+        }
+        load->hash = hash;
+        load->started_ns = now_ns();
+        load->waiters = NULL;
+        memcpy(&load->path, path, sizeof(load->path));
+        snprintf(load->file, sizeof(load->file), "%s", file);
+        snprintf(load->key, sizeof(load->key), "%s", key);
+
+        load->hash_next = ldr.table[hash & (LOADER_BUCKETS - 1)];
+        ldr.table[hash & (LOADER_BUCKETS - 1)] = load;
+        load->next = NULL;
+        if (ldr.tail != NULL)
+        {
+            ldr.tail->next = load;
+        }
+        else
+        {
+            ldr.head = load;
+        }
+        ldr.tail = load;
+        ldr.inflight++;
+        ldr.requests++;
+        reply_printf(&ldr.out, "GET /%s %s\n", path->buf, key);
+    }
+
+    // Park the client; its later commands wait like those behind a suspended command.
+    client->load = load;
+    client->load_next = load->waiters;
+    load->waiters = client;
+
+    // On failure the loads (this one included) are failed by the next loader_cycle.
+    if (ldr.out.failed)
+    {
+        error_log("Loader: no memory for requests");
+        ldr.broken = true;
+    }
+    else if (!ldr.want_write && loader_flush() != 0)
+    {
+        error_log("Loader: send failed: %s", strerror(errno));
+        ldr.broken = true;
+    }
+}
+
+/**
+ * @brief Unparks a client that is going away (the load goes on for the others).
+ */
+void loader_forget(struct client *client)
+{
+    struct load *load = client->load;
+    if (load == NULL)
+    {
+        return;
+    }
+    struct client **p = &load->waiters;
+    while (*p != client)
+    {
+        p = &(*p)->load_next;
+    }
+    *p = client->load_next;
+    client->load = NULL;
+}
+
+static void heap_swap(size_t a, size_t b)
+{
+    struct expiry *tmp = ldr.heap[a];
+    ldr.heap[a] = ldr.heap[b];
+    ldr.heap[b] = tmp;
+}
+
+/**
+ * @brief Schedules the expiry of a key the loader just stored.
+ */
+static void expiry_add(const path_t *path, const char *key, uint64_t seq)
+{
+    if (ldr.nheap == ldr.heap_cap)
+    {
+        size_t cap = ldr.heap_cap ? ldr.heap_cap * 2 : 64;
+        struct expiry **heap = (struct expiry **)realloc(ldr.heap, cap * sizeof(*heap));
+        if (heap == NULL)
+        {
+            error_log("Loader: no memory to expire key '%s' of '%s'", key, path->buf);
+            return;
+        }
+        ldr.heap = heap;
+        ldr.heap_cap = cap;
+    }
+
+    size_t key_len = strlen(key);
+    struct expiry *e = (struct expiry *)malloc(sizeof(*e) + path->len + 1 + key_len + 1);
+    if (e == NULL)
+    {
+        error_log("Loader: no memory to expire key '%s' of '%s'", key, path->buf);
+        return;
+    }
+    e->deadline_ns = now_ns() + (uint64_t)loader_ttl * 1000000000ULL;
+    e->seq = seq;
+    memcpy(e->text, path->buf, path->len + 1);
+    e->key = e->text + path->len + 1;
+    memcpy(e->key, key, key_len + 1);
+
+    // Sift up.
+    size_t i = ldr.nheap++;
+    ldr.heap[i] = e;
+    while (i > 0 && ldr.heap[(i - 1) / 2]->deadline_ns > ldr.heap[i]->deadline_ns)
+    {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static struct expiry *expiry_pop(void)
+{
+    struct expiry *top = ldr.heap[0];
+    ldr.heap[0] = ldr.heap[--ldr.nheap];
+
+    // Sift down.
+    size_t i = 0;
+    for (;;)
+    {
+        size_t least = i, l = 2 * i + 1, r = l + 1;
+        if (l < ldr.nheap && ldr.heap[l]->deadline_ns < ldr.heap[least]->deadline_ns)
+        {
+            least = l;
+        }
+        if (r < ldr.nheap && ldr.heap[r]->deadline_ns < ldr.heap[least]->deadline_ns)
+        {
+            least = r;
+        }
+        if (least == i)
+        {
+            break;
+        }
+        heap_swap(i, least);
+        i = least;
+    }
+    return top;
+}
+
+/**
+ * @brief Handles one reply line: the answer to the oldest request.
+ */
+static void loader_reply(char *line)
+{
+    struct load *load = ldr.head;
+    ldr.head = load->next;
+    if (ldr.head == NULL)
+    {
+        ldr.tail = NULL;
+    }
+    ldr.inflight--;
+    unlink_load(load);
+
+    bool failed = false;
+    Leaf view;
+    if (strncmp(line, "OK ", 3) == 0 && strlen(line + 3) < MAX_VALUE_LEN)
+    {
+        ldr.loaded++;
+        // A client may have written the key while it was loading: its value wins.
+        if (find_leaf_path(&load->path, load->key, &view) == NULL)
+        {
+            if (db_set(&load->path, load->key, line + 3) != 0)
+            {
+                failed = true;
+            }
+            else if (loader_ttl > 0)
+            {
+                Leaf *leaf = find_leaf_path(&load->path, load->key, &view);
+                if (leaf != NULL)
+                {
+                    expiry_add(&load->path, load->key, leaf->seq);
+                }
+            }
+        }
+    }
+    else if (strcmp(line, "NONE") == 0)
+    {
+        ldr.absent++;
+    }
+    else
+    {
+        error_log("Loader: failed to load key '%s' of '%s': %.64s", load->key, load->path.buf, line);
+        failed = true;
+    }
+    if (failed)
+    {
+        ldr.failed++;
+    }
+    finish_load(load, failed);
+}
+
+/**
+ * @brief Returns the loader connection (to recognize its events), or -1 if there is none.
+ */
+int loader_fd(void)
+{
+    return ldr.fd;
+}
+
+/**
+ * @brief Handles readiness of the loader connection: sends queued requests and answers
+ * the loads whose replies arrived.
+ */
+void loader_event(uint32_t events)
+{
+    const char *why = (events & EPOLLERR) ? "connection error" : NULL;
+    if (why == NULL && (events & EPOLLOUT) && loader_flush() != 0)
+    {
+        why = strerror(errno);
+    }
+    while (why == NULL && !ldr.broken)
+    {
+        ssize_t n = recv(ldr.fd, ldr.in + ldr.in_len, sizeof(ldr.in) - ldr.in_len, 0);
+        if (n == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                why = strerror(errno);
+            }
+            break;
+        }
+        if (n == 0)
+        {
+            why = "loader closed the connection";
+            break;
+        }
+        ldr.in_len += (size_t)n;
+
+        // Answer every complete line. The resumed clients may queue new requests (or,
+        // if writing them fails, give up on the connection).
+        char *line = ldr.in, *end;
+        while (!ldr.broken && (end = memchr(line, '\n', ldr.in_len - (size_t)(line - ldr.in))) != NULL)
+        {
+            *end = '\0';
+            if (end > line && end[-1] == '\r')
+            {
+                end[-1] = '\0';
+            }
+            if (ldr.head == NULL)
+            {
+                why = "reply without a request";
+                break;
+            }
+            loader_reply(line);
+            line = end + 1;
+        }
+        if (why != NULL || ldr.broken)
+        {
+            break;
+        }
+        ldr.in_len -= (size_t)(line - ldr.in);
+        memmove(ldr.in, line, ldr.in_len);
+        if (ldr.in_len == sizeof(ldr.in))
+        {
+            why = "reply line too long";
+        }
+    }
+
+    if (why != NULL || ldr.broken)
+    {
+        loader_fail(why != NULL ? why : "send failed");
+    }
+}
+
+/**
+ * @brief Returns true if a failed connection is waiting for loader_cycle.
+ */
+bool loader_pending(void)
+{
+    return ldr.broken;
+}
+
+/**
+ * @brief Background task: closes a failed connection, drops one whose oldest load timed
+ * out, and removes expired keys (as many as fit the budget).
+ *
+ * @param budget_ns Time the slice may take.
+ * @return Number of keys expired.
+ */
+int loader_cycle(uint64_t budget_ns)
+{
+    uint64_t start = now_ns();
+    int expired = 0;
+
+    if (ldr.broken)
+    {
+        loader_fail("send failed");
+    }
+    else if (ldr.head != NULL && start - ldr.head->started_ns > LOADER_TIMEOUT_MS * 1000000ULL)
+    {
+        ldr.timeouts++;
+        loader_fail("load timed out");
+    }
+
+    uint64_t now = start;
+    for (unsigned visited = 1; ldr.nheap > 0 && ldr.heap[0]->deadline_ns <= now; visited++)
+    {
+        struct expiry *e = expiry_pop();
+        path_t path;
+        Leaf view;
+        if (path_parse(&path, e->text) == 0)
+        {
+            Leaf *leaf = find_leaf_path(&path, e->key, &view);
+            if (leaf != NULL && leaf->seq == e->seq && db_del(&path, e->key) == 0)
+            {
+                ldr.expired++;
+                expired++;
+            }
+        }
+        free(e);
+
+        if (visited % LOADER_CHECK_EXPIRIES == 0)
+        {
+            now = now_ns();
+            if (now - start >= budget_ns)
+            {
+                break; // The rest go on the next slice.
+            }
+        }
+    }
+    return expired;
+}
+
+/**
+ * @brief Drops the connection and frees the expiry schedule. Runs after the clients are gone.
+ */
+void loader_shutdown(void)
+{
+    struct load *load = ldr.head;
+    while (load != NULL)
+    {
+        struct load *next = load->next;
+        free(load);
+        load = next;
+    }
+    ldr.head = ldr.tail = NULL;
+    ldr.inflight = 0;
+    loader_close();
+
+    while (ldr.nheap > 0)
+    {
+        free(ldr.heap[--ldr.nheap]);
+    }
+    free(ldr.heap);
+    ldr.heap = NULL;
+    ldr.heap_cap = 0;
+}
+
+/**
+ * @brief Formats loader counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int loader_stats(char *buf, size_t cap)
+{
+    if (loader_socket == NULL)
+    {
+        return snprintf(buf, cap, "  Loader: off\n");
+    }
+    return snprintf(buf, cap,
+                    "  Loader: %s inflight=%zu requests=%llu coalesced=%llu loaded=%llu absent=%llu failed=%llu "
+                    "timeouts=%llu unavailable=%llu ttl=%u s expiring=%zu expired=%llu\n",
+                    ldr.fd >= 0 && !ldr.broken ? "connected" : "disconnected", ldr.inflight,
+                    (unsigned long long)ldr.requests, (unsigned long long)ldr.coalesced,
+                    (unsigned long long)ldr.loaded, (unsigned long long)ldr.absent, (unsigned long long)ldr.failed,
+                    (unsigned long long)ldr.timeouts, (unsigned long long)ldr.unavailable, loader_ttl, ldr.nheap,
+                    (unsigned long long)ldr.expired);
+}
@@ -0,0 +1,50 @@
+/* loader.h - Read-through loading of missing keys from a backing store */
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdbool.h> // boolean
+
+#include "path.h" // path_t
+
+// Configuration constants
+#define LOADER_MAX_INFLIGHT 1024 // Distinct keys being loaded at once (more misses fail right away)
+#define LOADER_BUCKETS 1024      // Buckets of the in-flight table (a power of two)
+#define LOADER_TIMEOUT_MS 2000   // Oldest load may wait this long before the connection is dropped
+#define LOADER_RETRY_MS 1000     // After a failure, misses fail right away for this long
+#define LOADER_CHECK_EXPIRIES 64 // Expired keys removed between two clock reads
+
+/*
+ * With --loader <socket>, a GET that misses asks a helper process (the backing store's
+ * adapter) for the key over a Unix stream socket, one line per request:
+ *
+ *   server -> loader:  GET /<file> <key>
+ *   loader -> server:  OK <value>     (the key exists)
+ *                      NONE           (it doesn't: the GET misses as usual)
+ *                      anything else  (the load failed: the GET gets an error)
+ *
+ * Replies come in request order. A key is requested once however many clients miss on
+ * it (single-flight); the clients are parked like a suspended command (their later
+ * commands wait) while the event loop serves everybody else. A loaded value is stored
+ * in the tree, unless a client wrote the key meanwhile, and with --loader-ttl expires
+ * that many seconds later (unless it was overwritten since). If the loader is missing,
+ * slow or misbehaving, the connection is dropped, the waiting GETs fail, and misses fail
+ * right away until the next reconnect attempt.
+ */
+
+struct client;
+
+extern const char *loader_socket; // Path of the loader's Unix socket (--loader; NULL = read-through off)
+extern uint32_t loader_ttl;       // Lifetime of loaded keys in seconds (--loader-ttl; 0 = no expiry)
+
+void loader_fetch(struct client *client, const path_t *path, const char *file, const char *key);
+void loader_forget(struct client *client);
+int loader_fd(void);
+void loader_event(uint32_t events);
+bool loader_pending(void);
+int loader_cycle(uint64_t budget_ns);
+void loader_shutdown(void);
+int loader_stats(char *buf, size_t cap);
+
+#endif /* LOADER_H */
@@ -0,0 +1,1940 @@
+/* lsm.c - Log-structured merge engine: the durable, larger-than-memory backend */
+#include "lsm.h"   // Own header for configuration and prototypes
+#include "main.h"  // MAX_KEY_LEN, MAX_VALUE_LEN, logging macros
+#include "index.h" // struct hindex (the memtable)
+#include "hash.h"  // hash_bytes, hash_seeded
+#include "numa.h"  // numa_pin_thread, numa_thread_node
+#include "util.h"  // write_all
+
+#include <pthread.h>  // The compaction thread
+#include <dirent.h>   // fdopendir, readdir
+#include <sys/file.h> // flock
+#include <sys/stat.h> // mkdir, fstat
+
+const char *lsm_dir;
+bool lsm_sync;
+
+#define LSM_KEY_MAX (PATH_MAX_LEN + MAX_KEY_LEN)                 // Internal key: "<path>\0<key>"
+#define ENTRY_HEADER 5                                           // u16 key length, u16 value length, u8 flags
+#define ENTRY_MAX (ENTRY_HEADER + LSM_KEY_MAX + MAX_VALUE_LEN)   // Largest encoded entry
+#define BLOCK_MAX (LSM_BLOCK_BYTES + ENTRY_MAX)                  // A block ends with the entry that fills it
+#define WAL_CHECK 4                                              // u32 checksum in front of each WAL record
+#define ENTRY_DELETED 0x01                                       // Tombstone (no value)
+#define RUN_MAGIC 0x4d4c534dU                                    // "MSLM"
+#define HASH_SEED_FILES 0x6d656d6f64622d6cULL                    // Fixed: hashes stored in files outlive the process
+
+/**
+ * @brief Newest value (or tombstone) of one key in a memtable.
+ */
+struct mem_entry
+{
+    struct hlink link; // In the memtable's index
+    uint16_t klen;     // Internal key length
+    uint16_t vlen;     // Value length (0 for a tombstone)
+    bool deleted;      // Tombstone
+    char data[];       // Key, then value
+};
+
+/**
+ * @brief A memtable. The active one belongs to the event loop; once frozen it is never
+ * modified again and the compaction thread flushes it.
+ */
+struct memtable
+{
+    struct hindex index;    // Entries by key
+    size_t bytes;           // Memory held by the entries
+    uint64_t wal_no;        // The WAL holding the same writes
+    struct memtable *older; // Next older frozen memtable
+};
+
+/**
+ * @brief A sorted run: an immutable file of data blocks, followed by the block index, the
+ * bloom filter, the largest key and a fixed footer. Everything after the data blocks
+ * stays in memory (`meta`).
+ */
+struct run
+{
+    uint64_t file_no;      // run-<file_no>.sst
+    int fd;                // Open read-only
+    uint64_t bytes;        // File size
+    uint64_t entries;      // Keys (tombstones included)
+    uint32_t nblocks;      // Data blocks
+    uint8_t *meta;         // Index, bloom filter and largest key, as read from the file
+    uint32_t *index;       // Offset in `meta` of each block's index record
+    const uint8_t *bloom;  // Bloom filter bits (in `meta`)
+    uint64_t bloom_bits;   // Bits in the filter
+    const char *first;     // Smallest key (in `meta`)
+    uint16_t first_len;    // Its length
+    const char *last;      // Largest key (in `meta`)
+    uint16_t last_len;     // Its length
+};
+
+/**
+ * @brief Fixed-size tail of a run file.
+ */
+struct run_footer
+{
+    uint64_t index_off;  // Start of the block index
+    uint64_t bloom_off;  // Start of the bloom filter
+    uint64_t last_off;   // Start of the largest key (u16 length, bytes)
+    uint64_t entries;    // Keys in the run
+    uint64_t bloom_bits; // Bits in the filter
+    uint32_t nblocks;    // Data blocks
+    uint32_t magic;      // RUN_MAGIC
+};
+
+/**
+ * @brief Runs of one level. Level 0 is ordered oldest first and its runs may overlap;
+ * deeper levels are ordered by key and their runs don't.
+ */
+struct level
+{
+    struct run **runs; // The runs
+    unsigned n, cap;   // Used and allocated entries of `runs`
+    uint64_t bytes;    // Total file size
+};
+
+/**
+ * @brief Growable byte buffer used while writing a run.
+ */
+struct buf
+{
+    uint8_t *data;
+    size_t len, cap;
+};
+
+/**
+ * @brief Engine state. `lock` protects the frozen memtables, the levels, the file counter
+ * and the counters below them. Only the compaction thread changes the levels, so it
+ * reads them without the lock; the event loop holds it for a whole read.
+ */
+static struct
+{
+    bool ready;                        // lsm_init succeeded
+    int dir_fd;                        // The data directory
+    int lock_fd;                       // LOCK file, flock'ed against a second server
+    struct memtable *mem;              // Active memtable (event loop)
+    int wal_fd;                        // Its WAL (event loop)
+    uint64_t wal_bytes;                // Bytes appended to the WALs (event loop)
+    uint64_t stalls;                   // Freezes skipped because too many memtables were waiting (event loop)
+    pthread_t thread;                  // The compaction thread
+    bool thread_started;               // `thread` is running
+    pthread_mutex_t lock;              // See above
+    pthread_cond_t wake;               // Signalled when a memtable is frozen or the engine stops
+    struct memtable *imm;              // Frozen memtables, newest first
+    unsigned nimm;                     // Entries in `imm`
+    struct level levels[LSM_LEVELS];   // The runs
+    uint64_t next_file;                // Number of the next WAL or run file
+    uint64_t oldest_wal;               // WALs numbered below this are in runs (recorded in the MANIFEST)
+    bool stopping;                     // The thread exits once `imm` is empty
+    bool dirty;                        // The MANIFEST is behind the levels (a save failed)
+    uint64_t *dead_wals;               // WALs to delete after the next MANIFEST save (thread)
+    unsigned ndead_wals, cap_dead_wals; // Entries of `dead_wals`
+    struct run **dead_runs;            // Runs to delete after the next MANIFEST save (thread)
+    unsigned ndead_runs, cap_dead_runs; // Entries of `dead_runs`
+    unsigned cursor[LSM_LEVELS];       // Next run of each level to compact (thread)
+    uint64_t flushes;                  // Memtables written to level 0
+    uint64_t compactions;              // Merges into the next level
+    uint64_t moves;                    // Runs moved down a level without rewriting them
+    uint64_t written;                  // Bytes of run files written
+    uint64_t merged;                   // Bytes of run files read by merges
+    uint64_t errors;                   // Failed flushes, merges and MANIFEST saves
+    uint64_t gets;                     // Reads that got past the memtables
+    uint64_t probes;                   // Runs whose block was read by a get
+    uint64_t bloom_skips;              // Runs skipped thanks to their bloom filter
+} lsm = {.dir_fd = -1, .lock_fd = -1, .wal_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Orders internal keys bytewise (a key sorts before its extensions).
+ */
+static int key_cmp(const char *a, uint16_t alen, const char *b, uint16_t blen)
+{
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    return c != 0 ? c : (alen > blen) - (alen < blen);
+}
+
+/**
+ * @brief Builds the internal key of (path, key): the path, a NUL, then the key.
+ * @return Its length.
+ */
+static uint16_t make_key(char *out, const path_t *path, const char *key)
+{
+    size_t klen = strnlen(key, MAX_KEY_LEN - 1);
+    memcpy(out, path->buf, path->len);
+    out[path->len] = '\0';
+    memcpy(out + path->len + 1, key, klen);
+    return (uint16_t)(path->len + 1 + klen);
+}
+
+/**
+ * @brief Encodes an entry (header, key, value) at `out`.
+ * @return Bytes written.
+ */
+static size_t encode_entry(uint8_t *out, const char *k, uint16_t klen, const char *v, uint16_t vlen, bool deleted)
+{
+    out[4] = deleted ? ENTRY_DELETED : 0;
+    memcpy(out, &klen, sizeof(klen));
+    memcpy(out + 2, &vlen, sizeof(vlen));
+    memcpy(out + ENTRY_HEADER, k, klen);
+    memcpy(out + ENTRY_HEADER + klen, v, vlen);
+    return ENTRY_HEADER + (size_t)klen + vlen;
+}
+
+static int buf_append(struct buf *b, const void *data, size_t len)
+{
+    if (b->len + len > b->cap)
+    {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->len + len)
+        {
+            cap *= 2;
+        }
+        uint8_t *grown = (uint8_t *)realloc(b->data, cap);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+static uint64_t level_target(unsigned level)
+{
+    uint64_t target = LSM_L1_BYTES;
+    for (unsigned i = 1; i < level; i++)
+    {
+        target *= LSM_LEVEL_RATIO;
+    }
+    return target;
+}
+
+/* ------------------------------------------------------------------------------------ */
+/* Memtables                                                                             */
+/* ------------------------------------------------------------------------------------ */
+
+static struct mem_entry *mem_find(const struct memtable *m, const char *k, uint16_t klen, uint64_t hash)
+{
+    for (struct hlink *h = hindex_head(&m->index, hash); h != NULL; h = h->next)
+    {
+        struct mem_entry *e = hlink_entry(h, struct mem_entry, link);
+        if (h->hash == hash && e->klen == klen && memcmp(e->data, k, klen) == 0)
+        {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Records the newest value (or tombstone) of a key, replacing the previous one.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int mem_put(struct memtable *m, const char *k, uint16_t klen, const char *v, uint16_t vlen, bool deleted)
+{
+    uint64_t hash = hash_bytes(k, klen);
+    struct mem_entry *e = (struct mem_entry *)malloc(sizeof(*e) + klen + vlen);
+    if (e == NULL)
+    {
+        return -1;
+    }
+    e->link.hash = hash;
+    e->klen = klen;
+    e->vlen = vlen;
+    e->deleted = deleted;
+    memcpy(e->data, k, klen);
+    memcpy(e->data + klen, v, vlen);
+
+    struct mem_entry *old = mem_find(m, k, klen, hash);
+    if (old != NULL)
+    {
+        e->link.next = old->link.next;
+        hindex_replace(&m->index, &old->link, &e->link);
+        m->bytes -= sizeof(*old) + old->klen + old->vlen;
+        free(old);
+    }
+    else if (hindex_insert(&m->index, &e->link) != 0)
+    {
+        free(e);
+        return -1;
+    }
+    m->bytes += sizeof(*e) + klen + vlen;
+    return 0;
+}
+
+static void mem_free(struct memtable *m)
+{
+    if (m->index.buckets != NULL)
+    {
+        for (uint32_t b = 0; b <= m->index.mask; b++)
+        {
+            struct hlink *h = m->index.buckets[b];
+            while (h != NULL)
+            {
+                struct hlink *next = h->next;
+                free(hlink_entry(h, struct mem_entry, link));
+                h = next;
+            }
+        }
+    }
+    hindex_free(&m->index);
+    free(m);
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const struct mem_entry *x = *(const struct mem_entry *const *)a;
+    const struct mem_entry *y = *(const struct mem_entry *const *)b;
+    return key_cmp(x->data, x->klen, y->data, y->klen);
+}
+
+/* ------------------------------------------------------------------------------------ */
+/* Write-ahead log                                                                       */
+/* ------------------------------------------------------------------------------------ */
+
+/**
+ * @brief Creates a WAL and makes its directory entry durable, so the records synced to it
+ * can't be lost with the file at a crash.
+ * @return The file descriptor, or -1 on error.
+ */
+static int wal_open(uint64_t no)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "wal-%llu.log", (unsigned long long)no);
+    int fd = openat(lsm.dir_fd, name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1 || fsync(lsm.dir_fd) != 0)
+    {
+        error_log("LSM: cannot create %s/%s: %s", lsm_dir, name, strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+            unlinkat(lsm.dir_fd, name, 0);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Appends one write to the active WAL: a checksum, then the encoded entry.
+ * @return 0 on success, -1 on I/O error.
+ */
+static int wal_append(const char *k, uint16_t klen, const char *v, uint16_t vlen, bool deleted)
+{
+    uint8_t rec[WAL_CHECK + ENTRY_MAX];
+    size_t len = encode_entry(rec + WAL_CHECK, k, klen, v, vlen, deleted);
+    uint32_t check = (uint32_t)hash_seeded(rec + WAL_CHECK, len, HASH_SEED_FILES);
+    memcpy(rec, &check, sizeof(check));
+
+    if (write_all(lsm.wal_fd, rec, WAL_CHECK + len) != 0 || (lsm_sync && fdatasync(lsm.wal_fd) != 0))
+    {
+        error_log("LSM: WAL write failed: %s", strerror(errno));
+        return -1;
+    }
+    lsm.wal_bytes += WAL_CHECK + len;
+    return 0;
+}
+
+/**
+ * @brief Replays a WAL into a memtable, up to its first torn or corrupt record.
+ * @return 0 on success, -1 if the file can't be read or memory runs out.
+ */
+static int wal_replay(uint64_t no, struct memtable *m)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "wal-%llu.log", (unsigned long long)no);
+    int fd = openat(lsm.dir_fd, name, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0)
+    {
+        error_log("LSM: cannot read %s/%s: %s", lsm_dir, name, strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    uint8_t *data = (uint8_t *)malloc(st.st_size > 0 ? (size_t)st.st_size : 1);
+    ssize_t got = data ? pread(fd, data, (size_t)st.st_size, 0) : -1;
+    close(fd);
+    if (got != st.st_size)
+    {
+        error_log("LSM: cannot read %s/%s", lsm_dir, name);
+        free(data);
+        return -1;
+    }
+
+    size_t pos = 0, records = 0;
+    while (pos + WAL_CHECK + ENTRY_HEADER <= (size_t)got)
+    {
+        const uint8_t *e = data + pos + WAL_CHECK;
+        uint16_t klen = get_u16(e), vlen = get_u16(e + 2);
+        size_t len = ENTRY_HEADER + (size_t)klen + vlen;
+        if (pos + WAL_CHECK + len > (size_t)got || klen > LSM_KEY_MAX || vlen > MAX_VALUE_LEN ||
+            get_u32(data + pos) != (uint32_t)hash_seeded(e, len, HASH_SEED_FILES))
+        {
+            break;
+        }
+        if (mem_put(m, (const char *)e + ENTRY_HEADER, klen, (const char *)e + ENTRY_HEADER + klen, vlen,
+                    (e[4] & ENTRY_DELETED) != 0) != 0)
+        {
+            free(data);
+            return -1;
+        }
+        pos += WAL_CHECK + len;
+        records++;
+    }
+    if (pos < (size_t)got)
+    {
+        error_log("LSM: %s/%s: ignoring %zu bytes after the last intact record", lsm_dir, name, (size_t)got - pos);
+    }
+    info_log("LSM: replayed %zu writes from %s", records, name);
+    free(data);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------------------ */
+/* Runs                                                                                  */
+/* ------------------------------------------------------------------------------------ */
+
+static uint64_t take_file_no(void)
+{
+    pthread_mutex_lock(&lsm.lock);
+    uint64_t no = lsm.next_file++;
+    pthread_mutex_unlock(&lsm.lock);
+    return no;
+}
+
+static void run_free(struct run *r)
+{
+    if (r->fd != -1)
+    {
+        close(r->fd);
+    }
+    free(r->meta);
+    free(r->index);
+    free(r);
+}
+
+/**
+ * @brief Opens a run file and loads its index, bloom filter and key range.
+ * @return The run, or NULL if the file is missing, unreadable or malformed.
+ */
+static struct run *run_open(uint64_t file_no)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "run-%llu.sst", (unsigned long long)file_no);
+    struct run *r = (struct run *)calloc(1, sizeof(*r));
+    if (r == NULL)
+    {
+        return NULL;
+    }
+    r->file_no = file_no;
+    r->fd = openat(lsm.dir_fd, name, O_RDONLY | O_CLOEXEC);
+
+    struct stat st;
+    struct run_footer f;
+    if (r->fd == -1 || fstat(r->fd, &st) != 0 || (size_t)st.st_size < sizeof(f) ||
+        pread(r->fd, &f, sizeof(f), st.st_size - (off_t)sizeof(f)) != (ssize_t)sizeof(f) || f.magic != RUN_MAGIC ||
+        f.nblocks == 0 || f.index_off > f.bloom_off || f.bloom_off + f.bloom_bits / 8 > f.last_off ||
+        f.last_off + 2 > (uint64_t)st.st_size - sizeof(f))
+    {
+        error_log("LSM: cannot open %s/%s: %s", lsm_dir, name, r->fd == -1 ? strerror(errno) : "malformed file");
+        run_free(r);
+        return NULL;
+    }
+
+    size_t meta_len = (size_t)st.st_size - sizeof(f) - f.index_off;
+    r->bytes = (uint64_t)st.st_size;
+    r->entries = f.entries;
+    r->nblocks = f.nblocks;
+    r->bloom_bits = f.bloom_bits;
+    r->meta = (uint8_t *)malloc(meta_len);
+    r->index = (uint32_t *)malloc(f.nblocks * sizeof(uint32_t));
+    if (r->meta == NULL || r->index == NULL ||
+        pread(r->fd, r->meta, meta_len, (off_t)f.index_off) != (ssize_t)meta_len)
+    {
+        error_log("LSM: cannot load %s/%s", lsm_dir, name);
+        run_free(r);
+        return NULL;
+    }
+
+    // Index records: u64 offset, u32 length, u16 first-key length, first key.
+    size_t pos = 0, index_len = f.bloom_off - f.index_off;
+    for (uint32_t i = 0; i < f.nblocks; i++)
+    {
+        if (pos + 14 > index_len || pos + 14 + get_u16(r->meta + pos + 12) > index_len ||
+            get_u32(r->meta + pos + 8) > BLOCK_MAX)
+        {
+            error_log("LSM: %s/%s: corrupt block index", lsm_dir, name);
+            run_free(r);
+            return NULL;
+        }
+        r->index[i] = (uint32_t)pos;
+        pos += 14 + get_u16(r->meta + pos + 12);
+    }
+    r->bloom = r->meta + index_len;
+    r->first = (const char *)r->meta + 14;
+    r->first_len = get_u16(r->meta + 12);
+    r->last_len = get_u16(r->meta + (f.last_off - f.index_off));
+    r->last = (const char *)r->meta + (f.last_off - f.index_off) + 2;
+    return r;
+}
+
+static bool bloom_test(const struct run *r, uint64_t hash)
+{
+    uint64_t delta = (hash >> 33) | (hash << 31) | 1;
+    for (unsigned i = 0; i < LSM_BLOOM_PROBES; i++, hash += delta)
+    {
+        uint64_t bit = hash % r->bloom_bits;
+        if (!(r->bloom[bit / 8] & (1u << (bit % 8))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a data block of a run.
+ * @return Its length, or -1 on I/O error.
+ */
+static ssize_t read_block(const struct run *r, uint32_t block, uint8_t *out)
+{
+    const uint8_t *rec = r->meta + r->index[block];
+    uint32_t len = get_u32(rec + 8);
+    if (pread(r->fd, out, len, (off_t)get_u64(rec)) != (ssize_t)len)
+    {
+        error_log("LSM: read of run-%llu.sst block %u failed: %s", (unsigned long long)r->file_no, block,
+                  strerror(errno));
+        return -1;
+    }
+    return len;
+}
+
+/**
+ * @brief Looks a key up in one run.
+ *
+ * @param hash The key's hash_seeded(HASH_SEED_FILES).
+ * @param block A BLOCK_MAX-byte buffer.
+ * @param entry Receives the entry (in `block`) if the key is there.
+ * @return 1 if found, 0 if not, -1 on I/O error.
+ */
+static int run_get(const struct run *r, const char *k, uint16_t klen, uint64_t hash, uint8_t *block,
+                   const uint8_t **entry)
+{
+    if (key_cmp(k, klen, r->first, r->first_len) < 0 || key_cmp(k, klen, r->last, r->last_len) > 0)
+    {
+        return 0;
+    }
+    if (!bloom_test(r, hash))
+    {
+        lsm.bloom_skips++;
+        return 0;
+    }
+
+    // Last block whose first key is <= k.
+    uint32_t lo = 0, hi = r->nblocks - 1;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        const uint8_t *rec = r->meta + r->index[mid];
+        if (key_cmp((const char *)rec + 14, get_u16(rec + 12), k, klen) <= 0)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+
+    lsm.probes++;
+    ssize_t len = read_block(r, lo, block);
+    if (len < 0)
+    {
+        return -1;
+    }
+    for (ssize_t pos = 0; pos + ENTRY_HEADER <= len;)
+    {
+        const uint8_t *e = block + pos;
+        uint16_t elen = get_u16(e);
+        int c = key_cmp((const char *)e + ENTRY_HEADER, elen, k, klen);
+        if (c == 0)
+        {
+            *entry = e;
+            return 1;
+        }
+        if (c > 0)
+        {
+            break;
+        }
+        pos += ENTRY_HEADER + elen + get_u16(e + 2);
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes one run file a key at a time (keys in increasing order).
+ */
+struct run_writer
+{
+    FILE *f;                 // The file being written
+    uint64_t file_no;        // Its number
+    uint8_t block[BLOCK_MAX]; // Current data block
+    size_t block_len;        // Bytes in `block`
+    uint64_t data_len;       // Bytes of finished data blocks
+    struct buf index;        // Block index records
+    uint64_t *hashes;        // Bloom hash of every key
+    size_t nhashes, cap;     // Entries of `hashes`
+    uint32_t nblocks;        // Finished data blocks
+    char last[LSM_KEY_MAX];  // Last key added
+    uint16_t last_len;       // Its length
+    bool failed;             // A write or allocation failed
+};
+
+static struct run_writer *writer_open(void)
+{
+    struct run_writer *w = (struct run_writer *)calloc(1, sizeof(*w));
+    if (w == NULL)
+    {
+        return NULL;
+    }
+    w->file_no = take_file_no();
+    char name[64];
+    snprintf(name, sizeof(name), "run-%llu.sst", (unsigned long long)w->file_no);
+    int fd = openat(lsm.dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    w->f = fd != -1 ? fdopen(fd, "w") : NULL;
+    if (w->f == NULL)
+    {
+        error_log("LSM: cannot create %s/%s: %s", lsm_dir, name, strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+static void writer_end_block(struct run_writer *w)
+{
+    // The index record starts with the block's first key.
+    const uint8_t *first = w->block;
+    uint8_t rec[14];
+    uint32_t len = (uint32_t)w->block_len;
+    memcpy(rec, &w->data_len, 8);
+    memcpy(rec + 8, &len, 4);
+    memcpy(rec + 12, first, 2);
+    if (fwrite(w->block, 1, w->block_len, w->f) != w->block_len || buf_append(&w->index, rec, sizeof(rec)) != 0 ||
+        buf_append(&w->index, first + ENTRY_HEADER, get_u16(first)) != 0)
+    {
+        w->failed = true;
+    }
+    w->data_len += w->block_len;
+    w->block_len = 0;
+    w->nblocks++;
+}
+
+static void writer_add(struct run_writer *w, const char *k, uint16_t klen, const char *v, uint16_t vlen, bool deleted)
+{
+    if (w->nhashes == w->cap)
+    {
+        size_t cap = w->cap ? w->cap * 2 : 1024;
+        uint64_t *grown = (uint64_t *)realloc(w->hashes, cap * sizeof(uint64_t));
+        if (grown == NULL)
+        {
+            w->failed = true;
+            return;
+        }
+        w->hashes = grown;
+        w->cap = cap;
+    }
+    w->hashes[w->nhashes++] = hash_seeded(k, klen, HASH_SEED_FILES);
+    w->block_len += encode_entry(w->block + w->block_len, k, klen, v, vlen, deleted);
+    memcpy(w->last, k, klen);
+    w->last_len = klen;
+    if (w->block_len >= LSM_BLOCK_BYTES)
+    {
+        writer_end_block(w);
+    }
+}
+
+/**
+ * @brief Bytes the run will take so far (to split merge output).
+ */
+static uint64_t writer_size(const struct run_writer *w)
+{
+    return w->data_len + w->block_len;
+}
+
+static void writer_abort(struct run_writer *w)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "run-%llu.sst", (unsigned long long)w->file_no);
+    fclose(w->f);
+    unlinkat(lsm.dir_fd, name, 0);
+    free(w->index.data);
+    free(w->hashes);
+    free(w);
+}
+
+/**
+ * @brief Writes the index, bloom filter, largest key and footer, syncs the file and
+ * opens it as a run.
+ * @return The run, or NULL on failure (the file is removed).
+ */
+static struct run *writer_finish(struct run_writer *w)
+{
+    if (w->block_len > 0)
+    {
+        writer_end_block(w);
+    }
+    if (w->failed || w->nhashes == 0)
+    {
+        writer_abort(w);
+        return NULL;
+    }
+
+    struct run_footer f = {.entries = w->nhashes, .nblocks = w->nblocks, .magic = RUN_MAGIC};
+    f.bloom_bits = (w->nhashes * LSM_BLOOM_BITS + 63) / 64 * 64;
+    uint8_t *bloom = (uint8_t *)calloc(f.bloom_bits / 8, 1);
+    if (bloom == NULL)
+    {
+        writer_abort(w);
+        return NULL;
+    }
+    for (size_t i = 0; i < w->nhashes; i++)
+    {
+        uint64_t hash = w->hashes[i], delta = (hash >> 33) | (hash << 31) | 1;
+        for (unsigned p = 0; p < LSM_BLOOM_PROBES; p++, hash += delta)
+        {
+            uint64_t bit = hash % f.bloom_bits;
+            bloom[bit / 8] |= (uint8_t)(1u << (bit % 8));
+        }
+    }
+
+    f.index_off = w->data_len;
+    f.bloom_off = f.index_off + w->index.len;
+    f.last_off = f.bloom_off + f.bloom_bits / 8;
+    bool ok = fwrite(w->index.data, 1, w->index.len, w->f) == w->index.len &&
+              fwrite(bloom, 1, f.bloom_bits / 8, w->f) == f.bloom_bits / 8 &&
+              fwrite(&w->last_len, 2, 1, w->f) == 1 && fwrite(w->last, 1, w->last_len, w->f) == w->last_len &&
+              fwrite(&f, sizeof(f), 1, w->f) == 1 && fflush(w->f) == 0 && fdatasync(fileno(w->f)) == 0;
+    free(bloom);
+    if (!ok)
+    {
+        error_log("LSM: writing run-%llu.sst failed: %s", (unsigned long long)w->file_no, strerror(errno));
+        writer_abort(w);
+        return NULL;
+    }
+
+    fclose(w->f);
+    uint64_t file_no = w->file_no;
+    free(w->index.data);
+    free(w->hashes);
+    free(w);
+    struct run *r = run_open(file_no);
+    if (r != NULL)
+    {
+        pthread_mutex_lock(&lsm.lock);
+        lsm.written += r->bytes;
+        pthread_mutex_unlock(&lsm.lock);
+    }
+    return r;
+}
+
+/* ------------------------------------------------------------------------------------ */
+/* Levels and the MANIFEST                                                               */
+/* ------------------------------------------------------------------------------------ */
+
+/**
+ * @brief Adds a run to a level: at the end of level 0, in key order elsewhere.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int level_add(unsigned level, struct run *r)
+{
+    struct level *l = &lsm.levels[level];
+    if (l->n == l->cap)
+    {
+        unsigned cap = l->cap ? l->cap * 2 : 16;
+        struct run **grown = (struct run **)realloc(l->runs, cap * sizeof(*grown));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        l->runs = grown;
+        l->cap = cap;
+    }
+    unsigned pos = l->n;
+    while (level > 0 && pos > 0 && key_cmp(l->runs[pos - 1]->first, l->runs[pos - 1]->first_len, r->first,
+                                           r->first_len) > 0)
+    {
+        l->runs[pos] = l->runs[pos - 1];
+        pos--;
+    }
+    l->runs[pos] = r;
+    l->n++;
+    l->bytes += r->bytes;
+    return 0;
+}
+
+static void level_remove(unsigned level, struct run *r)
+{
+    struct level *l = &lsm.levels[level];
+    for (unsigned i = 0; i < l->n; i++)
+    {
+        if (l->runs[i] == r)
+        {
+            memmove(&l->runs[i], &l->runs[i + 1], (l->n - i - 1) * sizeof(*l->runs));
+            l->n--;
+            l->bytes -= r->bytes;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Rewrites the MANIFEST (the oldest live WAL and the runs of every level) through a
+ * temporary file, then deletes the WALs and runs it no longer needs.
+ * @return 0 on success, -1 if the MANIFEST couldn't be replaced (it is retried later).
+ */
+static int manifest_save(void)
+{
+    int fd = openat(lsm.dir_fd, "MANIFEST.tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    FILE *f = fd != -1 ? fdopen(fd, "w") : NULL;
+    if (f == NULL)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        error_log("LSM: cannot write %s/MANIFEST.tmp: %s", lsm_dir, strerror(errno));
+        lsm.dirty = true;
+        return -1;
+    }
+    fprintf(f, "memodb-lsm 1\n");
+    fprintf(f, "wal %llu\n", (unsigned long long)lsm.oldest_wal);
+    for (unsigned level = 0; level < LSM_LEVELS; level++)
+    {
+        for (unsigned i = 0; i < lsm.levels[level].n; i++)
+        {
+            fprintf(f, "run %u %llu\n", level, (unsigned long long)lsm.levels[level].runs[i]->file_no);
+        }
+    }
+    bool ok = fflush(f) == 0 && !ferror(f) && fdatasync(fd) == 0;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || renameat(lsm.dir_fd, "MANIFEST.tmp", lsm.dir_fd, "MANIFEST") != 0 || fsync(lsm.dir_fd) != 0)
+    {
+        error_log("LSM: cannot replace %s/MANIFEST: %s", lsm_dir, strerror(errno));
+        lsm.dirty = true;
+        return -1;
+    }
+    lsm.dirty = false;
+
+    char name[64];
+    for (unsigned i = 0; i < lsm.ndead_wals; i++)
+    {
+        snprintf(name, sizeof(name), "wal-%llu.log", (unsigned long long)lsm.dead_wals[i]);
+        unlinkat(lsm.dir_fd, name, 0);
+    }
+    lsm.ndead_wals = 0;
+    for (unsigned i = 0; i < lsm.ndead_runs; i++)
+    {
+        snprintf(name, sizeof(name), "run-%llu.sst", (unsigned long long)lsm.dead_runs[i]->file_no);
+        unlinkat(lsm.dir_fd, name, 0);
+        run_free(lsm.dead_runs[i]);
+    }
+    lsm.ndead_runs = 0;
+    return 0;
+}
+
+/**
+ * @brief Queues a WAL or a run for deletion once the MANIFEST no longer refers to it.
+ * On allocation failure the file is simply kept: the next startup deletes it unread, a
+ * WAL because it is older than the MANIFEST's oldest live WAL, a run because it isn't listed.
+ */
+static void retire_wal(uint64_t no)
+{
+    if (lsm.ndead_wals == lsm.cap_dead_wals)
+    {
+        unsigned cap = lsm.cap_dead_wals ? lsm.cap_dead_wals * 2 : 8;
+        uint64_t *grown = (uint64_t *)realloc(lsm.dead_wals, cap * sizeof(*grown));
+        if (grown == NULL)
+        {
+            return;
+        }
+        lsm.dead_wals = grown;
+        lsm.cap_dead_wals = cap;
+    }
+    lsm.dead_wals[lsm.ndead_wals++] = no;
+}
+
+static void retire_run(struct run *r)
+{
+    if (lsm.ndead_runs == lsm.cap_dead_runs)
+    {
+        unsigned cap = lsm.cap_dead_runs ? lsm.cap_dead_runs * 2 : 16;
+        struct run **grown = (struct run **)realloc(lsm.dead_runs, cap * sizeof(*grown));
+        if (grown == NULL)
+        {
+            run_free(r); // Closed now; the file goes at the next startup.
+            return;
+        }
+        lsm.dead_runs = grown;
+        lsm.cap_dead_runs = cap;
+    }
+    lsm.dead_runs[lsm.ndead_runs++] = r;
+}
+
+/**
+ * @brief Loads the oldest live WAL and the runs listed in the MANIFEST (a missing MANIFEST
+ * is an empty engine).
+ * @return 0 on success, -1 if it lists a run that can't be opened.
+ */
+static int manifest_load(void)
+{
+    int fd = openat(lsm.dir_fd, "MANIFEST", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    FILE *f = fdopen(fd, "r");
+    if (f == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+    char line[128];
+    unsigned level;
+    unsigned long long no;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "wal %llu", &no) == 1)
+        {
+            lsm.oldest_wal = no;
+            continue;
+        }
+        if (sscanf(line, "run %u %llu", &level, &no) != 2)
+        {
+            continue; // Header
+        }
+        struct run *r = level < LSM_LEVELS ? run_open(no) : NULL;
+        if (r == NULL || level_add(level, r) != 0)
+        {
+            if (r != NULL)
+            {
+                run_free(r);
+            }
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/**
+ * @brief Deletes a run no MANIFEST ever listed.
+ */
+static void retire_unlisted(struct run *r)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "run-%llu.sst", (unsigned long long)r->file_no);
+    unlinkat(lsm.dir_fd, name, 0);
+    run_free(r);
+}
+
+static bool run_listed(uint64_t no)
+{
+    for (unsigned level = 0; level < LSM_LEVELS; level++)
+    {
+        for (unsigned i = 0; i < lsm.levels[level].n; i++)
+        {
+            if (lsm.levels[level].runs[i]->file_no == no)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* ------------------------------------------------------------------------------------ */
+/* Flushes and compactions (the compaction thread)                                       */
+/* ------------------------------------------------------------------------------------ */
+
+/**
+ * @brief Writes a memtable out as one sorted run.
+ * @return The run, or NULL on failure (or if the memtable is empty).
+ */
+static struct run *write_memtable(const struct memtable *m)
+{
+    uint32_t count = m->index.count;
+    if (count == 0)
+    {
+        return NULL;
+    }
+    struct mem_entry **sorted = (struct mem_entry **)malloc(count * sizeof(*sorted));
+    struct run_writer *w = sorted ? writer_open() : NULL;
+    if (w == NULL)
+    {
+        free(sorted);
+        return NULL;
+    }
+    uint32_t n = 0;
+    for (uint32_t b = 0; b <= m->index.mask; b++)
+    {
+        for (struct hlink *h = m->index.buckets[b]; h != NULL; h = h->next)
+        {
+            sorted[n++] = hlink_entry(h, struct mem_entry, link);
+        }
+    }
+    qsort(sorted, n, sizeof(*sorted), entry_cmp);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const struct mem_entry *e = sorted[i];
+        writer_add(w, e->data, e->klen, e->data + e->klen, e->vlen, e->deleted);
+    }
+    free(sorted);
+    return writer_finish(w);
+}
+
+/**
+ * @brief Flushes the oldest frozen memtable to level 0.
+ * @return 0 on success, -1 on failure (the memtable stays frozen, to be retried).
+ */
+static int flush_oldest(void)
+{
+    pthread_mutex_lock(&lsm.lock);
+    struct memtable *m = lsm.imm;
+    while (m->older != NULL)
+    {
+        m = m->older;
+    }
+    pthread_mutex_unlock(&lsm.lock);
+
+    struct run *r = write_memtable(m);
+    if (r == NULL && m->index.count > 0)
+    {
+        return -1;
+    }
+
+    // The run replaces the memtable for readers in one step.
+    pthread_mutex_lock(&lsm.lock);
+    if (r != NULL && level_add(0, r) != 0)
+    {
+        pthread_mutex_unlock(&lsm.lock);
+        retire_unlisted(r);
+        return -1;
+    }
+    struct memtable **link = &lsm.imm; // Newer memtables may have been frozen meanwhile.
+    while (*link != m)
+    {
+        link = &(*link)->older;
+    }
+    *link = NULL;
+    lsm.nimm--;
+    lsm.flushes++;
+    pthread_mutex_unlock(&lsm.lock);
+
+    // Memtables are flushed oldest first, so every WAL up to this one is now in a run.
+    lsm.oldest_wal = m->wal_no + 1;
+    retire_wal(m->wal_no);
+    mem_free(m);
+    manifest_save();
+    return 0;
+}
+
+/**
+ * @brief A run being read in key order by a merge.
+ */
+struct source
+{
+    const struct run *run; // The run
+    uint32_t block;        // Block in `buf`
+    uint8_t *buf;          // Its bytes
+    ssize_t len, pos;      // Length of the block, position of the current entry
+    bool valid;            // An entry is current
+};
+
+/**
+ * @brief Moves a source to its next entry, reading the next block when needed.
+ * @return 0 on success (check `valid`), -1 on I/O error.
+ */
+static int source_next(struct source *s, bool first)
+{
+    if (!first)
+    {
+        const uint8_t *e = s->buf + s->pos;
+        s->pos += ENTRY_HEADER + get_u16(e) + get_u16(e + 2);
+    }
+    while (first || s->pos + ENTRY_HEADER > s->len)
+    {
+        if (!first)
+        {
+            s->block++;
+        }
+        first = false;
+        if (s->block >= s->run->nblocks)
+        {
+            s->valid = false;
+            return 0;
+        }
+        s->len = read_block(s->run, s->block, s->buf);
+        if (s->len < 0)
+        {
+            return -1;
+        }
+        s->pos = 0;
+    }
+    s->valid = true;
+    return 0;
+}
+
+static inline const uint8_t *source_entry(const struct source *s)
+{
+    return s->buf + s->pos;
+}
+
+/**
+ * @brief Appends a run to a growable array of runs.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int push_run(struct run ***runs, unsigned *n, unsigned *cap, struct run *r)
+{
+    if (*n == *cap)
+    {
+        unsigned grown_cap = *cap ? *cap * 2 : 8;
+        struct run **grown = (struct run **)realloc(*runs, grown_cap * sizeof(*grown));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        *runs = grown;
+        *cap = grown_cap;
+    }
+    (*runs)[(*n)++] = r;
+    return 0;
+}
+
+/**
+ * @brief Merges runs into new runs of the next level.
+ *
+ * @param inputs The runs, newest first (the first of equal keys wins).
+ * @param n Number of inputs.
+ * @param drop_tombstones No deeper level holds data: tombstones can go.
+ * @param outs Receives the new runs (a malloc'ed array).
+ * @return Number of new runs, or -1 on failure (nothing is left behind).
+ */
+static int merge(struct run **inputs, unsigned n, bool drop_tombstones, struct run ***outs)
+{
+    struct source *src = (struct source *)calloc(n, sizeof(*src));
+    uint8_t *bufs = (uint8_t *)malloc((size_t)n * BLOCK_MAX);
+    struct run **made = NULL;
+    unsigned nmade = 0, cap = 0;
+    struct run_writer *w = NULL;
+    bool ok = src != NULL && bufs != NULL;
+
+    for (unsigned i = 0; ok && i < n; i++)
+    {
+        src[i].run = inputs[i];
+        src[i].buf = bufs + (size_t)i * BLOCK_MAX;
+        ok = source_next(&src[i], true) == 0;
+    }
+
+    while (ok)
+    {
+        // Smallest current key; on ties the earlier (newer) input wins.
+        int win = -1;
+        for (unsigned i = 0; i < n; i++)
+        {
+            if (src[i].valid &&
+                (win < 0 || key_cmp((const char *)source_entry(&src[i]) + ENTRY_HEADER, get_u16(source_entry(&src[i])),
+                                    (const char *)source_entry(&src[win]) + ENTRY_HEADER,
+                                    get_u16(source_entry(&src[win]))) < 0))
+            {
+                win = (int)i;
+            }
+        }
+        if (win < 0)
+        {
+            break;
+        }
+
+        const uint8_t *e = source_entry(&src[win]);
+        uint16_t klen = get_u16(e), vlen = get_u16(e + 2);
+        const char *k = (const char *)e + ENTRY_HEADER;
+        if (!((e[4] & ENTRY_DELETED) && drop_tombstones))
+        {
+            if (w == NULL && (w = writer_open()) == NULL)
+            {
+                ok = false;
+                break;
+            }
+            writer_add(w, k, klen, k + klen, vlen, (e[4] & ENTRY_DELETED) != 0);
+        }
+
+        // Older copies of the same key are dropped.
+        for (unsigned i = 0; ok && i < n; i++)
+        {
+            if ((int)i != win && src[i].valid &&
+                key_cmp((const char *)source_entry(&src[i]) + ENTRY_HEADER, get_u16(source_entry(&src[i])), k,
+                        klen) == 0)
+            {
+                ok = source_next(&src[i], false) == 0;
+            }
+        }
+        ok = ok && source_next(&src[win], false) == 0;
+
+        // Cut the output into runs of about LSM_RUN_BYTES (and finish the last one).
+        bool done = true;
+        for (unsigned i = 0; ok && done && i < n; i++)
+        {
+            done = !src[i].valid;
+        }
+        if (ok && w != NULL && (done || writer_size(w) >= LSM_RUN_BYTES))
+        {
+            struct run *r = writer_finish(w);
+            w = NULL;
+            if (r == NULL || push_run(&made, &nmade, &cap, r) != 0)
+            {
+                if (r != NULL)
+                {
+                    retire_unlisted(r);
+                }
+                ok = false;
+            }
+        }
+    }
+
+    if (w != NULL)
+    {
+        writer_abort(w); // Only left over on failure.
+    }
+    free(src);
+    free(bufs);
+
+    if (!ok)
+    {
+        for (unsigned i = 0; i < nmade; i++)
+        {
+            retire_unlisted(made[i]);
+        }
+        free(made);
+        return -1;
+    }
+    *outs = made;
+    return (int)nmade;
+}
+
+/**
+ * @brief Returns the level most in need of compaction, or -1 if none is.
+ */
+static int pick_level(void)
+{
+    if (lsm.levels[0].n >= LSM_L0_TRIGGER)
+    {
+        return 0;
+    }
+    int best = -1;
+    double best_score = 1.0;
+    for (unsigned level = 1; level < LSM_LEVELS - 1; level++)
+    {
+        double score = (double)lsm.levels[level].bytes / (double)level_target(level);
+        if (score > best_score)
+        {
+            best = (int)level;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Merges one step down: all of level 0, or one run of a deeper level (taken in
+ * turn), together with the runs of the next level it overlaps.
+ * @return 0 on success, -1 on failure (the levels are unchanged).
+ */
+static int compact(unsigned level)
+{
+    struct level *from = &lsm.levels[level], *to = &lsm.levels[level + 1];
+    struct run **inputs = (struct run **)malloc((from->n + to->n) * sizeof(*inputs));
+    if (inputs == NULL)
+    {
+        return -1;
+    }
+
+    unsigned n = 0;
+    if (level == 0)
+    {
+        for (unsigned i = from->n; i > 0; i--)
+        {
+            inputs[n++] = from->runs[i - 1]; // Newest first
+        }
+    }
+    else
+    {
+        inputs[n++] = from->runs[lsm.cursor[level]++ % from->n];
+    }
+    unsigned nfrom = n;
+
+    // Key range of the inputs from `level`.
+    const char *lo = inputs[0]->first, *hi = inputs[0]->last;
+    uint16_t lo_len = inputs[0]->first_len, hi_len = inputs[0]->last_len;
+    for (unsigned i = 1; i < nfrom; i++)
+    {
+        if (key_cmp(inputs[i]->first, inputs[i]->first_len, lo, lo_len) < 0)
+        {
+            lo = inputs[i]->first;
+            lo_len = inputs[i]->first_len;
+        }
+        if (key_cmp(inputs[i]->last, inputs[i]->last_len, hi, hi_len) > 0)
+        {
+            hi = inputs[i]->last;
+            hi_len = inputs[i]->last_len;
+        }
+    }
+    for (unsigned i = 0; i < to->n; i++)
+    {
+        struct run *r = to->runs[i];
+        if (key_cmp(r->last, r->last_len, lo, lo_len) >= 0 && key_cmp(r->first, r->first_len, hi, hi_len) <= 0)
+        {
+            inputs[n++] = r;
+        }
+    }
+
+    // A lone run of a deeper level that overlaps nothing below just changes level.
+    if (level > 0 && n == 1)
+    {
+        pthread_mutex_lock(&lsm.lock);
+        level_remove(level, inputs[0]);
+        int rc = level_add(level + 1, inputs[0]);
+        if (rc != 0)
+        {
+            level_add(level, inputs[0]); // Has room: it was just removed.
+        }
+        else
+        {
+            lsm.moves++;
+        }
+        pthread_mutex_unlock(&lsm.lock);
+        free(inputs);
+        if (rc == 0)
+        {
+            manifest_save();
+        }
+        return rc;
+    }
+
+    bool bottom = true;
+    for (unsigned deeper = level + 2; deeper < LSM_LEVELS; deeper++)
+    {
+        bottom = bottom && lsm.levels[deeper].n == 0;
+    }
+    uint64_t read = 0;
+    for (unsigned i = 0; i < n; i++)
+    {
+        read += inputs[i]->bytes;
+    }
+
+    struct run **outs = NULL;
+    int nouts = merge(inputs, n, bottom, &outs);
+    if (nouts < 0)
+    {
+        free(inputs);
+        return -1;
+    }
+
+    // Swap the inputs for the outputs in one step.
+    pthread_mutex_lock(&lsm.lock);
+    int rc = 0;
+    for (unsigned i = 0; i < n; i++)
+    {
+        level_remove(i < nfrom ? level : level + 1, inputs[i]);
+    }
+    for (int i = 0; i < nouts; i++)
+    {
+        if (level_add(level + 1, outs[i]) != 0)
+        {
+            rc = -1;
+        }
+    }
+    if (rc != 0)
+    {
+        // Out of memory for the level array: put the inputs back and drop the outputs.
+        for (int i = 0; i < nouts; i++)
+        {
+            level_remove(level + 1, outs[i]);
+        }
+        for (unsigned i = 0; i < n; i++)
+        {
+            level_add(i < nfrom ? level : level + 1, inputs[i]);
+        }
+    }
+    else
+    {
+        lsm.compactions++;
+        lsm.merged += read;
+    }
+    pthread_mutex_unlock(&lsm.lock);
+
+    for (unsigned i = 0; rc == 0 && i < n; i++)
+    {
+        retire_run(inputs[i]);
+    }
+    for (int i = 0; rc != 0 && i < nouts; i++)
+    {
+        retire_unlisted(outs[i]);
+    }
+    free(inputs);
+    free(outs);
+    manifest_save();
+    return rc;
+}
+
+/**
+ * @brief The compaction thread: flushes frozen memtables first, then compacts while a
+ * level is over its target. Before exiting it flushes what is frozen.
+ * @param arg The event loop's NUMA node (as intptr_t), -1 if it isn't pinned.
+ */
+static void *lsm_main(void *arg)
+{
+    // The memtables it sorts were filled on the event loop's node: stay there.
+    int node = (int)(intptr_t)arg;
+    if (node >= 0)
+    {
+        numa_pin_thread(node);
+    }
+    pthread_mutex_lock(&lsm.lock);
+    for (;;)
+    {
+        int level = -1;
+        bool flush = lsm.imm != NULL;
+        if (!flush && !lsm.stopping)
+        {
+            level = pick_level();
+        }
+        if (!flush && level < 0 && !lsm.dirty)
+        {
+            if (lsm.stopping)
+            {
+                break;
+            }
+            pthread_cond_wait(&lsm.wake, &lsm.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&lsm.lock);
+
+        int rc;
+        if (lsm.dirty)
+        {
+            rc = manifest_save(); // Nothing new goes to disk until the MANIFEST catches up.
+        }
+        else
+        {
+            rc = flush ? flush_oldest() : compact((unsigned)level);
+        }
+
+        pthread_mutex_lock(&lsm.lock);
+        if (rc != 0)
+        {
+            lsm.errors++;
+            if (lsm.stopping)
+            {
+                break; // The WALs of what couldn't be flushed are replayed at the next start.
+            }
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += LSM_RETRY_MS / 1000;
+            until.tv_nsec += (LSM_RETRY_MS % 1000) * 1000000L;
+            if (until.tv_nsec >= 1000000000L)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&lsm.wake, &lsm.lock, &until);
+        }
+    }
+    pthread_mutex_unlock(&lsm.lock);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------------------ */
+/* The engine (event loop)                                                               */
+/* ------------------------------------------------------------------------------------ */
+
+static uint8_t get_block[BLOCK_MAX]; // Block buffer of the event loop's reads
+
+static struct memtable *mem_new(uint64_t wal_no)
+{
+    struct memtable *m = (struct memtable *)calloc(1, sizeof(*m));
+    if (m != NULL)
+    {
+        m->wal_no = wal_no;
+    }
+    return m;
+}
+
+/**
+ * @brief Freezes the active memtable for the thread to flush and starts a new one with
+ * a new WAL. If too many are waiting already, or the new WAL can't be created, the
+ * active memtable simply keeps growing.
+ */
+static void rotate(void)
+{
+    pthread_mutex_lock(&lsm.lock);
+    unsigned waiting = lsm.nimm;
+    pthread_mutex_unlock(&lsm.lock);
+    if (waiting >= LSM_MAX_IMMUTABLE)
+    {
+        lsm.stalls++;
+        return;
+    }
+
+    uint64_t no = take_file_no();
+    int fd = wal_open(no);
+    struct memtable *fresh = fd != -1 ? mem_new(no) : NULL;
+    if (fresh == NULL)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return;
+    }
+    close(lsm.wal_fd);
+    lsm.wal_fd = fd;
+
+    pthread_mutex_lock(&lsm.lock);
+    lsm.mem->older = lsm.imm;
+    lsm.imm = lsm.mem;
+    lsm.nimm++;
+    pthread_cond_signal(&lsm.wake);
+    pthread_mutex_unlock(&lsm.lock);
+    lsm.mem = fresh;
+}
+
+/**
+ * @brief Finds the newest entry of a key.
+ *
+ * @param block A BLOCK_MAX-byte buffer (receives the block of a key found in a run).
+ * @param value Receives the value (in the memtable or `block`).
+ * @param vlen Receives its length.
+ * @return 1 if the key has a value, 0 if it doesn't (never written, or deleted), -1 on I/O error.
+ */
+static int find_newest(const char *k, uint16_t klen, uint8_t *block, const char **value, uint16_t *vlen)
+{
+    uint64_t hash = hash_bytes(k, klen);
+    const struct mem_entry *e = mem_find(lsm.mem, k, klen, hash);
+    if (e != NULL)
+    {
+        *value = e->data + e->klen;
+        *vlen = e->vlen;
+        return e->deleted ? 0 : 1;
+    }
+
+    // The rest may change under the compaction thread: hold the lock until the value is copied.
+    for (const struct memtable *m = lsm.imm; m != NULL; m = m->older)
+    {
+        if ((e = mem_find(m, k, klen, hash)) != NULL)
+        {
+            *value = e->data + e->klen;
+            *vlen = e->vlen;
+            return e->deleted ? 0 : 1;
+        }
+    }
+
+    lsm.gets++;
+    uint64_t bloom_hash = hash_seeded(k, klen, HASH_SEED_FILES);
+    const uint8_t *entry = NULL;
+    int found = 0;
+    for (unsigned i = lsm.levels[0].n; found == 0 && i > 0; i--)
+    {
+        found = run_get(lsm.levels[0].runs[i - 1], k, klen, bloom_hash, block, &entry);
+    }
+    for (unsigned level = 1; found == 0 && level < LSM_LEVELS; level++)
+    {
+        // The one run whose range may hold the key: the last one starting at or before it.
+        const struct level *l = &lsm.levels[level];
+        unsigned lo = 0, hi = l->n;
+        while (lo < hi)
+        {
+            unsigned mid = lo + (hi - lo) / 2;
+            if (key_cmp(l->runs[mid]->first, l->runs[mid]->first_len, k, klen) <= 0)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        if (lo > 0)
+        {
+            found = run_get(l->runs[lo - 1], k, klen, bloom_hash, block, &entry);
+        }
+    }
+    if (found <= 0)
+    {
+        return found;
+    }
+    *value = (const char *)entry + ENTRY_HEADER + get_u16(entry);
+    *vlen = get_u16(entry + 2);
+    return (entry[4] & ENTRY_DELETED) ? 0 : 1;
+}
+
+/**
+ * @brief Opens (or creates) the data directory, loads the runs, replays and flushes the
+ * WALs, and starts the compaction thread.
+ * @return 0 on success, -1 if the engine can't start (the server must not run without it).
+ */
+int lsm_init(void)
+{
+    if (lsm_dir == NULL)
+    {
+        lsm_dir = LSM_DEFAULT_DIR;
+    }
+    if (mkdir(lsm_dir, 0755) != 0 && errno != EEXIST)
+    {
+        error_log("LSM: cannot create %s: %s", lsm_dir, strerror(errno));
+        return -1;
+    }
+    lsm.dir_fd = open(lsm_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    lsm.lock_fd = lsm.dir_fd != -1 ? openat(lsm.dir_fd, "LOCK", O_RDWR | O_CREAT | O_CLOEXEC, 0644) : -1;
+    if (lsm.lock_fd == -1)
+    {
+        error_log("LSM: cannot open %s: %s", lsm_dir, strerror(errno));
+        return -1;
+    }
+    if (flock(lsm.lock_fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        error_log("LSM: %s is in use by another server", lsm_dir);
+        return -1;
+    }
+
+    if (manifest_load() != 0)
+    {
+        error_log("LSM: cannot load %s/MANIFEST", lsm_dir);
+        return -1;
+    }
+
+    // Delete what a crash left behind, and collect the WALs to replay in order. A WAL older
+    // than the MANIFEST's oldest live one was flushed before the crash: replaying it over
+    // newer runs would bring back the values they replaced.
+    int scan_fd = dup(lsm.dir_fd);
+    DIR *dir = scan_fd != -1 ? fdopendir(scan_fd) : NULL;
+    if (dir == NULL)
+    {
+        error_log("LSM: cannot list %s: %s", lsm_dir, strerror(errno));
+        if (scan_fd != -1)
+        {
+            close(scan_fd);
+        }
+        return -1;
+    }
+    struct dirent *de;
+    unsigned long long no;
+    int end;
+    uint64_t max_no = 0;
+    struct buf wals = {0};
+    while ((de = readdir(dir)) != NULL)
+    {
+        if (sscanf(de->d_name, "run-%llu.sst%n", &no, &end) == 1 && de->d_name[end] == '\0')
+        {
+            if (!run_listed(no))
+            {
+                unlinkat(lsm.dir_fd, de->d_name, 0);
+            }
+        }
+        else if (sscanf(de->d_name, "wal-%llu.log%n", &no, &end) == 1 && de->d_name[end] == '\0')
+        {
+            uint64_t wal = no;
+            if (wal < lsm.oldest_wal)
+            {
+                unlinkat(lsm.dir_fd, de->d_name, 0);
+            }
+            else if (buf_append(&wals, &wal, sizeof(wal)) != 0)
+            {
+                closedir(dir);
+                free(wals.data);
+                return -1;
+            }
+        }
+        else
+        {
+            continue;
+        }
+        max_no = no > max_no ? no : max_no;
+    }
+    closedir(dir);
+    lsm.next_file = max_no + 1 > lsm.oldest_wal ? max_no + 1 : lsm.oldest_wal;
+    unlinkat(lsm.dir_fd, "MANIFEST.tmp", 0);
+
+    // Replay the WALs, oldest first, and flush them as one level-0 run.
+    uint64_t *wal_nos = (uint64_t *)wals.data;
+    size_t nwals = wals.len / sizeof(uint64_t);
+    for (size_t i = 1; i < nwals; i++)
+    {
+        for (size_t j = i; j > 0 && wal_nos[j - 1] > wal_nos[j]; j--)
+        {
+            uint64_t t = wal_nos[j];
+            wal_nos[j] = wal_nos[j - 1];
+            wal_nos[j - 1] = t;
+        }
+    }
+    struct memtable *replayed = mem_new(0);
+    int rc = replayed ? 0 : -1;
+    for (size_t i = 0; rc == 0 && i < nwals; i++)
+    {
+        rc = wal_replay(wal_nos[i], replayed);
+    }
+    if (rc == 0 && replayed->index.count > 0)
+    {
+        struct run *r = write_memtable(replayed);
+        rc = (r != NULL && level_add(0, r) == 0) ? 0 : -1;
+    }
+    for (size_t i = 0; rc == 0 && i < nwals; i++)
+    {
+        retire_wal(wal_nos[i]);
+        lsm.oldest_wal = wal_nos[i] + 1;
+    }
+    if (rc == 0 && nwals > 0)
+    {
+        rc = manifest_save();
+    }
+    if (replayed != NULL)
+    {
+        mem_free(replayed);
+    }
+    free(wals.data);
+    if (rc != 0)
+    {
+        error_log("LSM: recovery of %s failed", lsm_dir);
+        return -1;
+    }
+
+    uint64_t wal_no = lsm.next_file++;
+    lsm.wal_fd = wal_open(wal_no);
+    lsm.mem = lsm.wal_fd != -1 ? mem_new(wal_no) : NULL;
+    if (lsm.mem == NULL)
+    {
+        return -1;
+    }
+    int err = pthread_create(&lsm.thread, NULL, lsm_main, (void *)(intptr_t)numa_thread_node());
+    if (err != 0)
+    {
+        error_log("LSM: pthread_create failed: %s", strerror(err));
+        return -1;
+    }
+    lsm.thread_started = true;
+    lsm.ready = true;
+
+    unsigned runs = 0;
+    for (unsigned level = 0; level < LSM_LEVELS; level++)
+    {
+        runs += lsm.levels[level].n;
+    }
+    info_log("LSM: engine on %s (%u runs, %zu WALs replayed, sync=%s)", lsm_dir, runs, nwals, lsm_sync ? "on" : "off");
+    return 0;
+}
+
+/**
+ * @brief Returns true if SET, GET and DEL go to this engine.
+ */
+bool lsm_enabled(void)
+{
+    return lsm.ready;
+}
+
+/**
+ * @brief Stores a value: appended to the WAL, then recorded in the memtable.
+ * @return 0 on success, -1 on error (the write didn't happen).
+ */
+int lsm_set(const path_t *path, const char *key, const char *value)
+{
+    char k[LSM_KEY_MAX];
+    uint16_t klen = make_key(k, path, key);
+    uint16_t vlen = (uint16_t)strnlen(value, MAX_VALUE_LEN - 1);
+    if (wal_append(k, klen, value, vlen, false) != 0 || mem_put(lsm.mem, k, klen, value, vlen, false) != 0)
+    {
+        return -1;
+    }
+    if (lsm.mem->bytes >= LSM_MEMTABLE_BYTES)
+    {
+        rotate();
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a value.
+ * @return A heap-allocated copy the caller must free, or NULL if the key doesn't exist
+ * (or can't be read: the error is logged).
+ */
+char *lsm_get(const path_t *path, const char *key)
+{
+    char k[LSM_KEY_MAX];
+    uint16_t klen = make_key(k, path, key);
+    const char *value;
+    uint16_t vlen;
+
+    pthread_mutex_lock(&lsm.lock);
+    char *copy = NULL;
+    if (find_newest(k, klen, get_block, &value, &vlen) == 1 && (copy = (char *)malloc(vlen + 1)) != NULL)
+    {
+        memcpy(copy, value, vlen);
+        copy[vlen] = '\0';
+    }
+    pthread_mutex_unlock(&lsm.lock);
+    return copy;
+}
+
+/**
+ * @brief Deletes a key by writing a tombstone. Like DEL on the tree, deleting a key that
+ * doesn't exist is an error, so the key is looked up first.
+ * @return 0 on success, -1 if the key doesn't exist or on error.
+ */
+int lsm_del(const path_t *path, const char *key)
+{
+    char k[LSM_KEY_MAX];
+    uint16_t klen = make_key(k, path, key);
+    const char *value;
+    uint16_t vlen;
+
+    pthread_mutex_lock(&lsm.lock);
+    int found = find_newest(k, klen, get_block, &value, &vlen);
+    pthread_mutex_unlock(&lsm.lock);
+    if (found != 1 || wal_append(k, klen, "", 0, true) != 0 || mem_put(lsm.mem, k, klen, "", 0, true) != 0)
+    {
+        return -1;
+    }
+    if (lsm.mem->bytes >= LSM_MEMTABLE_BYTES)
+    {
+        rotate();
+    }
+    return 0;
+}
+
+/**
+ * @brief Stops the compaction thread (after it flushed the frozen memtables) and closes
+ * the engine. The active memtable is not flushed: its WAL is replayed at the next start.
+ */
+void lsm_shutdown(void)
+{
+    if (lsm.thread_started)
+    {
+        pthread_mutex_lock(&lsm.lock);
+        lsm.stopping = true;
+        pthread_cond_signal(&lsm.wake);
+        pthread_mutex_unlock(&lsm.lock);
+        pthread_join(lsm.thread, NULL);
+        lsm.thread_started = false;
+    }
+    lsm.ready = false;
+
+    if (lsm.wal_fd != -1)
+    {
+        close(lsm.wal_fd);
+        lsm.wal_fd = -1;
+    }
+    if (lsm.mem != NULL)
+    {
+        mem_free(lsm.mem);
+        lsm.mem = NULL;
+    }
+    while (lsm.imm != NULL)
+    {
+        struct memtable *older = lsm.imm->older;
+        mem_free(lsm.imm);
+        lsm.imm = older;
+    }
+    for (unsigned i = 0; i < lsm.ndead_runs; i++)
+    {
+        run_free(lsm.dead_runs[i]); // Deleted at the next start if the MANIFEST doesn't list them.
+    }
+    free(lsm.dead_runs);
+    free(lsm.dead_wals);
+    for (unsigned level = 0; level < LSM_LEVELS; level++)
+    {
+        for (unsigned i = 0; i < lsm.levels[level].n; i++)
+        {
+            run_free(lsm.levels[level].runs[i]);
+        }
+        free(lsm.levels[level].runs);
+    }
+    memset(lsm.levels, 0, sizeof(lsm.levels));
+    if (lsm.lock_fd != -1)
+    {
+        close(lsm.lock_fd);
+    }
+    if (lsm.dir_fd != -1)
+    {
+        close(lsm.dir_fd);
+    }
+    lsm.lock_fd = lsm.dir_fd = -1;
+}
+
+/**
+ * @brief Formats engine counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int lsm_stats(char *buf, size_t cap)
+{
+    if (!lsm.ready)
+    {
+        return snprintf(buf, cap, "  LSM: off\n");
+    }
+    pthread_mutex_lock(&lsm.lock);
+    char levels[256];
+    int len = 0;
+    for (unsigned level = 0; level < LSM_LEVELS && len < (int)sizeof(levels); level++)
+    {
+        if (lsm.levels[level].n > 0)
+        {
+            len += snprintf(levels + len, sizeof(levels) - len, " L%u=%u/%llu", level, lsm.levels[level].n,
+                            (unsigned long long)lsm.levels[level].bytes);
+        }
+    }
+    if (len == 0)
+    {
+        snprintf(levels, sizeof(levels), " none");
+    }
+    int n = snprintf(buf, cap,
+                     "  LSM: memtable=%zu bytes (%u keys) frozen=%u wal_written=%llu bytes runs (count/bytes):%s\n"
+                     "       flushes=%llu compactions=%llu moves=%llu written=%llu merged=%llu bytes "
+                     "gets=%llu probes=%llu bloom_skips=%llu stalls=%llu errors=%llu\n",
+                     lsm.mem->bytes, lsm.mem->index.count, lsm.nimm, (unsigned long long)lsm.wal_bytes, levels,
+                     (unsigned long long)lsm.flushes, (unsigned long long)lsm.compactions,
+                     (unsigned long long)lsm.moves, (unsigned long long)lsm.written,
+                     (unsigned long long)lsm.merged, (unsigned long long)lsm.gets, (unsigned long long)lsm.probes,
+                     (unsigned long long)lsm.bloom_skips, (unsigned long long)lsm.stalls,
+                     (unsigned long long)lsm.errors);
+    pthread_mutex_unlock(&lsm.lock);
+    return n;
+}
@@ -0,0 +1,61 @@
+/* lsm.h - Log-structured merge engine: the durable, larger-than-memory backend */
+#ifndef LSM_H
+#define LSM_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <stdbool.h> // boolean
+
+#include "path.h" // path_t
+
+// Configuration constants
+#define LSM_DEFAULT_DIR "memodb-lsm"    // Data directory when --lsm-dir is not given
+#define LSM_MEMTABLE_BYTES (4ULL << 20) // Memtable size at which it is frozen and flushed
+#define LSM_MAX_IMMUTABLE 4             // Frozen memtables awaiting a flush (beyond that the memtable keeps growing)
+#define LSM_BLOCK_BYTES 4096            // Target size of a data block
+#define LSM_BLOOM_BITS 10               // Bloom filter bits per key (about 1% false positives)
+#define LSM_BLOOM_PROBES 7              // Bits set per key
+#define LSM_LEVELS 7                    // Levels 0 .. LSM_LEVELS - 1
+#define LSM_L0_TRIGGER 4                // Level-0 runs that trigger a compaction into level 1
+#define LSM_L1_BYTES (32ULL << 20)      // Target size of level 1
+#define LSM_LEVEL_RATIO 10              // Each deeper level may hold this many times more
+#define LSM_RUN_BYTES (8ULL << 20)      // Compactions split their output into runs of about this size
+#define LSM_RETRY_MS 1000               // After a failed flush or compaction, wait this long before retrying
+
+/*
+ * With --engine lsm, SET, GET and DEL go to this engine instead of the tree, and are
+ * durable across restarts. Every other data command is refused.
+ *
+ * A write is appended to the write-ahead log (WAL) and then goes into the memtable,
+ * a hash index (see index.h) of the newest value or tombstone of each key. A full
+ * memtable is frozen and a fresh one (with a fresh WAL) takes its place. A background
+ * thread sorts each frozen memtable into an immutable sorted run on level 0 and then
+ * deletes its WAL. Each run is a file of ~4 KB data blocks with a block index and a
+ * bloom filter, which stay in memory. When level 0 holds LSM_L0_TRIGGER runs, or a
+ * deeper level outgrows its target, the thread merges runs into the next level. Levels
+ * 1 and deeper hold runs with disjoint key ranges, so a read checks at most one run per
+ * level there. The set of live runs, and the oldest WAL not yet flushed into one, are
+ * recorded in a MANIFEST file that is replaced atomically.
+ *
+ * A read checks the memtable, then the frozen memtables, the level-0 runs (newest
+ * first) and one run per deeper level, and stops at the first value or tombstone.
+ * Run blocks are read with pread on the event loop (through the page cache).
+ *
+ * At startup the MANIFEST is loaded, runs it doesn't list and WALs older than its oldest
+ * live one are deleted, and the remaining WALs are replayed and flushed. A WAL record reaches the kernel before the reply goes out,
+ * so acknowledged writes survive a crash of the server. With --lsm-sync on, each record
+ * is also fdatasync'ed, so they survive a crash of the machine too.
+ */
+
+extern const char *lsm_dir; // Data directory (--lsm-dir)
+extern bool lsm_sync;       // fdatasync every WAL record (--lsm-sync)
+
+int lsm_init(void);
+bool lsm_enabled(void);
+int lsm_set(const path_t *path, const char *key, const char *value);
+char *lsm_get(const path_t *path, const char *key);
+int lsm_del(const path_t *path, const char *key);
+void lsm_shutdown(void);
+int lsm_stats(char *buf, size_t cap);
+
+#endif /* LSM_H */
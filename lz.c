@@ -0,0 +1,187 @@
+/* lz.c - Small in-tree LZ77-family codec used for value compression */
+#include "lz.h" // Own header for the stream format and prototypes
+
+#include <string.h> // memset, memcpy
+
+/**
+ * @brief Hashes the three bytes at `p` into the match-finder table.
+ */
+static inline uint32_t lz_hash(const uint8_t *p)
+{
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2];
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+/**
+ * @brief Compresses a buffer.
+ * The encoder gives up as soon as the output would exceed `out_cap`, so callers
+ * pass the largest size they are willing to store and treat 0 as "not worth it".
+ *
+ * @param in Input bytes.
+ * @param in_len Number of input bytes.
+ * @param out Output buffer.
+ * @param out_cap Capacity of the output buffer.
+ * @return Compressed size, or 0 if the input is empty or doesn't fit in `out_cap`.
+ */
+size_t lz_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap)
+{
+    uint32_t htab[1 << LZ_HASH_LOG]; // Last position (+1) seen for each 3-byte hash, 0 = none.
+    size_t ip = 0;                   // Input position.
+    size_t op = 0;                   // Output position.
+    size_t lit = 0;                  // Literals in the current run.
+    size_t lit_ctrl;                 // Output position of the current run's control byte.
+
+    if (in_len == 0 || out_cap < 2)
+    {
+        return 0;
+    }
+    memset(htab, 0, sizeof(htab));
+
+    lit_ctrl = op++; // Reserve the control byte of the first literal run.
+
+    while (ip < in_len)
+    {
+        // Every step emits at most 4 bytes (3-byte reference + next control byte).
+        if (op + 4 > out_cap)
+        {
+            return 0;
+        }
+
+        if (ip + 2 < in_len)
+        {
+            uint32_t h = lz_hash(in + ip);
+            size_t ref = htab[h];
+            htab[h] = (uint32_t)(ip + 1);
+
+            if (ref != 0 && ip - (ref - 1) <= LZ_MAX_OFFSET &&
+                in[ref - 1] == in[ip] && in[ref] == in[ip + 1] && in[ref + 1] == in[ip + 2])
+            {
+                size_t r = ref - 1;
+                size_t off = ip - r - 1;
+                size_t max_len = in_len - ip;
+                size_t len = 3;
+
+                if (max_len > LZ_MAX_MATCH)
+                {
+                    max_len = LZ_MAX_MATCH;
+                }
+                while (len < max_len && in[r + len] == in[ip + len])
+                {
+                    len++;
+                }
+
+                // Close the pending literal run, or take back its unused control byte.
+                if (lit)
+                {
+                    out[lit_ctrl] = (uint8_t)(lit - 1);
+                }
+                else
+                {
+                    op--;
+                }
+
+                size_t l = len - 2;
+                if (l < 7)
+                {
+                    out[op++] = (uint8_t)((off >> 8) + (l << 5));
+                }
+                else
+                {
+                    out[op++] = (uint8_t)((off >> 8) + (7 << 5));
+                    out[op++] = (uint8_t)(l - 7);
+                }
+                out[op++] = (uint8_t)(off & 0xff);
+
+                ip += len;
+                lit = 0;
+                lit_ctrl = op++; // Start the next literal run.
+                continue;
+            }
+        }
+
+        // No match: copy one literal.
+        out[op++] = in[ip++];
+        if (++lit == LZ_MAX_LITERAL)
+        {
+            out[lit_ctrl] = (uint8_t)(lit - 1);
+            lit = 0;
+            lit_ctrl = op++;
+        }
+    }
+
+    if (lit)
+    {
+        out[lit_ctrl] = (uint8_t)(lit - 1);
+    }
+    else
+    {
+        op--; // Trailing control byte was never used.
+    }
+
+    return op;
+}
+
+/**
+ * @brief Decompresses a buffer produced by lz_compress().
+ *
+ * @param in Compressed bytes.
+ * @param in_len Number of compressed bytes.
+ * @param out Output buffer.
+ * @param out_cap Capacity of the output buffer.
+ * @return Decompressed size, or 0 if the input is corrupt or doesn't fit in `out_cap`.
+ */
+size_t lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap)
+{
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < in_len)
+    {
+        size_t ctrl = in[ip++];
+
+        if (ctrl < LZ_MAX_LITERAL)
+        {
+            size_t len = ctrl + 1;
+            if (ip + len > in_len || op + len > out_cap)
+            {
+                return 0;
+            }
+            memcpy(out + op, in + ip, len);
+            ip += len;
+            op += len;
+        }
+        else
+        {
+            size_t len = ctrl >> 5;
+            if (len == 7)
+            {
+                if (ip >= in_len)
+                {
+                    return 0;
+                }
+                len += in[ip++];
+            }
+            len += 2;
+
+            if (ip >= in_len)
+            {
+                return 0;
+            }
+            size_t off = ((ctrl & 0x1f) << 8) + in[ip++] + 1;
+            if (off > op || op + len > out_cap)
+            {
+                return 0;
+            }
+
+            // Byte-wise copy: the reference may overlap the bytes being produced.
+            const uint8_t *ref = out + op - off;
+            for (size_t i = 0; i < len; i++)
+            {
+                out[op + i] = ref[i];
+            }
+            op += len;
+        }
+    }
+
+    return op;
+}
@@ -0,0 +1,23 @@
+/* lz.h - Small in-tree LZ77-family codec used for value compression */
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t
+
+/*
+ * Stream format (LZF-style, byte oriented):
+ *   000LLLLL                      literal run of L+1 bytes follows (1..32)
+ *   LLLooooo oooooooo             back-reference of L+2 bytes (L = 1..6), offset o+1 (1..8192)
+ *   111ooooo LLLLLLLL oooooooo    back-reference of L+9 bytes (9..264), offset o+1
+ */
+
+#define LZ_HASH_LOG 12            // log2 of the match-finder hash table size
+#define LZ_MAX_LITERAL 32         // Longest literal run per control byte
+#define LZ_MAX_OFFSET (1 << 13)   // Farthest back-reference distance
+#define LZ_MAX_MATCH (264)        // Longest back-reference length
+
+size_t lz_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+size_t lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+
+#endif /* LZ_H */
@@ -1,94 +1,72 @@
 /* main.c - Event-driven MemoDB server implementation using epoll for Linux computers/servers */
 #include "main.h" // Includes standard headers and server-specific definitions
 #include "tree.h"   // Includes the tree data structure definitions (Node, Leaf, Tree, etc.)
+#include "hotcache.h" // Per-thread read replicas of hot keys
+#include "value.h"    // Value storage path (compression)
+#include "arena.h"    // Huge-page backed arena allocator
+#include "numa.h"     // NUMA thread pinning and memory placement
+#include "mvcc.h"     // Commit sequence numbers and snapshot reads
+#include "index.h"    // Salted hash indexes (stats)
+#include "packed.h"   // Packed encoding of small files
+#include "region.h"   // Per-file regions (stats)
+#include "defrag.h"   // Idle-time defragmentation of file regions
+#include "tasks.h"    // Time-sliced background tasks
+#include "admin.h"    // DUMP and MEMORY on worker threads
+#include "loader.h"   // Read-through loading of missing keys
+#include "vlog.h"     // Value log for cold values
+#include "lsm.h"      // Log-structured merge engine (--engine lsm)
+#include "table.h"    // Immutable tables served from a memory map (ATTACH)
+#include "util.h"     // now_ns
 
 // Global server context (declared here and defined in main.c)
 struct server_context *g_server = NULL;
 
+// Seconds a client may stay silent before it is disconnected (0 = never, see --idle-timeout)
+static uint32_t idle_timeout;
+
 // Declare the global root tree from tree.c (it is defined there)
 extern Tree root;
 
 /**
  * @brief Helper function to ensure a node path exists, creating intermediate nodes if necessary.
- * This function traverses the tree based on the provided path. If any segment of the path
+ * This function walks the parsed path segment by segment. If any segment of the path
  * does not exist, it creates a new Node for that segment and links it into the tree.
- * The current tree implementation uses 'west' for sibling nodes and 'east' for the first leaf.
- * This function will create new 'west' children for the current_node if a path segment is not found.
+ * Each node keeps its sub-paths in a first-child/next-sibling list (indexed by segment hash)
+ * and its leaves at 'east'.
  *
- * @param path The full path string (e.g., "users/data").
+ * @param path The parsed path (e.g., "users/data").
  * @return A pointer to the Node at the end of the specified path, or NULL on error.
  */
-static Node *ensure_node_path(const char *path)
+static Node *ensure_node_path(const path_t *path)
 {
     // Start from the global root node. The root is a union, so access its node member.
     Node *current_node = &(root.node);
-    // Make a mutable copy of the path string as strtok_r modifies it.
-    char *path_copy = strdup(path);
-    if (path_copy == NULL)
-    {
-        error_log("ensure_node_path: Failed to allocate memory for path copy.");
-        return NULL;
-    }
 
-    char *token;
-    char *saveptr; // Used by strtok_r to maintain state for re-entrant tokenizing.
-
-    // Handle leading slash: if the path starts with '/', skip it.
-    char *path_start = path_copy;
-    if (path_start[0] == '/')
+    for (uint16_t i = 0; i < path->nseg; i++)
     {
-        path_start++;
-    }
+        const char *segment = path->buf + path->seg_off[i];
 
-    // If the path is empty or just "/", return the root node.
-    if (strlen(path_start) == 0)
-    {
-        free(path_copy); // Free the duplicated path string.
-        return current_node;
-    }
-
-    // Tokenize the path by '/' to process each segment.
-    token = strtok_r(path_start, "/", &saveptr);
-
-    // Loop through each token (path segment)
-    while (token != NULL)
-    {
-        bool found = false;
-        Node *child_candidate = current_node->west; // Start search from the current node's first child.
-
-        // Iterate through siblings (nodes linked via 'west' pointer) to find the next path segment.
-        // The tree structure here implies `west` links are for a list of child nodes from a single parent.
-        while (child_candidate != NULL)
-        {
-            // Compare the current path segment (token) with the child's path.
-            if (strcmp((char *)child_candidate->path, token) == 0)
-            {
-                current_node = child_candidate; // Found the next segment, move to this node.
-                found = true;
-                break;
-            }
-            child_candidate = child_candidate->west; // Move to the next sibling in the list.
-        }
+        // Search the current node's children for the next path segment (hash computed at parse time).
+        Node *child = find_child_hashed(current_node, segment, path->seg_len[i], path->seg_hash[i]);
 
-        if (!found)
+        if (child == NULL)
         {
             // If the path segment was not found, create a new Node for it.
-            // create_node links the new node as the 'west' child of the 'parent' (current_node).
-            Node *new_node = create_node(current_node, (int8_t *)token);
-            if (new_node == NULL)
+            // create_node links the new node as the first child of the 'parent' (current_node).
+            char name[PATH_MAX_LEN];
+            memcpy(name, segment, path->seg_len[i]);
+            name[path->seg_len[i]] = '\0';
+
+            child = create_node(current_node, (int8_t *)name);
+            if (child == NULL)
             {
-                error_log("ensure_node_path: Failed to create new node for path segment '%s'.", token);
-                free(path_copy); // Clean up allocated memory.
+                error_log("ensure_node_path: Failed to create new node for path segment '%s'.", name);
                 return NULL;
             }
-            current_node = new_node; // Move to the newly created node for the next iteration.
         }
-
-        // Move to the next path segment token.
-        token = strtok_r(NULL, "/", &saveptr);
+        current_node = child; // Move to this node for the next segment.
     }
 
-    free(path_copy);     // Free the duplicated path string.
     return current_node; // Return the node at the end of the processed path.
 }
 
@@ -98,62 +76,83 @@ static Node *ensure_node_path(const char *path)
  * If the path or key doesn't exist, it creates them. If the key exists,
  * its value is updated.
  *
- * @param filename The path (database name) where the key-value pair should be stored.
+ * @param path The parsed path (database name) where the key-value pair should be stored.
  * @param key The key to store.
  * @param value The value associated with the key.
  * @return 0 on success, -1 on error.
  */
-int db_set(const char *filename, const char *key, const char *value)
+int db_set(const path_t *path, const char *key, const char *value)
 {
-    debug_log("DB_SET: file='%s', key='%s', value='%s'", filename, key, value);
+    debug_log("DB_SET: file='%s', key='%s', value='%s'", path->buf, key, value);
+    if (lsm_enabled())
+    {
+        return lsm_set(path, key, value);
+    }
 
     // 1. Ensure the node path (file) exists in the tree. Create it if it doesn't.
-    Node *target_node = ensure_node_path(filename);
+    Node *target_node = ensure_node_path(path);
     if (target_node == NULL)
     {
-        error_log("db_set: Failed to ensure node path '%s' exists.", filename);
+        error_log("db_set: Failed to ensure node path '%s' exists.", path->buf);
         return -1;
     }
 
-    // 2. Try to find if the key already exists as a Leaf under the target_node.
-    // The find_leaf_linear function expects an int8_t* path and key.
-    Leaf *existing_leaf = find_leaf_linear((int8_t *)filename, (int8_t *)key);
+    uint64_t seq = mvcc_begin_write(); // Commit sequence number of this write.
+
+    // 2. Small files keep their keys packed in one buffer; packed_set converts the file
+    // to leaves when it outgrows that (or a snapshot needs the old value).
+    int packed = packed_set(target_node, key, (const uint8_t *)value, (uint16_t)strlen(value), seq);
+    if (packed == 0)
+    {
+        hot_cache_invalidate(hot_key_hash(path_hash(path), key)); // After the write (see hot_version).
+        return 0;
+    }
+    if (packed < 0)
+    {
+        error_log("db_set: Failed to store key '%s' in '%s'.", key, path->buf);
+        return -1;
+    }
+
+    // 3. Try to find if the key already exists as a Leaf under the target_node.
+    Leaf *existing_leaf = find_leaf_at(target_node, key, MVCC_LATEST);
 
     if (existing_leaf)
     {
         // Key exists: Update the value.
-        debug_log("db_set: Key '%s' found in '%s'. Updating value.", key, filename);
-        // Free the old value before allocating new memory for the updated value.
-        if (existing_leaf->value != NULL)
+        debug_log("db_set: Key '%s' found in '%s'. Updating value.", key, path->buf);
+        // Open snapshots may still need the old value: keep it on the leaf's version chain.
+        if (mvcc_preserve(existing_leaf) != 0)
         {
-            free(existing_leaf->value);
-            existing_leaf->value = NULL; // Set to NULL defensively.
+            error_log("db_set: Failed to preserve old version of key '%s'.", key);
+            return -1;
         }
-        // Allocate new memory for the updated value, including space for null terminator.
-        existing_leaf->value = (int8_t *)malloc(strlen(value) + 1);
-        if (existing_leaf->value == NULL)
+        // value_store replaces (and frees) the old value, compressing the new one if worthwhile.
+        if (value_store(existing_leaf, (const uint8_t *)value, strlen(value)) != 0)
         {
             error_log("db_set: Failed to allocate memory for new value for key '%s'.", key);
             return -1;
         }
-        // Copy the new value and update its size.
-        strcpy((char *)existing_leaf->value, value);
-        existing_leaf->size = strlen(value);
+        existing_leaf->seq = seq;
+        compact_leaves(target_node); // The old value went onto the region's free list.
     }
     else
     {
         // Key does not exist: Create a new Leaf.
-        debug_log("db_set: Key '%s' not found in '%s'. Creating new leaf.", key, filename);
+        debug_log("db_set: Key '%s' not found in '%s'. Creating new leaf.", key, path->buf);
         // Call create_leaf. The 'west' argument expects a Tree* which should be the target Node.
         // The Leaf will be linked to the Node's 'east' pointer (if first) or to the last existing leaf's 'east'.
         Leaf *new_leaf = create_leaf((Tree *)target_node, (uint8_t *)key, (uint8_t *)value, strlen(value));
         if (new_leaf == NULL)
         {
-            error_log("db_set: Failed to create new leaf for key '%s' in '%s'.", key, filename);
+            error_log("db_set: Failed to create new leaf for key '%s' in '%s'.", key, path->buf);
             return -1;
         }
+        new_leaf->seq = seq;
     }
 
+    // Invalidate any replica of this key held by any thread, now that the new value is in
+    // place: a reader that took the old stamp then rejects what it replicated (see hot_version).
+    hot_cache_invalidate(hot_key_hash(path_hash(path), key));
     return 0; // Success
 }
 
@@ -161,29 +160,57 @@ int db_set(const char *filename, const char *key, const char *value)
  * @brief Implements the GET command for the in-memory database.
  * Retrieves the value associated with a key from a specified 'file' (node path).
  *
- * @param filename The path (database name) to search within.
+ * @param path The parsed path (database name) to search within.
  * @param key The key to retrieve.
  * @return A dynamically allocated string containing the value, or NULL if not found.
  * The caller is responsible for freeing the returned string.
  */
-char *db_get(const char *filename, const char *key)
+char *db_get(const path_t *path, const char *key)
 {
-    debug_log("DB_GET: file='%s', key='%s'", filename, key);
+    debug_log("DB_GET: file='%s', key='%s'", path->buf, key);
+    if (lsm_enabled())
+    {
+        return lsm_get(path, key);
+    }
 
-    // Use the lookup_linear function from tree.c which finds the leaf and returns its value.
-    // lookup_linear returns an `int8_t *`.
-    int8_t *value_ptr = lookup_linear((int8_t *)filename, (int8_t *)key);
+    // Hot keys are served from this thread's replica cache without touching the shared tree.
+    uint64_t hash = hot_key_hash(path_hash(path), key);
+    uint16_t cached_size;
+    const char *cached = hot_cache_lookup(hash, path->buf, key, &cached_size);
+    if (cached)
+    {
+        char *ret_value = strdup(cached);
+        if (ret_value == NULL)
+        {
+            error_log("db_get: Failed to allocate memory for return value for key '%s'.", key);
+        }
+        return ret_value;
+    }
+
+    // Take the version stamp before reading, so a concurrent write invalidates what we replicate.
+    bool hot = hot_cache_record(hash);
+    uint32_t version = hot_version(hash);
 
-    if (value_ptr)
+    // Find the leaf (and with it the value and its size) in the tree.
+    Leaf view;
+    Leaf *leaf = find_leaf_path(path, key, &view);
+
+    if (leaf && leaf->value)
     {
-        // Value found, return a dynamically allocated copy using strdup.
+        // Value found, return an uncompressed, dynamically allocated copy.
         // This ensures the caller gets a copy and is responsible for its memory.
-        char *ret_value = strdup((char *)value_ptr);
+        char *ret_value = value_dup(leaf);
         if (ret_value == NULL)
         {
             error_log("db_get: Failed to allocate memory for return value for key '%s'.", key);
             return NULL;
         }
+
+        if (hot)
+        {
+            // Key crossed the heat threshold: replicate it into this thread's cache.
+            hot_cache_fill(hash, version, path->buf, key, ret_value, (uint16_t)leaf->size);
+        }
         return ret_value;
     }
     else
@@ -193,60 +220,841 @@ char *db_get(const char *filename, const char *key)
     }
 }
 
+/**
+ * @brief Retrieves a value exactly as stored, for clients that accept compressed replies.
+ *
+ * @param path The parsed path (database name) to search within.
+ * @param key The key to retrieve.
+ * @param size Receives the uncompressed value size.
+ * @param stored_size Receives the number of bytes returned.
+ * @param compressed Receives true if the returned bytes are an LZ stream.
+ * @return A dynamically allocated (and null-terminated) copy of the stored bytes, or NULL
+ * if not found. The caller is responsible for freeing the returned buffer.
+ */
+char *db_get_stored(const path_t *path, const char *key, uint16_t *size, uint16_t *stored_size,
+                    bool *compressed)
+{
+    debug_log("DB_GET_STORED: file='%s', key='%s'", path->buf, key);
+    if (lsm_enabled())
+    {
+        // The engine stores values as they are.
+        char *value = lsm_get(path, key);
+        if (value != NULL)
+        {
+            *size = *stored_size = (uint16_t)strlen(value);
+            *compressed = false;
+        }
+        return value;
+    }
+
+    Leaf view;
+    Leaf *leaf = find_leaf_path(path, key, &view);
+    if (leaf == NULL || leaf->value == NULL)
+    {
+        return NULL;
+    }
+
+    char *copy = (char *)malloc((uint16_t)leaf->stored_size + 1);
+    if (copy == NULL)
+    {
+        error_log("db_get_stored: Failed to allocate memory for return value for key '%s'.", key);
+        return NULL;
+    }
+    if (value_read(leaf, (int8_t *)copy) != 0)
+    {
+        error_log("db_get_stored: Failed to read value of key '%s': %s", key, strerror(errno));
+        free(copy);
+        return NULL;
+    }
+    copy[(uint16_t)leaf->stored_size] = '\0';
+
+    *size = (uint16_t)leaf->size;
+    *stored_size = (uint16_t)leaf->stored_size;
+    *compressed = (leaf->flags & LeafCompressed) != 0;
+    return copy;
+}
+
 /**
  * @brief Implements the DEL command for the in-memory database.
  * Deletes a key-value pair from a specified 'file' (node path).
  *
- * @param filename The path (database name) from which to delete.
+ * @param path The parsed path (database name) from which to delete.
  * @param key The key to delete.
  * @return 0 on success, -1 on error (e.g., key not found or file not found).
  */
-int db_del(const char *filename, const char *key)
+int db_del(const path_t *path, const char *key)
 {
-    debug_log("DB_DEL: file='%s', key='%s'", filename, key);
+    debug_log("DB_DEL: file='%s', key='%s'", path->buf, key);
+    if (lsm_enabled())
+    {
+        return lsm_del(path, key);
+    }
 
     // 1. Find the target node (file/path) where the key should be.
-    Node *target_node = find_node_linear((int8_t *)filename);
+    Node *target_node = find_node_path(path);
     if (target_node == NULL)
     {
         // Node (file/path) does not exist, so the key cannot be there.
-        debug_log("db_del: File/node '%s' not found.", filename);
+        debug_log("db_del: File/node '%s' not found.", path->buf);
+        return -1;
+    }
+
+    // 2. Packed files delete in place (unless a snapshot still sees the key: the file is
+    // then converted to leaves and the key tombstoned below).
+    int packed = packed_del(target_node, key);
+    if (packed <= 0)
+    {
+        if (packed == 0)
+        {
+            hot_cache_invalidate(hot_key_hash(path_hash(path), key)); // Drop replicas of the deleted key.
+        }
+        debug_log("db_del: Key '%s' %s in packed file '%s'.", key, packed == 0 ? "deleted" : "not found",
+                  path->buf);
+        return packed;
+    }
+
+    // 3. Look the key up in the node's key index (tombstones are invisible to latest reads).
+    Leaf *leaf = find_leaf_at(target_node, key, MVCC_LATEST);
+    if (leaf != NULL)
+    {
+        // Open snapshots still see this key: leave a tombstone for mvcc_collect() to free.
+        if (mvcc_must_tombstone(leaf))
+        {
+            if (mvcc_tombstone(leaf, mvcc_begin_write()) != 0)
+            {
+                error_log("db_del: Failed to keep key '%s' for open snapshots.", key);
+                return -1;
+            }
+            hot_cache_invalidate(hot_key_hash(path_hash(path), key)); // Drop replicas of the deleted key.
+            debug_log("db_del: Tombstoned key '%s' in file '%s'.", key, path->buf);
+            return 0;
+        }
+
+        // Leaf found! Remove it from the node's list and index (O(1)), then free it.
+        unlink_leaf(target_node, leaf);
+        free_leaf(leaf);
+        hot_cache_invalidate(hot_key_hash(path_hash(path), key)); // Drop replicas of the deleted key.
+        compact_leaves(target_node); // Returns the file's free space once it piles up.
+        debug_log("db_del: Successfully deleted key '%s' from file '%s'.", key, path->buf);
+        return 0; // Success: Key was found and deleted.
+    }
+
+    // The key was not found in the specified file/node.
+    debug_log("db_del: Key '%s' not found in file '%s'.", key, path->buf);
+    return -1; // Error: Key not found.
+}
+
+/**
+ * @brief Checks a RENAME or CLONE of `from` to `to` and prepares the target: finds the
+ * source, creates the target's parent if missing and extracts the target's last segment.
+ *
+ * @param from The parsed source path (not the root).
+ * @param to The parsed target path (must not exist, nor lie inside `from`).
+ * @param parent Receives the target's parent node.
+ * @param name Receives the target's last segment.
+ * @return The source node, or NULL with errno ENOENT (no such file), EINVAL (root, or a
+ * target inside the source), EEXIST (target exists) or ENOMEM.
+ */
+static Node *subtree_target(const path_t *from, const path_t *to, Node **parent, char name[PATH_MAX_LEN])
+{
+    Node *node = find_node_path(from);
+    if (node == NULL)
+    {
+        return NULL; // errno is ENOENT.
+    }
+    if (from->nseg == 0 || to->nseg == 0 ||
+        (strncmp(to->buf, from->buf, from->len) == 0 && (to->buf[from->len] == '/' || to->buf[from->len] == '\0')))
+    {
+        errno = EINVAL; // The root can't move, and nothing can move or be copied into itself.
+        return NULL;
+    }
+    if (find_node_path(to) != NULL)
+    {
+        errno = EEXIST;
+        return NULL;
+    }
+
+    // The parent is the target path minus its last segment: the same buffer and hashes,
+    // one segment shorter.
+    path_t parent_path = *to;
+    parent_path.nseg--;
+    *parent = ensure_node_path(&parent_path);
+    if (*parent == NULL)
+    {
+        error_log("Failed to create the parent of '%s'.", to->buf);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    uint16_t last = to->nseg - 1;
+    memcpy(name, to->buf + to->seg_off[last], to->seg_len[last]);
+    name[to->seg_len[last]] = '\0';
+    return node;
+}
+
+/**
+ * @brief Implements the RENAME command: moves a 'file', with all of its sub-paths and
+ * keys, to a new path. The subtree is relinked under its new parent (created if missing)
+ * in O(depth + siblings): no key or value is copied.
+ *
+ * @param from The parsed path to move (not the root).
+ * @param to The parsed new path (must not exist, nor lie inside `from`).
+ * @return 0 on success, -1 with errno ENOENT (no such file), EEXIST (target exists),
+ * EINVAL (root, or a move into itself) or ENOMEM.
+ */
+int db_rename(const path_t *from, const path_t *to)
+{
+    debug_log("DB_RENAME: from='%s', to='%s'", from->buf, to->buf);
+
+    Node *parent;
+    char name[PATH_MAX_LEN];
+    Node *node = subtree_target(from, to, &parent, name);
+    if (node == NULL)
+    {
+        return -1;
+    }
+    if (move_node(node, parent, name) != 0)
+    {
+        error_log("db_rename: Failed to move '%s' to '%s': %s", from->buf, to->buf, strerror(errno));
+        return -1;
+    }
+    hot_cache_invalidate_all(); // Replicas are keyed by path: every key under `from` moved.
+    return 0;
+}
+
+/**
+ * @brief Implements the CLONE command: copies a 'file', with all of its sub-paths and
+ * keys, to a new path. Only metadata is copied (nodes, leaves, indexes); values are
+ * shared by reference count and copied on the next write to either side, so a clone
+ * costs O(paths + keys) regardless of value sizes.
+ *
+ * @param from The parsed path to copy (not the root).
+ * @param to The parsed new path (must not exist, nor lie inside `from`).
+ * @param nodes Receives the number of paths copied.
+ * @param keys Receives the number of keys copied.
+ * @return 0 on success, -1 with errno ENOENT, EEXIST, EINVAL or ENOMEM (as db_rename).
+ */
+int db_clone(const path_t *from, const path_t *to, uint64_t *nodes, uint64_t *keys)
+{
+    debug_log("DB_CLONE: from='%s', to='%s'", from->buf, to->buf);
+
+    Node *parent;
+    char name[PATH_MAX_LEN];
+    Node *node = subtree_target(from, to, &parent, name);
+    if (node == NULL)
+    {
+        return -1;
+    }
+    if (clone_subtree(node, parent, name, mvcc_begin_write(), nodes, keys) == NULL)
+    {
+        error_log("db_clone: Failed to clone '%s' to '%s': %s", from->buf, to->buf, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Implements the MOVEKEY command: moves one key from a 'file' to another (created
+ * if missing), replacing any value the key had there. The Leaf is relinked and its value
+ * handed over without copying shared or compressed buffers (see move_leaf). When an open
+ * snapshot still sees the key, or the destination is packed, the key is copied and
+ * deleted instead, so snapshots keep their view.
+ *
+ * @param from The parsed source path.
+ * @param to The parsed destination path.
+ * @param key The key to move.
+ * @return 0 on success, -1 if the source file or key doesn't exist or on error.
+ */
+int db_movekey(const path_t *from, const path_t *to, const char *key)
+{
+    debug_log("DB_MOVEKEY: from='%s', to='%s', key='%s'", from->buf, to->buf, key);
+
+    Node *src = find_node_path(from);
+    Leaf view;
+    Leaf *leaf = src ? node_read(src, key, MVCC_LATEST, &view) : NULL;
+    if (leaf == NULL || leaf->value == NULL)
+    {
+        return -1;
+    }
+
+    Node *dst = ensure_node_path(to);
+    if (dst == NULL)
+    {
+        return -1;
+    }
+    if (dst == src)
+    {
+        return 0; // Already there.
+    }
+
+    bool relink = (leaf != &view) && !mvcc_must_tombstone(leaf) && !(leaf->flags & LeafInGc) && dst->packed == NULL;
+    if (!relink)
+    {
+        char *value = value_dup(leaf);
+        int rc = (value != NULL && db_set(to, key, value) == 0) ? db_del(from, key) : -1;
+        free(value);
+        return rc;
+    }
+
+    // The destination's current value (if any) goes the way of a DEL.
+    if (find_leaf_at(dst, key, MVCC_LATEST) != NULL && db_del(to, key) != 0)
+    {
+        return -1;
+    }
+
+    uint64_t seq = mvcc_begin_write();
+    Leaf *moved = move_leaf(src, leaf, dst);
+    if (moved == NULL)
+    {
+        error_log("db_movekey: Failed to move key '%s' from '%s' to '%s'.", key, from->buf, to->buf);
+        return -1;
+    }
+    moved->seq = seq;
+    hot_cache_invalidate(hot_key_hash(path_hash(from), key)); // After the move (see hot_version).
+    hot_cache_invalidate(hot_key_hash(path_hash(to), key));
+    compact_leaves(src); // The leaf went onto the source region's free list.
+    return 0;
+}
+
+/**
+ * @brief Implements the ATTACH command: serves a prebuilt table file as `path` (see
+ * table.h). A file holding keys in the tree can't be shadowed by a table.
+ *
+ * @param path The parsed path to attach the table as.
+ * @param file The table file.
+ * @param keys Receives the number of keys in the table.
+ * @return 0 on success, -1 with errno set (EEXIST if the file holds keys or already has a
+ * table, EBADMSG if `file` isn't a valid table, see table_attach).
+ */
+int db_attach(const path_t *path, const char *file, uint64_t *keys)
+{
+    debug_log("DB_ATTACH: path='%s', table='%s'", path->buf, file);
+
+    Node *node = find_node_path(path);
+    if (node != NULL && node->nleaves > 0)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    return table_attach(path, file, keys);
+}
+
+/**
+ * @brief Implements the MGET command: reads several keys of one 'file' from a single
+ * snapshot, so the reply never mixes values from before and after a concurrent write.
+ *
+ * @param path The parsed path (database name) to search within.
+ * @param keys Space-separated keys (modified in place by tokenizing).
+ * @param out Reply receiving one "key: value" or "key: (nil)" line per key.
+ * @return Number of keys found, or -1 if the file doesn't exist.
+ */
+int db_mget(const path_t *path, char *keys, struct reply *out)
+{
+    debug_log("DB_MGET: file='%s', keys='%s'", path->buf, keys);
+
+    Node *node = find_node_path(path);
+    if (node == NULL)
+    {
         return -1;
     }
 
-    // 2. Traverse the list of leaves attached to the target_node to find the key.
-    Leaf *current_leaf = target_node->east; // Start from the first leaf attached to this node.
-    Leaf *prev_leaf = NULL;                 // Keep track of the previous leaf for relinking.
+    uint64_t snapshot = mvcc_snapshot_open();
+    int found = 0;
+    char *saveptr;
+    const char *batch[LOOKUP_BATCH_GROUP]; // Keys looked up together (overlapping their cache misses)
+    Leaf *leaves[LOOKUP_BATCH_GROUP];
+    Leaf views[LOOKUP_BATCH_GROUP]; // Results from packed files
+    char *key = strtok_r(keys, " ", &saveptr);
 
-    while (current_leaf != NULL)
+    while (key != NULL)
     {
-        // Check if the current leaf's key matches the key to be deleted.
-        if (strcmp((char *)current_leaf->key, key) == 0)
+        size_t n = 0;
+        for (; key != NULL && n < LOOKUP_BATCH_GROUP; key = strtok_r(NULL, " ", &saveptr))
         {
-            // Leaf found! Now, remove it from the linked list.
-            if (prev_leaf == NULL)
+            batch[n++] = key;
+        }
+        find_leaves_batch(node, batch, n, snapshot, leaves, views);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            char *value = (leaves[i] && leaves[i]->value) ? value_dup(leaves[i]) : NULL;
+            if (value)
             {
-                // This is the first leaf in the list (attached directly to the node's east pointer).
-                target_node->east = current_leaf->east; // Node now points to the next leaf.
+                reply_printf(out, "%s: %s\n", batch[i], value);
+                free(value);
+                found++;
             }
             else
             {
-                // This leaf is in the middle or at the end of the list.
-                prev_leaf->east = current_leaf->east; // Previous leaf now points to the current leaf's next.
+                reply_printf(out, "%s: (nil)\n", batch[i]);
             }
-            // Free the found leaf and its dynamically allocated value.
-            free_leaf(current_leaf);
-            debug_log("db_del: Successfully deleted key '%s' from file '%s'.", key, filename);
-            return 0; // Success: Key was found and deleted.
         }
-        // Move to the next leaf in the list.
-        prev_leaf = current_leaf;
-        current_leaf = current_leaf->east;
     }
 
-    // If the loop finishes, it means the key was not found in the specified file/node.
-    debug_log("db_del: Key '%s' not found in file '%s'.", key, filename);
-    return -1; // Error: Key not found.
+    mvcc_snapshot_close(snapshot);
+    return found;
+}
+
+/**
+ * @brief One requested key of an MGETX batch.
+ */
+struct mgetx_item
+{
+    const char *file; // File as given by the client
+    const char *key;  // Key within it
+    uint32_t pos;     // Position in the request (replies keep this order)
+};
+
+/**
+ * @brief Orders MGETX items by file, then by position, so each file's keys form one run.
+ */
+static int mgetx_cmp(const void *a, const void *b)
+{
+    const struct mgetx_item *x = (const struct mgetx_item *)a;
+    const struct mgetx_item *y = (const struct mgetx_item *)b;
+    int c = strcmp(x->file, y->file);
+    return c ? c : (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/**
+ * @brief Implements the MGETX command: reads keys spread over many 'files' from a single
+ * snapshot. The batch is split by file, each file is resolved once and its keys are
+ * looked up together (see find_leaves_batch); the results are then gathered back into
+ * the order of the request.
+ *
+ * @param pairs Space-separated "<file> <key>" pairs (modified in place by tokenizing).
+ * @param out Reply receiving one "file key: value" or "file key: (nil)" line per pair.
+ * @return Number of keys found, or -1 if the pairs are incomplete, too many or memory ran out.
+ */
+int db_mgetx(char *pairs, struct reply *out)
+{
+    debug_log("DB_MGETX: pairs='%s'", pairs);
+
+    struct mgetx_item *items = (struct mgetx_item *)malloc(MGETX_MAX_PAIRS * sizeof(*items));
+    char **values = (char **)calloc(MGETX_MAX_PAIRS, sizeof(*values));
+    path_t *path = (path_t *)malloc(sizeof(*path));
+    uint32_t n = 0;
+    int found = -1;
+
+    if (items == NULL || values == NULL || path == NULL)
+    {
+        goto out;
+    }
+
+    // Split the request into (file, key) items.
+    char *saveptr;
+    for (char *file = strtok_r(pairs, " ", &saveptr); file != NULL; file = strtok_r(NULL, " ", &saveptr))
+    {
+        char *key = strtok_r(NULL, " ", &saveptr);
+        if (key == NULL || n == MGETX_MAX_PAIRS)
+        {
+            goto out; // A file without a key, or too many pairs.
+        }
+        items[n] = (struct mgetx_item){file, key, n};
+        n++;
+    }
+
+    // Group by file and look each group up in one pass over its node.
+    qsort(items, n, sizeof(*items), mgetx_cmp);
+    uint64_t snapshot = mvcc_snapshot_open();
+    found = 0;
+    for (uint32_t start = 0, end; start < n; start = end)
+    {
+        for (end = start + 1; end < n && strcmp(items[end].file, items[start].file) == 0; end++)
+        {
+        }
+        if (path_parse(path, items[start].file) != 0)
+        {
+            continue; // An invalid file holds no keys.
+        }
+        struct table *table = table_find(path);
+        if (table != NULL)
+        {
+            // An attached table answers its keys from the mapping, as it does for GET.
+            for (uint32_t i = start; i < end; i++)
+            {
+                const char *value;
+                uint16_t len;
+                if (table_get(table, items[i].key, &value, &len))
+                {
+                    values[items[i].pos] = strndup(value, len);
+                }
+            }
+            continue;
+        }
+        Node *node = find_node_path(path);
+        if (node == NULL)
+        {
+            continue; // Every key of a missing file reads as (nil).
+        }
+
+        for (uint32_t base = start; base < end; base += LOOKUP_BATCH_GROUP)
+        {
+            const char *batch[LOOKUP_BATCH_GROUP];
+            Leaf *leaves[LOOKUP_BATCH_GROUP];
+            Leaf views[LOOKUP_BATCH_GROUP]; // Results from packed files
+            size_t group = (end - base < LOOKUP_BATCH_GROUP) ? end - base : LOOKUP_BATCH_GROUP;
+
+            for (size_t i = 0; i < group; i++)
+            {
+                batch[i] = items[base + i].key;
+            }
+            find_leaves_batch(node, batch, group, snapshot, leaves, views);
+            for (size_t i = 0; i < group; i++)
+            {
+                if (leaves[i] && leaves[i]->value)
+                {
+                    values[items[base + i].pos] = value_dup(leaves[i]);
+                }
+            }
+        }
+    }
+    mvcc_snapshot_close(snapshot);
+
+    // Gather: put the items back in request order (positions are a permutation), one line each.
+    for (uint32_t i = 0; i < n; i++)
+    {
+        while (items[i].pos != i)
+        {
+            uint32_t to = items[i].pos;
+            struct mgetx_item tmp = items[to];
+            items[to] = items[i];
+            items[i] = tmp;
+        }
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (values[i])
+        {
+            reply_printf(out, "%s %s: %s\n", items[i].file, items[i].key, values[i]);
+            found++;
+        }
+        else
+        {
+            reply_printf(out, "%s %s: (nil)\n", items[i].file, items[i].key);
+        }
+    }
+
+out:
+    if (values != NULL)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            free(values[i]);
+        }
+    }
+    free(values);
+    free(items);
+    free(path);
+    return found;
+}
+
+/**
+ * @brief Sends a counted listing: "OK: <n>" followed by the body, or the not-found error
+ * when n < 0 (replies of MGET and KEYS).
+ */
+static void send_listing(struct client *client, int n, const struct reply *body, const char *file)
+{
+    struct reply response;
+    reply_init(&response);
+
+    if (n < 0)
+    {
+        reply_printf(&response, "ERR: File '%s' not found.\n> ", file);
+    }
+    else
+    {
+        reply_printf(&response, "OK: %d\n", n);
+        reply_append(&response, body->data, body->len);
+        reply_printf(&response, "> ");
+    }
+
+    if (response.failed || body->failed)
+    {
+        send_to_client(client, "ERR: Out of memory composing reply.\n> ");
+    }
+    else
+    {
+        send_bytes_to_client(client, response.data, response.len);
+    }
+    reply_free(&response);
+}
+
+/**
+ * @brief A KEYS listing in progress. The snapshot keeps every leaf it can see linked and
+ * in place (deleted ones stay as tombstones, and regions aren't compacted while a snapshot
+ * is open), so the last listed leaf is a safe place to resume from.
+ */
+struct keys_cmd
+{
+    struct coro co;          // Coroutine header (must be first)
+    char file[PATH_MAX_LEN]; // File name for the reply
+    Node *node;              // The file being listed
+    Leaf *cursor;            // Last leaf listed (NULL before the first)
+    uint64_t snapshot;       // Snapshot all keys are read from
+    uint64_t generation;     // tree_generation at the start (a DROP or RENAME invalidates `node`)
+    int count;               // Keys listed so far
+    struct reply body;       // One key per line
+};
+
+/**
+ * @brief Lists up to CORO_STEP_WORK keys from where the previous step stopped; the reply
+ * is sent once the whole file has been listed.
+ */
+static int keys_step(struct coro *co)
+{
+    struct keys_cmd *k = (struct keys_cmd *)co;
+    uint32_t work = 0;
+
+    if (k->generation != tree_generation)
+    {
+        char response[BUFFER_SIZE];
+        snprintf(response, sizeof(response), "ERR: KEYS of '%s' interrupted by a DROP or RENAME, retry.\n> ", k->file);
+        send_to_client(co->client, response);
+        return CORO_DONE;
+    }
+
+    for (Leaf *leaf = k->cursor ? k->cursor->east : k->node->east; leaf != NULL; leaf = leaf->east)
+    {
+        if (mvcc_visible(leaf, k->snapshot) != NULL)
+        {
+            reply_printf(&k->body, "%s\n", (char *)leaf->key);
+            k->count++;
+            k->cursor = leaf;
+            if (++work >= CORO_STEP_WORK && leaf->east != NULL)
+            {
+                return CORO_YIELD;
+            }
+        }
+    }
+
+    // A packed file holds at most PACKED_MAX_KEYS keys: list them in one go.
+    Leaf view;
+    for (unsigned i = 0; packed_at(k->node, i, &view) != NULL; i++)
+    {
+        if (view.seq <= k->snapshot) // Packed keys have no older versions (see packed_set).
+        {
+            reply_printf(&k->body, "%s\n", (char *)view.key);
+            k->count++;
+        }
+    }
+
+    send_listing(co->client, k->count, &k->body, k->file);
+    return CORO_DONE;
+}
+
+static void keys_release(struct coro *co)
+{
+    struct keys_cmd *k = (struct keys_cmd *)co;
+    mvcc_snapshot_close(k->snapshot);
+    reply_free(&k->body);
+    free(k);
+}
+
+/**
+ * @brief Implements the KEYS command: lists the keys of one 'file' as of a single snapshot.
+ * Big files are listed a step at a time (see coro.h); the reply goes out when done.
+ *
+ * @param client The connection receiving the reply.
+ * @param path The parsed path (database name) to list.
+ * @return 0 if the listing finished or was suspended, -1 if the file doesn't exist or
+ * memory ran out (nothing was sent).
+ */
+int db_keys(struct client *client, const path_t *path)
+{
+    debug_log("DB_KEYS: file='%s'", path->buf);
+
+    Node *node = find_node_path(path);
+    if (node == NULL)
+    {
+        return -1;
+    }
+
+    struct keys_cmd *k = (struct keys_cmd *)calloc(1, sizeof(*k));
+    if (k == NULL)
+    {
+        return -1;
+    }
+    k->co.step = keys_step;
+    k->co.release = keys_release;
+    snprintf(k->file, sizeof(k->file), "%s", path->buf);
+    k->node = node;
+    k->snapshot = mvcc_snapshot_open();
+    k->generation = tree_generation;
+    reply_init(&k->body);
+
+    coro_launch(&k->co, client);
+    return 0;
+}
+
+/**
+ * @brief A DROP in progress: the subtree is already detached, the reaper frees it.
+ */
+struct drop_cmd
+{
+    struct coro co;  // Coroutine header (must be first)
+    reaper_t reaper; // Detached subtree still to free
+};
+
+/**
+ * @brief Frees about CORO_STEP_WORK nodes and keys; replies with the totals when done.
+ */
+static int drop_step(struct coro *co)
+{
+    struct drop_cmd *d = (struct drop_cmd *)co;
+    if (!reaper_step(&d->reaper, CORO_STEP_WORK))
+    {
+        return CORO_YIELD;
+    }
+
+    char response[BUFFER_SIZE];
+    snprintf(response, sizeof(response), "OK: dropped %llu paths, %llu keys\n> ",
+             (unsigned long long)d->reaper.nodes, (unsigned long long)d->reaper.keys);
+    send_to_client(co->client, response);
+    return CORO_DONE;
+}
+
+static void drop_release(struct coro *co)
+{
+    struct drop_cmd *d = (struct drop_cmd *)co;
+    reaper_step(&d->reaper, UINT64_MAX); // Cancelled: the memory still has to go.
+    free(d);
+}
+
+/**
+ * @brief Implements the DROP command: deletes a 'file' together with all of its sub-paths
+ * and their keys. Dropping "/" empties the whole database.
+ * The subtree disappears from the tree at once; big subtrees are then freed a step at
+ * a time (see coro.h) and the reply, with the counts, goes out when done.
+ *
+ * @param client The connection receiving the reply.
+ * @param path The parsed path (database name) to drop.
+ * @return 0 if the drop finished or was suspended, -1 if the file doesn't exist or
+ * memory ran out (nothing was sent).
+ */
+int db_drop(struct client *client, const path_t *path)
+{
+    debug_log("DB_DROP: file='%s'", path->buf);
+
+    Node *node = find_node_path(path);
+    if (node == NULL)
+    {
+        return -1;
+    }
+
+    struct drop_cmd *d = (struct drop_cmd *)malloc(sizeof(*d));
+    if (d == NULL)
+    {
+        return -1;
+    }
+    d->co.step = drop_step;
+    d->co.release = drop_release;
+    reaper_init(&d->reaper, node);
+    hot_cache_invalidate_all(); // Replicas of any dropped key must not be served again.
+
+    coro_launch(&d->co, client);
+    return 0;
+}
+
+/**
+ * @brief State threaded through scan_children() by db_ls.
+ */
+struct ls_page
+{
+    struct reply *out; // Reply receiving the lines
+    int listed;        // Children listed so far
+};
+
+/**
+ * @brief Formats one LS line: the child's name, its sub-path count and its key count.
+ */
+static void ls_emit(Node *child, void *ctx)
+{
+    struct ls_page *page = (struct ls_page *)ctx;
+    reply_printf(page->out, "%s/ children=%u keys=%u\n", (char *)child->path, child->nchildren, child->nleaves);
+    page->listed++;
+}
+
+/**
+ * @brief Implements the LS command: lists one page of the sub-paths of a 'file'.
+ * Pages are served from the node's child index, so each call costs O(count) even
+ * for a node with a huge number of children.
+ *
+ * @param path The parsed path whose children are listed.
+ * @param cursor 0 for the first page, then the cursor returned by the previous page.
+ * @param count Page size.
+ * @param out Reply receiving one line per child.
+ * @param next_cursor Receives the cursor of the next page (0 when the listing is complete).
+ * @return Number of children listed, or -1 if the file doesn't exist.
+ */
+int db_ls(const path_t *path, uint64_t cursor, uint32_t count, struct reply *out, uint64_t *next_cursor)
+{
+    debug_log("DB_LS: file='%s', cursor=%llu, count=%u", path->buf, (unsigned long long)cursor, count);
+
+    Node *node = find_node_path(path);
+    if (node == NULL)
+    {
+        return -1;
+    }
+
+    struct ls_page page = {out, 0};
+    *next_cursor = scan_children(node, cursor, count, ls_emit, &page);
+    return page.listed;
+}
+
+/**
+ * @brief Implements the GETGLOB command: reads one key under every path matching a pattern
+ * such as "users/user-??/last_login". The walk runs in bounded steps; each call returns one
+ * chunk of matches and a cursor to continue from, so large expansions never stall the loop.
+ * Each connection has one walk in flight; starting a new one (cursor 0) abandons the old one.
+ *
+ * @param walk The connection's walk slot (allocated on first use).
+ * @param pattern The path pattern ('*' and '?' wildcards within segments).
+ * @param key The key to read at every matching path.
+ * @param cursor 0 to start, then the cursor returned by the previous call.
+ * @param out Reply receiving one "path: value" line per match, or the error message.
+ * @param next_cursor Receives the cursor for the next chunk (0 when the walk is complete).
+ * @return Number of matches in this chunk, or -1 on error.
+ */
+int db_getglob(struct glob_walk **walk, const char *pattern, const char *key, uint64_t cursor, struct reply *out,
+               uint64_t *next_cursor)
+{
+    debug_log("DB_GETGLOB: pattern='%s', key='%s', cursor=%llu", pattern, key, (unsigned long long)cursor);
+
+    struct glob_walk *w = *walk;
+    if (cursor == 0)
+    {
+        if (w == NULL && (w = *walk = malloc(sizeof(struct glob_walk))) == NULL)
+        {
+            reply_printf(out, "ERR: Out of memory.\n");
+            return -1;
+        }
+        if (glob_walk_start(w, pattern, key) != 0)
+        {
+            reply_printf(out, "ERR: Invalid pattern '%s'.\n", pattern);
+            return -1;
+        }
+    }
+    else if (w == NULL || w->cursor != cursor || strcmp(w->text, pattern) != 0 || strcmp(w->key, key) != 0)
+    {
+        reply_printf(out, "ERR: Unknown GETGLOB cursor %llu.\n", (unsigned long long)cursor);
+        return -1;
+    }
+
+    int matches = glob_walk_step(w, out);
+    if (matches < 0)
+    {
+        w->cursor = 0;
+        reply_printf(out, "ERR: Paths were dropped during GETGLOB; restart with cursor 0.\n");
+        return -1;
+    }
+
+    if (w->done)
+    {
+        w->cursor = 0; // A finished walk can't be resumed.
+    }
+    *next_cursor = w->cursor;
+    return matches;
 }
 
 /**
@@ -325,6 +1133,79 @@ struct client *create_client(int fd, struct sockaddr_in *addr)
     return client;
 }
 
+// Clients whose command completed during the current event batch, in completion order.
+static struct client *resume_head = NULL;
+static struct client *resume_tail = NULL;
+
+/**
+ * Resume a client once the current event batch is done
+ * For completions delivered inside the batch (worker jobs, loader replies): resuming there
+ * could destroy the client while a later event of the same batch still points at it.
+ *
+ * @param client - Client whose suspended command just completed
+ */
+void resume_client_later(struct client *client)
+{
+    if (client->resume_queued)
+    {
+        return;
+    }
+    client->resume_queued = true;
+    client->resume_next = NULL;
+    if (resume_tail != NULL)
+    {
+        resume_tail->resume_next = client;
+    }
+    else
+    {
+        resume_head = client;
+    }
+    resume_tail = client;
+}
+
+/**
+ * Resume the clients queued by resume_client_later (between event batches)
+ */
+void resume_clients(void)
+{
+    while (resume_head != NULL)
+    {
+        struct client *client = resume_head;
+        resume_head = client->resume_next;
+        if (resume_head == NULL)
+        {
+            resume_tail = NULL;
+        }
+        client->resume_next = NULL;
+        client->resume_queued = false;
+        resume_client(client);
+    }
+}
+
+/**
+ * Drop a client that is going away from the resume queue
+ */
+static void resume_cancel(struct client *client)
+{
+    struct client **link = &resume_head;
+    struct client *prev = NULL;
+
+    while (*link != NULL && *link != client)
+    {
+        prev = *link;
+        link = &(*link)->resume_next;
+    }
+    if (*link == client)
+    {
+        *link = client->resume_next;
+        if (resume_tail == client)
+        {
+            resume_tail = prev;
+        }
+    }
+    client->resume_queued = false;
+}
+
 /**
  * Destroy a client and free its resources
  * Removes client from epoll, closes socket, frees memory
@@ -358,6 +1239,21 @@ void destroy_client(struct client *client)
         }
     }
 
+    if (client->coro != NULL)
+    {
+        coro_cancel(client->coro); // Nobody is left to reply to.
+    }
+    if (client->job != NULL)
+    {
+        client->job->client = NULL; // The job finishes on its own; its reply is dropped.
+    }
+    loader_forget(client); // A load it waits for still completes for the others.
+    if (client->resume_queued)
+    {
+        resume_cancel(client);
+    }
+    free(client->write_buffer);
+    free(client->glob);
     free(client);
 }
 
@@ -440,9 +1336,64 @@ int handle_new_connection(void)
     return 0;
 }
 
+/**
+ * Check whether a client is waiting for a command to complete
+ * (suspended, see coro.h, running on a worker, see workers.h, or loading a key, see loader.h)
+ *
+ * @param client - Client to check
+ * @return true if the client's further commands must wait
+ */
+static bool client_waiting(const struct client *client)
+{
+    return client->coro != NULL || client->job != NULL || client->load != NULL;
+}
+
+/**
+ * Run the complete commands (lines ending with \n) waiting in a client's read buffer
+ * Stops early when a command suspends (see coro.h) or goes to a worker (see workers.h): the lines after it stay buffered
+ * until it completes, so a connection's commands run and reply strictly in order.
+ *
+ * @param client - Client whose buffer to process
+ */
+static void process_buffered_commands(struct client *client)
+{
+    char *line_start = client->read_buffer;
+    char *line_end;
+
+    while (!client_waiting(client) && (line_end = strchr(line_start, '\n')) != NULL)
+    {
+        *line_end = '\0'; // Null-terminate the command
+
+        // Remove carriage return if present
+        if (line_end > line_start && *(line_end - 1) == '\r')
+        {
+            *(line_end - 1) = '\0';
+        }
+
+        // Process the command
+        if (strlen(line_start) > 0)
+        {
+            process_client_command(client, line_start);
+        }
+
+        line_start = line_end + 1;
+    }
+
+    // Move remaining data to beginning of buffer
+    size_t remaining = client->read_buffer + client->read_pos - line_start;
+    if (remaining > 0)
+    {
+        memmove(client->read_buffer, line_start, remaining);
+    }
+    client->read_pos = remaining;
+    client->read_buffer[client->read_pos] = '\0';
+}
+
 /**
  * Handle client read event
  * Reads data from client socket and processes commands
+ * While a command of this client is suspended or on a worker nothing is read: the data waits in the
+ * socket, and resume_client picks it up once the command completes.
  *
  * @param client - Client to read from
  * @return 0 on success, -1 on error/disconnect
@@ -451,7 +1402,10 @@ int handle_client_read(struct client *client)
 {
     client->last_activity = time(NULL);
 
-    while (1)
+    // Commands left over from before a suspended command go first.
+    process_buffered_commands(client);
+
+    while (!client_waiting(client))
     {
         ssize_t bytes_read = recv(client->fd,
                                   client->read_buffer + client->read_pos,
@@ -479,47 +1433,33 @@ int handle_client_read(struct client *client)
         client->read_pos += bytes_read;
         client->read_buffer[client->read_pos] = '\0';
 
-        // Process complete commands (lines ending with \n)
-        char *line_start = client->read_buffer;
-        char *line_end;
+        process_buffered_commands(client);
 
-        while ((line_end = strchr(line_start, '\n')) != NULL)
-        {
-            *line_end = '\0'; // Null-terminate the command
-
-            // Remove carriage return if present
-            if (line_end > line_start && *(line_end - 1) == '\r')
-            {
-                *(line_end - 1) = '\0';
-            }
-
-            // Process the command
-            if (strlen(line_start) > 0)
-            {
-                process_client_command(client, line_start);
-            }
-
-            line_start = line_end + 1;
-        }
-
-        // Move remaining data to beginning of buffer
-        size_t remaining = client->read_buffer + client->read_pos - line_start;
-        if (remaining > 0)
-        {
-            memmove(client->read_buffer, line_start, remaining);
-        }
-        client->read_pos = remaining;
-
-        // Check for buffer overflow
-        if (client->read_pos >= BUFFER_SIZE - 1)
+        // Check for buffer overflow (a suspended command may leave complete lines behind)
+        if (!client_waiting(client) && client->read_pos >= BUFFER_SIZE - 1)
         {
             error_log("Client %s:%d command too long, disconnecting",
                       client->ip, client->port);
             return -1;
         }
     }
-
-    return 0;
+
+    return 0;
+}
+
+/**
+ * Continue a client whose suspended command just completed
+ * Runs the commands that were held back and reads what arrived meanwhile (edge-triggered
+ * epoll does not report data that was already waiting). May destroy the client.
+ *
+ * @param client - Client to resume
+ */
+void resume_client(struct client *client)
+{
+    if (handle_client_read(client) == -1 || client->state == CLIENT_DISCONNECTING)
+    {
+        destroy_client(client);
+    }
 }
 
 /**
@@ -589,6 +1529,15 @@ int handle_client_write(struct client *client)
  * GET <file> <key>
  * SET <file> <key> <value>
  * DEL <file> <key>
+ * MGET <file> <key> [<key> ...]
+ * MGETX <file> <key> [<file> <key> ...]
+ * RENAME <old-file> <new-file>
+ * CLONE <src-file> <new-file>
+ * MOVEKEY <src-file> <dst-file> <key>
+ * KEYS <file>
+ * DROP <file>
+ * LS <file> [<cursor> [<count>]]
+ * GETGLOB <pattern> <key> [<cursor>]
  *
  * @param command_str The raw command string received from the client.
  * @param parsed_cmd Pointer to a parsed_command_t structure to fill.
@@ -739,17 +1688,458 @@ bool parse_command(const char *command_str, parsed_command_t *parsed_cmd)
             return false; // Too many arguments for DEL.
         }
     }
+    // Handle MGET command: MGET <file> <key> [<key> ...]
+    else if (strcmp(parsed_cmd->command, "MGET") == 0)
+    {
+        // Get the 'file' token.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing file argument.
+        }
+        strncpy(parsed_cmd->file, token, sizeof(parsed_cmd->file) - 1);
+        parsed_cmd->file[sizeof(parsed_cmd->file) - 1] = '\0';
+
+        // The remaining part of `saveptr` holds the keys; db_mget tokenizes it.
+        char *keys_start = saveptr;
+        while (*keys_start == ' ')
+        {
+            keys_start++;
+        }
+        if (*keys_start == '\0')
+        {
+            free(cmd_copy);
+            return false; // MGET needs at least one key.
+        }
+        strncpy(parsed_cmd->args, keys_start, sizeof(parsed_cmd->args) - 1);
+        parsed_cmd->args[sizeof(parsed_cmd->args) - 1] = '\0';
+    }
+    // Handle MGETX command: MGETX <file> <key> [<file> <key> ...]
+    else if (strcmp(parsed_cmd->command, "MGETX") == 0)
+    {
+        // The pairs are kept whole; db_mgetx tokenizes and groups them.
+        char *pairs_start = saveptr;
+        while (*pairs_start == ' ')
+        {
+            pairs_start++;
+        }
+        if (*pairs_start == '\0')
+        {
+            free(cmd_copy);
+            return false; // MGETX needs at least one pair.
+        }
+        strncpy(parsed_cmd->args, pairs_start, sizeof(parsed_cmd->args) - 1);
+        parsed_cmd->args[sizeof(parsed_cmd->args) - 1] = '\0';
+    }
+    // Handle RENAME, CLONE and MOVEKEY commands: RENAME <old-file> <new-file>, CLONE <src-file> <new-file>,
+    // MOVEKEY <src-file> <dst-file> <key>
+    else if (strcmp(parsed_cmd->command, "RENAME") == 0 || strcmp(parsed_cmd->command, "CLONE") == 0 ||
+             strcmp(parsed_cmd->command, "MOVEKEY") == 0)
+    {
+        // Get the source 'file' token.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing source argument.
+        }
+        strncpy(parsed_cmd->file, token, sizeof(parsed_cmd->file) - 1);
+        parsed_cmd->file[sizeof(parsed_cmd->file) - 1] = '\0';
+
+        // Get the destination 'file' token, parsed straight into `dest`.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token || path_parse(&parsed_cmd->dest, token) != 0)
+        {
+            free(cmd_copy);
+            return false; // Missing or invalid destination.
+        }
+        strncpy(parsed_cmd->to, token, sizeof(parsed_cmd->to) - 1);
+        parsed_cmd->to[sizeof(parsed_cmd->to) - 1] = '\0';
+
+        // MOVEKEY also names the key.
+        if (parsed_cmd->command[0] == 'M')
+        {
+            token = strtok_r(NULL, " ", &saveptr);
+            if (!token)
+            {
+                free(cmd_copy);
+                return false; // Missing key argument.
+            }
+            strncpy(parsed_cmd->key, token, sizeof(parsed_cmd->key) - 1);
+            parsed_cmd->key[sizeof(parsed_cmd->key) - 1] = '\0';
+        }
+
+        // Ensure no extra arguments are present.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (token)
+        {
+            free(cmd_copy);
+            return false; // Too many arguments for RENAME/CLONE/MOVEKEY.
+        }
+    }
+    // Handle KEYS, DROP and DETACH commands: KEYS <file>, DROP <file>, DETACH <file>
+    else if (strcmp(parsed_cmd->command, "KEYS") == 0 || strcmp(parsed_cmd->command, "DROP") == 0 ||
+             strcmp(parsed_cmd->command, "DETACH") == 0)
+    {
+        // Get the 'file' token.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing file argument.
+        }
+        strncpy(parsed_cmd->file, token, sizeof(parsed_cmd->file) - 1);
+        parsed_cmd->file[sizeof(parsed_cmd->file) - 1] = '\0';
+
+        // Ensure no extra arguments are present for KEYS.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (token)
+        {
+            free(cmd_copy);
+            return false; // Too many arguments for KEYS/DROP/DETACH.
+        }
+    }
+    // Handle ATTACH command: ATTACH <file> <table-file>
+    else if (strcmp(parsed_cmd->command, "ATTACH") == 0)
+    {
+        // Get the 'file' token.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing file argument.
+        }
+        strncpy(parsed_cmd->file, token, sizeof(parsed_cmd->file) - 1);
+        parsed_cmd->file[sizeof(parsed_cmd->file) - 1] = '\0';
+
+        // Get the table file (a path on the server's filesystem).
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing table file.
+        }
+        strncpy(parsed_cmd->args, token, sizeof(parsed_cmd->args) - 1);
+        parsed_cmd->args[sizeof(parsed_cmd->args) - 1] = '\0';
+
+        // Ensure no extra arguments are present.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (token)
+        {
+            free(cmd_copy);
+            return false; // Too many arguments for ATTACH.
+        }
+    }
+    // Handle LS command: LS <file> [<cursor> [<count>]]
+    else if (strcmp(parsed_cmd->command, "LS") == 0)
+    {
+        // Get the 'file' token.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing file argument.
+        }
+        strncpy(parsed_cmd->file, token, sizeof(parsed_cmd->file) - 1);
+        parsed_cmd->file[sizeof(parsed_cmd->file) - 1] = '\0';
+
+        // Optional cursor and page size, both plain decimal numbers.
+        parsed_cmd->count = LS_DEFAULT_COUNT;
+        token = strtok_r(NULL, " ", &saveptr);
+        if (token)
+        {
+            char *end;
+            parsed_cmd->cursor = strtoull(token, &end, 10);
+            if (*end != '\0' || *token == '-')
+            {
+                free(cmd_copy);
+                return false; // Cursor is not a number.
+            }
+
+            token = strtok_r(NULL, " ", &saveptr);
+            if (token)
+            {
+                unsigned long count = strtoul(token, &end, 10);
+                if (*end != '\0' || count == 0 || count > LS_MAX_COUNT)
+                {
+                    free(cmd_copy);
+                    return false; // Page size out of range.
+                }
+                parsed_cmd->count = (uint32_t)count;
+
+                if (strtok_r(NULL, " ", &saveptr))
+                {
+                    free(cmd_copy);
+                    return false; // Too many arguments for LS.
+                }
+            }
+        }
+    }
+    // Handle GETGLOB command: GETGLOB <pattern> <key> [<cursor>]
+    else if (strcmp(parsed_cmd->command, "GETGLOB") == 0)
+    {
+        // Get the 'pattern' token (kept in `file`).
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing pattern argument.
+        }
+        strncpy(parsed_cmd->file, token, sizeof(parsed_cmd->file) - 1);
+        parsed_cmd->file[sizeof(parsed_cmd->file) - 1] = '\0';
+
+        // Get the 'key' token.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (!token)
+        {
+            free(cmd_copy);
+            return false; // Missing key argument.
+        }
+        strncpy(parsed_cmd->key, token, sizeof(parsed_cmd->key) - 1);
+        parsed_cmd->key[sizeof(parsed_cmd->key) - 1] = '\0';
+
+        // Optional cursor from the previous chunk.
+        token = strtok_r(NULL, " ", &saveptr);
+        if (token)
+        {
+            char *end;
+            parsed_cmd->cursor = strtoull(token, &end, 10);
+            if (*end != '\0' || *token == '-' || strtok_r(NULL, " ", &saveptr))
+            {
+                free(cmd_copy);
+                return false; // Bad cursor or too many arguments for GETGLOB.
+            }
+        }
+    }
     else
     {
-        // Command is not recognized as GET, SET, or DEL.
+        // Command is not recognized as GET, SET, DEL, MGET, MGETX, RENAME, CLONE, MOVEKEY, KEYS, DROP, LS or GETGLOB.
         free(cmd_copy);
         return false; // Unknown command.
     }
 
+    // Parse and hash the path once; every lookup for this command reuses it.
+    // (A GETGLOB pattern is matched segment by segment instead, see glob.c; MGETX parses
+    // each of its files in db_mgetx.)
+    if (strcmp(parsed_cmd->command, "GETGLOB") != 0 && strcmp(parsed_cmd->command, "MGETX") != 0 &&
+        path_parse(&parsed_cmd->path, parsed_cmd->file) != 0)
+    {
+        free(cmd_copy);
+        return false; // Path too long or too deep.
+    }
+
     free(cmd_copy); // Free the duplicated string after parsing is complete.
     return true;    // Parsing successful.
 }
 
+/**
+ * @brief Sends the reply to a GET: the value (compressed, if the client accepts OKZ) or
+ * the not-found error.
+ *
+ * @param client The client to reply to.
+ * @param path The parsed file.
+ * @param file The file as the client wrote it (for the error).
+ * @param key The key.
+ * @param reply_miss Whether to reply when the key doesn't exist.
+ * @return false if the key doesn't exist and nothing was sent, true otherwise.
+ */
+bool send_get_reply(struct client *client, const path_t *path, const char *file, const char *key, bool reply_miss)
+{
+    char response[BUFFER_SIZE];
+    if (client->compressed_replies)
+    {
+        // Client accepts compressed replies: ship compressed values without decompressing them.
+        uint16_t size, stored_size;
+        bool compressed;
+        char *stored = db_get_stored(path, key, &size, &stored_size, &compressed);
+        int len;
+        if (stored == NULL)
+        {
+            if (!reply_miss)
+            {
+                return false;
+            }
+            len = snprintf(response, sizeof(response), "ERR: Key '%s' not found in file '%s'.\n> ", key, file);
+        }
+        else if (compressed)
+        {
+            // Binary-safe framing: "OKZ <raw-size> <stored-size>\n" followed by the LZ stream.
+            // Stored values are bounded by MAX_VALUE_LEN, so the frame always fits the buffer.
+            len = snprintf(response, sizeof(response), "OKZ %u %u\n", size, stored_size);
+            memcpy(response + len, stored, stored_size);
+            len += stored_size;
+            len += snprintf(response + len, sizeof(response) - len, "\n> ");
+        }
+        else
+        {
+            len = snprintf(response, sizeof(response), "OK: %s\n> ", stored);
+        }
+        free(stored);
+        send_bytes_to_client(client, response, (size_t)len);
+        return true;
+    }
+
+    // Call the database GET function to retrieve the value.
+    char *value = db_get(path, key);
+    if (value)
+    {
+        // Value found, send it back to the client.
+        snprintf(response, sizeof(response), "OK: %s\n> ", value);
+        free(value); // Important: Free the dynamically allocated value returned by db_get.
+    }
+    else
+    {
+        if (!reply_miss)
+        {
+            return false;
+        }
+        // Key not found in the specified file.
+        snprintf(response, sizeof(response), "ERR: Key '%s' not found in file '%s'.\n> ", key, file);
+    }
+    send_to_client(client, response);
+    return true;
+}
+
+/**
+ * @brief A GET of a cold value, read from the value log on a worker thread (see vlog.h).
+ */
+struct cold_get
+{
+    struct job job;              // Job header (must be first)
+    uint64_t ref;                // The value's record in the log
+    int fd;                      // Its segment, kept open by vlog_pin
+    uint16_t size;               // Uncompressed size of the value
+    uint16_t stored_size;        // Bytes in the record
+    uint8_t flags;               // Leaf flags when the read started (LeafCompressed)
+    int err;                     // errno of a failed read, 0 on success
+    path_t path;                 // Where to promote the value
+    char key[MAX_KEY_LEN];       // Key (for the promotion)
+    char file[MAX_FILENAME_LEN]; // File as the client wrote it (for the error)
+    int8_t data[];               // The stored bytes
+};
+
+/**
+ * @brief Worker side: reads the record.
+ */
+static void cold_get_run(struct job *job)
+{
+    struct cold_get *g = (struct cold_get *)job;
+    g->err = vlog_read_fd(g->fd, g->ref, g->data, g->stored_size) == 0 ? 0 : errno;
+}
+
+/**
+ * @brief Event-loop side: promotes the value (if it is still the one read), replies and
+ * frees the job.
+ */
+static void cold_get_done(struct job *job)
+{
+    struct cold_get *g = (struct cold_get *)job;
+    bool promoted = false;
+    if (g->err == 0 && vlog_promote)
+    {
+        // The key may have been overwritten, deleted or promoted while the read ran.
+        Leaf view;
+        Leaf *leaf = find_leaf_path(&g->path, g->key, &view);
+        promoted = leaf && (leaf->flags & LeafCold) && leaf->cold_ref == g->ref && value_warm(leaf, g->data) == 0;
+    }
+    vlog_unpin(g->ref, promoted);
+
+    if (job->client != NULL)
+    {
+        char response[BUFFER_SIZE];
+        int len;
+        if (g->err != 0)
+        {
+            error_log("GET: read of '%s' in '%s' from the value log failed: %s", g->key, g->path.buf,
+                      strerror(g->err));
+            len = snprintf(response, sizeof(response), "ERR: Failed to read key '%s' in file '%s'.\n> ", g->key,
+                           g->file);
+        }
+        else if (job->client->compressed_replies && (g->flags & LeafCompressed))
+        {
+            // Same framing as send_get_reply.
+            len = snprintf(response, sizeof(response), "OKZ %u %u\n", g->size, g->stored_size);
+            memcpy(response + len, g->data, g->stored_size);
+            len += g->stored_size;
+            len += snprintf(response + len, sizeof(response) - len, "\n> ");
+        }
+        else
+        {
+            // Decode through a leaf standing in for the in-memory one.
+            Leaf tmp = {.size = g->size, .stored_size = g->stored_size, .flags = g->flags & LeafCompressed};
+            tmp.value = g->data;
+            char *value = value_dup(&tmp);
+            if (value != NULL)
+            {
+                len = snprintf(response, sizeof(response), "OK: %s\n> ", value);
+                free(value);
+            }
+            else
+            {
+                len = snprintf(response, sizeof(response), "ERR: Failed to read key '%s' in file '%s'.\n> ",
+                               g->key, g->file);
+            }
+        }
+        send_bytes_to_client(job->client, response, (size_t)len);
+    }
+    free(g);
+}
+
+/**
+ * @brief Starts a GET of a cold value on the worker pool; the client waits for the reply.
+ *
+ * @return true if the read was started, false if the GET should be served right away
+ * (the value is in memory, the key is missing, or the pool is full: a cold value is
+ * then read synchronously).
+ */
+static bool get_cold(struct client *client, const path_t *path, const char *file, const char *key)
+{
+    if (!vlog_enabled() || !workers_accepting())
+    {
+        return false;
+    }
+    Leaf view;
+    Leaf *leaf = find_leaf_path(path, key, &view);
+    if (leaf == NULL || !(leaf->flags & LeafCold))
+    {
+        return false;
+    }
+    if (!client->compressed_replies)
+    {
+        // A replica in the hot cache (see hotcache.h) is served by db_get without the tree.
+        uint16_t cached_size;
+        if (hot_cache_lookup(hot_key_hash(path_hash(path), key), path->buf, key, &cached_size) != NULL)
+        {
+            return false;
+        }
+    }
+
+    uint16_t stored_size = (uint16_t)leaf->stored_size;
+    struct cold_get *g = (struct cold_get *)malloc(sizeof(*g) + stored_size + 1);
+    if (g == NULL)
+    {
+        return false;
+    }
+    *g = (struct cold_get){.job = {.run = cold_get_run, .done = cold_get_done},
+                           .ref = leaf->cold_ref,
+                           .size = (uint16_t)leaf->size,
+                           .stored_size = stored_size,
+                           .flags = leaf->flags,
+                           .path = *path};
+    g->data[stored_size] = '\0';
+    snprintf(g->key, sizeof(g->key), "%s", key);
+    snprintf(g->file, sizeof(g->file), "%s", file);
+    g->fd = vlog_pin(g->ref);
+    if (workers_submit(&g->job, client) != 0)
+    {
+        vlog_unpin(g->ref, false);
+        free(g);
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief Processes a client command, handling built-in commands and CRUD operations.
  *
@@ -780,27 +2170,99 @@ void process_client_command(struct client *client, const char *command)
                        "Available commands:\n"
                        "  help        - Show this help message\n"
                        "  info        - Show server information\n"
+                       "  stats       - Show storage statistics\n"
+                       "  compress on|off - Receive compressed values as 'OKZ <size> <len>' frames\n"
+                       "  DUMP        - Write all keys to a new file in the dump directory as SET commands\n"
+                       "  MEMORY      - Report memory use per structure and the largest files\n"
                        "  quit        - Disconnect from server\n"
                        "  GET <file> <key> - Retrieve a value from a file\n"
                        "  SET <file> <key> <value> - Set a value in a file\n"
                        "  DEL <file> <key> - Delete a key-value pair from a file\n"
+                       "  MGET <file> <key> [<key> ...] - Retrieve several values from one snapshot\n"
+                       "  MGETX <file> <key> [<file> <key> ...] - Retrieve keys of several files from one snapshot\n"
+                       "  RENAME <old-file> <new-file> - Move a file with all its sub-paths and keys\n"
+                       "  CLONE <src-file> <new-file> - Copy a file with all its sub-paths, sharing values\n"
+                       "  MOVEKEY <src-file> <dst-file> <key> - Move one key to another file\n"
+                       "  KEYS <file> - List the keys of a file\n"
+                       "  DROP <file> - Delete a file with all its sub-paths and keys\n"
+                       "  ATTACH <file> <table-file> - Serve GET on a file from a table built by memodb_mktable\n"
+                       "  DETACH <file> - Stop serving an attached table\n"
+                       "  LS <file> [cursor] [count] - List sub-paths a page at a time (cursor 0 = done)\n"
+                       "  GETGLOB <pattern> <key> [cursor] - Read a key under every path matching a pattern\n"
+                       "                                     ('*' and '?' within segments), in chunks\n"
                        "> ");
         return;
     }
 
-    // Display server and client information.
-    if (strcmp(command, "info") == 0)
+    // Display server and client information.
+    if (strcmp(command, "info") == 0)
+    {
+        char info_msg[512]; // Buffer to compose the info message.
+        snprintf(info_msg, sizeof(info_msg),
+                 "Server Information:\n"
+                 "  Host: %s:%d\n"
+                 "  Connected clients: %d/%d\n"
+                 "  Your IP: %s:%d\n"
+                 "> ",
+                 HOST, g_server->port, g_server->client_count, MAX_CLIENTS,
+                 client->ip, client->port);
+        send_to_client(client, info_msg);
+        return;
+    }
+
+    // Display storage statistics.
+    if (strcmp(command, "stats") == 0)
+    {
+        char stats_msg[BUFFER_SIZE]; // Buffer to compose the statistics report.
+        int len = snprintf(stats_msg, sizeof(stats_msg), "Server Statistics:\n");
+        len += hot_cache_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += value_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += arena_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += numa_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += mvcc_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += hindex_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += packed_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += region_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += defrag_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += coro_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += tasks_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += workers_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += loader_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += vlog_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += lsm_stats(stats_msg + len, sizeof(stats_msg) - len);
+        len += table_stats(stats_msg + len, sizeof(stats_msg) - len);
+        snprintf(stats_msg + len, sizeof(stats_msg) - len, "> ");
+        send_to_client(client, stats_msg);
+        return;
+    }
+
+    // Heavyweight reports run off the event loop; the reply goes out when they are done.
+    if (strcmp(command, "DUMP") == 0 || strcmp(command, "MEMORY") == 0)
+    {
+        if (lsm_enabled())
+        {
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "ERR: %s is not available with the lsm engine.\n> ", command);
+            send_to_client(client, response);
+            return;
+        }
+        int rc = (command[0] == 'D') ? admin_dump(client) : admin_memory(client);
+        if (rc != 0)
+        {
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "ERR: %s could not be started (too many running?), retry later.\n> ",
+                     command);
+            send_to_client(client, response);
+        }
+        return;
+    }
+
+    // Toggle compressed replies for this connection.
+    if (strcmp(command, "compress on") == 0 || strcmp(command, "compress off") == 0)
     {
-        char info_msg[512]; // Buffer to compose the info message.
-        snprintf(info_msg, sizeof(info_msg),
-                 "Server Information:\n"
-                 "  Host: %s:%d\n"
-                 "  Connected clients: %d/%d\n"
-                 "  Your IP: %s:%d\n"
-                 "> ",
-                 HOST, g_server->port, g_server->client_count, MAX_CLIENTS,
-                 client->ip, client->port);
-        send_to_client(client, info_msg);
+        client->compressed_replies = (strcmp(command, "compress on") == 0);
+        send_to_client(client, client->compressed_replies ? "OK: compressed replies on\n> "
+                                                          : "OK: compressed replies off\n> ");
         return;
     }
 
@@ -817,32 +2279,78 @@ void process_client_command(struct client *client, const char *command)
         return;
     }
 
-    // Dispatch to the appropriate database function based on the parsed command.
-    if (strcmp(parsed_cmd.command, "GET") == 0)
+    // Attached tables are read-only and answer GET from their mapping (see table.h).
+    bool attach = (strcmp(parsed_cmd.command, "ATTACH") == 0 || strcmp(parsed_cmd.command, "DETACH") == 0);
+    struct table *table = attach ? NULL : table_find(&parsed_cmd.path);
+    if (!attach && table == NULL)
+    {
+        table = table_find(&parsed_cmd.dest); // RENAME, CLONE or MOVEKEY into a table
+    }
+    if (table != NULL)
     {
-        // Call the database GET function to retrieve the value.
-        char *value = db_get(parsed_cmd.file, parsed_cmd.key);
         char response[BUFFER_SIZE];
-        if (value)
+        const char *value;
+        uint16_t len;
+        if (strcmp(parsed_cmd.command, "GET") != 0)
+        {
+            snprintf(response, sizeof(response), "ERR: %s is not available on an attached table.\n> ",
+                     parsed_cmd.command);
+        }
+        else if (table_get(table, parsed_cmd.key, &value, &len))
         {
-            // Value found, send it back to the client.
-            snprintf(response, sizeof(response), "OK: %s\n> ", value);
-            free(value); // Important: Free the dynamically allocated value returned by db_get.
+            snprintf(response, sizeof(response), "OK: %.*s\n> ", (int)len, value);
         }
         else
         {
-            // Key not found in the specified file.
-            snprintf(response, sizeof(response), "ERR: Key '%s' not found in file '%s'.\n> ",
-                     parsed_cmd.key, parsed_cmd.file);
+            snprintf(response, sizeof(response), "ERR: Key '%s' not found in file '%s'.\n> ", parsed_cmd.key,
+                     parsed_cmd.file);
         }
         send_to_client(client, response);
+        return;
+    }
+    bool subtree = (strcmp(parsed_cmd.command, "DROP") == 0 || strcmp(parsed_cmd.command, "RENAME") == 0 ||
+                    strcmp(parsed_cmd.command, "CLONE") == 0);
+    const char *below = subtree ? table_under(&parsed_cmd.path) : NULL;
+    if (subtree && below == NULL && parsed_cmd.command[0] != 'D')
+    {
+        below = table_under(&parsed_cmd.dest);
+    }
+    if (below != NULL)
+    {
+        char response[BUFFER_SIZE];
+        snprintf(response, sizeof(response),
+                 "ERR: %s is not available above the attached table '/%.*s' (DETACH it first).\n> ",
+                 parsed_cmd.command, PATH_MAX_LEN, below);
+        send_to_client(client, response);
+        return;
+    }
+
+    // The lsm engine only implements the single-key commands (tables work with either engine).
+    if (lsm_enabled() && strcmp(parsed_cmd.command, "GET") != 0 && strcmp(parsed_cmd.command, "SET") != 0 &&
+        strcmp(parsed_cmd.command, "DEL") != 0 && !attach)
+    {
+        char response[BUFFER_SIZE];
+        snprintf(response, sizeof(response), "ERR: %s is not available with the lsm engine.\n> ", parsed_cmd.command);
+        send_to_client(client, response);
+        return;
+    }
+
+    // Dispatch to the appropriate database function based on the parsed command.
+    if (strcmp(parsed_cmd.command, "GET") == 0)
+    {
+        // In read-through mode a miss is loaded from the backing store and answered later.
+        if (!get_cold(client, &parsed_cmd.path, parsed_cmd.file, parsed_cmd.key) &&
+            !send_get_reply(client, &parsed_cmd.path, parsed_cmd.file, parsed_cmd.key, loader_socket == NULL))
+        {
+            loader_fetch(client, &parsed_cmd.path, parsed_cmd.file, parsed_cmd.key);
+        }
     }
     else if (strcmp(parsed_cmd.command, "SET") == 0)
     {
         // Call the database SET function to store or update the key-value pair.
         // db_set now takes (const char *file, const char *key, const char *value)
         // Ensure the db_set signature matches this call here.
-        if (db_set(parsed_cmd.file, parsed_cmd.key, parsed_cmd.value) == 0)
+        if (db_set(&parsed_cmd.path, parsed_cmd.key, parsed_cmd.value) == 0)
         {
             // Set operation successful.
             send_to_client(client, "OK\n> ");
@@ -856,7 +2364,7 @@ void process_client_command(struct client *client, const char *command)
     else if (strcmp(parsed_cmd.command, "DEL") == 0)
     {
         // Attempt to delete the key-value pair from the specified file.
-        if (db_del(parsed_cmd.file, parsed_cmd.key) == 0)
+        if (db_del(&parsed_cmd.path, parsed_cmd.key) == 0)
         {
             // Delete operation successful.
             send_to_client(client, "OK\n> ");
@@ -867,6 +2375,175 @@ void process_client_command(struct client *client, const char *command)
             send_to_client(client, "ERR: Failed to delete key. Check server logs.\n> ");
         }
     }
+    else if (strcmp(parsed_cmd.command, "MGET") == 0)
+    {
+        // Multi-line replies are composed in a growable buffer and queued in one piece.
+        struct reply body;
+        reply_init(&body);
+        int n = db_mget(&parsed_cmd.path, parsed_cmd.args, &body);
+        send_listing(client, n, &body, parsed_cmd.file);
+        reply_free(&body);
+    }
+    else if (strcmp(parsed_cmd.command, "MGETX") == 0)
+    {
+        struct reply body;
+        reply_init(&body);
+        int n = db_mgetx(parsed_cmd.args, &body);
+        if (n < 0)
+        {
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "ERR: MGETX takes 1 to %d complete <file> <key> pairs.\n> ", MGETX_MAX_PAIRS);
+            send_to_client(client, response);
+        }
+        else
+        {
+            send_listing(client, n, &body, NULL);
+        }
+        reply_free(&body);
+    }
+    else if (strcmp(parsed_cmd.command, "RENAME") == 0 || strcmp(parsed_cmd.command, "CLONE") == 0)
+    {
+        char response[BUFFER_SIZE];
+        uint64_t nodes, keys;
+        if (parsed_cmd.command[0] == 'R' && db_rename(&parsed_cmd.path, &parsed_cmd.dest) == 0)
+        {
+            snprintf(response, sizeof(response), "OK\n> ");
+        }
+        else if (parsed_cmd.command[0] == 'C' && db_clone(&parsed_cmd.path, &parsed_cmd.dest, &nodes, &keys) == 0)
+        {
+            snprintf(response, sizeof(response), "OK: cloned %llu paths, %llu keys\n> ", (unsigned long long)nodes,
+                     (unsigned long long)keys);
+        }
+        else if (errno == ENOENT)
+        {
+            snprintf(response, sizeof(response), "ERR: File '%s' not found.\n> ", parsed_cmd.file);
+        }
+        else if (errno == EEXIST)
+        {
+            snprintf(response, sizeof(response), "ERR: File '%s' already exists.\n> ", parsed_cmd.to);
+        }
+        else if (errno == EINVAL)
+        {
+            snprintf(response, sizeof(response), "ERR: Cannot %s '%s' to '%s'.\n> ",
+                     parsed_cmd.command[0] == 'C' ? "clone" : "move", parsed_cmd.file, parsed_cmd.to);
+        }
+        else
+        {
+            snprintf(response, sizeof(response), "ERR: %s failed. Check server logs.\n> ", parsed_cmd.command);
+        }
+        send_to_client(client, response);
+    }
+    else if (strcmp(parsed_cmd.command, "MOVEKEY") == 0)
+    {
+        if (db_movekey(&parsed_cmd.path, &parsed_cmd.dest, parsed_cmd.key) == 0)
+        {
+            send_to_client(client, "OK\n> ");
+        }
+        else
+        {
+            send_to_client(client, "ERR: Failed to move key (no such file or key?). Check server logs.\n> ");
+        }
+    }
+    else if (strcmp(parsed_cmd.command, "KEYS") == 0)
+    {
+        // Replies when the listing is complete, possibly after a few loop iterations.
+        if (db_keys(client, &parsed_cmd.path) != 0)
+        {
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "ERR: File '%s' not found.\n> ", parsed_cmd.file);
+            send_to_client(client, response);
+        }
+    }
+    else if (strcmp(parsed_cmd.command, "LS") == 0 || strcmp(parsed_cmd.command, "GETGLOB") == 0)
+    {
+        struct reply body, response;
+        uint64_t next_cursor = 0;
+        reply_init(&body);
+        reply_init(&response);
+
+        int n = (parsed_cmd.command[0] == 'L')
+                    ? db_ls(&parsed_cmd.path, parsed_cmd.cursor, parsed_cmd.count, &body, &next_cursor)
+                    : db_getglob(&client->glob, parsed_cmd.file, parsed_cmd.key, parsed_cmd.cursor, &body,
+                                 &next_cursor);
+        if (n < 0 && parsed_cmd.command[0] == 'G')
+        {
+            reply_append(&response, body.data, body.len); // db_getglob wrote the error message.
+            reply_printf(&response, "> ");
+        }
+        else if (n < 0)
+        {
+            reply_printf(&response, "ERR: File '%s' not found.\n> ", parsed_cmd.file);
+        }
+        else
+        {
+            // Header carries the cursor for the next page; 0 means the listing is complete.
+            reply_printf(&response, "OK: %d cursor=%llu\n", n, (unsigned long long)next_cursor);
+            reply_append(&response, body.data, body.len);
+            reply_printf(&response, "> ");
+        }
+
+        if (response.failed || body.failed)
+        {
+            send_to_client(client, "ERR: Out of memory composing reply.\n> ");
+        }
+        else
+        {
+            send_bytes_to_client(client, response.data, response.len);
+        }
+        reply_free(&body);
+        reply_free(&response);
+    }
+    else if (strcmp(parsed_cmd.command, "DROP") == 0)
+    {
+        // Replies with the counts once the subtree is freed, possibly after a few loop iterations.
+        if (db_drop(client, &parsed_cmd.path) != 0)
+        {
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "ERR: File '%s' not found.\n> ", parsed_cmd.file);
+            send_to_client(client, response);
+        }
+    }
+    else if (strcmp(parsed_cmd.command, "ATTACH") == 0)
+    {
+        char response[BUFFER_SIZE];
+        uint64_t keys;
+        if (db_attach(&parsed_cmd.path, parsed_cmd.args, &keys) == 0)
+        {
+            snprintf(response, sizeof(response), "OK: attached %llu keys\n> ", (unsigned long long)keys);
+        }
+        else if (errno == EEXIST)
+        {
+            snprintf(response, sizeof(response), "ERR: File '%s' already exists.\n> ", parsed_cmd.file);
+        }
+        else if (errno == ENOSPC)
+        {
+            snprintf(response, sizeof(response), "ERR: At most %d tables can be attached.\n> ", TABLE_MAX_ATTACHED);
+        }
+        else if (errno == EBADMSG)
+        {
+            snprintf(response, sizeof(response), "ERR: '%.*s' is not a valid table file.\n> ", PATH_MAX_LEN,
+                     parsed_cmd.args);
+        }
+        else
+        {
+            snprintf(response, sizeof(response), "ERR: Cannot attach '%.*s': %s.\n> ", PATH_MAX_LEN,
+                     parsed_cmd.args, strerror(errno));
+        }
+        send_to_client(client, response);
+    }
+    else if (strcmp(parsed_cmd.command, "DETACH") == 0)
+    {
+        if (table_detach(&parsed_cmd.path) == 0)
+        {
+            send_to_client(client, "OK\n> ");
+        }
+        else
+        {
+            char response[BUFFER_SIZE];
+            snprintf(response, sizeof(response), "ERR: File '%s' is not an attached table.\n> ", parsed_cmd.file);
+            send_to_client(client, response);
+        }
+    }
     else
     {
         // This case should ideally be caught by `parse_command`, but acts as a final fallback.
@@ -887,33 +2564,63 @@ void process_client_command(struct client *client, const char *command)
  */
 void send_to_client(struct client *client, const char *message)
 {
-    size_t msg_len = strlen(message);
-
-    // Check if message fits in buffer
-    if (msg_len >= BUFFER_SIZE)
-    {
-        error_log("Message too long for client %s:%d", client->ip, client->port);
-        return;
-    }
+    send_bytes_to_client(client, message, strlen(message));
+}
 
+/**
+ * Send a binary-safe message to a client
+ * Queues `msg_len` bytes (which may contain NULs) for asynchronous sending; the write buffer
+ * grows as needed, so replies larger than BUFFER_SIZE (MGET, KEYS) are sent whole
+ *
+ * @param client - Client to send message to
+ * @param message - Bytes to send
+ * @param msg_len - Number of bytes to send
+ */
+void send_bytes_to_client(struct client *client, const char *message, size_t msg_len)
+{
     // If we already have pending data, try to send it first
-    // This ensures that the write buffer is cleared before adding new data if possible.
+    // This keeps the write buffer small when the socket is keeping up.
     if (client->write_pending)
     {
         handle_client_write(client);
-        if (client->write_pending)
+    }
+
+    // Drop the part of the buffer that has already been sent.
+    if (client->write_pos > 0)
+    {
+        memmove(client->write_buffer, client->write_buffer + client->write_pos,
+                client->write_len - client->write_pos);
+        client->write_len -= client->write_pos;
+        client->write_pos = 0;
+    }
+
+    // Check if message fits in buffer, growing it if needed
+    size_t needed = client->write_len + msg_len;
+    if (needed > MAX_WRITE_BUFFER)
+    {
+        error_log("Write buffer full for client %s:%d", client->ip, client->port);
+        return;
+    }
+    if (needed > client->write_cap)
+    {
+        size_t cap = client->write_cap ? client->write_cap : BUFFER_SIZE;
+        while (cap < needed)
+        {
+            cap *= 2;
+        }
+        char *buffer = realloc(client->write_buffer, cap);
+        if (buffer == NULL)
         {
-            // Still have pending data, can't send new message right now.
-            // This might happen if the socket write buffer is full.
-            error_log("Write buffer full for client %s:%d", client->ip, client->port);
+            error_log("Failed to grow write buffer for client %s:%d", client->ip, client->port);
             return;
         }
+        client->write_buffer = buffer;
+        client->write_cap = cap;
     }
 
-    // Copy message to write buffer
-    memcpy(client->write_buffer, message, msg_len);
-    client->write_len = msg_len;
-    client->write_pos = 0; // Reset write position for the new message.
+    // Append message to write buffer (after anything still queued)
+    memcpy(client->write_buffer + client->write_len, message, msg_len);
+    client->write_len += msg_len;
     client->write_pending = true;
 
     // Add EPOLLOUT event to trigger handle_client_write when the socket is ready for writing.
@@ -992,6 +2699,60 @@ int init_server(uint16_t port)
     return listen_fd; // Return the listening socket file descriptor.
 }
 
+/**
+ * @brief Background task: disconnects clients that have been idle longer than
+ * `idle_timeout` seconds. Scans the client table a slice at a time, resuming where the
+ * previous slice stopped, so a full table never costs more than the task's budget.
+ *
+ * @param budget_ns Time the slice may take.
+ * @return Number of clients disconnected.
+ */
+static int expire_idle_clients(uint64_t budget_ns)
+{
+    static int next_slot; // Where the previous slice stopped
+    time_t cutoff = time(NULL) - (time_t)idle_timeout;
+    int expired = 0;
+
+    if (idle_timeout == 0)
+    {
+        return 0;
+    }
+    uint64_t start = now_ns();
+
+    for (int scanned = 0; scanned < MAX_CLIENTS; scanned++)
+    {
+        struct client *client = g_server->clients[next_slot];
+        next_slot = (next_slot + 1) % MAX_CLIENTS;
+
+        if (client != NULL && client->last_activity < cutoff && !client->write_pending)
+        {
+            info_log("Client %s:%d idle for more than %u s, disconnecting", client->ip, client->port, idle_timeout);
+            destroy_client(client);
+            expired++;
+        }
+
+        if (scanned % 1024 == 1023 && now_ns() - start >= budget_ns)
+        {
+            break; // Continue from `next_slot` on the next run.
+        }
+    }
+    return expired;
+}
+
+/**
+ * @brief Work the event loop does between event batches (see tasks.h).
+ */
+static struct task background_tasks[] = {
+    {.name = "idle-timeout", .priority = TASK_URGENT, .interval_ms = 1000, .budget_ns = 200000,
+     .run = expire_idle_clients},
+    {.name = "loader", .priority = TASK_URGENT, .interval_ms = 100, .budget_ns = 200000,
+     .pending = loader_pending, .run = loader_cycle},
+    {.name = "vlog", .priority = TASK_NORMAL, .interval_ms = 1000, .budget_ns = VLOG_BUDGET_NS,
+     .pending = vlog_pending, .run = vlog_cycle},
+    {.name = "defrag", .priority = TASK_IDLE, .budget_ns = DEFRAG_BUDGET_NS, .pending = defrag_pending,
+     .run = defrag_cycle},
+};
+
 /**
  * Main event loop
  * Uses epoll to handle multiple clients efficiently
@@ -1012,7 +2773,10 @@ void main_loop(void)
         // Wait for events on the epoll file descriptor.
         // It waits up to 1 second (1000 ms) for any file descriptor in the epoll interest list to become ready.
         // This timeout prevents the loop from blocking indefinitely, allowing periodic tasks to be performed.
-        int nfds = epoll_wait(g_server->epoll_fd, events, MAX_EVENTS, 1000);
+        // Background tasks are woken more precisely by their own timer (see tasks.c), and
+        // suspended commands (see coro.h) and queued resumes must not wait at all.
+        int nfds =
+            epoll_wait(g_server->epoll_fd, events, MAX_EVENTS, (coro_active() || resume_head != NULL) ? 0 : 1000);
 
         if (nfds == -1)
         {
@@ -1035,6 +2799,21 @@ void main_loop(void)
                 // New connection event: Handle incoming client connection.
                 handle_new_connection();
             }
+            else if (events[i].data.fd == workers_event_fd())
+            {
+                // Workers finished jobs: send their replies.
+                workers_complete();
+            }
+            else if (events[i].data.fd == loader_fd())
+            {
+                // Backing-store loader: requests went out or replies came in.
+                loader_event(events[i].events);
+            }
+            else if (events[i].data.fd == tasks_timer_fd())
+            {
+                // Scheduler tick: the tasks run once the rest of this batch is served.
+                tasks_tick();
+            }
             else
             {
                 // This is a client-specific event. Retrieve the client structure from event data.
@@ -1081,10 +2860,12 @@ void main_loop(void)
             }
         }
 
-        // TODO: Add periodic maintenance tasks here
-        // - Check for client timeouts (e.g., based on client->last_activity).
-        // - More sophisticated database cleanup if needed (e.g., periodic tree optimization).
-        // - Update server statistics.
+        // Between event batches: the clients whose commands completed during the batch,
+        // one step for every suspended command, then the due background tasks (timeouts,
+        // defrag) get their slices.
+        resume_clients();
+        coro_run();
+        tasks_run();
     }
 
     info_log("Main event loop exited");
@@ -1100,6 +2881,8 @@ void cleanup_server(void)
 
     info_log("Cleaning up server resources...");
 
+    workers_shutdown(); // Let jobs finish before the tree and the clients go away.
+
     // Free the entire in-memory database tree.
     info_log("Freeing MemoDB in-memory tree...");
     free_tree(&root); // Call the tree cleanup function from tree.c.
@@ -1113,6 +2896,10 @@ void cleanup_server(void)
             destroy_client(g_server->clients[i]); // Calls destroy_client for each active client.
         }
     }
+    loader_shutdown(); // After the clients: they may still be parked on loads.
+    vlog_shutdown();   // After the tree: freeing cold leaves releases their records.
+    lsm_shutdown();    // The active memtable stays in its WAL, replayed at the next start.
+    table_shutdown();  // Unmaps the attached tables.
 
     // Close the listening socket if it's open.
     if (g_server->listen_fd >= 0)
@@ -1120,6 +2907,8 @@ void cleanup_server(void)
         close(g_server->listen_fd);
     }
 
+    tasks_shutdown(); // Close the scheduler timer before the epoll instance.
+
     // Close the epoll file descriptor if it's open.
     if (g_server->epoll_fd >= 0)
     {
@@ -1133,29 +2922,186 @@ void cleanup_server(void)
 }
 
 /**
- * Main entry point of the MemoDB server application.
+ * @brief Parses command-line arguments: an optional port followed or preceded by options.
+ *
+ * Usage: memodb_server [port] [--compress-min <bytes>] [--dedup-min <bytes>]
+ *                      [--arena huge|thp|malloc] [--numa-node <id>|auto|off]
+ *                      [--idle-timeout <seconds>] [--dump-dir <directory>]
+ *                      [--loader <unix-socket>] [--loader-ttl <seconds>]
+ *                      [--vlog-dir <directory>] [--vlog-cold <seconds>] [--vlog-promote on|off]
+ *                      [--engine memory|lsm] [--lsm-dir <directory>] [--lsm-sync on|off]
+ *
+ * @param argc Argument count from main().
+ * @param argv Argument vector from main().
+ * @param port Receives the port to listen on.
+ * @return 0 on success, -1 on an invalid argument.
  */
-int main(int argc, const char *argv[])
+static int parse_options(int argc, const char *argv[], uint16_t *port, int *numa_node, bool *use_lsm)
 {
-    uint16_t port; // Variable to store the server port.
+    const char *port_arg = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--compress-min") == 0 && i + 1 < argc)
+        {
+            // Compression threshold in bytes; 0 turns value compression off.
+            value_config.compress_min = (uint16_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dedup-min") == 0 && i + 1 < argc)
+        {
+            // Deduplication threshold in bytes; 0 (the default) turns deduplication off.
+            value_config.dedup_min = (uint16_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc)
+        {
+            // Disconnect clients silent for this many seconds; 0 (the default) never does.
+            idle_timeout = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dump-dir") == 0 && i + 1 < argc)
+        {
+            // Directory DUMP writes its files to (the working directory by default).
+            admin_dump_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--loader") == 0 && i + 1 < argc)
+        {
+            // Helper process to load missing keys from (read-through mode; off by default).
+            loader_socket = argv[++i];
+        }
+        else if (strcmp(argv[i], "--loader-ttl") == 0 && i + 1 < argc)
+        {
+            // Seconds a loaded key stays before it is loaded again; 0 (the default) keeps it.
+            loader_ttl = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--vlog-dir") == 0 && i + 1 < argc)
+        {
+            // Directory for the value log cold values move to (tiering is off by default).
+            vlog_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--vlog-cold") == 0 && i + 1 < argc)
+        {
+            // Seconds without a lookup after which a value moves to the log.
+            vlog_cold = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--vlog-promote") == 0 && i + 1 < argc)
+        {
+            // Whether a GET brings a cold value back into memory (on by default).
+            vlog_promote = strcmp(argv[++i], "off") != 0;
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+        {
+            // Storage engine: the in-memory tree (default) or the durable lsm engine.
+            i++;
+            if (strcmp(argv[i], "memory") != 0 && strcmp(argv[i], "lsm") != 0)
+            {
+                error_log("Invalid engine: %s (expected memory or lsm)", argv[i]);
+                return -1;
+            }
+            *use_lsm = strcmp(argv[i], "lsm") == 0;
+        }
+        else if (strcmp(argv[i], "--lsm-dir") == 0 && i + 1 < argc)
+        {
+            // Data directory of the lsm engine (LSM_DEFAULT_DIR by default).
+            lsm_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--lsm-sync") == 0 && i + 1 < argc)
+        {
+            // Whether every write is fdatasync'ed before it is acknowledged (off by default).
+            lsm_sync = strcmp(argv[++i], "on") == 0;
+        }
+        else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc)
+        {
+            // Backing for tree structures and values: huge pages (default), THP only, or malloc.
+            if (arena_set_mode(argv[++i]) != 0)
+            {
+                error_log("Invalid arena mode: %s (expected huge, thp or malloc)", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--numa-node") == 0 && i + 1 < argc)
+        {
+            // Node to pin the event loop (and its memory) to; "auto" keeps the starting node.
+            i++;
+            if (strcmp(argv[i], "auto") == 0)
+            {
+                *numa_node = NUMA_NODE_AUTO;
+            }
+            else if (strcmp(argv[i], "off") == 0)
+            {
+                *numa_node = NUMA_NODE_OFF;
+            }
+            else
+            {
+                *numa_node = atoi(argv[i]);
+            }
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            error_log("Unknown or incomplete option: %s", argv[i]);
+            return -1;
+        }
+        else if (port_arg == NULL)
+        {
+            port_arg = argv[i];
+        }
+        else
+        {
+            error_log("Unexpected argument: %s", argv[i]);
+            return -1;
+        }
+    }
 
     // Parse command line arguments for the port number.
-    if (argc < 2)
+    if (port_arg == NULL)
     {
         // If no port is provided, use the default from configuration.
-        port = (uint16_t)atoi(PORT); // Convert the string PORT to an integer.
-        info_log("Using default port: %d", port);
+        *port = (uint16_t)atoi(PORT); // Convert the string PORT to an integer.
+        info_log("Using default port: %d", *port);
     }
     else
     {
         // Use the port number provided as a command-line argument.
-        port = (uint16_t)atoi(argv[1]);
-        if (port == 0) // atoi returns 0 if the string is not a valid number.
+        *port = (uint16_t)atoi(port_arg);
+        if (*port == 0) // atoi returns 0 if the string is not a valid number.
         {
-            error_log("Invalid port number: %s", argv[1]);
-            exit(EXIT_FAILURE); // Exit if the port is invalid.
+            error_log("Invalid port number: %s", port_arg);
+            return -1;
         }
-        info_log("Using port from command line: %d", port);
+        info_log("Using port from command line: %d", *port);
+    }
+
+    info_log("Value compression threshold: %u bytes%s", value_config.compress_min,
+             value_config.compress_min ? "" : " (disabled)");
+    info_log("Value deduplication threshold: %u bytes%s", value_config.dedup_min,
+             value_config.dedup_min ? "" : " (disabled)");
+    info_log("Arena mode: %s", arena_mode_name());
+    if (loader_socket != NULL)
+    {
+        info_log("Read-through loader: %s, loaded keys expire after %u s%s", loader_socket, loader_ttl,
+                 loader_ttl ? "" : " (never)");
+    }
+    return 0;
+}
+
+/**
+ * Main entry point of the MemoDB server application.
+ */
+int main(int argc, const char *argv[])
+{
+    uint16_t port;                  // Variable to store the server port.
+    int numa_node = NUMA_NODE_AUTO; // NUMA node for the event loop.
+    bool use_lsm = false;           // --engine lsm
+
+    if (parse_options(argc, argv, &port, &numa_node, &use_lsm) == -1)
+    {
+        exit(EXIT_FAILURE); // Exit if the arguments are invalid.
+    }
+
+    hash_init(); // Seed the index hashes before anything is inserted.
+
+    // Pin the event loop before anything is allocated, so arenas land on its node.
+    if (numa_init(numa_node) == -1)
+    {
+        exit(EXIT_FAILURE);
     }
 
     // Allocate memory for the global server context structure.
@@ -1201,6 +3147,26 @@ int main(int argc, const char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    // Background work runs in slices between event batches, woken by its own timer.
+    tasks_init(g_server->epoll_fd); // Without a timer the tasks still run on the loop timeout.
+    for (size_t i = 0; i < sizeof(background_tasks) / sizeof(background_tasks[0]); i++)
+    {
+        tasks_register(&background_tasks[i]);
+    }
+
+    // Heavyweight commands (DUMP, MEMORY) run on worker threads; without them they are refused.
+    workers_init(g_server->epoll_fd);
+
+    // Cold values move to the value log if --vlog-dir is set (see vlog.h).
+    vlog_init();
+
+    // With --engine lsm, SET/GET/DEL go to the durable engine (see lsm.h).
+    if (use_lsm && lsm_init() != 0)
+    {
+        cleanup_server();
+        exit(EXIT_FAILURE);
+    }
+
     // Install signal handlers for graceful shutdown (SIGINT, SIGTERM) and ignore broken pipes (SIGPIPE).
     signal(SIGINT, shutdown_handler);
     signal(SIGTERM, shutdown_handler);
@@ -1213,10 +3179,10 @@ int main(int argc, const char *argv[])
     // Initialize the Root node of the in-memory database tree.
     // The `root` variable is global (extern in tree.h, defined in tree.c).
     // Access its `node` member directly to initialize it.
-    root.node.north = NULL;  // The root node has no parent.
-    root.node.west = NULL;   // The root node initially has no child nodes.
-    root.node.east = NULL;   // The root node initially has no leaves.
-    root.node.tag = TagRoot; // Set the tag to identify it as the root node.
+    root.node.north = NULL;       // The root node has no parent.
+    root.node.first_child = NULL; // The root node initially has no child nodes.
+    root.node.east = NULL;        // The root node initially has no leaves.
+    root.node.tag = TagRoot;      // Set the tag to identify it as the root node.
     // Set the root's path. "root" serves as an identifier for the base of the tree.
     strncpy((char *)root.node.path, "root", sizeof(root.node.path) - 1);
     root.node.path[sizeof(root.node.path) - 1] = '\0'; // Ensure null-termination.
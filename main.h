@@ -25,6 +25,12 @@
 // Event-driven I/O (Linux epoll)
 #include <sys/epoll.h> // For epoll functionality
 
+#include "reply.h"   // Growable buffer for multi-line replies
+#include "glob.h"    // Resumable GETGLOB walks
+#include "path.h"    // Parsed paths with precomputed hashes
+#include "coro.h"    // Commands that run a step at a time
+#include "workers.h" // Worker threads for heavyweight commands
+
 // Configuration constants
 #define HOST "127.0.0.1"  // Localhost IP address
 #define PORT "12049"      // Default port number as string
@@ -33,16 +39,21 @@
 #define BUFFER_SIZE 4096  // Buffer size for client data
 #define BACKLOG 128       // Listen backlog queue size
 
+#define MAX_WRITE_BUFFER (1024 * 1024) // Maximum bytes queued for one client (multi-key replies)
+
 #define NoError 0 // Success return code
 
 // --- NEW ADDITIONS FOR COMMAND PARSING AND DB INTERACTION ---
 #define MAX_KEY_LEN 128      // Maximum length for a database key (matching Leaf key size)
 #define MAX_VALUE_LEN 1024   // Maximum length for a database value
 #define MAX_FILENAME_LEN 256 // Maximum length for a 'file' (database) name (matching Node path size)
+#define LS_DEFAULT_COUNT 100 // Children listed per LS page unless the client asks otherwise
+#define LS_MAX_COUNT 1000    // Largest LS page (bounds the work done per command)
+#define MGETX_MAX_PAIRS 1024 // Most <file> <key> pairs one MGETX may ask for
 
 /**
  * @brief Represents a parsed client command.
- * This structure holds the components of a command like GET, SET, DEL.
+ * This structure holds the components of a command like GET, SET, DEL, MGET, MGETX, RENAME, CLONE, KEYS, DROP, LS, GETGLOB.
  */
 typedef struct
 {
@@ -50,14 +61,33 @@ typedef struct
     char file[MAX_FILENAME_LEN]; // Stores the 'file' (database name)
     char key[MAX_KEY_LEN];       // Stores the key for GET/SET/DEL
     char value[MAX_VALUE_LEN];   // Stores the value for SET
+    char args[BUFFER_SIZE];      // Remaining arguments (the keys of MGET, the pairs of MGETX)
+    uint64_t cursor;             // Scan cursor for LS and GETGLOB (0 starts a new listing)
+    uint32_t count;              // Page size for LS
+    path_t path;                 // `file` parsed once, with segment and prefix hashes (not for GETGLOB)
+    path_t dest;                 // Target path of RENAME, CLONE and MOVEKEY
+    char to[MAX_FILENAME_LEN];   // The target as the client wrote it (for messages)
 } parsed_command_t;
 
 // Function prototypes for command parsing and database operations
 // (These functions are implemented in main.c and interact with the tree from tree.c)
 bool parse_command(const char *command_str, parsed_command_t *parsed_cmd);
-int db_set(const char *filename, const char *key, const char *value);
-char *db_get(const char *filename, const char *key);
-int db_del(const char *filename, const char *key);
+int db_set(const path_t *path, const char *key, const char *value);
+char *db_get(const path_t *path, const char *key);
+char *db_get_stored(const path_t *path, const char *key, uint16_t *size, uint16_t *stored_size,
+                    bool *compressed);
+int db_del(const path_t *path, const char *key);
+int db_mget(const path_t *path, char *keys, struct reply *out);
+int db_mgetx(char *pairs, struct reply *out);
+int db_rename(const path_t *from, const path_t *to);
+int db_clone(const path_t *from, const path_t *to, uint64_t *nodes, uint64_t *keys);
+int db_movekey(const path_t *from, const path_t *to, const char *key);
+int db_keys(struct client *client, const path_t *path);
+int db_drop(struct client *client, const path_t *path);
+int db_attach(const path_t *path, const char *file, uint64_t *keys);
+int db_ls(const path_t *path, uint64_t cursor, uint32_t count, struct reply *out, uint64_t *next_cursor);
+int db_getglob(struct glob_walk **walk, const char *pattern, const char *key, uint64_t cursor, struct reply *out,
+               uint64_t *next_cursor);
 
 // Client connection states
 typedef enum
@@ -77,11 +107,20 @@ struct client
     client_state_t state;           // Current client state
     char read_buffer[BUFFER_SIZE];  // Buffer for incoming data
     size_t read_pos;                // Current position in read buffer
-    char write_buffer[BUFFER_SIZE]; // Buffer for outgoing data
+    char *write_buffer;             // Buffer for outgoing data (grows up to MAX_WRITE_BUFFER)
+    size_t write_cap;               // Allocated size of write_buffer
     size_t write_len;               // Length of data to write
     size_t write_pos;               // Current position in write buffer
     time_t last_activity;           // Last activity timestamp (for timeouts)
     bool write_pending;             // True if we have data to write
+    bool compressed_replies;        // True if the client accepts compressed GET replies (OKZ)
+    struct glob_walk *glob;         // GETGLOB walk in progress (NULL until the first GETGLOB)
+    struct coro *coro;              // Command suspended mid-way (NULL if none); later input waits for it
+    struct job *job;                // Command running on a worker (NULL if none); later input waits for it
+    struct load *load;              // GET waiting for the backing store (NULL if none, see loader.h); later input waits for it
+    struct client *load_next;       // Next client waiting on the same load
+    struct client *resume_next;     // Next client in the resume queue (see resume_client_later)
+    bool resume_queued;             // True while the client is in that queue
 };
 
 // Server context structure
@@ -107,9 +146,14 @@ struct client *create_client(int fd, struct sockaddr_in *addr);
 void destroy_client(struct client *client);
 int handle_new_connection(void);
 int handle_client_read(struct client *client);
+void resume_client(struct client *client);
+void resume_client_later(struct client *client);
+void resume_clients(void);
 int handle_client_write(struct client *client);
 void process_client_command(struct client *client, const char *command);
 void send_to_client(struct client *client, const char *message);
+void send_bytes_to_client(struct client *client, const char *message, size_t msg_len);
+bool send_get_reply(struct client *client, const path_t *path, const char *file, const char *key, bool reply_miss);
 void cleanup_server(void);
 
 // Error logging macros (no changes needed for these, they are fine)
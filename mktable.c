@@ -0,0 +1,150 @@
+/* mktable.c - Offline builder of the immutable tables served by ATTACH (see table.h) */
+#include "table.h" // table_write, struct table_item
+#include "main.h"  // MAX_KEY_LEN, MAX_VALUE_LEN
+
+/**
+ * @brief A line of the input: the key, the value and where it came from.
+ */
+struct line
+{
+    struct table_item item; // Key and value (pointing into `text`)
+    char *text;             // The line as read
+    size_t no;              // Line number, so the last of several values for a key wins
+};
+
+static int line_cmp(const void *a, const void *b)
+{
+    const struct line *x = (const struct line *)a, *y = (const struct line *)b;
+    size_t n = x->item.klen < y->item.klen ? x->item.klen : y->item.klen;
+    int c = memcmp(x->item.key, y->item.key, n);
+    if (c == 0)
+    {
+        c = (x->item.klen > y->item.klen) - (x->item.klen < y->item.klen);
+    }
+    if (c == 0)
+    {
+        c = (x->no > y->no) - (x->no < y->no);
+    }
+    return c;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: memodb_mktable [--phf] <input|-> <table-file>\n"
+                    "  Reads '<key> <value>' lines (as for SET; a later line wins over an earlier one\n"
+                    "  with the same key) and writes a table for 'ATTACH <file> <table-file>'.\n"
+                    "  --phf adds a perfect hash: one probe per GET instead of a binary search.\n");
+}
+
+int main(int argc, const char *argv[])
+{
+    bool phf = (argc == 4 && strcmp(argv[1], "--phf") == 0);
+    if (argc != 3 + phf)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    const char *input = argv[1 + phf], *output = argv[2 + phf];
+    FILE *in = (strcmp(input, "-") == 0) ? stdin : fopen(input, "r");
+    if (in == NULL)
+    {
+        fprintf(stderr, "memodb_mktable: %s: %s\n", input, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    struct line *lines = NULL;
+    size_t n = 0, cap = 0, no = 0;
+    char *text = NULL;
+    size_t text_cap = 0;
+    ssize_t len;
+    while ((len = getline(&text, &text_cap, in)) >= 0)
+    {
+        no++;
+        while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+        {
+            text[--len] = '\0';
+        }
+        if (len == 0)
+        {
+            continue; // Blank lines are allowed.
+        }
+        char *space = memchr(text, ' ', (size_t)len);
+        size_t klen = space ? (size_t)(space - text) : 0;
+        size_t vlen = space ? (size_t)(text + len - space - 1) : 0;
+        if (space == NULL || klen == 0 || vlen == 0 || klen >= MAX_KEY_LEN || vlen >= MAX_VALUE_LEN ||
+            strlen(text) != (size_t)len)
+        {
+            fprintf(stderr, "memodb_mktable: %s:%zu: expected '<key> <value>' (key < %d bytes, value < %d bytes)\n",
+                    input, no, MAX_KEY_LEN, MAX_VALUE_LEN);
+            return EXIT_FAILURE;
+        }
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+            lines = (struct line *)realloc(lines, cap * sizeof(*lines));
+            if (lines == NULL)
+            {
+                fprintf(stderr, "memodb_mktable: out of memory\n");
+                return EXIT_FAILURE;
+            }
+        }
+        lines[n].text = text;
+        lines[n].no = no;
+        lines[n].item.key = text;
+        lines[n].item.klen = (uint8_t)klen;
+        lines[n].item.value = space + 1;
+        lines[n].item.vlen = (uint16_t)vlen;
+        n++;
+        text = NULL; // The line is kept; getline allocates the next one.
+        text_cap = 0;
+    }
+    if (ferror(in))
+    {
+        fprintf(stderr, "memodb_mktable: %s: %s\n", input, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // Sort by key, then keep only the last line of each key.
+    if (n > 0)
+    {
+        qsort(lines, n, sizeof(*lines), line_cmp);
+    }
+    struct table_item *items = (struct table_item *)malloc((n + 1) * sizeof(*items));
+    if (items == NULL)
+    {
+        fprintf(stderr, "memodb_mktable: out of memory\n");
+        return EXIT_FAILURE;
+    }
+    size_t nitems = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i + 1 < n && lines[i + 1].item.klen == lines[i].item.klen &&
+            memcmp(lines[i + 1].item.key, lines[i].item.key, lines[i].item.klen) == 0)
+        {
+            continue;
+        }
+        items[nitems++] = lines[i].item;
+    }
+
+    if (table_write(output, items, nitems, phf) != 0)
+    {
+        fprintf(stderr, "memodb_mktable: %s: %s%s\n", output, strerror(errno),
+                errno == EAGAIN ? " (no perfect hash found; try without --phf)" : "");
+        return EXIT_FAILURE;
+    }
+    printf("memodb_mktable: wrote %zu keys to %s (%zu duplicate lines dropped%s)\n", nitems, output, n - nitems,
+           phf ? ", with a perfect hash" : "");
+
+    for (size_t i = 0; i < n; i++)
+    {
+        free(lines[i].text);
+    }
+    free(lines);
+    free(items);
+    free(text);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    return EXIT_SUCCESS;
+}
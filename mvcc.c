@@ -0,0 +1,342 @@
+/* mvcc.c - Multi-version values and snapshot reads */
+#include "mvcc.h"  // Own header for prototypes
+#include "value.h" // value_release
+#include "arena.h" // arena_alloc, arena_free
+
+#include <stdio.h> // snprintf
+
+/**
+ * @brief MVCC bookkeeping. Open snapshots are few and short-lived, so a plain array
+ * (scanned linearly) is the right size of data structure for them.
+ */
+static struct
+{
+    uint64_t commit_seq;   // Sequence number of the last write
+    uint64_t *snapshots;   // Open snapshots (unsorted, duplicates allowed)
+    size_t nsnapshots;     // Number of open snapshots
+    size_t snapshots_cap;  // Capacity of `snapshots`
+    Leaf **gc;             // Leaves with old versions or tombstones (LeafInGc)
+    size_t ngc;            // Number of leaves in `gc`
+    size_t gc_cap;         // Capacity of `gc`
+    uint64_t versions;     // Old versions currently kept
+    uint64_t tombstones;   // Tombstones currently kept
+    uint64_t collected;    // Versions and tombstones freed so far
+} mvcc;
+
+/**
+ * @brief Returns true if some open snapshot `s` satisfies lo <= s < hi, i.e. would
+ * see a version committed at `lo` that was superseded at `hi`.
+ */
+static bool snapshot_in(uint64_t lo, uint64_t hi)
+{
+    for (size_t i = 0; i < mvcc.nsnapshots; i++)
+    {
+        if (mvcc.snapshots[i] >= lo && mvcc.snapshots[i] < hi)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Frees one old version (a detached Leaf copy) and its value.
+ */
+static void free_version(Leaf *version)
+{
+    value_release(version);
+    arena_free(version, sizeof(struct s_leaf));
+    mvcc.versions--;
+    mvcc.collected++;
+}
+
+/**
+ * @brief Drops the old versions of a leaf that no open snapshot can see any more.
+ * A version is visible to snapshot `s` iff its seq <= s < seq of the next newer version.
+ */
+static void trim(Leaf *leaf)
+{
+    uint64_t newer = leaf->seq;
+    Leaf **link = &leaf->older;
+
+    while (*link != NULL)
+    {
+        Leaf *v = *link;
+        uint64_t upper = newer;
+        newer = v->seq;
+        if (snapshot_in(v->seq, upper))
+        {
+            link = &v->older; // Still needed: keep it.
+        }
+        else
+        {
+            *link = v->older;
+            free_version(v);
+        }
+    }
+}
+
+/**
+ * @brief Allocates the sequence number for a new write.
+ */
+uint64_t mvcc_begin_write(void)
+{
+    return ++mvcc.commit_seq;
+}
+
+/**
+ * @brief Opens a snapshot of the current committed state.
+ * @return The snapshot sequence, or MVCC_LATEST if it couldn't be registered
+ * (reads then simply see the latest state).
+ */
+uint64_t mvcc_snapshot_open(void)
+{
+    if (mvcc.nsnapshots == mvcc.snapshots_cap)
+    {
+        size_t cap = mvcc.snapshots_cap ? mvcc.snapshots_cap * 2 : 16;
+        uint64_t *snapshots = (uint64_t *)realloc(mvcc.snapshots, cap * sizeof(uint64_t));
+        if (snapshots == NULL)
+        {
+            return MVCC_LATEST;
+        }
+        mvcc.snapshots = snapshots;
+        mvcc.snapshots_cap = cap;
+    }
+    mvcc.snapshots[mvcc.nsnapshots++] = mvcc.commit_seq;
+    return mvcc.commit_seq;
+}
+
+/**
+ * @brief Closes a snapshot and garbage-collects versions nobody needs any more.
+ * @param snapshot The value returned by mvcc_snapshot_open.
+ */
+void mvcc_snapshot_close(uint64_t snapshot)
+{
+    if (snapshot == MVCC_LATEST)
+    {
+        return;
+    }
+    for (size_t i = 0; i < mvcc.nsnapshots; i++)
+    {
+        if (mvcc.snapshots[i] == snapshot)
+        {
+            mvcc.snapshots[i] = mvcc.snapshots[--mvcc.nsnapshots];
+            break;
+        }
+    }
+    mvcc_collect();
+}
+
+/**
+ * @brief Adds a leaf to the GC list (idempotent).
+ */
+void mvcc_track(Leaf *leaf)
+{
+    if (leaf->flags & LeafInGc)
+    {
+        return;
+    }
+    if (mvcc.ngc == mvcc.gc_cap)
+    {
+        size_t cap = mvcc.gc_cap ? mvcc.gc_cap * 2 : 64;
+        Leaf **gc = (Leaf **)realloc(mvcc.gc, cap * sizeof(Leaf *));
+        if (gc == NULL)
+        {
+            return; // Versions are then collected when the leaf is next written or freed.
+        }
+        mvcc.gc = gc;
+        mvcc.gc_cap = cap;
+    }
+    leaf->gc_slot = (uint32_t)mvcc.ngc;
+    mvcc.gc[mvcc.ngc++] = leaf;
+    leaf->flags |= LeafInGc;
+}
+
+/**
+ * @brief Drops all MVCC state of a leaf that is about to be freed:
+ * its old versions and its GC-list entry.
+ */
+void mvcc_forget(Leaf *leaf)
+{
+    while (leaf->older != NULL)
+    {
+        Leaf *v = leaf->older;
+        leaf->older = v->older;
+        free_version(v);
+    }
+
+    if (leaf->flags & LeafDeleted)
+    {
+        mvcc.tombstones--;
+        mvcc.collected++;
+        leaf->flags &= ~LeafDeleted;
+    }
+
+    if (leaf->flags & LeafInGc)
+    {
+        Leaf *last = mvcc.gc[--mvcc.ngc];
+        mvcc.gc[leaf->gc_slot] = last;
+        last->gc_slot = leaf->gc_slot;
+        leaf->flags &= ~LeafInGc;
+    }
+}
+
+/**
+ * @brief Keeps the current value of a leaf for open snapshots before it is overwritten.
+ * If some snapshot can see the current value, the value (pointer, sizes and flags) moves
+ * onto the leaf's `older` chain and the leaf is left without a value; otherwise nothing
+ * happens and the caller replaces the value in place as usual.
+ *
+ * @param leaf The leaf about to be written.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int mvcc_preserve(Leaf *leaf)
+{
+    trim(leaf); // Opportunistically drop versions that are no longer needed.
+
+    if (!snapshot_in(leaf->seq, UINT64_MAX))
+    {
+        if (leaf->older == NULL && (leaf->flags & LeafInGc) && !(leaf->flags & LeafDeleted))
+        {
+            mvcc_forget(leaf);
+        }
+        return 0;
+    }
+
+    Leaf *version = (Leaf *)arena_alloc(sizeof(struct s_leaf));
+    if (version == NULL)
+    {
+        return -1;
+    }
+    memcpy(version, leaf, sizeof(struct s_leaf));
+    version->flags &= ~LeafInGc;
+    version->east = NULL;
+    version->prev = NULL; // Versions hang off `older` only: never in the leaf list or key index.
+
+    leaf->older = version;
+    leaf->value = NULL; // Ownership of the value moved to the version.
+    leaf->size = 0;
+    leaf->stored_size = 0;
+    leaf->flags &= ~(LeafCompressed | LeafShared | LeafCold);
+
+    mvcc.versions++;
+    mvcc_track(leaf);
+    return 0;
+}
+
+/**
+ * @brief Returns true if deleting this leaf must leave a tombstone behind
+ * (because a snapshot can still see it, or it carries old versions).
+ */
+bool mvcc_must_tombstone(const Leaf *leaf)
+{
+    return leaf->older != NULL || snapshot_in(leaf->seq, UINT64_MAX);
+}
+
+/**
+ * @brief Returns true if an open snapshot can see a value committed at `seq`
+ * (for values kept outside leaves, which have no version chain, see packed.c).
+ */
+bool mvcc_in_use(uint64_t seq)
+{
+    return snapshot_in(seq, UINT64_MAX);
+}
+
+/**
+ * @brief Returns true if no leaf has old versions or is a tombstone (the GC list is empty).
+ */
+bool mvcc_idle(void)
+{
+    return mvcc.ngc == 0;
+}
+
+/**
+ * @brief Returns true if some snapshot is open. A suspended command (KEYS, see coro.h)
+ * holds leaf pointers for as long as its snapshot is open, so leaves must not move then.
+ */
+bool mvcc_snapshots_open(void)
+{
+    return mvcc.nsnapshots > 0;
+}
+
+/**
+ * @brief Turns a leaf into a tombstone committed at `seq`, keeping its value for snapshots.
+ * The leaf stays linked (latest reads skip it) until mvcc_collect() frees it.
+ *
+ * @return 0 on success, -1 on allocation failure (the leaf is then left untouched).
+ */
+int mvcc_tombstone(Leaf *leaf, uint64_t seq)
+{
+    if (mvcc_preserve(leaf) != 0)
+    {
+        return -1;
+    }
+    value_release(leaf); // No-op if the value moved onto the chain.
+    leaf->flags |= LeafDeleted;
+    leaf->seq = seq;
+    mvcc.tombstones++;
+    mvcc_track(leaf);
+    return 0;
+}
+
+/**
+ * @brief Resolves which version of a leaf a snapshot sees.
+ *
+ * @param leaf The leaf (as linked in the tree).
+ * @param snapshot A snapshot sequence, or MVCC_LATEST.
+ * @return The leaf or one of its old versions, or NULL if the key doesn't exist in that
+ * snapshot (created later, or deleted).
+ */
+Leaf *mvcc_visible(Leaf *leaf, uint64_t snapshot)
+{
+    for (Leaf *v = leaf; v != NULL; v = v->older)
+    {
+        if (snapshot == MVCC_LATEST || v->seq <= snapshot)
+        {
+            return (v->flags & LeafDeleted) ? NULL : v;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Garbage-collects old versions and tombstones that no open snapshot needs.
+ * Runs whenever a snapshot closes; cost is proportional to the GC list, not the tree.
+ */
+void mvcc_collect(void)
+{
+    // Walk backwards: removing entry i swaps in the last entry, which was already visited.
+    for (size_t i = mvcc.ngc; i-- > 0;)
+    {
+        Leaf *leaf = mvcc.gc[i];
+        trim(leaf);
+        if (leaf->older != NULL)
+        {
+            continue;
+        }
+
+        if (leaf->flags & LeafDeleted)
+        {
+            unlink_leaf((Node *)leaf->west, leaf); // Tombstone no longer needed by anyone.
+            free_leaf(leaf);
+        }
+        else
+        {
+            mvcc_forget(leaf);
+        }
+    }
+}
+
+/**
+ * @brief Formats MVCC counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int mvcc_stats(char *buf, size_t cap)
+{
+    return snprintf(buf, cap,
+                    "  MVCC: commit_seq=%llu snapshots=%zu versions=%llu tombstones=%llu gc_list=%zu "
+                    "collected=%llu\n",
+                    (unsigned long long)mvcc.commit_seq, mvcc.nsnapshots,
+                    (unsigned long long)mvcc.versions, (unsigned long long)mvcc.tombstones, mvcc.ngc,
+                    (unsigned long long)mvcc.collected);
+}
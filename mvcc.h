@@ -0,0 +1,36 @@
+/* mvcc.h - Multi-version values and snapshot reads */
+#ifndef MVCC_H
+#define MVCC_H
+
+#include "tree.h" // Leaf definition and flags
+
+#include <stddef.h> // size_t
+
+#define MVCC_LATEST UINT64_MAX // Snapshot value meaning "read the latest committed state"
+
+/*
+ * Every write (`db_set`, `db_del`) gets a commit sequence number. A reader that needs a
+ * consistent view over many keys opens a snapshot (the current sequence) and reads each
+ * leaf through mvcc_visible(). Writers never wait for readers: before overwriting or
+ * deleting a value that an open snapshot can still see, they move it onto the leaf's
+ * `older` chain (a detached leaf header takes over the value pointer; the bytes are
+ * never copied) or leave a tombstone behind.
+ * Versions and tombstones are garbage-collected as soon as no open snapshot needs them.
+ */
+
+uint64_t mvcc_begin_write(void);
+uint64_t mvcc_snapshot_open(void);
+void mvcc_snapshot_close(uint64_t snapshot);
+int mvcc_preserve(Leaf *leaf);
+bool mvcc_must_tombstone(const Leaf *leaf);
+bool mvcc_in_use(uint64_t seq);
+bool mvcc_idle(void);
+bool mvcc_snapshots_open(void);
+int mvcc_tombstone(Leaf *leaf, uint64_t seq);
+void mvcc_track(Leaf *leaf);
+void mvcc_forget(Leaf *leaf);
+Leaf *mvcc_visible(Leaf *leaf, uint64_t snapshot);
+void mvcc_collect(void);
+int mvcc_stats(char *buf, size_t cap);
+
+#endif /* MVCC_H */
@@ -0,0 +1,290 @@
+/* numa.c - NUMA topology discovery, thread pinning and node-local memory placement */
+#include "numa.h" // Own header for configuration and prototypes
+#include "main.h" // Logging macros
+
+#include <sched.h>       // sched_setaffinity, sched_getcpu, cpu_set_t
+#include <sys/syscall.h> // SYS_mbind
+
+#define NUMA_MPOL_PREFERRED 1 // MPOL_PREFERRED from <linux/mempolicy.h>
+
+/**
+ * @brief Topology and placement bookkeeping.
+ */
+static struct
+{
+    int nodes;                           // Online node count (1 when NUMA is unavailable)
+    int max_node;                        // Highest online node id
+    bool online[NUMA_MAX_NODES];         // Online nodes
+    cpu_set_t cpus[NUMA_MAX_NODES];      // CPUs of each node
+    size_t bound_bytes[NUMA_MAX_NODES];  // Arena memory bound to each node
+    bool active;                         // True when pinning/binding is in effect
+} numa = {.nodes = 1};
+
+// Node the calling thread is pinned to, -1 if unpinned.
+static _Thread_local int t_numa_node = -1;
+
+/**
+ * @brief Parses a sysfs list such as "0-3,8-11", calling `add` for every id.
+ * @return Number of ids found.
+ */
+static int parse_list(const char *list, void (*add)(int id, void *ctx), void *ctx)
+{
+    int count = 0;
+    const char *p = list;
+
+    while (*p && *p != '\n')
+    {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (end == p)
+        {
+            break; // Not a number: stop parsing.
+        }
+        if (*end == '-')
+        {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+        }
+        for (long id = lo; id <= hi; id++)
+        {
+            add((int)id, ctx);
+            count++;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+static void add_node(int id, void *ctx)
+{
+    (void)ctx;
+    if (id >= 0 && id < NUMA_MAX_NODES)
+    {
+        numa.online[id] = true;
+        if (id > numa.max_node)
+        {
+            numa.max_node = id;
+        }
+    }
+}
+
+static void add_cpu(int id, void *ctx)
+{
+    if (id >= 0 && id < CPU_SETSIZE)
+    {
+        CPU_SET(id, (cpu_set_t *)ctx);
+    }
+}
+
+/**
+ * @brief Reads a small sysfs file into `buf`.
+ * @return 0 on success, -1 if the file doesn't exist or is empty.
+ */
+static int read_sysfs(const char *path, char *buf, size_t cap)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return -1;
+    }
+    char *ok = fgets(buf, (int)cap, f);
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Returns the node owning a CPU, or 0 if unknown.
+ */
+static int node_of_cpu(int cpu)
+{
+    for (int n = 0; n <= numa.max_node; n++)
+    {
+        if (numa.online[n] && cpu >= 0 && CPU_ISSET(cpu, &numa.cpus[n]))
+        {
+            return n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Discovers the topology and pins the calling (event-loop) thread.
+ *
+ * @param requested_node A node id, NUMA_NODE_AUTO, or NUMA_NODE_OFF.
+ * @return 0 on success (including the single-node no-op), -1 on an invalid node.
+ */
+int numa_init(int requested_node)
+{
+    char buf[1024];
+
+    if (read_sysfs("/sys/devices/system/node/online", buf, sizeof(buf)) != 0 ||
+        (numa.nodes = parse_list(buf, add_node, NULL)) <= 0)
+    {
+        numa.nodes = 1; // No NUMA support in the kernel: behave as a single node.
+    }
+
+    for (int n = 0; n <= numa.max_node && numa.nodes > 1; n++)
+    {
+        char path[128];
+        CPU_ZERO(&numa.cpus[n]);
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+        if (numa.online[n] && read_sysfs(path, buf, sizeof(buf)) == 0)
+        {
+            parse_list(buf, add_cpu, &numa.cpus[n]);
+        }
+    }
+
+    if (numa.nodes <= 1 || requested_node == NUMA_NODE_OFF)
+    {
+        info_log("NUMA: %d node(s), placement %s", numa.nodes, numa.nodes <= 1 ? "not needed" : "disabled");
+        return 0;
+    }
+
+    int node = requested_node;
+    if (node == NUMA_NODE_AUTO)
+    {
+        node = node_of_cpu(sched_getcpu()); // Stay where the scheduler started us.
+    }
+    if (numa_pin_thread(node) != 0)
+    {
+        return -1;
+    }
+
+    numa.active = true;
+    info_log("NUMA: %d nodes, event loop pinned to node %d", numa.nodes, node);
+    return 0;
+}
+
+/**
+ * @brief Returns the number of online NUMA nodes (1 on non-NUMA machines).
+ */
+int numa_node_count(void)
+{
+    return numa.nodes;
+}
+
+/**
+ * @brief Pins the calling thread to the CPUs of a node. Worker threads call this at start-up
+ * so that the memory they first-touch or bind ends up on their own node.
+ *
+ * @param node The node id.
+ * @return 0 on success (a no-op on single-node machines), -1 on error.
+ */
+int numa_pin_thread(int node)
+{
+    if (numa.nodes <= 1)
+    {
+        return 0;
+    }
+    if (node < 0 || node >= NUMA_MAX_NODES || !numa.online[node])
+    {
+        error_log("NUMA: node %d is not online", node);
+        return -1;
+    }
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &numa.cpus[node]) != 0)
+    {
+        error_log("NUMA: sched_setaffinity to node %d failed: %s", node, strerror(errno));
+        return -1;
+    }
+    t_numa_node = node;
+    return 0;
+}
+
+/**
+ * @brief Returns the node the calling thread is pinned to, or -1 if it isn't pinned.
+ */
+int numa_thread_node(void)
+{
+    return t_numa_node;
+}
+
+/**
+ * @brief Prefers the calling thread's node for a freshly mapped, untouched range.
+ * This makes placement independent of which thread happens to touch a page first.
+ *
+ * @param addr Page-aligned start of the range.
+ * @param len Length of the range.
+ * @return The node the range was bound to, or -1 if no binding was applied.
+ */
+int numa_bind_local(void *addr, size_t len)
+{
+    int node = t_numa_node;
+    if (!numa.active || node < 0)
+    {
+        return -1;
+    }
+
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_mbind, addr, len, NUMA_MPOL_PREFERRED, &mask, (unsigned long)NUMA_MAX_NODES + 1, 0) != 0)
+    {
+        debug_log("NUMA: mbind to node %d failed: %s", node, strerror(errno));
+        return -1;
+    }
+    numa.bound_bytes[node] += len;
+    return node;
+}
+
+/**
+ * @brief Sums the process's resident memory per node from /proc/self/numa_maps.
+ * @param resident_kb Output array of NUMA_MAX_NODES counters (in kB).
+ */
+static void resident_per_node(unsigned long *resident_kb)
+{
+    FILE *f = fopen("/proc/self/numa_maps", "r");
+    char line[1024];
+
+    if (f == NULL)
+    {
+        return;
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned long page_kb = 4;
+        unsigned long pages[NUMA_MAX_NODES] = {0};
+        char *saveptr;
+
+        for (char *tok = strtok_r(line, " \n", &saveptr); tok; tok = strtok_r(NULL, " \n", &saveptr))
+        {
+            int node;
+            unsigned long count;
+            if (sscanf(tok, "N%d=%lu", &node, &count) == 2 && node >= 0 && node < NUMA_MAX_NODES)
+            {
+                pages[node] += count;
+            }
+            else if (strncmp(tok, "kernelpagesize_kB=", 18) == 0)
+            {
+                page_kb = strtoul(tok + 18, NULL, 10);
+            }
+        }
+        for (int n = 0; n < NUMA_MAX_NODES; n++)
+        {
+            resident_kb[n] += pages[n] * page_kb;
+        }
+    }
+    fclose(f);
+}
+
+/**
+ * @brief Formats per-node placement and memory for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int numa_stats(char *buf, size_t cap)
+{
+    unsigned long resident_kb[NUMA_MAX_NODES] = {0};
+    int len;
+
+    resident_per_node(resident_kb);
+    len = snprintf(buf, cap, "  NUMA: nodes=%d placement=%s loop_node=%d\n", numa.nodes,
+                   numa.active ? "on" : "off", t_numa_node);
+
+    for (int n = 0; n <= numa.max_node && len >= 0 && (size_t)len < cap; n++)
+    {
+        if (numa.online[n] || numa.nodes <= 1)
+        {
+            len += snprintf(buf + len, cap - len, "    node%d: resident=%lu kB arena_bound=%zu bytes\n", n,
+                            resident_kb[n], numa.bound_bytes[n]);
+        }
+    }
+    return len;
+}
@@ -0,0 +1,26 @@
+/* numa.h - NUMA topology discovery, thread pinning and node-local memory placement */
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stddef.h>  // size_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define NUMA_MAX_NODES 64 // Largest node id handled (fits one 64-bit nodemask word)
+#define NUMA_NODE_AUTO -1 // Pin to the node of the CPU the thread is running on
+#define NUMA_NODE_OFF -2  // Don't pin or bind at all
+
+/*
+ * Everything here talks to the kernel directly (sysfs, sched_setaffinity, mbind via
+ * syscall), so there is no dependency on libnuma. On a single-node machine all calls
+ * are no-ops and memory simply stays where first-touch puts it.
+ */
+
+int numa_init(int requested_node);
+int numa_node_count(void);
+int numa_pin_thread(int node);
+int numa_thread_node(void);
+int numa_bind_local(void *addr, size_t len);
+int numa_stats(char *buf, size_t cap);
+
+#endif /* NUMA_H */
@@ -0,0 +1,447 @@
+/* packed.c - Packed encoding of small files (contiguous key/value entries) */
+#include "packed.h" // Own header for the layout and prototypes
+#include "arena.h"  // arena_alloc, arena_free
+#include "hash.h"   // hash_bytes (fingerprints)
+#include "mvcc.h"   // mvcc_in_use, MVCC_LATEST
+
+#ifdef __SSE2__
+#include <emmintrin.h> // _mm_cmpeq_epi8, _mm_movemask_epi8
+#endif
+
+#define ENTRY_HEADER 11 // seq (8) + key length (1) + value length (2)
+
+_Static_assert(PACKED_MAX_KEYS == 16, "fingerprints are matched with one 16-byte compare");
+_Static_assert(PACKED_MAX_BYTES <= UINT16_MAX, "entry offsets are 16-bit");
+
+/**
+ * @brief Counters reported by the `stats` command.
+ */
+static struct
+{
+    uint64_t files;    // Files currently packed
+    uint64_t entries;  // Entries in packed files
+    uint64_t bytes;    // Bytes held by packed buffers (headers included)
+    uint64_t upgrades; // Files converted to leaves
+} stats;
+
+/**
+ * @brief Fingerprint of a key: the top byte of its hash, never 0 (0 marks unused slots).
+ */
+static inline uint8_t fingerprint(const char *key, size_t len)
+{
+    uint8_t fp = (uint8_t)(hash_bytes(key, len) >> 56);
+    return fp ? fp : 1;
+}
+
+static inline size_t alloc_size(const struct packed *p)
+{
+    return sizeof(struct packed) + p->cap;
+}
+
+static inline size_t entry_len(size_t klen, size_t vlen)
+{
+    return ENTRY_HEADER + klen + vlen + 1;
+}
+
+static inline uint64_t entry_seq(const uint8_t *e)
+{
+    uint64_t seq;
+    memcpy(&seq, e, sizeof(seq));
+    return seq;
+}
+
+static inline uint16_t entry_vlen(const uint8_t *e)
+{
+    uint16_t vlen;
+    memcpy(&vlen, e + 9, sizeof(vlen));
+    return vlen;
+}
+
+/**
+ * @brief Finds the slot of a key.
+ * All fingerprints are compared at once; only slots whose fingerprint matches have their
+ * key compared, so a lookup usually touches a single entry.
+ * @return The slot, or -1 if the key isn't there.
+ */
+static int find_slot(const struct packed *p, const char *key, size_t klen, uint8_t fp)
+{
+#ifdef __SSE2__
+    __m128i fps = _mm_loadu_si128((const __m128i *)p->fp);
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(fps, _mm_set1_epi8((char)fp)));
+#else
+    uint32_t mask = 0;
+    for (unsigned i = 0; i < PACKED_MAX_KEYS; i++)
+    {
+        mask |= (uint32_t)(p->fp[i] == fp) << i;
+    }
+#endif
+    mask &= (1u << p->count) - 1;
+
+    while (mask != 0)
+    {
+        int i = __builtin_ctz(mask);
+        const uint8_t *e = p->data + p->off[i];
+        if (e[8] == klen && memcmp(e + ENTRY_HEADER, key, klen) == 0)
+        {
+            return i;
+        }
+        mask &= mask - 1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Resizes entry `i` from `old_len` to `new_len` bytes, moving the entries after it
+ * (the caller makes sure the buffer is large enough).
+ */
+static void splice(struct packed *p, unsigned i, size_t old_len, size_t new_len)
+{
+    size_t end = p->off[i] + old_len;
+    memmove(p->data + p->off[i] + new_len, p->data + end, p->used - end);
+    for (unsigned j = i + 1; j < p->count; j++)
+    {
+        p->off[j] = (uint16_t)(p->off[j] + new_len - old_len);
+    }
+    p->used = (uint16_t)(p->used + new_len - old_len);
+}
+
+/**
+ * @brief Makes room for `used` bytes of entries, growing the buffer (or creating it) with
+ * a quarter of headroom. Small files are the point of this encoding, so the buffer grows
+ * in small steps rather than by doubling.
+ * @return 0 on success, -1 on allocation failure (the buffer is left as it was).
+ */
+static int reserve(Node *node, size_t used)
+{
+    struct packed *p = node->packed;
+
+    if (p != NULL && used <= p->cap)
+    {
+        return 0;
+    }
+    size_t cap = used + used / 4;
+    cap = (cap < PACKED_MIN_CAP) ? PACKED_MIN_CAP : (cap + PACKED_GROW_STEP - 1) & ~(size_t)(PACKED_GROW_STEP - 1);
+    if (cap > PACKED_MAX_BYTES)
+    {
+        cap = PACKED_MAX_BYTES;
+    }
+
+    struct packed *grown = (struct packed *)arena_alloc(sizeof(struct packed) + cap);
+    if (grown == NULL)
+    {
+        return -1;
+    }
+    if (p != NULL)
+    {
+        memcpy(grown, p, sizeof(struct packed) + p->used);
+        stats.bytes -= alloc_size(p);
+        arena_free(p, alloc_size(p));
+    }
+    else
+    {
+        memset(grown, 0, sizeof(struct packed));
+        stats.files++;
+    }
+    grown->cap = (uint16_t)cap;
+    stats.bytes += alloc_size(grown);
+    node->packed = grown;
+    return 0;
+}
+
+/**
+ * @brief Sets a key of a file, keeping the file packed when it is (or can start out) small.
+ * A file starts out packed when it has no leaves at all. It is converted to leaves when
+ * the entry count, entry bytes, key or value size would cross a threshold, or when an
+ * open snapshot can still see the value being replaced (packed entries keep no versions).
+ *
+ * @param node The file's Node.
+ * @param key The key.
+ * @param value The value bytes.
+ * @param size The value size.
+ * @param seq Commit sequence number of the write.
+ * @return 0 if the value was stored packed, 1 if the file uses leaves (it has just been
+ * converted if needed; the caller stores the value as a Leaf), -1 on allocation failure.
+ */
+int packed_set(Node *node, const char *key, const uint8_t *value, uint16_t size, uint64_t seq)
+{
+    struct packed *p = node->packed;
+    size_t klen = strlen(key);
+
+    if (p == NULL && node->east != NULL)
+    {
+        return 1; // Already uses leaves (or holds tombstones).
+    }
+    if (klen > PACKED_MAX_KEY || size > PACKED_MAX_VALUE)
+    {
+        goto upgrade;
+    }
+
+    uint8_t fp = fingerprint(key, klen);
+    int i = p ? find_slot(p, key, klen, fp) : -1;
+    size_t len = entry_len(klen, size);
+    size_t old_len = 0;
+
+    if (i >= 0)
+    {
+        const uint8_t *e = p->data + p->off[i];
+        if (mvcc_in_use(entry_seq(e)))
+        {
+            goto upgrade; // A snapshot still needs the current value.
+        }
+        old_len = entry_len(klen, entry_vlen(e));
+    }
+    else if (p != NULL && p->count == PACKED_MAX_KEYS)
+    {
+        goto upgrade;
+    }
+
+    size_t used = (p ? p->used : 0) - old_len + len;
+    if (used > PACKED_MAX_BYTES)
+    {
+        goto upgrade;
+    }
+    if (p == NULL)
+    {
+        hindex_free(&node->keys); // Left over from leaves that were all deleted.
+    }
+    if (reserve(node, used) != 0)
+    {
+        return -1;
+    }
+    p = node->packed;
+
+    if (i >= 0)
+    {
+        splice(p, (unsigned)i, old_len, len); // Replace in place, keeping the key order.
+    }
+    else
+    {
+        i = p->count++;
+        p->off[i] = p->used;
+        p->fp[i] = fp;
+        p->used = (uint16_t)(p->used + len);
+        node->nleaves++;
+        stats.entries++;
+    }
+
+    uint8_t *e = p->data + p->off[i];
+    memcpy(e, &seq, sizeof(seq));
+    e[8] = (uint8_t)klen;
+    memcpy(e + 9, &size, sizeof(size));
+    memcpy(e + ENTRY_HEADER, key, klen);
+    memcpy(e + ENTRY_HEADER + klen, value, size);
+    e[ENTRY_HEADER + klen + size] = '\0';
+    return 0;
+
+upgrade:
+    return packed_unpack(node) == 0 ? 1 : -1;
+}
+
+/**
+ * @brief Deletes a key of a packed file. The buffer is freed with the last entry.
+ * @return 0 if the key was deleted, 1 if the file uses leaves (it has just been converted
+ * if an open snapshot still sees the key; the caller deletes the Leaf), -1 if the key
+ * doesn't exist or on allocation failure.
+ */
+int packed_del(Node *node, const char *key)
+{
+    struct packed *p = node->packed;
+    size_t klen = strlen(key);
+
+    if (p == NULL)
+    {
+        return 1;
+    }
+    int i = klen <= PACKED_MAX_KEY ? find_slot(p, key, klen, fingerprint(key, klen)) : -1;
+    if (i < 0)
+    {
+        return -1;
+    }
+
+    const uint8_t *e = p->data + p->off[i];
+    if (mvcc_in_use(entry_seq(e)))
+    {
+        return packed_unpack(node) == 0 ? 1 : -1; // The snapshot needs a tombstone.
+    }
+
+    splice(p, (unsigned)i, entry_len(klen, entry_vlen(e)), 0);
+    p->count--;
+    memmove(&p->fp[i], &p->fp[i + 1], p->count - i);
+    memmove(&p->off[i], &p->off[i + 1], (p->count - i) * sizeof(p->off[0]));
+    p->fp[p->count] = 0;
+    node->nleaves--;
+    stats.entries--;
+
+    if (p->count == 0)
+    {
+        packed_free(node);
+    }
+    return 0;
+}
+
+/**
+ * @brief Fills a Leaf-shaped view of entry `i`, so readers (value_dup, snapshot checks)
+ * treat packed and Leaf values alike. Only key, value, sizes, flags, seq and west are
+ * meaningful in a view, and the value stays valid until the file is next written.
+ */
+static Leaf *fill_view(const Node *node, unsigned i, Leaf *view)
+{
+    const uint8_t *e = node->packed->data + node->packed->off[i];
+    uint8_t klen = e[8];
+    uint16_t vlen = entry_vlen(e);
+
+    view->west = (Tree *)node;
+    view->east = NULL;
+    view->prev = NULL;
+    memcpy(view->key, e + ENTRY_HEADER, klen);
+    view->key[klen] = '\0';
+    view->value = (int8_t *)(e + ENTRY_HEADER + klen);
+    view->size = (int16_t)vlen;
+    view->stored_size = (int16_t)vlen;
+    view->flags = 0;
+    view->tag = TagLeaf;
+    view->seq = entry_seq(e);
+    view->older = NULL;
+    return view;
+}
+
+/**
+ * @brief Finds the value of a key in a packed file as a snapshot sees it.
+ * Packed entries never have older versions (see packed_set), so the entry is either
+ * visible or the key didn't exist yet when the snapshot was taken.
+ *
+ * @param node The file's Node (which must be packed).
+ * @param key The key.
+ * @param snapshot A snapshot from mvcc_snapshot_open, or MVCC_LATEST.
+ * @param view Receives the entry (see fill_view).
+ * @return `view`, or NULL if the key isn't visible.
+ */
+Leaf *packed_find(const Node *node, const char *key, uint64_t snapshot, Leaf *view)
+{
+    size_t klen = strlen(key);
+    if (klen > PACKED_MAX_KEY)
+    {
+        return NULL;
+    }
+    int i = find_slot(node->packed, key, klen, fingerprint(key, klen));
+    if (i < 0)
+    {
+        return NULL;
+    }
+    fill_view(node, (unsigned)i, view);
+    return (snapshot == MVCC_LATEST || view->seq <= snapshot) ? view : NULL;
+}
+
+/**
+ * @brief Returns a view of the i-th entry of a packed file (in insertion order),
+ * or NULL past the last one.
+ */
+Leaf *packed_at(const Node *node, unsigned i, Leaf *view)
+{
+    if (node->packed == NULL || i >= node->packed->count)
+    {
+        return NULL;
+    }
+    return fill_view(node, i, view);
+}
+
+/**
+ * @brief Converts a packed file to one Leaf per key (keeping each key's commit sequence).
+ * @return 0 on success (or if the file isn't packed), -1 on allocation failure
+ * (the file is then left packed).
+ */
+int packed_unpack(Node *node)
+{
+    struct packed *p = node->packed;
+    uint32_t nleaves = node->nleaves;
+    Leaf view;
+
+    if (p == NULL)
+    {
+        return 0;
+    }
+
+    node->nleaves = 0; // create_leaf counts the leaves again.
+    for (unsigned i = 0; i < p->count; i++)
+    {
+        fill_view(node, i, &view);
+        Leaf *leaf = create_leaf((Tree *)node, (uint8_t *)view.key, (uint8_t *)view.value, (uint16_t)view.size);
+        if (leaf == NULL)
+        {
+            while (node->east != NULL) // Roll back to the packed file.
+            {
+                Leaf *l = node->east;
+                unlink_leaf(node, l);
+                free_leaf(l);
+            }
+            node->nleaves = nleaves;
+            return -1;
+        }
+        leaf->seq = view.seq;
+    }
+
+    stats.upgrades++;
+    packed_free(node);
+    return 0;
+}
+
+/**
+ * @brief Gives a file without keys a copy of another file's packed buffer (for CLONE),
+ * with every entry recommitted at `seq`. A packed buffer is small by construction, so it
+ * is copied whole rather than shared.
+ * @return 0 on success (or if `from` isn't packed), -1 on allocation failure.
+ */
+int packed_copy(Node *to, const Node *from, uint64_t seq)
+{
+    const struct packed *p = from->packed;
+    if (p == NULL)
+    {
+        return 0;
+    }
+
+    struct packed *copy = (struct packed *)arena_alloc(alloc_size(p));
+    if (copy == NULL)
+    {
+        return -1;
+    }
+    memcpy(copy, p, sizeof(struct packed) + p->used);
+    for (unsigned i = 0; i < copy->count; i++)
+    {
+        memcpy(copy->data + copy->off[i], &seq, sizeof(seq));
+    }
+
+    to->packed = copy;
+    to->nleaves = copy->count;
+    stats.files++;
+    stats.entries += copy->count;
+    stats.bytes += alloc_size(copy);
+    return 0;
+}
+
+/**
+ * @brief Frees a node's packed buffer (if any).
+ */
+void packed_free(Node *node)
+{
+    struct packed *p = node->packed;
+    if (p != NULL)
+    {
+        stats.files--;
+        stats.entries -= p->count;
+        stats.bytes -= alloc_size(p);
+        arena_free(p, alloc_size(p));
+        node->packed = NULL;
+    }
+}
+
+/**
+ * @brief Formats packed-file counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int packed_stats(char *buf, size_t cap)
+{
+    return snprintf(buf, cap, "  Packed: files=%llu entries=%llu bytes=%llu upgrades=%llu (limit %d keys, %d bytes)\n",
+                    (unsigned long long)stats.files, (unsigned long long)stats.entries,
+                    (unsigned long long)stats.bytes, (unsigned long long)stats.upgrades, PACKED_MAX_KEYS,
+                    PACKED_MAX_BYTES);
+}
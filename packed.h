@@ -0,0 +1,42 @@
+/* packed.h - Packed encoding of small files (contiguous key/value entries) */
+#ifndef PACKED_H
+#define PACKED_H
+
+#include "tree.h" // Node, Leaf
+
+#include <stddef.h> // size_t
+
+// Thresholds of the packed encoding (crossing any of them converts the file to leaves)
+#define PACKED_MAX_KEYS 16    // Entries per packed file (one SSE2 fingerprint compare)
+#define PACKED_MAX_BYTES 2048 // Entry bytes per packed file
+#define PACKED_MAX_VALUE 128  // Largest value kept packed (larger ones may be worth compressing)
+#define PACKED_MAX_KEY 127    // Longest key kept packed (as Leaf.key, minus the terminator)
+#define PACKED_MIN_CAP 64     // Initial entry capacity in bytes
+#define PACKED_GROW_STEP 32   // Capacities are rounded up to this (power of two)
+
+/**
+ * @brief A small file stored as one buffer instead of a Leaf (and value allocation) per key.
+ * Entries are laid out back to back as
+ *     [seq: 8][key_len: 1][value_len: 2][key][value]['\0']
+ * and found by comparing a one-byte fingerprint of every key at once, then the key itself.
+ */
+struct packed
+{
+    uint16_t cap;                   // Bytes available in `data`
+    uint16_t used;                  // Bytes of `data` in use
+    uint8_t count;                  // Number of entries
+    uint8_t fp[PACKED_MAX_KEYS];    // Key fingerprints (unused slots are 0, live ones never are)
+    uint16_t off[PACKED_MAX_KEYS];  // Offset of each entry in `data`
+    uint8_t data[];                 // The entries
+};
+
+int packed_set(Node *node, const char *key, const uint8_t *value, uint16_t size, uint64_t seq);
+int packed_del(Node *node, const char *key);
+Leaf *packed_find(const Node *node, const char *key, uint64_t snapshot, Leaf *view);
+Leaf *packed_at(const Node *node, unsigned i, Leaf *view);
+int packed_unpack(Node *node);
+int packed_copy(Node *to, const Node *from, uint64_t seq);
+void packed_free(Node *node);
+int packed_stats(char *buf, size_t cap);
+
+#endif /* PACKED_H */
@@ -0,0 +1,70 @@
+/* path.c - Parsed 'file' paths with precomputed segment and prefix hashes */
+#include "path.h" // Own header for the path structure and prototypes
+#include "hash.h" // hash_bytes, hash_combine
+
+#define PATH_ROOT_HASH HASH_P0 // Hash of the root path (no segments)
+
+/**
+ * @brief Parses and normalizes a path, hashing every segment and prefix.
+ * "a/b", "/a/b" and "a//b/" all parse to the same path.
+ *
+ * @param path The structure to fill.
+ * @param text The path as given by the client.
+ * @return 0 on success, -1 if the path is too long or has a segment too long for a Node.
+ */
+int path_parse(path_t *path, const char *text)
+{
+    uint64_t h = PATH_ROOT_HASH;
+    size_t len = 0;
+
+    path->nseg = 0;
+    for (const char *p = text; *p;)
+    {
+        if (*p == '/')
+        {
+            p++; // Skip leading, trailing and repeated slashes.
+            continue;
+        }
+
+        const char *end = p;
+        while (*end && *end != '/')
+        {
+            end++;
+        }
+        size_t seg = (size_t)(end - p);
+
+        // The separator plus the segment must fit, leaving room for the NUL.
+        size_t need = seg + (path->nseg ? 1 : 0);
+        if (path->nseg == PATH_MAX_SEGMENTS || len + need >= PATH_MAX_LEN)
+        {
+            return -1;
+        }
+        if (path->nseg)
+        {
+            path->buf[len++] = '/';
+        }
+        memcpy(path->buf + len, p, seg);
+
+        path->seg_off[path->nseg] = (uint16_t)len;
+        path->seg_len[path->nseg] = (uint16_t)seg;
+        path->seg_hash[path->nseg] = hash_bytes(p, seg);
+        h = hash_combine(h, path->seg_hash[path->nseg]);
+        path->prefix_hash[path->nseg] = h;
+        path->nseg++;
+
+        len += seg;
+        p = end;
+    }
+
+    path->buf[len] = '\0';
+    path->len = (uint16_t)len;
+    return 0;
+}
+
+/**
+ * @brief Returns the hash of the whole path (a constant for the root).
+ */
+uint64_t path_hash(const path_t *path)
+{
+    return path->nseg ? path->prefix_hash[path->nseg - 1] : PATH_ROOT_HASH;
+}
@@ -0,0 +1,32 @@
+/* path.h - Parsed 'file' paths with precomputed segment and prefix hashes */
+#ifndef PATH_H
+#define PATH_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint16_t, uint64_t
+
+// Configuration constants
+#define PATH_MAX_LEN 256      // Longest normalized path, including the NUL (matches MAX_FILENAME_LEN)
+#define PATH_MAX_SEGMENTS 128 // Most segments a path of PATH_MAX_LEN bytes can have
+
+/**
+ * @brief A path parsed once (in parse_command) and then reused by every lookup:
+ * segment boundaries plus the hash of every segment and of every prefix.
+ * Segment hashes feed the per-node child indexes; prefix hashes identify a path
+ * (or any ancestor of it) without rehashing, e.g. for the hot-key cache.
+ */
+typedef struct
+{
+    char buf[PATH_MAX_LEN];                  // Normalized path ("a/b/c": no leading, trailing or double slashes)
+    uint16_t len;                            // Length of `buf`
+    uint16_t nseg;                           // Number of segments (0 for the root)
+    uint16_t seg_off[PATH_MAX_SEGMENTS];     // Offset of each segment in `buf`
+    uint16_t seg_len[PATH_MAX_SEGMENTS];     // Length of each segment
+    uint64_t seg_hash[PATH_MAX_SEGMENTS];    // hash_bytes() of each segment
+    uint64_t prefix_hash[PATH_MAX_SEGMENTS]; // Hash of segments 0..i combined
+} path_t;
+
+int path_parse(path_t *path, const char *text);
+uint64_t path_hash(const path_t *path);
+
+#endif /* PATH_H */
@@ -0,0 +1,267 @@
+/* region.c - Per-file regions holding a file's leaves and values */
+#include "region.h" // Own header for configuration and prototypes
+#include "arena.h"  // arena_alloc, arena_free (blocks come from the arena)
+#include "tree.h"   // struct s_leaf (size of the leaf class)
+
+#define BLOCK_HEADER sizeof(struct region_block)
+#define LEAF_SIZE ((sizeof(struct s_leaf) + REGION_MIN_CLASS - 1) & ~(size_t)(REGION_MIN_CLASS - 1))
+
+_Static_assert(sizeof(struct region_block) % REGION_MIN_CLASS == 0, "blocks keep allocations aligned");
+
+/**
+ * @brief Counters over all regions, reported by the `stats` command.
+ */
+static struct
+{
+    uint64_t regions;     // Live regions
+    uint64_t reserved;    // Bytes held in blocks
+    uint64_t live;        // Bytes handed out
+    uint64_t compactions; // Regions rebuilt by relocate_leaves
+    uint64_t fast_drops;  // Files released without visiting their leaves
+    uint64_t slow_drops;  // Files whose leaves had to be released one by one
+} stats;
+
+/**
+ * @brief Size class of an allocation: the leaf class for exactly Leaf-sized requests,
+ * otherwise the smallest power of two (at least REGION_MIN_CLASS) that fits.
+ */
+static unsigned class_of(size_t size)
+{
+    if (size == sizeof(struct s_leaf))
+    {
+        return REGION_LEAF_CLASS;
+    }
+    unsigned cls = 1;
+    for (size_t c = REGION_MIN_CLASS; c < size; c <<= 1)
+    {
+        cls++;
+    }
+    return cls;
+}
+
+static size_t class_bytes(unsigned cls)
+{
+    return cls == REGION_LEAF_CLASS ? LEAF_SIZE : (size_t)REGION_MIN_CLASS << (cls - 1);
+}
+
+/**
+ * @brief Returns the bytes a request of `size` really takes in a region.
+ */
+size_t region_class_size(size_t size)
+{
+    return class_bytes(class_of(size));
+}
+
+/**
+ * @brief Creates an empty region (no block is allocated until the first request).
+ * @param first_block Usable bytes of the first block.
+ * @return The region, or NULL on allocation failure.
+ */
+struct region *region_create(size_t first_block)
+{
+    struct region *r = (struct region *)arena_alloc(sizeof(struct region));
+    if (r == NULL)
+    {
+        return NULL;
+    }
+    memset(r, 0, sizeof(*r));
+    r->next_block = first_block + BLOCK_HEADER;
+    stats.regions++;
+    return r;
+}
+
+/**
+ * @brief Starts a new block large enough for `need` bytes. The unused tail of the previous
+ * block stays reserved until the region is compacted or destroyed.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int add_block(struct region *r, size_t need)
+{
+    size_t size = r->next_block;
+    if (size < need + BLOCK_HEADER)
+    {
+        size = need + BLOCK_HEADER; // Oversized request: a block of its own size.
+    }
+    else if (r->next_block < REGION_MAX_BLOCK)
+    {
+        r->next_block *= 2;
+    }
+
+    struct region_block *block = (struct region_block *)arena_alloc(size);
+    if (block == NULL)
+    {
+        return -1;
+    }
+    block->next = r->blocks;
+    block->size = size;
+    r->blocks = block;
+    r->bump = (uint8_t *)block + BLOCK_HEADER;
+    r->bump_end = (uint8_t *)block + size;
+    r->reserved += size;
+    stats.reserved += size;
+    return 0;
+}
+
+/**
+ * @brief Makes sure the next `bytes` bytes (in class sizes) come from the current block,
+ * so that many allocations can be made afterwards without any of them failing.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int region_reserve(struct region *r, size_t bytes)
+{
+    if (r->bump != NULL && r->bump + bytes <= r->bump_end)
+    {
+        return 0;
+    }
+    return add_block(r, bytes);
+}
+
+/**
+ * @brief Allocates from a file's region, creating the region on first use.
+ *
+ * @param rp The owner's region pointer (may point to NULL).
+ * @param size Requested size (the same size must be passed to region_free).
+ * @return Pointer to uninitialized memory, or NULL on failure.
+ */
+void *region_alloc(struct region **rp, size_t size)
+{
+    struct region *r = *rp;
+    if (r == NULL)
+    {
+        if ((r = region_create(REGION_MIN_BLOCK)) == NULL)
+        {
+            return NULL;
+        }
+        *rp = r;
+    }
+
+    unsigned cls = class_of(size);
+    size_t bytes = class_bytes(cls);
+    void *p = r->free_lists[cls];
+    if (p != NULL)
+    {
+        r->free_lists[cls] = *(void **)p; // Pop the free list.
+    }
+    else
+    {
+        if (r->bump == NULL || r->bump + bytes > r->bump_end)
+        {
+            if (add_block(r, bytes) != 0)
+            {
+                return NULL;
+            }
+        }
+        p = r->bump;
+        r->bump += bytes;
+    }
+
+    r->live += bytes;
+    stats.live += bytes;
+    return p;
+}
+
+/**
+ * @brief Returns memory to its region's free list.
+ * @param r The region it came from (NULL pointers are ignored).
+ * @param ptr The pointer returned by region_alloc.
+ * @param size The size that was passed to region_alloc.
+ */
+void region_free(struct region *r, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    unsigned cls = class_of(size);
+    *(void **)ptr = r->free_lists[cls]; // Push onto the free list.
+    r->free_lists[cls] = ptr;
+    r->live -= class_bytes(cls);
+    stats.live -= class_bytes(cls);
+}
+
+/**
+ * @brief Releases a region and everything allocated from it, in O(blocks).
+ * @param rp The owner's region pointer (set to NULL; NULL regions are ignored).
+ */
+void region_destroy(struct region **rp)
+{
+    struct region *r = *rp;
+    if (r == NULL)
+    {
+        return;
+    }
+
+    struct region_block *block = r->blocks;
+    while (block != NULL)
+    {
+        struct region_block *next = block->next;
+        arena_free(block, block->size);
+        block = next;
+    }
+    stats.reserved -= r->reserved;
+    stats.live -= r->live;
+    stats.regions--;
+    arena_free(r, sizeof(struct region));
+    *rp = NULL;
+}
+
+/**
+ * @brief Returns the bytes of a region that are neither handed out nor still available
+ * for bumping: free-list entries, block headers and the abandoned tails of older blocks.
+ */
+size_t region_waste(const struct region *r)
+{
+    if (r == NULL)
+    {
+        return 0;
+    }
+    return r->reserved - r->live - (size_t)(r->bump_end - r->bump);
+}
+
+/**
+ * @brief Returns true if more than half of a (not tiny) region is free-list or dead space.
+ */
+bool region_wasteful(const struct region *r)
+{
+    return r != NULL && r->reserved >= REGION_COMPACT_MIN && region_waste(r) * 2 > r->reserved;
+}
+
+/**
+ * @brief Reports the bytes held in blocks and handed out, summed over all regions.
+ */
+void region_totals(size_t *reserved, size_t *live)
+{
+    *reserved = (size_t)stats.reserved;
+    *live = (size_t)stats.live;
+}
+
+void region_note_compaction(void)
+{
+    stats.compactions++;
+}
+
+void region_note_drop(bool fast)
+{
+    if (fast)
+    {
+        stats.fast_drops++;
+    }
+    else
+    {
+        stats.slow_drops++;
+    }
+}
+
+/**
+ * @brief Formats region counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int region_stats(char *buf, size_t cap)
+{
+    return snprintf(buf, cap,
+                    "  Regions: files=%llu reserved=%llu live=%llu bytes compactions=%llu drops: fast=%llu "
+                    "slow=%llu\n",
+                    (unsigned long long)stats.regions, (unsigned long long)stats.reserved,
+                    (unsigned long long)stats.live, (unsigned long long)stats.compactions,
+                    (unsigned long long)stats.fast_drops, (unsigned long long)stats.slow_drops);
+}
@@ -0,0 +1,57 @@
+/* region.h - Per-file regions holding a file's leaves and values */
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint8_t, uint32_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define REGION_MIN_BLOCK 1024        // First block of a region (grows by doubling)
+#define REGION_MAX_BLOCK (64 * 1024) // Largest block allocated for growth (bigger requests get their own)
+#define REGION_MIN_CLASS 16          // Smallest size class (classes are powers of two)
+#define REGION_CLASSES 13            // REGION_LEAF_CLASS plus 16 B .. 32 KB
+#define REGION_LEAF_CLASS 0          // Exact-size class for Leaf structures
+#define REGION_COMPACT_MIN (32 * 1024) // Regions smaller than this are never compacted
+
+/**
+ * @brief A block of a region (the header sits at the start of the block).
+ */
+struct region_block
+{
+    struct region_block *next; // Next (older) block
+    size_t size;               // Block size including this header
+};
+
+/**
+ * @brief Allocator owned by one file (Node). Everything a file's leaves point to that
+ * belongs to the file alone lives here, so dropping the file releases a handful of
+ * blocks instead of freeing every leaf and value, and a file's keys sit next to each
+ * other in memory. Freed memory goes onto per-class free lists for later writes of the
+ * same file; compaction (see compact_leaves in tree.c) returns it once it piles up.
+ */
+struct region
+{
+    struct region_block *blocks;      // All blocks, newest first
+    uint8_t *bump;                    // Next free byte in the newest block
+    uint8_t *bump_end;                // End of the newest block
+    void *free_lists[REGION_CLASSES]; // Intrusive free list per size class
+    size_t reserved;                  // Bytes held in blocks
+    size_t live;                      // Bytes handed out and not freed (rounded to classes)
+    size_t next_block;                // Size of the next block
+};
+
+size_t region_class_size(size_t size);
+struct region *region_create(size_t first_block);
+int region_reserve(struct region *r, size_t bytes);
+void *region_alloc(struct region **r, size_t size);
+void region_free(struct region *r, void *ptr, size_t size);
+void region_destroy(struct region **r);
+size_t region_waste(const struct region *r);
+bool region_wasteful(const struct region *r);
+void region_totals(size_t *reserved, size_t *live);
+void region_note_compaction(void);
+void region_note_drop(bool fast);
+int region_stats(char *buf, size_t cap);
+
+#endif /* REGION_H */
@@ -0,0 +1,95 @@
+/* reply.c - Growable buffer for composing multi-line client replies */
+#include "reply.h" // Own header for the reply structure and prototypes
+
+#include <stdarg.h> // va_list
+#include <stdio.h>  // vsnprintf
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memcpy
+
+#define REPLY_INITIAL_CAP 256 // First allocation size in bytes
+
+/**
+ * @brief Initializes an empty reply.
+ */
+void reply_init(struct reply *r)
+{
+    r->data = NULL;
+    r->len = 0;
+    r->cap = 0;
+    r->failed = false;
+}
+
+/**
+ * @brief Makes room for `extra` more bytes plus a terminator.
+ * @return True if the room is available.
+ */
+static bool reply_reserve(struct reply *r, size_t extra)
+{
+    if (r->failed)
+    {
+        return false;
+    }
+    if (r->len + extra + 1 <= r->cap)
+    {
+        return true;
+    }
+
+    size_t cap = r->cap ? r->cap : REPLY_INITIAL_CAP;
+    while (cap < r->len + extra + 1)
+    {
+        cap *= 2;
+    }
+    char *data = (char *)realloc(r->data, cap);
+    if (data == NULL)
+    {
+        r->failed = true;
+        return false;
+    }
+    r->data = data;
+    r->cap = cap;
+    return true;
+}
+
+/**
+ * @brief Appends raw bytes (which may contain NULs) to a reply.
+ */
+void reply_append(struct reply *r, const void *data, size_t len)
+{
+    if (len == 0 || !reply_reserve(r, len))
+    {
+        return; // An empty append (e.g. an empty listing, whose data is NULL) changes nothing.
+    }
+    memcpy(r->data + r->len, data, len);
+    r->len += len;
+    r->data[r->len] = '\0';
+}
+
+/**
+ * @brief Appends formatted text to a reply.
+ */
+void reply_printf(struct reply *r, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || !reply_reserve(r, (size_t)n))
+    {
+        return;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(r->data + r->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    r->len += (size_t)n;
+}
+
+/**
+ * @brief Releases a reply's buffer.
+ */
+void reply_free(struct reply *r)
+{
+    free(r->data);
+    reply_init(r);
+}
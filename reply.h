@@ -0,0 +1,25 @@
+/* reply.h - Growable buffer for composing multi-line client replies */
+#ifndef REPLY_H
+#define REPLY_H
+
+#include <stddef.h>  // size_t
+#include <stdbool.h> // boolean
+
+/**
+ * @brief A reply under construction. Appends never fail loudly: on allocation failure
+ * the reply is marked `failed` and further appends are ignored.
+ */
+struct reply
+{
+    char *data;  // Reply bytes (null-terminated while not failed)
+    size_t len;  // Bytes used
+    size_t cap;  // Bytes allocated
+    bool failed; // An allocation failed; the reply is incomplete
+};
+
+void reply_init(struct reply *r);
+void reply_append(struct reply *r, const void *data, size_t len);
+void reply_printf(struct reply *r, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void reply_free(struct reply *r);
+
+#endif /* REPLY_H */
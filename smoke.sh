@@ -0,0 +1,228 @@
+#!/usr/bin/env bash
+# smoke.sh - End-to-end smoke test of a built memodb_server and memodb_mktable
+#
+# Usage: ./smoke.sh [port]   (run by 'make check'; the default port is 7399)
+#
+# Starts the server on a scratch directory and talks to it over /dev/tcp: the tree
+# commands (SET/GET/DEL, MGET, MGETX, LS, GETGLOB, RENAME, MOVEKEY, CLONE, DROP), tables
+# built with and without --phf and served by ATTACH (hits, misses, a later line winning,
+# MGETX and GETGLOB reads, refused writes and refused DROP/RENAME/CLONE above them), then
+# the lsm engine: writes, a kill -9 and a restart that must recover every write from the
+# WAL and the runs.
+set -u
+
+PORT=${1:-7399}
+DIR=$(mktemp -d "${TMPDIR:-/tmp}/memodb-smoke.XXXXXX")
+SERVER_PID=
+FAILED=0
+CHECKED=0
+
+cleanup()
+{
+    stop_server KILL
+    rm -rf "$DIR"
+}
+trap cleanup EXIT
+
+# Starts the server with the given options and waits until it accepts connections.
+start_server()
+{
+    ./memodb_server "$PORT" --dump-dir "$DIR" "$@" >>"$DIR/server.log" 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 50); do
+        if (exec 4<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+            connect
+            return
+        fi
+        sleep 0.1
+    done
+    echo "smoke: the server did not start on port $PORT:" >&2
+    tail -20 "$DIR/server.log" >&2
+    exit 1
+}
+
+# Stops the server with the given signal (TERM by default) and waits for it.
+stop_server()
+{
+    exec 3<&- 2>/dev/null
+    if [ -n "$SERVER_PID" ]; then
+        kill "-${1:-TERM}" "$SERVER_PID" 2>/dev/null
+        wait "$SERVER_PID" 2>/dev/null
+        SERVER_PID=
+    fi
+}
+
+# Opens the connection on fd 3 and skips the greeting.
+connect()
+{
+    exec 3<>"/dev/tcp/127.0.0.1/$PORT"
+    read_reply >/dev/null
+}
+
+# Prints one reply, without the "> " prompt that ends it.
+read_reply()
+{
+    local c out=
+    while IFS= read -r -N 1 -t 5 c <&3; do
+        out+=$c
+        if [ "$out" = "> " ] || [[ $out == *$'\n> ' ]]; then
+            break
+        fi
+    done
+    out=${out%> }
+    printf '%s' "${out%$'\n'}"
+}
+
+# Sends a command and prints its reply.
+send()
+{
+    printf '%s\n' "$1" >&3
+    read_reply
+}
+
+# expect <command> <pattern>: the reply must match the (glob) pattern.
+expect()
+{
+    local reply
+    reply=$(send "$1")
+    CHECKED=$((CHECKED + 1))
+    # shellcheck disable=SC2053 # The pattern is a glob on purpose.
+    if [[ $reply != $2 ]]; then
+        FAILED=$((FAILED + 1))
+        printf 'FAIL: %s\n  expected: %s\n  got:      %s\n' "$1" "$2" "${reply//$'\n'/\\n}"
+    fi
+}
+
+section()
+{
+    echo "smoke: $*"
+}
+
+section "tree commands"
+start_server
+expect "SET /u/a k1 v1" "OK"
+expect "SET /u/b k1 v2" "OK"
+expect "SET /u/b k2 v3" "OK"
+expect "GET /u/a k1" "OK: v1"
+expect "GET /u/a nope" "ERR: Key 'nope' not found in file '/u/a'."
+expect "MGET /u/b k1 k2" $'OK: 2\nk1: v2\nk2: v3'
+expect "MGETX /u/a k1 /u/b k2 /u/a nope" $'OK: 2\n/u/a k1: v1\n/u/b k2: v3\n/u/a nope: (nil)'
+expect "LS /u" $'OK: 2 cursor=0\n*a/ children=0 keys=1*'
+expect "LS /u" $'OK: 2 cursor=0\n*b/ children=0 keys=2*'
+expect "GETGLOB /u/* k1" $'OK: 2 cursor=0\n*u/a: v1*'
+expect "GETGLOB /u/* k1" $'OK: 2 cursor=0\n*u/b: v2*'
+expect "RENAME /u/a /w" "OK"
+expect "GET /w k1" "OK: v1"
+expect "GET /u/a k1" "ERR: Key 'k1' not found in file '/u/a'."
+expect "RENAME /u/b /w" "ERR: File '/w' already exists."
+expect "MOVEKEY /u/b /w k2" "OK"
+expect "GET /w k2" "OK: v3"
+expect "GET /u/b k2" "ERR: Key 'k2' not found in file '/u/b'."
+expect "CLONE /w /c" "OK: cloned 1 paths, 2 keys"
+expect "SET /c k2 changed" "OK"
+expect "GET /c k2" "OK: changed"
+expect "GET /w k2" "OK: v3"
+expect "DEL /c k1" "OK"
+expect "KEYS /c" $'OK: 1\nk2'
+expect "DROP /u" "OK: dropped 2 paths, 1 keys"
+expect "GET /u/b k1" "ERR: Key 'k1' not found in file '/u/b'."
+
+section "attached tables"
+for i in $(seq 1 300); do
+    echo "key$i val$i"
+done >"$DIR/table.txt"
+echo "key7 newer" >>"$DIR/table.txt"
+if ! ./memodb_mktable "$DIR/table.txt" "$DIR/plain.tbl" >/dev/null ||
+   ! ./memodb_mktable --phf "$DIR/table.txt" "$DIR/phf.tbl" >/dev/null; then
+    echo "smoke: memodb_mktable failed" >&2
+    exit 1
+fi
+expect "SET /tbl/tree k v" "OK"
+expect "ATTACH /tbl/plain $DIR/plain.tbl" "OK: attached 300 keys"
+expect "ATTACH /tbl/phf $DIR/phf.tbl" "OK: attached 300 keys"
+expect "ATTACH /tbl/plain $DIR/phf.tbl" "ERR:*"
+for t in plain phf; do
+    for i in 1 2 150 299 300; do
+        expect "GET /tbl/$t key$i" "OK: val$i"
+    done
+    expect "GET /tbl/$t key7" "OK: newer"
+    expect "GET /tbl/$t key0" "ERR: Key 'key0' not found in file '/tbl/$t'."
+    expect "GET /tbl/$t key3000" "ERR: Key 'key3000' not found in file '/tbl/$t'."
+    expect "GET /tbl/$t ke" "ERR: Key 'ke' not found in file '/tbl/$t'."
+    expect "SET /tbl/$t key1 x" "ERR: SET is not available on an attached table."
+    expect "DEL /tbl/$t key1" "ERR: DEL is not available on an attached table."
+    expect "DROP /tbl/$t" "ERR: DROP is not available on an attached table."
+    expect "MOVEKEY /tbl/tree /tbl/$t k" "ERR: MOVEKEY is not available on an attached table."
+done
+expect "MGETX /tbl/plain key1 /tbl/tree k /tbl/phf key7 /tbl/phf key0" \
+    $'OK: 3\n/tbl/plain key1: val1\n/tbl/tree k: v\n/tbl/phf key7: newer\n/tbl/phf key0: (nil)'
+expect "GETGLOB /tbl/* key2" $'OK: 2 cursor=0\n*tbl/plain: val2*'
+expect "GETGLOB /tbl/* key2" $'OK: 2 cursor=0\n*tbl/phf: val2*'
+expect "GETGLOB /tbl/p?f key300" $'OK: 1 cursor=0\ntbl/phf: val300'
+expect "GETGLOB /tbl/* k" $'OK: 1 cursor=0\ntbl/tree: v'
+expect "GETGLOB /* key2" "OK: 0 cursor=0"
+expect "DROP /tbl" "ERR: DROP is not available above the attached table '/tbl/*' (DETACH it first)."
+expect "RENAME /tbl /moved" "ERR: RENAME is not available above the attached table '/tbl/*' (DETACH it first)."
+expect "CLONE /tbl /copy" "ERR: CLONE is not available above the attached table '/tbl/*' (DETACH it first)."
+expect "RENAME /w /tbl" "ERR: RENAME is not available above the attached table '/tbl/*' (DETACH it first)."
+expect "GET /tbl/tree k" "OK: v"
+expect "DETACH /tbl/plain" "OK"
+expect "DETACH /tbl/phf" "OK"
+expect "DETACH /tbl/phf" "ERR: File '/tbl/phf' is not an attached table."
+expect "GET /tbl/phf key1" "ERR: Key 'key1' not found in file '/tbl/phf'."
+expect "DROP /tbl" "OK: dropped 2 paths, 1 keys"
+stop_server
+
+section "lsm engine recovery"
+mkdir -p "$DIR/lsm"
+start_server --engine lsm --lsm-dir "$DIR/lsm"
+# Enough bulk data (sent in one go) to freeze the 4 MB memtable and flush it into a run.
+filler=$(printf '%*s' 1000 '' | tr ' ' x)
+for i in $(seq 1 6000); do
+    printf 'SET /bulk key%d %d%s\n' "$i" "$i" "$filler"
+done >&3
+for i in $(seq 1 6000); do
+    read_reply >/dev/null
+done
+for _ in $(seq 50); do
+    compgen -G "$DIR/lsm/run-*.sst" >/dev/null && break
+    sleep 0.1
+done
+CHECKED=$((CHECKED + 1))
+if ! compgen -G "$DIR/lsm/run-*.sst" >/dev/null; then
+    FAILED=$((FAILED + 1))
+    echo "FAIL: no run was flushed to $DIR/lsm"
+fi
+for i in $(seq 1 400); do
+    send "SET /l$((i % 4)) key$i value$i" >/dev/null
+done
+for i in $(seq 10 10 400); do
+    send "SET /l$((i % 4)) key$i rewritten$i" >/dev/null
+done
+for i in $(seq 5 10 400); do
+    send "DEL /l$((i % 4)) key$i" >/dev/null
+done
+expect "GET /l1 key1" "OK: value1"
+expect "RENAME /l1 /l9" "ERR: RENAME is not available with the lsm engine."
+stop_server KILL
+start_server --engine lsm --lsm-dir "$DIR/lsm"
+for i in $(seq 1 7 400); do
+    if [ $((i % 10)) -eq 5 ]; then
+        expect "GET /l$((i % 4)) key$i" "ERR: Key 'key$i' not found in file '/l$((i % 4))'."
+    elif [ $((i % 10)) -eq 0 ]; then
+        expect "GET /l$((i % 4)) key$i" "OK: rewritten$i"
+    else
+        expect "GET /l$((i % 4)) key$i" "OK: value$i"
+    fi
+done
+for i in 1 2999 6000; do
+    expect "GET /bulk key$i" "OK: $i$filler"
+done
+stop_server
+
+if [ "$FAILED" -ne 0 ]; then
+    echo "smoke: $FAILED of $CHECKED checks failed (server log follows)"
+    tail -30 "$DIR/server.log"
+    exit 1
+fi
+echo "smoke: all $CHECKED checks passed"
@@ -0,0 +1,721 @@
+/* table.c - Immutable sorted tables: prebuilt read-only files served from a memory map */
+#include "table.h" // Own header for the file layout and prototypes
+#include "main.h"  // MAX_KEY_LEN, MAX_VALUE_LEN, logging macros
+#include "hash.h"  // hash_seeded, hash_mix, hash_random
+
+#include <fcntl.h>    // open
+#include <limits.h>   // PATH_MAX
+#include <sys/mman.h> // mmap, madvise
+#include <sys/stat.h> // fstat
+
+#define ENTRY_HEADER 3                         // u8 key length, u16 value length
+#define TABLE_HASH_SEED 0x6d656d6f74626c31ULL // Fixed: the header checksum is stored in the file
+
+/**
+ * @brief An attached table: where it is served and the parts of its mapping.
+ */
+struct table
+{
+    char path[PATH_MAX_LEN];           // File it is attached as
+    uint16_t path_len;                 // Length of `path`
+    uint64_t path_hash;                // path_hash of `path`
+    const uint8_t *map;                // The whole file, mapped read-only
+    size_t bytes;                      // Size of the mapping
+    const struct table_header *header; // At the start of `map`
+    const struct table_block *index;   // Block index (in `map`)
+    const uint8_t *keys;               // First keys (in `map`)
+    const uint32_t *disp;              // Perfect-hash displacements (in `map`), or NULL
+    const uint64_t *slots;             // Perfect-hash slots (in `map`), or NULL
+};
+
+/**
+ * @brief Attached tables and counters (event loop only).
+ */
+static struct
+{
+    struct table *tables[TABLE_MAX_ATTACHED]; // Attached tables, in no particular order
+    unsigned n;                               // Entries in `tables`
+    uint64_t gets;                            // Lookups
+    uint64_t hits;                            // Lookups that found the key
+    uint64_t hashed;                          // Lookups answered through a perfect hash
+} tab;
+
+/**
+ * @brief Orders keys as the tables store them: bytewise, a prefix before longer keys.
+ */
+static int key_cmp(const void *a, size_t alen, const void *b, size_t blen)
+{
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0)
+    {
+        return c;
+    }
+    return (alen > blen) - (alen < blen);
+}
+
+/**
+ * @brief Slot of a key with hash `h` in a bucket displaced by `d`.
+ */
+static inline uint64_t phf_slot(uint64_t h, uint32_t d, uint64_t nslots)
+{
+    return hash_mix(h ^ d, HASH_P2) % nslots;
+}
+
+/**
+ * @brief Start of the slots, which follow the displacements at the next 8-byte boundary.
+ */
+static inline uint64_t phf_slots_off(const struct table_header *h)
+{
+    return h->phf_off + (((uint64_t)h->phf_buckets * sizeof(uint32_t) + 7) & ~7ULL);
+}
+
+static uint64_t header_checksum(const struct table_header *h)
+{
+    return hash_seeded(h, offsetof(struct table_header, checksum), TABLE_HASH_SEED);
+}
+
+/**
+ * @brief Whether `len` bytes at `off` lie within `size` bytes (without overflowing).
+ */
+static bool in_range(uint64_t off, uint64_t len, uint64_t size)
+{
+    return off <= size && len <= size - off;
+}
+
+/**
+ * @brief Checks a mapped header against the file (a constant amount of work, whatever the
+ * table's size: the contents are bounds-checked as lookups read them).
+ * @return NULL if the table is usable, otherwise what is wrong with it.
+ */
+static const char *check_header(const struct table_header *h, uint64_t size)
+{
+    if (h->magic != TABLE_MAGIC)
+    {
+        return "not a table file";
+    }
+    if (h->version != TABLE_VERSION)
+    {
+        return "unsupported version";
+    }
+    if (h->checksum != header_checksum(h))
+    {
+        return "header checksum mismatch";
+    }
+    if (h->bytes != size)
+    {
+        return "truncated or extended since it was built";
+    }
+    if (h->index_off < sizeof(*h) || h->index_off % 8 != 0 ||
+        !in_range(h->index_off, (uint64_t)h->nblocks * sizeof(struct table_block), size) ||
+        h->keys_off < h->index_off + (uint64_t)h->nblocks * sizeof(struct table_block) ||
+        !in_range(h->keys_off, h->keys_bytes, size) || h->keys_bytes > UINT32_MAX)
+    {
+        return "block index out of bounds";
+    }
+    if (h->nkeys > 0 && h->nblocks == 0)
+    {
+        return "keys without blocks";
+    }
+    if (h->phf_off != 0 &&
+        (h->phf_off % 8 != 0 || h->phf_off < h->keys_off + h->keys_bytes || h->phf_buckets == 0 ||
+         h->phf_slots == 0 || h->phf_slots > size / sizeof(uint64_t) ||
+         !in_range(h->phf_off, (uint64_t)h->phf_buckets * sizeof(uint32_t), size) ||
+         !in_range(phf_slots_off(h), h->phf_slots * sizeof(uint64_t), size)))
+    {
+        return "perfect hash out of bounds";
+    }
+    return NULL;
+}
+
+/**
+ * @brief Decodes the entry at `off`, which must end by `end`.
+ * @return false if it doesn't (a damaged table).
+ */
+static bool entry_at(const struct table *t, uint64_t off, uint64_t end, const uint8_t **key, uint8_t *klen,
+                     const uint8_t **value, uint16_t *vlen)
+{
+    if (off < sizeof(struct table_header) || !in_range(off, ENTRY_HEADER, end))
+    {
+        return false;
+    }
+    const uint8_t *p = t->map + off;
+    *klen = p[0];
+    memcpy(vlen, p + 1, sizeof(*vlen));
+    if (!in_range(off + ENTRY_HEADER, (uint64_t)*klen + *vlen, end))
+    {
+        return false;
+    }
+    *key = p + ENTRY_HEADER;
+    *value = *key + *klen;
+    return true;
+}
+
+/**
+ * @brief Compares the first key of block `i` with `key`. A damaged record compares
+ * greater, which steers the search away from it.
+ */
+static int first_key_cmp(const struct table *t, uint32_t i, const char *key, size_t klen)
+{
+    uint64_t off = t->index[i].key_off;
+    if (!in_range(off, 1, t->header->keys_bytes) || !in_range(off + 1, t->keys[off], t->header->keys_bytes))
+    {
+        return 1;
+    }
+    return key_cmp(t->keys + off + 1, t->keys[off], key, klen);
+}
+
+/**
+ * @brief Maps a table file and serves it as `path` (see table.h).
+ * @param keys Receives the number of keys in the table.
+ * @return 0 on success, -1 with errno set: EINVAL for the root, EEXIST if a table is
+ * already attached there, ENOSPC with TABLE_MAX_ATTACHED tables attached, EBADMSG for a
+ * file that isn't a valid table, or the error of open, fstat or mmap.
+ */
+int table_attach(const path_t *path, const char *file, uint64_t *keys)
+{
+    if (path->nseg == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (table_find(path) != NULL)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    if (tab.n == TABLE_MAX_ATTACHED)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode) || (uint64_t)st.st_size < sizeof(struct table_header))
+    {
+        close(fd);
+        error_log("Tables: %s is not a valid table (too small)", file);
+        errno = EBADMSG;
+        return -1;
+    }
+    // Shared and read-only: every process mapping the file uses the same page-cache pages.
+    const uint8_t *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd); // The mapping keeps the file open.
+    if (map == MAP_FAILED)
+    {
+        errno = err;
+        return -1;
+    }
+
+    const struct table_header *h = (const struct table_header *)map;
+    const char *why = check_header(h, (uint64_t)st.st_size);
+    struct table *t = NULL;
+    if (why != NULL || (t = (struct table *)calloc(1, sizeof(*t))) == NULL)
+    {
+        munmap((void *)map, (size_t)st.st_size);
+        if (why != NULL)
+        {
+            error_log("Tables: %s is not a valid table (%s)", file, why);
+        }
+        errno = (why != NULL) ? EBADMSG : ENOMEM;
+        return -1;
+    }
+    // Lookups touch a block or two per key; readahead would only evict other pages.
+    madvise((void *)map, (size_t)st.st_size, MADV_RANDOM);
+
+    memcpy(t->path, path->buf, path->len + 1);
+    t->path_len = path->len;
+    t->path_hash = path_hash(path);
+    t->map = map;
+    t->bytes = (size_t)st.st_size;
+    t->header = h;
+    t->index = (const struct table_block *)(map + h->index_off);
+    t->keys = map + h->keys_off;
+    if (h->phf_off != 0)
+    {
+        t->disp = (const uint32_t *)(map + h->phf_off);
+        t->slots = (const uint64_t *)(map + phf_slots_off(h));
+    }
+    tab.tables[tab.n++] = t;
+    *keys = h->nkeys;
+    info_log("Tables: attached %s as '%s' (%llu keys, %llu bytes%s)", file, t->path, (unsigned long long)h->nkeys,
+             (unsigned long long)t->bytes, t->slots != NULL ? ", perfect hash" : "");
+    return 0;
+}
+
+/**
+ * @brief Unmaps the table attached as `path`.
+ * @return 0 on success, -1 with errno ENOENT if no table is attached there.
+ */
+int table_detach(const path_t *path)
+{
+    struct table *t = table_find(path);
+    if (t == NULL)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    for (unsigned i = 0; i < tab.n; i++)
+    {
+        if (tab.tables[i] == t)
+        {
+            tab.tables[i] = tab.tables[--tab.n];
+            break;
+        }
+    }
+    info_log("Tables: detached '%s'", t->path);
+    munmap((void *)t->map, t->bytes);
+    free(t);
+    return 0;
+}
+
+/**
+ * @brief Returns the table attached as `path`, or NULL (also for the root, which can't
+ * have one). Costs nothing while no table is attached.
+ */
+struct table *table_find(const path_t *path)
+{
+    if (tab.n == 0 || path->nseg == 0)
+    {
+        return NULL;
+    }
+    uint64_t hash = path_hash(path);
+    for (unsigned i = 0; i < tab.n; i++)
+    {
+        struct table *t = tab.tables[i];
+        if (t->path_hash == hash && t->path_len == path->len && memcmp(t->path, path->buf, path->len) == 0)
+        {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns the path of a table attached as `path` or anywhere below it (any table
+ * for the root), or NULL. DROP, RENAME and CLONE of such a subtree would leave the table
+ * serving a file the tree no longer has, so they are refused while it is attached.
+ */
+const char *table_under(const path_t *path)
+{
+    for (unsigned i = 0; i < tab.n; i++)
+    {
+        const struct table *t = tab.tables[i];
+        if (path->len == 0 || (t->path_len >= path->len && memcmp(t->path, path->buf, path->len) == 0 &&
+                               (t->path_len == path->len || t->path[path->len] == '/')))
+        {
+            return t->path;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Looks a key up in a table.
+ * @param value Receives the value, which points into the mapping (not NUL-terminated,
+ * valid until the table is detached).
+ * @param len Receives its length.
+ * @return true if the key is in the table.
+ */
+bool table_get(struct table *t, const char *key, const char **value, uint16_t *len)
+{
+    const struct table_header *h = t->header;
+    size_t klen = strlen(key);
+    const uint8_t *k, *v;
+    uint8_t n;
+
+    tab.gets++;
+    if (t->slots != NULL)
+    {
+        // One hash, one displacement, one slot, one entry.
+        tab.hashed++;
+        uint64_t hash = hash_seeded(key, klen, h->phf_seed);
+        uint64_t off = t->slots[phf_slot(hash, t->disp[hash % h->phf_buckets], h->phf_slots)];
+        if (off == 0 || !entry_at(t, off, h->index_off, &k, &n, &v, len) || key_cmp(k, n, key, klen) != 0)
+        {
+            return false;
+        }
+        *value = (const char *)v;
+        tab.hits++;
+        return true;
+    }
+
+    // The last block whose first key is not greater than `key`.
+    uint32_t lo = 0, hi = h->nblocks;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (first_key_cmp(t, mid, key, klen) <= 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo == 0)
+    {
+        return false; // Before the first key of the table.
+    }
+    const struct table_block *b = &t->index[lo - 1];
+    if (!in_range(b->off, b->len, h->index_off))
+    {
+        return false;
+    }
+    uint64_t end = b->off + b->len;
+    for (uint64_t off = b->off; off < end; off += ENTRY_HEADER + n + *len)
+    {
+        if (!entry_at(t, off, end, &k, &n, &v, len))
+        {
+            return false;
+        }
+        int c = key_cmp(k, n, key, klen);
+        if (c == 0)
+        {
+            *value = (const char *)v;
+            tab.hits++;
+            return true;
+        }
+        if (c > 0)
+        {
+            return false; // Sorted: the key would have come before this one.
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the path of the i-th attached table and the table through `t`, or NULL
+ * past the last one (for GETGLOB, which has to visit every table).
+ */
+const char *table_nth(unsigned i, struct table **t)
+{
+    if (i >= tab.n)
+    {
+        return NULL;
+    }
+    *t = tab.tables[i];
+    return tab.tables[i]->path;
+}
+
+/**
+ * @brief Unmaps every table.
+ */
+void table_shutdown(void)
+{
+    while (tab.n > 0)
+    {
+        struct table *t = tab.tables[--tab.n];
+        munmap((void *)t->map, t->bytes);
+        free(t);
+    }
+}
+
+/**
+ * @brief Formats table counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int table_stats(char *buf, size_t cap)
+{
+    uint64_t keys = 0, bytes = 0;
+    unsigned hashed = 0;
+    for (unsigned i = 0; i < tab.n; i++)
+    {
+        keys += tab.tables[i]->header->nkeys;
+        bytes += tab.tables[i]->bytes;
+        hashed += (tab.tables[i]->slots != NULL);
+    }
+    return snprintf(buf, cap,
+                    "  Tables: attached=%u (perfect hash: %u) keys=%llu mapped=%llu bytes gets=%llu hits=%llu "
+                    "hashed=%llu\n",
+                    tab.n, hashed, (unsigned long long)keys, (unsigned long long)bytes, (unsigned long long)tab.gets,
+                    (unsigned long long)tab.hits, (unsigned long long)tab.hashed);
+}
+
+/* --- Builder (memodb_mktable) --- */
+
+/**
+ * @brief A bucket of the perfect hash, placed largest first.
+ */
+struct phf_bucket
+{
+    uint32_t id;    // Bucket number
+    uint32_t size;  // Keys in it
+    size_t first;   // Its first key in the members array
+};
+
+static int bucket_cmp(const void *a, const void *b)
+{
+    const struct phf_bucket *x = (const struct phf_bucket *)a, *y = (const struct phf_bucket *)b;
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+/**
+ * @brief Builds the perfect hash of `n` keys whose entries are at `offs`: fills the phf
+ * fields of `h` except phf_off, and the displacements and slots.
+ * @return 0 on success, -1 with errno set (ENOMEM, or EAGAIN if no seed worked).
+ */
+static int phf_build(const struct table_item *items, const uint64_t *offs, size_t n, struct table_header *h,
+                     uint32_t **disp_out, uint64_t **slots_out)
+{
+    uint64_t nbuckets = n / TABLE_PHF_BUCKET + 1;
+    uint64_t nslots = (uint64_t)n * 100 / TABLE_PHF_LOAD + 1;
+    if (nbuckets > UINT32_MAX)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+    uint64_t *hashes = (uint64_t *)malloc(n * sizeof(*hashes));
+    size_t *members = (size_t *)malloc(n * sizeof(*members));
+    struct phf_bucket *buckets = (struct phf_bucket *)malloc(nbuckets * sizeof(*buckets));
+    uint32_t *disp = (uint32_t *)malloc(nbuckets * sizeof(*disp));
+    uint64_t *slots = (uint64_t *)malloc(nslots * sizeof(*slots));
+    int rc = -1;
+    errno = ENOMEM;
+
+    for (unsigned attempt = 0; hashes != NULL && members != NULL && buckets != NULL && disp != NULL &&
+                               slots != NULL && rc != 0 && attempt < TABLE_PHF_SEEDS;
+         attempt++)
+    {
+        uint64_t seed = hash_random();
+
+        // Group the keys by bucket (a counting sort), then place the largest buckets first,
+        // while most slots are still free.
+        memset(buckets, 0, nbuckets * sizeof(*buckets));
+        for (size_t i = 0; i < n; i++)
+        {
+            hashes[i] = hash_seeded(items[i].key, items[i].klen, seed);
+            buckets[hashes[i] % nbuckets].size++;
+        }
+        size_t first = 0;
+        for (uint32_t b = 0; b < nbuckets; b++)
+        {
+            buckets[b].id = b;
+            buckets[b].first = first;
+            first += buckets[b].size;
+            buckets[b].size = 0;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            struct phf_bucket *b = &buckets[hashes[i] % nbuckets];
+            members[b->first + b->size++] = i;
+        }
+        qsort(buckets, nbuckets, sizeof(*buckets), bucket_cmp);
+
+        memset(disp, 0, nbuckets * sizeof(*disp));
+        memset(slots, 0, nslots * sizeof(*slots));
+        bool placed = true;
+        for (uint64_t b = 0; b < nbuckets && buckets[b].size > 0 && placed; b++)
+        {
+            const struct phf_bucket *bk = &buckets[b];
+            placed = false;
+            for (uint32_t d = 0; d < TABLE_PHF_TRIES && !placed; d++)
+            {
+                // Claim a free slot for every key of the bucket, or give them all back.
+                uint32_t j;
+                for (j = 0; j < bk->size; j++)
+                {
+                    uint64_t *s = &slots[phf_slot(hashes[members[bk->first + j]], d, nslots)];
+                    if (*s != 0)
+                    {
+                        break;
+                    }
+                    *s = offs[members[bk->first + j]];
+                }
+                placed = (j == bk->size);
+                while (!placed && j-- > 0)
+                {
+                    slots[phf_slot(hashes[members[bk->first + j]], d, nslots)] = 0;
+                }
+                if (placed)
+                {
+                    disp[bk->id] = d;
+                }
+            }
+        }
+        if (placed)
+        {
+            h->phf_seed = seed;
+            h->phf_buckets = (uint32_t)nbuckets;
+            h->phf_slots = nslots;
+            *disp_out = disp;
+            *slots_out = slots;
+            disp = NULL;
+            slots = NULL;
+            rc = 0;
+        }
+        else
+        {
+            errno = EAGAIN;
+        }
+    }
+
+    int err = errno;
+    free(hashes);
+    free(members);
+    free(buckets);
+    free(disp);
+    free(slots);
+    errno = err;
+    return rc;
+}
+
+/**
+ * @brief Writes zero bytes up to the next multiple of 8.
+ */
+static bool write_pad(FILE *f, uint64_t *pos)
+{
+    static const uint8_t zeros[8];
+    size_t pad = (size_t)((8 - *pos % 8) % 8);
+    *pos += pad;
+    return fwrite(zeros, 1, pad, f) == pad;
+}
+
+/**
+ * @brief Writes a table of `n` items, sorted by key without duplicates, to `file` (through
+ * a temporary file renamed into place once it is complete and synced).
+ * @param phf Whether to add a perfect hash.
+ * @return 0 on success, -1 with errno set (EINVAL for unsorted items or bad lengths).
+ */
+int table_write(const char *file, const struct table_item *items, size_t n, bool phf)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (items[i].klen == 0 || items[i].klen >= MAX_KEY_LEN || items[i].vlen >= MAX_VALUE_LEN ||
+            (i > 0 && key_cmp(items[i - 1].key, items[i - 1].klen, items[i].key, items[i].klen) >= 0))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    // Lay the entries out in blocks, remembering where each entry and block goes.
+    struct table_header h = {0};
+    uint64_t *offs = (uint64_t *)malloc((n + 1) * sizeof(*offs));
+    struct table_block *blocks = (struct table_block *)malloc((n + 1) * sizeof(*blocks));
+    if (offs == NULL || blocks == NULL)
+    {
+        free(offs);
+        free(blocks);
+        errno = ENOMEM;
+        return -1;
+    }
+    uint64_t pos = sizeof(h);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t size = ENTRY_HEADER + items[i].klen + items[i].vlen;
+        if (h.nblocks == 0 || blocks[h.nblocks - 1].len + size > TABLE_BLOCK_BYTES)
+        {
+            blocks[h.nblocks].off = pos;
+            blocks[h.nblocks].len = 0;
+            blocks[h.nblocks].key_off = (uint32_t)h.keys_bytes;
+            h.keys_bytes += 1 + items[i].klen;
+            h.nblocks++;
+        }
+        offs[i] = pos;
+        blocks[h.nblocks - 1].len += size;
+        pos += size;
+    }
+    h.index_off = (pos + 7) & ~7ULL;
+    h.keys_off = h.index_off + (uint64_t)h.nblocks * sizeof(struct table_block);
+    h.nkeys = n;
+
+    uint32_t *disp = NULL;
+    uint64_t *slots = NULL;
+    if (phf && n > 0 && phf_build(items, offs, n, &h, &disp, &slots) != 0)
+    {
+        int err = errno;
+        free(offs);
+        free(blocks);
+        errno = err;
+        return -1;
+    }
+    if (slots != NULL)
+    {
+        h.phf_off = (h.keys_off + h.keys_bytes + 7) & ~7ULL;
+        h.bytes = phf_slots_off(&h) + h.phf_slots * sizeof(uint64_t);
+    }
+    else
+    {
+        h.bytes = h.keys_off + h.keys_bytes;
+    }
+    h.magic = TABLE_MAGIC;
+    h.version = TABLE_VERSION;
+    h.checksum = header_checksum(&h);
+
+    char tmp[PATH_MAX];
+    FILE *f = NULL;
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", file) >= (int)sizeof(tmp))
+    {
+        errno = ENAMETOOLONG;
+    }
+    else
+    {
+        f = fopen(tmp, "wb");
+    }
+    bool ok = (f != NULL);
+
+    // Header, data blocks, block index, first keys, perfect hash.
+    pos = sizeof(h);
+    ok = ok && fwrite(&h, sizeof(h), 1, f) == 1;
+    for (size_t i = 0; ok && i < n; i++)
+    {
+        uint8_t head[ENTRY_HEADER] = {items[i].klen};
+        memcpy(head + 1, &items[i].vlen, sizeof(items[i].vlen));
+        ok = fwrite(head, sizeof(head), 1, f) == 1 && fwrite(items[i].key, 1, items[i].klen, f) == items[i].klen &&
+             fwrite(items[i].value, 1, items[i].vlen, f) == items[i].vlen;
+        pos += ENTRY_HEADER + items[i].klen + items[i].vlen;
+    }
+    ok = ok && write_pad(f, &pos) && fwrite(blocks, sizeof(*blocks), h.nblocks, f) == h.nblocks;
+    for (size_t i = 0, b = 0; ok && b < h.nblocks; i++)
+    {
+        if (offs[i] == blocks[b].off)
+        {
+            ok = fputc(items[i].klen, f) != EOF && fwrite(items[i].key, 1, items[i].klen, f) == items[i].klen;
+            b++;
+        }
+    }
+    if (ok && slots != NULL)
+    {
+        pos = h.keys_off + h.keys_bytes;
+        ok = write_pad(f, &pos) && fwrite(disp, sizeof(*disp), h.phf_buckets, f) == h.phf_buckets;
+        pos += (uint64_t)h.phf_buckets * sizeof(*disp);
+        ok = ok && write_pad(f, &pos) && fwrite(slots, sizeof(*slots), h.phf_slots, f) == h.phf_slots;
+    }
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+
+    int err = errno;
+    if (f != NULL && fclose(f) != 0 && ok)
+    {
+        ok = false;
+        err = errno;
+    }
+    if (ok && rename(tmp, file) != 0)
+    {
+        ok = false;
+        err = errno;
+    }
+    if (!ok && f != NULL)
+    {
+        unlink(tmp);
+    }
+    free(offs);
+    free(blocks);
+    free(disp);
+    free(slots);
+    errno = err;
+    return ok ? 0 : -1;
+}
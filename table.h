@@ -0,0 +1,102 @@
+/* table.h - Immutable sorted tables: prebuilt read-only files served from a memory map */
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint8_t, uint16_t, uint64_t
+#include <stdbool.h> // boolean
+
+#include "path.h" // path_t
+
+// Configuration constants
+#define TABLE_MAGIC 0x314c42544f4d454dULL // "MEMOTBL1" (little-endian), first field of every table file
+#define TABLE_VERSION 1                   // Layout version written by the builder
+#define TABLE_MAX_ATTACHED 64             // Tables attached at the same time
+#define TABLE_BLOCK_BYTES 4096            // Target size of a data block
+#define TABLE_PHF_BUCKET 4                // Average keys per perfect-hash bucket
+#define TABLE_PHF_LOAD 80                 // Perfect-hash slots in use, in percent
+#define TABLE_PHF_TRIES 100000            // Displacements tried per bucket before a new seed is drawn
+#define TABLE_PHF_SEEDS 8                 // Seeds tried before the builder gives up on the perfect hash
+
+/*
+ * ATTACH <file> <table-file> maps a table built offline by memodb_mktable and serves GET
+ * on <file>, and the MGETX pairs and GETGLOB matches that name it, straight from the
+ * mapping: no leaf, value or index entry is allocated, and attaching costs one mmap and a
+ * check of the header whatever the table's size. The mapping is read-only and shared, so
+ * every process that maps the same file (servers on one host, DUMP children) shares its
+ * pages in the page cache. An attached file is read-only: commands other than these reads
+ * (and DETACH) on it are refused, and so are DROP, RENAME and CLONE of a file above it or
+ * into a path above it.
+ *
+ * Layout (native byte order, so a table is built on the architecture that serves it):
+ *
+ *   header      struct table_header
+ *   data blocks ~TABLE_BLOCK_BYTES of entries in key order: u8 key length, u16 value
+ *               length, key, value
+ *   block index one struct table_block per block
+ *   first keys  u8 length and bytes of the first key of each block
+ *   [phf]       u32 displacement per bucket, then (8-byte aligned) u64 entry offset per
+ *               slot (0 = empty)
+ *
+ * Without the optional perfect hash, a GET binary-searches the block index and scans one
+ * block. With it (mktable --phf) a GET hashes the key once and reads one displacement and
+ * one slot: the bucket hash picks the displacement, which moves the key to a slot that no
+ * other key of the table occupies (hash and displace). The key stored in the entry is
+ * always compared, so keys that aren't in the table still miss.
+ */
+
+/**
+ * @brief Fixed-size head of a table file.
+ */
+struct table_header
+{
+    uint64_t magic;       // TABLE_MAGIC
+    uint32_t version;     // TABLE_VERSION
+    uint32_t nblocks;     // Data blocks
+    uint64_t nkeys;       // Keys in the table
+    uint64_t bytes;       // File size
+    uint64_t index_off;   // Start of the block index (also the end of the data blocks)
+    uint64_t keys_off;    // Start of the first keys
+    uint64_t keys_bytes;  // Size of the first keys
+    uint64_t phf_off;     // Start of the displacements, 0 without a perfect hash
+    uint64_t phf_seed;    // Seed of the key hash
+    uint64_t phf_slots;   // Slots
+    uint32_t phf_buckets; // Buckets (one displacement each)
+    uint32_t reserved;    // 0
+    uint64_t checksum;    // hash_seeded of the fields above
+};
+
+/**
+ * @brief Block index record.
+ */
+struct table_block
+{
+    uint64_t off;     // Start of the block in the file
+    uint32_t len;     // Bytes in the block
+    uint32_t key_off; // Its first key, relative to keys_off
+};
+
+/**
+ * @brief One key and value handed to table_write (keys sorted and unique).
+ */
+struct table_item
+{
+    const char *key;   // Key bytes
+    const char *value; // Value bytes
+    uint8_t klen;      // Key length (1 .. MAX_KEY_LEN - 1)
+    uint16_t vlen;     // Value length (up to MAX_VALUE_LEN - 1)
+};
+
+struct table; // An attached table (opaque)
+
+int table_attach(const path_t *path, const char *file, uint64_t *keys);
+int table_detach(const path_t *path);
+struct table *table_find(const path_t *path);
+const char *table_under(const path_t *path);
+bool table_get(struct table *t, const char *key, const char **value, uint16_t *len);
+const char *table_nth(unsigned i, struct table **t);
+void table_shutdown(void);
+int table_stats(char *buf, size_t cap);
+int table_write(const char *file, const struct table_item *items, size_t n, bool phf);
+
+#endif /* TABLE_H */
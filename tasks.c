@@ -0,0 +1,246 @@
+/* tasks.c - Cooperative, time-sliced background tasks run by the event loop */
+#include "tasks.h" // Own header for configuration and prototypes
+#include "main.h"  // Logging macros
+#include "util.h"  // now_ns
+
+#include <poll.h>         // poll (is client work waiting?)
+#include <sys/timerfd.h>  // timerfd_create, timerfd_settime
+
+#define NS_PER_MS 1000000ULL
+
+/**
+ * @brief Scheduler state. Tasks are kept sorted by priority, so one pass over the
+ * array serves urgent work first.
+ */
+static struct
+{
+    struct task *tasks[TASKS_MAX]; // Registered tasks, by priority
+    size_t ntasks;                 // Number of registered tasks
+    int epoll_fd;                  // The event loop's epoll instance
+    int timer_fd;                  // timerfd waking the loop for the next run, -1 if unavailable
+    uint64_t next_run;             // Earliest time tasks_run does anything
+    uint64_t ticks;                // Timer expirations seen
+    uint64_t passes;               // Calls to tasks_run that looked at the tasks
+} sched = {.epoll_fd = -1, .timer_fd = -1};
+
+/**
+ * @brief Schedules the next run `delay_ns` from `now` and arms the timer for it.
+ */
+static void arm(uint64_t now, uint64_t delay_ns)
+{
+    if (delay_ns < NS_PER_MS)
+    {
+        delay_ns = NS_PER_MS;
+    }
+    sched.next_run = now + delay_ns;
+
+    if (sched.timer_fd >= 0)
+    {
+        struct itimerspec its = {0}; // One-shot: it_interval stays zero.
+        its.it_value.tv_sec = (time_t)(delay_ns / 1000000000ULL);
+        its.it_value.tv_nsec = (long)(delay_ns % 1000000000ULL);
+        timerfd_settime(sched.timer_fd, 0, &its, NULL);
+    }
+}
+
+/**
+ * @brief Returns true if the event loop has something to do (a client or the listening
+ * socket is ready). The epoll descriptor itself polls readable in that case.
+ */
+static bool clients_waiting(void)
+{
+    struct pollfd pfd = {.fd = sched.epoll_fd, .events = POLLIN};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * @brief Creates the tick timer and adds it to the event loop's epoll set.
+ * Without a timer (e.g. no timerfd support) tasks still run, but only as often as the
+ * loop wakes up on its own.
+ *
+ * @param epoll_fd The event loop's epoll descriptor.
+ * @return 0 on success, -1 if the timer couldn't be set up.
+ */
+int tasks_init(int epoll_fd)
+{
+    sched.epoll_fd = epoll_fd;
+    sched.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sched.timer_fd == -1)
+    {
+        error_log("timerfd_create failed: %s (background tasks run on the loop timeout)", strerror(errno));
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = sched.timer_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sched.timer_fd, &ev) == -1)
+    {
+        error_log("epoll_ctl ADD (timer) failed: %s", strerror(errno));
+        close(sched.timer_fd);
+        sched.timer_fd = -1;
+        return -1;
+    }
+
+    arm(now_ns(), TASKS_TICK_MS * NS_PER_MS);
+    return 0;
+}
+
+/**
+ * @brief Registers a task. Interval tasks first run one interval from now.
+ * @param task The task (must stay alive while the scheduler runs).
+ * @return 0 on success, -1 if TASKS_MAX tasks are already registered.
+ */
+int tasks_register(struct task *task)
+{
+    if (sched.ntasks == TASKS_MAX)
+    {
+        error_log("Too many background tasks, '%s' not registered", task->name);
+        return -1;
+    }
+
+    uint64_t now = now_ns();
+    task->next_due = now + task->interval_ms * NS_PER_MS;
+    task->due_since = 0;
+
+    // Insert after every task of the same or a more urgent priority.
+    size_t i = sched.ntasks;
+    while (i > 0 && sched.tasks[i - 1]->priority > task->priority)
+    {
+        sched.tasks[i] = sched.tasks[i - 1];
+        i--;
+    }
+    sched.tasks[i] = task;
+    sched.ntasks++;
+    return 0;
+}
+
+/**
+ * @brief Returns the timer descriptor (to recognize its events), or -1 if there is none.
+ */
+int tasks_timer_fd(void)
+{
+    return sched.timer_fd;
+}
+
+/**
+ * @brief Acknowledges a timer event. The tasks themselves run in tasks_run, after the
+ * rest of the event batch has been served.
+ */
+void tasks_tick(void)
+{
+    uint64_t expirations;
+    if (read(sched.timer_fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations))
+    {
+        sched.ticks += expirations;
+    }
+}
+
+/**
+ * @brief Gives due tasks their slices. Called after every event batch; returns at once
+ * until the next scheduled run. Urgent tasks always run when due; the others yield while
+ * clients are waiting (re-checked after every slice), unless they have already waited
+ * TASKS_STARVE_MS. Afterwards the timer is re-armed: a short tick while some task still
+ * has work, otherwise the next interval deadline (at most TASKS_MAX_SLEEP_MS away).
+ */
+void tasks_run(void)
+{
+    uint64_t now = now_ns();
+    if (now < sched.next_run)
+    {
+        return;
+    }
+    sched.passes++;
+
+    bool busy = clients_waiting();
+    bool more = false; // Some task is still due or has work left.
+    uint64_t wake = now + TASKS_MAX_SLEEP_MS * NS_PER_MS;
+
+    for (size_t i = 0; i < sched.ntasks; i++)
+    {
+        struct task *t = sched.tasks[i];
+        bool due = (t->interval_ms > 0 && now >= t->next_due) || (t->pending != NULL && t->pending());
+        if (!due)
+        {
+            if (t->interval_ms > 0 && t->next_due < wake)
+            {
+                wake = t->next_due;
+            }
+            continue;
+        }
+
+        if (t->due_since == 0)
+        {
+            t->due_since = now;
+        }
+        if (busy && t->priority != TASK_URGENT && now - t->due_since < TASKS_STARVE_MS * NS_PER_MS)
+        {
+            t->deferred++;
+            more = true;
+            continue;
+        }
+
+        uint64_t start = now_ns();
+        int work = t->run(t->budget_ns);
+        now = now_ns();
+
+        uint64_t spent = now - start;
+        t->runs++;
+        t->work += work > 0 ? (uint64_t)work : 0;
+        t->total_ns += spent;
+        if (spent > t->max_ns)
+        {
+            t->max_ns = spent;
+        }
+        t->due_since = 0;
+        if (t->interval_ms > 0)
+        {
+            t->next_due = start + t->interval_ms * NS_PER_MS;
+            if (t->next_due < wake)
+            {
+                wake = t->next_due;
+            }
+        }
+        if (t->pending != NULL && t->pending())
+        {
+            more = true;
+        }
+        busy = busy || clients_waiting();
+    }
+
+    arm(now, more ? TASKS_TICK_MS * NS_PER_MS : (wake > now ? wake - now : 0));
+}
+
+/**
+ * @brief Closes the timer (registered tasks are owned by their callers).
+ */
+void tasks_shutdown(void)
+{
+    if (sched.timer_fd >= 0)
+    {
+        close(sched.timer_fd);
+        sched.timer_fd = -1;
+    }
+}
+
+/**
+ * @brief Formats per-task time for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int tasks_stats(char *buf, size_t cap)
+{
+    static const char *priorities[] = {"urgent", "normal", "idle"};
+    int len = snprintf(buf, cap, "  Tasks: timer=%s ticks=%llu passes=%llu\n", sched.timer_fd >= 0 ? "on" : "off",
+                       (unsigned long long)sched.ticks, (unsigned long long)sched.passes);
+
+    for (size_t i = 0; i < sched.ntasks && len >= 0 && (size_t)len < cap; i++)
+    {
+        const struct task *t = sched.tasks[i];
+        len += snprintf(buf + len, cap - len,
+                        "    %s: priority=%s runs=%llu work=%llu time=%.3f ms max_slice=%llu us deferred=%llu\n",
+                        t->name, priorities[t->priority], (unsigned long long)t->runs,
+                        (unsigned long long)t->work, t->total_ns / 1e6, (unsigned long long)(t->max_ns / 1000),
+                        (unsigned long long)t->deferred);
+    }
+    return len;
+}
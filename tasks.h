@@ -0,0 +1,59 @@
+/* tasks.h - Cooperative, time-sliced background tasks run by the event loop */
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint32_t, uint64_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define TASKS_MAX 16            // Tasks that can be registered
+#define TASKS_TICK_MS 10        // Tick while some task has work pending
+#define TASKS_MAX_SLEEP_MS 1000 // Longest the scheduler sleeps (`pending` is polled at least this often)
+#define TASKS_STARVE_MS 1000    // Longest a due task yields to client work
+
+/**
+ * @brief How a task competes with client work. Urgent tasks run as soon as they are due;
+ * the others yield while clients are waiting, for at most TASKS_STARVE_MS.
+ */
+typedef enum
+{
+    TASK_URGENT, // Correctness or fairness work (timeouts)
+    TASK_NORMAL, // Housekeeping that should keep up with the load
+    TASK_IDLE    // Work that only pays off when the server has nothing else to do
+} task_priority_t;
+
+/**
+ * @brief A background task. The caller fills in the first five fields and registers the
+ * structure (which must stay alive); the scheduler owns the rest.
+ * A task is due when `interval_ms` has passed since its last slice or `pending` says it
+ * has work. Each slice gets `budget_ns` and must return within it (give or take one
+ * unit of work), keeping its own position between slices.
+ */
+struct task
+{
+    const char *name;               // Name shown by `stats`
+    task_priority_t priority;       // See task_priority_t
+    uint32_t interval_ms;           // Run at least this often (0 = only when pending)
+    uint64_t budget_ns;             // Time one slice may take
+    bool (*pending)(void);          // Returns true if work is waiting now (NULL = interval only)
+    int (*run)(uint64_t budget_ns); // Runs one slice; returns the units of work done
+
+    uint64_t next_due;              // Monotonic time of the next interval run (ns)
+    uint64_t due_since;             // Monotonic time the task started waiting for a slice (0 = not waiting)
+    uint64_t runs;                  // Slices run
+    uint64_t work;                  // Units of work done (sum of `run` results)
+    uint64_t total_ns;              // Time spent in all slices
+    uint64_t max_ns;                // Longest slice
+    uint64_t deferred;              // Times the task yielded to client work
+};
+
+int tasks_init(int epoll_fd);
+int tasks_register(struct task *task);
+int tasks_timer_fd(void);
+void tasks_tick(void);
+void tasks_run(void);
+void tasks_shutdown(void);
+int tasks_stats(char *buf, size_t cap);
+
+#endif /* TASKS_H */
@@ -1,9 +1,22 @@
 /* tree.c - Implementation of the MemoDB tree data structure */
-#include "tree.h" // Include its own header for definitions and prototypes
+#include "tree.h"  // Include its own header for definitions and prototypes
+#include "value.h" // Value storage path (compression)
+#include "arena.h" // Huge-page backed allocation of nodes and leaves
+#include "mvcc.h"  // Version chains and tombstones
+#include "hash.h"  // hash_bytes (child and key indexes)
+#include "packed.h" // Packed small files
+#include "region.h" // Per-file allocation of leaves and values
 
 // Global root of the MemoDB tree. This is defined here and declared extern in tree.h.
 Tree root;
 
+// Incremented by reaper_init (DROP) and move_node (RENAME), so resumable walks (glob.c) can tell
+// their saved position is stale.
+uint64_t tree_generation;
+
+// Advanced by the value log's task (vlog.c); lookups copy it into the leaves they find.
+uint16_t tier_clock;
+
 /**
  * @brief Generates an indentation string for pretty-printing the tree.
  * @param n The number of indentation levels (each level is two spaces).
@@ -35,16 +48,42 @@ uint8_t *indent(uint8_t n)
     return buf;
 }
 
+/**
+ * @brief Prints one key of the tree (see print_tree).
+ */
+static void print_leaf(uint8_t fd, uint8_t indentation, Leaf *l)
+{
+    if (l->flags & LeafDeleted)
+    {
+        return; // Tombstones only exist for snapshot readers.
+    }
+    Print(fd, indent(indentation));
+    Print(fd, "Leaf[");
+    Print(fd, (char *)l->key);
+    Print(fd, "] = '");
+    char *plain = value_dup(l); // Values may be stored compressed.
+    Print(fd, plain ? plain : "<unreadable>");
+    free(plain);
+    Print(fd, "' (size: ");
+
+    // Convert size (integer) to string for printing.
+    char size_str[16];
+    snprintf(size_str, sizeof(size_str), "%d", l->size);
+    Print(fd, size_str);
+    Print(fd, ")\n");
+}
+
 /**
  * @brief Prints the tree structure to a given file descriptor (e.g., standard output).
- * This function recursively traverses the tree and prints nodes and their associated leaves.
+ * Nodes are visited in pre-order, so every node is followed by its leaves and then by its
+ * sub-paths, indented one level deeper.
  *
  * @param fd The file descriptor to write the output to (e.g., 1 for stdout).
  * @param _root The root of the tree (or subtree) to print.
  */
 void print_tree(uint8_t fd, Tree *_root)
 {
-    uint8_t indentation;
+    node_iter_t it;
     Node *n;
     Leaf *l;
 
@@ -54,11 +93,12 @@ void print_tree(uint8_t fd, Tree *_root)
         return;
     }
 
-    indentation = 0;
-
-    // Traverse nodes (nodes are linked via their 'west' pointer, forming a flat list here)
-    for (n = (Node *)_root; n; n = n->west)
+    node_iter_init(&it, (Node *)_root, false);
+    while ((n = node_iter_next(&it)) != NULL)
     {
+        // Clamp so indent() (and a leaf one level deeper) stays within its buffer.
+        uint8_t indentation = it.depth < 126 ? (uint8_t)it.depth : 126;
+
         // Print node information.
         Print(fd, indent(indentation));
         Print(fd, "Node[");
@@ -72,26 +112,118 @@ void print_tree(uint8_t fd, Tree *_root)
         Print(fd, ")\n");
 
         // Print associated leaves (leaves are linked via 'east' pointer from this node).
-        if (n->east) // Check if this node has any leaves.
+        for (l = n->east; l; l = l->east) // Iterate through the leaves.
         {
-            for (l = n->east; l; l = l->east) // Iterate through the leaves.
-            {
-                Print(fd, indent(indentation + 1)); // Indent leaves more than their parent node.
-                Print(fd, "Leaf[");
-                Print(fd, (char *)l->key);
-                Print(fd, "] = '");
-                Print(fd, (char *)l->value);
-                Print(fd, "' (size: ");
-
-                // Convert size (integer) to string for printing.
-                char size_str[16];
-                snprintf(size_str, sizeof(size_str), "%d", l->size);
-                Print(fd, size_str);
-                Print(fd, ")\n");
-            }
+            print_leaf(fd, indentation + 1, l); // Indent leaves more than their parent node.
+        }
+        // Keys of a packed file are printed the same way.
+        Leaf view;
+        for (unsigned i = 0; (l = packed_at(n, i, &view)) != NULL; i++)
+        {
+            print_leaf(fd, indentation + 1, l);
+        }
+    }
+}
+
+/**
+ * @brief Descends to the first node (in post-order) of the subtree rooted at `n`.
+ * @param depth Depth of `n` on entry; depth of the returned node on return.
+ */
+static Node *leftmost_descendant(Node *n, uint16_t *depth)
+{
+    while (n->first_child != NULL)
+    {
+        n = n->first_child;
+        (*depth)++;
+    }
+    return n;
+}
+
+/**
+ * @brief Starts a walk over the subtree rooted at `top` (including `top` itself).
+ * @param it The iterator to initialize.
+ * @param top The subtree root.
+ * @param post True for post-order (children before their parent), false for pre-order.
+ */
+void node_iter_init(node_iter_t *it, Node *top, bool post)
+{
+    it->top = top;
+    it->post = post;
+    it->depth = 0;
+    it->next_depth = 0;
+    it->next = (post && top != NULL) ? leftmost_descendant(top, &it->next_depth) : top;
+}
+
+/**
+ * @brief Returns the next node of the walk, or NULL when the subtree is exhausted.
+ * The successor is computed before the node is returned, so in post-order the caller
+ * may free (or unlink) the returned node right away.
+ *
+ * @param it The iterator.
+ * @return The next Node; `it->depth` holds its depth below `top`.
+ */
+Node *node_iter_next(node_iter_t *it)
+{
+    Node *ret = it->next;
+    if (ret == NULL)
+    {
+        return NULL;
+    }
+    it->depth = it->next_depth;
+
+    if (it->post)
+    {
+        if (ret == it->top)
+        {
+            it->next = NULL; // The subtree root comes last.
+        }
+        else if (ret->next_sibling != NULL)
+        {
+            it->next = leftmost_descendant(ret->next_sibling, &it->next_depth);
+        }
+        else
+        {
+            it->next = ret->north; // All children done: visit the parent.
+            it->next_depth--;
+        }
+    }
+    else if (ret->first_child != NULL)
+    {
+        it->next = ret->first_child;
+        it->next_depth++;
+    }
+    else
+    {
+        // Climb until some ancestor (below `top`) has a sibling left to visit.
+        Node *n = ret;
+        while (n != it->top && n->next_sibling == NULL)
+        {
+            n = n->north;
+            it->next_depth--;
         }
+        it->next = (n == it->top) ? NULL : n->next_sibling;
+    }
+    return ret;
+}
 
-        indentation++; // Increase indentation for child nodes (if recursion were used).
+/**
+ * @brief Counts the nodes and leaves of a subtree (including `top` and its leaves).
+ * @param top The subtree root.
+ * @param nodes Receives the number of nodes.
+ * @param leaves Receives the number of leaves (including MVCC tombstones).
+ */
+void count_subtree(Node *top, uint64_t *nodes, uint64_t *leaves)
+{
+    node_iter_t it;
+    Node *n;
+
+    *nodes = 0;
+    *leaves = 0;
+    node_iter_init(&it, top, false);
+    while ((n = node_iter_next(&it)) != NULL)
+    {
+        (*nodes)++;
+        *leaves += n->nleaves;
     }
 }
 
@@ -110,7 +242,45 @@ void zero(uint8_t *ptr, uint16_t size)
 }
 
 /**
- * @brief Creates a new Node and links it as a child (via 'west' link) to the parent.
+ * @brief Links a node as the first child of `parent` (O(1) at the head of the list).
+ */
+static void link_child(Node *parent, Node *node)
+{
+    node->prev_sibling = NULL;
+    node->next_sibling = parent->first_child; // Existing children become the new node's siblings.
+    if (parent->first_child != NULL)
+    {
+        parent->first_child->prev_sibling = node;
+    }
+    parent->first_child = node; // Parent now points to this new node as its first child.
+    parent->nchildren++;
+}
+
+/**
+ * @brief Unlinks a node from its parent's list of children in O(1), whatever its
+ * position among its siblings.
+ */
+static void unlink_child(Node *parent, Node *node)
+{
+    if (node->prev_sibling != NULL)
+    {
+        node->prev_sibling->next_sibling = node->next_sibling;
+    }
+    else
+    {
+        parent->first_child = node->next_sibling;
+    }
+    if (node->next_sibling != NULL)
+    {
+        node->next_sibling->prev_sibling = node->prev_sibling;
+    }
+    node->next_sibling = NULL;
+    node->prev_sibling = NULL;
+    parent->nchildren--;
+}
+
+/**
+ * @brief Creates a new Node and links it as the first child of the parent.
  *
  * @param parent The parent Node to which the new node will be linked.
  * @param path The path segment for the new node.
@@ -125,7 +295,7 @@ Node *create_node(Node *parent, int8_t *path)
     assert(parent != NULL && "Error: Parent node cannot be NULL when creating a new node.");
 
     node_size = sizeof(struct s_node); // Determine the exact size required for a `Node` structure.
-    node = (Node *)malloc(node_size);  // Allocate memory from the heap.
+    node = (Node *)arena_alloc(node_size); // Allocate memory from the huge-page arena.
 
     // Error handling: Check if memory allocation was successful.
     if (node == NULL)
@@ -136,13 +306,6 @@ Node *create_node(Node *parent, int8_t *path)
 
     zero((uint8_t *)node, node_size); // Initialize the allocated memory to all zeros.
 
-    // Link the newly created node into the tree structure.
-    // In this tree design, 'west' is used as a sibling link for nodes,
-    // so new nodes are typically added to a list branched from the parent.
-    // The ensure_node_path function in main.c handles adding new children.
-    node->west = parent->west; // Link new node to existing sibling list.
-    parent->west = node;       // Parent now points to this new node as its first child.
-
     node->tag = TagNode;  // Assign the appropriate tag to identify this as a Node.
     node->north = parent; // Set the new node's 'north' (parent) pointer.
     node->east = NULL;    // Initialize 'east' (pointer to first Leaf) to NULL.
@@ -150,6 +313,18 @@ Node *create_node(Node *parent, int8_t *path)
     // Safely copy the provided path segment into the new node's `path` field.
     // snprintf ensures null-termination and prevents buffer overflow.
     snprintf((char *)node->path, sizeof(node->path), "%s", (char *)path);
+    node->link.hash = hash_bytes(node->path, strlen((char *)node->path));
+
+    // Index the node under its parent first: it is the only step here that can fail.
+    if (hindex_insert(&parent->children, &node->link) != 0)
+    {
+        arena_free(node, node_size);
+        reterr(ENOMEM);
+    }
+
+    // Link the newly created node into the parent's list of children (O(1) at the head).
+    // The ensure_node_path function in main.c handles adding new children.
+    link_child(parent, node);
 
     return node;
 }
@@ -161,12 +336,13 @@ Node *create_node(Node *parent, int8_t *path)
  *
  * @param path The path (Node) where the leaf is expected to be.
  * @param key The key of the leaf to find.
- * @return Pointer to the found Leaf, or NULL if not found.
+ * @return Pointer to the found Leaf, or NULL if not found. Keys of packed files are
+ * returned as a static view that the next call overwrites.
  */
 Leaf *find_leaf_linear(int8_t *path, int8_t *key)
 {
+    static Leaf view;
     Node *n;
-    Leaf *l, *ret;
 
     // Get the Node of the given path.
     n = find_node_linear(path);
@@ -177,102 +353,324 @@ Leaf *find_leaf_linear(int8_t *path, int8_t *key)
         return NULL;
     }
 
-    // Linear Algorithm to traverse leaves associated with the found node.
-    for (ret = NULL, l = n->east; l != NULL; l = l->east)
+    // Tombstones (LeafDeleted) are skipped: they are only visible to snapshot readers.
+    return node_read(n, (char *)key, MVCC_LATEST, &view);
+}
+
+/**
+ * @brief Walks one chain of a Node's key index for a key whose hash is already known.
+ * @return The Leaf or old version visible in `snapshot`, or NULL.
+ */
+static Leaf *resolve_leaf(struct hlink *h, const char *key, uint64_t hash, uint64_t snapshot)
+{
+    for (; h != NULL; h = h->next)
     {
-        if (strcmp((char *)l->key, (char *)key) == 0)
+        Leaf *l = hlink_entry(h, Leaf, link);
+        if (h->hash == hash && strcmp((char *)l->key, key) == 0)
         {
-            ret = l; // Found the leaf.
-            break;   // Exit loop.
+            Leaf *v = mvcc_visible(l, snapshot);
+            if (v != NULL)
+            {
+                l->atime = tier_clock;
+                return v;
+            }
         }
     }
-    return ret; // Return the found leaf or NULL.
+    return NULL;
+}
+
+/**
+ * @brief Finds the version of a key that a snapshot sees within one Node.
+ * A key can briefly appear twice in a Node's leaf list (a tombstone kept for older
+ * snapshots plus the leaf created after the delete); at most one of them is visible.
+ *
+ * @param node The Node holding the leaves.
+ * @param key The key to find.
+ * @param snapshot A snapshot from mvcc_snapshot_open, or MVCC_LATEST.
+ * @return The visible Leaf or old version, or NULL if the key doesn't exist in the snapshot.
+ */
+Leaf *find_leaf_at(Node *node, const char *key, uint64_t snapshot)
+{
+    uint64_t hash = hash_bytes(key, strlen(key));
+    return resolve_leaf(hindex_head(&node->keys, hash), key, hash, snapshot);
 }
 
 /**
- * @brief Finds a Node by traversing the tree linearly based on the provided path.
- * The path can contain multiple segments separated by '/'.
+ * @brief Reads a key of a file whatever its encoding: from its leaves (find_leaf_at) or,
+ * for a packed file, as a Leaf-shaped view of the packed entry. Use this for reads;
+ * writers go through packed_set/packed_del first.
+ *
+ * @param node The file's Node.
+ * @param key The key to find.
+ * @param snapshot A snapshot from mvcc_snapshot_open, or MVCC_LATEST.
+ * @param view Filled for packed files (only valid until the file is next written).
+ * @return The visible Leaf, old version or `view`, or NULL if the key isn't visible.
+ */
+Leaf *node_read(Node *node, const char *key, uint64_t snapshot, Leaf *view)
+{
+    return node->packed ? packed_find(node, key, snapshot, view) : find_leaf_at(node, key, snapshot);
+}
+
+/**
+ * @brief Looks up many keys of one Node at once (as find_leaf_at for each key).
+ * The keys are processed in groups of LOOKUP_BATCH_GROUP with group prefetching:
+ * first every key of the group is hashed and its bucket prefetched, then every bucket
+ * head is loaded and the leaf it points to prefetched, and only then are the chains
+ * walked. The cache misses of a whole group thus overlap instead of being paid one
+ * dependent pointer chase after another.
+ *
+ * @param node The Node holding the leaves.
+ * @param keys The keys to find.
+ * @param n Number of keys.
+ * @param snapshot A snapshot from mvcc_snapshot_open, or MVCC_LATEST.
+ * @param out Receives, per key, the visible Leaf, old version or view, or NULL.
+ * @param views `n` views, used when the file is packed (see node_read).
+ */
+void find_leaves_batch(Node *node, const char *const *keys, size_t n, uint64_t snapshot, Leaf **out,
+                       Leaf *views)
+{
+    uint64_t hash[LOOKUP_BATCH_GROUP];
+    struct hlink *head[LOOKUP_BATCH_GROUP];
+    const struct hindex *idx = &node->keys;
+
+    if (node->packed != NULL)
+    {
+        // A packed file is one small buffer: there are no misses to overlap.
+        for (size_t i = 0; i < n; i++)
+        {
+            out[i] = packed_find(node, keys[i], snapshot, &views[i]);
+        }
+        return;
+    }
+
+    if (idx->buckets == NULL)
+    {
+        memset(out, 0, n * sizeof(Leaf *)); // No keys at all.
+        return;
+    }
+
+    for (size_t base = 0; base < n; base += LOOKUP_BATCH_GROUP)
+    {
+        size_t group = (n - base < LOOKUP_BATCH_GROUP) ? n - base : LOOKUP_BATCH_GROUP;
+
+        // Stage 1: hash and prefetch the buckets.
+        for (size_t i = 0; i < group; i++)
+        {
+            hash[i] = hash_bytes(keys[base + i], strlen(keys[base + i]));
+            __builtin_prefetch(&idx->buckets[hindex_slot(idx, hash[i])]);
+        }
+        // Stage 2: load the chain heads and prefetch the first leaf (link and key).
+        for (size_t i = 0; i < group; i++)
+        {
+            head[i] = idx->buckets[hindex_slot(idx, hash[i])];
+            if (head[i] != NULL)
+            {
+                __builtin_prefetch(head[i]);
+                __builtin_prefetch(hlink_entry(head[i], Leaf, link)->key);
+            }
+        }
+        // Stage 3: resolve (chains are short, so the first leaf is usually the match).
+        for (size_t i = 0; i < group; i++)
+        {
+            out[base + i] = resolve_leaf(head[i], keys[base + i], hash[i], snapshot);
+        }
+    }
+}
+
+/**
+ * @brief Finds a Node from a parsed path, using the precomputed segment hashes.
+ *
+ * @param path The parsed path (no segments means the root).
+ * @return Pointer to the found Node, or NULL if not found.
+ */
+Node *find_node_path(const path_t *path)
+{
+    Node *current_node = &(root.node); // Start from the global root Node.
+
+    for (uint16_t i = 0; i < path->nseg && current_node != NULL; i++)
+    {
+        current_node = find_child_hashed(current_node, path->buf + path->seg_off[i], path->seg_len[i],
+                                          path->seg_hash[i]);
+    }
+    if (current_node == NULL)
+    {
+        errno = ENOENT; // No such entry.
+    }
+    return current_node;
+}
+
+/**
+ * @brief Finds the live value of a key under a parsed path (see node_read).
+ * @return The Leaf or `view`, or NULL if the path or key doesn't exist.
+ */
+Leaf *find_leaf_path(const path_t *path, const char *key, Leaf *view)
+{
+    Node *n = find_node_path(path);
+    return n ? node_read(n, key, MVCC_LATEST, view) : NULL;
+}
+
+/**
+ * @brief Finds a Node by traversing the tree based on the provided path.
+ * The path can contain multiple segments separated by '/'. Callers that already
+ * hold a parsed path should use find_node_path instead.
  *
  * @param path The full path string (e.g., "users/john/data").
  * @return Pointer to the found Node, or NULL if not found or on error.
  */
 Node *find_node_linear(int8_t *path)
 {
-    Node *current_node;
-    char *path_copy;
-    char *token;
-    char *saveptr; // For strtok_r state.
+    path_t parsed;
 
     // Pre-condition check: path must be valid.
-    if (path == NULL)
+    if (path == NULL || path_parse(&parsed, (char *)path) != 0)
     {
         reterr(EINVAL); // Invalid argument.
     }
+    return find_node_path(&parsed);
+}
 
-    // Start from the global root Node.
-    current_node = &(root.node);
+/**
+ * @brief Finds a direct child of a Node by its path segment.
+ * @param parent The Node whose children are searched.
+ * @param name The path segment (no slashes).
+ * @return The child Node, or NULL if there is none with that name.
+ */
+Node *find_child(Node *parent, const char *name)
+{
+    size_t len = strlen(name);
+    return find_child_hashed(parent, name, len, hash_bytes(name, len));
+}
 
-    // Make a copy of the path since strtok_r modifies the string.
-    path_copy = strdup((char *)path);
-    if (path_copy == NULL)
+/**
+ * @brief Finds a direct child of a Node by a segment whose hash is already known.
+ * @param parent The Node whose children are searched.
+ * @param name The path segment (need not be NUL-terminated).
+ * @param len Length of the segment.
+ * @param hash hash_bytes() of the segment (e.g. from path_t.seg_hash).
+ * @return The child Node, or NULL if there is none with that name.
+ */
+Node *find_child_hashed(Node *parent, const char *name, size_t len, uint64_t hash)
+{
+    for (struct hlink *h = hindex_head(&parent->children, hash); h != NULL; h = h->next)
     {
-        reterr(ENOMEM); // Out of memory.
+        Node *child = hlink_entry(h, Node, link);
+        if (h->hash == hash && strncmp((char *)child->path, name, len) == 0 && child->path[len] == '\0')
+        {
+            return child;
+        }
     }
+    return NULL;
+}
 
-    // Skip leading slash if present.
-    char *path_start = path_copy;
-    if (path_start[0] == '/')
+/**
+ * @brief Writes the full path of a Node ("a/b/c", or "/" for the root).
+ *
+ * @param node The Node.
+ * @param buf Output buffer.
+ * @param cap Size of `buf`.
+ * @return Length of the path, or -1 if it doesn't fit (`buf` is then empty).
+ */
+int node_path(Node *node, char *buf, size_t cap)
+{
+    size_t len = 0;
+
+    // First pass: measure, so the second pass can fill the buffer from the end.
+    for (Node *n = node; n->north != NULL; n = n->north)
     {
-        path_start++;
+        len += strlen((char *)n->path) + (len ? 1 : 0);
     }
-
-    // If path is empty or just "/", return the root.
-    if (strlen(path_start) == 0)
+    if (len == 0)
     {
-        free(path_copy); // Free the duplicated string.
-        return current_node;
+        return snprintf(buf, cap, "/") < (int)cap ? 1 : -1;
     }
-
-    // Tokenize the path by '/' and traverse the tree.
-    token = strtok_r(path_start, "/", &saveptr);
-
-    // Loop through each path segment.
-    while (token != NULL)
+    if (len + 1 > cap)
     {
-        bool found = false;
-        Node *child = current_node->west; // Start searching among the current node's direct children.
-
-        // Search through the linked list of children (linked via 'west' pointers).
-        while (child != NULL)
+        if (cap > 0)
         {
-            if (strcmp((char *)child->path, token) == 0)
-            {
-                current_node = child; // Found the next segment, move to this child node.
-                found = true;
-                break;
-            }
-            child = child->west; // Move to the next sibling.
+            buf[0] = '\0';
         }
+        return -1;
+    }
 
-        if (!found)
+    size_t pos = len;
+    buf[len] = '\0';
+    for (Node *n = node; n->north != NULL; n = n->north)
+    {
+        size_t seg = strlen((char *)n->path);
+        pos -= seg;
+        memcpy(buf + pos, n->path, seg);
+        if (pos > 0)
         {
-            // Path segment not found.
-            free(path_copy); // Clean up allocated memory.
-            reterr(ENOENT);  // No such entry.
+            buf[--pos] = '/';
         }
+    }
+    return (int)len;
+}
+
+/**
+ * @brief Reverses the bits of a 64-bit word (for the scan cursor).
+ */
+static uint64_t reverse_bits(uint64_t v)
+{
+    uint64_t r = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        r = (r << 1) | (v & 1);
+        v >>= 1;
+    }
+    return r;
+}
 
-        // Move to the next path segment token.
-        token = strtok_r(NULL, "/", &saveptr);
+/**
+ * @brief Pages through the children of a node using its child index.
+ * The cursor walks the buckets in reverse-binary order, so a child that exists for the
+ * whole scan is returned at least once even if the index doubles between calls, and
+ * each call costs O(count) no matter how many children the node has. The guarantee
+ * does not survive a re-salt of the index (see hindex_insert), which only happens when
+ * a chain grows abnormally long; a scan running across one may miss or repeat children.
+ *
+ * @param parent The node whose children are listed.
+ * @param cursor 0 to start, then the value returned by the previous call.
+ * @param count Minimum number of children to emit (whole buckets are emitted, so a call
+ * may return a few more; fewer only at the end of the scan).
+ * @param emit Called once per child.
+ * @param ctx Passed through to `emit`.
+ * @return The cursor for the next call, or 0 when the scan is complete.
+ */
+uint64_t scan_children(Node *parent, uint64_t cursor, uint32_t count, void (*emit)(Node *child, void *ctx),
+                       void *ctx)
+{
+    if (parent->children.buckets == NULL)
+    {
+        return 0; // No children.
     }
 
-    free(path_copy);     // Free the duplicated string.
-    return current_node; // Return the node corresponding to the full path.
+    uint64_t mask = parent->children.mask;
+    uint32_t emitted = 0;
+    do
+    {
+        for (struct hlink *h = parent->children.buckets[cursor & mask]; h != NULL; h = h->next)
+        {
+            emit(hlink_entry(h, Node, link), ctx);
+            emitted++;
+        }
+
+        // Advance: increment the masked bits starting from the top one (set the bits above
+        // the mask so the carry runs through them, reverse, add one, reverse back).
+        cursor |= ~mask;
+        cursor = reverse_bits(cursor);
+        cursor++;
+        cursor = reverse_bits(cursor);
+    } while (cursor != 0 && emitted < count);
+
+    return cursor;
 }
 
 /**
  * @brief Looks up a value given a path and a key.
  * This function is a wrapper around `find_leaf_linear` to directly
- * return the value's pointer.
+ * return the value's pointer. The value is returned as stored; use
+ * `value_dup` on the Leaf when it may be compressed (LeafCompressed) or cold (LeafCold).
  *
  * @param path The path (Node) where the key is located.
  * @param key The key to look up.
@@ -301,27 +699,10 @@ int8_t *lookup_linear(int8_t *path, int8_t *key)
  */
 Leaf *find_last_linear(Node *parent)
 {
-    Leaf *current_leaf; // Iterator for traversing the leaf list.
-
     // Pre-condition check: Ensure the parent node is valid.
     assert(parent != NULL && "Error: Parent node cannot be NULL for find_last_linear.");
 
-    // If the parent has no 'east' leaf, the list is empty.
-    if (parent->east == NULL)
-    {
-        return NULL; // No leaves found.
-    }
-
-    current_leaf = parent->east; // Start traversal from the first leaf.
-
-    // Iterate through the linked list of leaves until the last one is found.
-    while (current_leaf->east != NULL)
-    {
-        assert(current_leaf != NULL && "Error: NULL leaf pointer encountered during linear search.");
-        current_leaf = current_leaf->east;
-    }
-
-    return current_leaf; // Return the last leaf.
+    return parent->last_leaf; // Maintained by create_leaf and unlink_leaf.
 }
 
 /**
@@ -349,7 +730,7 @@ Leaf *create_leaf(Tree *west, uint8_t *key, uint8_t *value, uint16_t size)
     leaf_list_last = find_last_linear((Node *)west);
 
     leaf_struct_size = sizeof(struct s_leaf);    // Determine the size required for a `Leaf` structure.
-    new_leaf = (Leaf *)malloc(leaf_struct_size); // Allocate memory for the new Leaf structure.
+    new_leaf = (Leaf *)region_alloc(&west->node.region, leaf_struct_size); // Allocate from the file's region.
 
     // Error handling: Check if `malloc` for the leaf structure failed.
     if (new_leaf == NULL)
@@ -360,41 +741,45 @@ Leaf *create_leaf(Tree *west, uint8_t *key, uint8_t *value, uint16_t size)
 
     zero((uint8_t *)new_leaf, leaf_struct_size); // Initialize the new leaf structure to zeros.
 
-    // Link the new leaf into the existing list or directly to the parent Node.
-    if (leaf_list_last == NULL)
-    {
-        // If no existing leaves for this node, link directly to the 'east' of the parent Node.
-        west->node.east = new_leaf;
-    }
-    else
-    {
-        // If there are existing leaves, link the new leaf after the last one found.
-        leaf_list_last->east = new_leaf;
-    }
-
     new_leaf->tag = TagLeaf; // Set the tag for the new leaf.
     new_leaf->west = west;   // Set the 'west' pointer for the new leaf (back-link to parent/sibling).
     new_leaf->east = NULL;   // New leaf is always the last in its chain.
+    new_leaf->prev = leaf_list_last;
 
     // Safely copy the provided key into the new leaf's `key` field.
     snprintf((char *)new_leaf->key, sizeof(new_leaf->key), "%s", (char *)key);
     // Explicitly null-terminate, though snprintf should handle this if buffer is large enough.
     new_leaf->key[sizeof(new_leaf->key) - 1] = '\0';
+    new_leaf->link.hash = hash_bytes(new_leaf->key, strlen((char *)new_leaf->key));
 
-    // Allocate memory for the value data. (+1 for null terminator).
-    new_leaf->value = (int8_t *)malloc(size + 1);
-    // Error handling: Check if `malloc` for value data failed.
-    if (new_leaf->value == NULL)
+    // Store the value through the value storage path (which may compress it), then index
+    // the key; the leaf is only linked once nothing can fail any more.
+    if (value_store(new_leaf, value, size) != 0)
     {
-        perror("ERROR: Failed to allocate memory for Leaf value");
-        free(new_leaf); // Free the leaf structure if value allocation fails.
+        region_free(west->node.region, new_leaf, leaf_struct_size); // Free the leaf structure if value allocation fails.
         reterr(ENOMEM); // Use reterr macro.
     }
-    zero((uint8_t *)new_leaf->value, size + 1); // Initialize the allocated value memory to zeros.
+    if (hindex_insert(&west->node.keys, &new_leaf->link) != 0)
+    {
+        value_release(new_leaf);
+        region_free(west->node.region, new_leaf, leaf_struct_size);
+        reterr(ENOMEM);
+    }
 
-    memcpy(new_leaf->value, value, size); // Copy the provided value data.
-    new_leaf->size = size;                // Store the actual size of the value.
+    // Link the new leaf into the existing list or directly to the parent Node.
+    if (leaf_list_last == NULL)
+    {
+        // If no existing leaves for this node, link directly to the 'east' of the parent Node.
+        west->node.east = new_leaf;
+    }
+    else
+    {
+        // If there are existing leaves, link the new leaf after the last one found.
+        leaf_list_last->east = new_leaf;
+    }
+    west->node.last_leaf = new_leaf;
 
+    west->node.nleaves++;
     return new_leaf; // Return the newly created leaf.
 }
 
@@ -406,20 +791,77 @@ void free_leaf(Leaf *leaf)
 {
     if (leaf != NULL)
     {
-        if (leaf->value != NULL)
+        mvcc_forget(leaf);                       // Free old versions kept for snapshots.
+        value_release(leaf);                     // Free the dynamically allocated value.
+        region_free(((Node *)leaf->west)->region, leaf, sizeof(struct s_leaf)); // Free the Leaf structure itself.
+    }
+}
+
+/**
+ * @brief Removes a Leaf from its Node's leaf list and key index (without freeing it).
+ * @param node The Node the leaf is attached to.
+ * @param leaf The leaf to unlink.
+ */
+void unlink_leaf(Node *node, Leaf *leaf)
+{
+    hindex_remove(&node->keys, &leaf->link);
+
+    if (leaf->prev != NULL)
+    {
+        leaf->prev->east = leaf->east;
+    }
+    else
+    {
+        node->east = leaf->east;
+    }
+    if (leaf->east != NULL)
+    {
+        leaf->east->prev = leaf->prev;
+    }
+    else
+    {
+        node->last_leaf = leaf->prev;
+    }
+    leaf->east = leaf->prev = NULL;
+    node->nleaves--;
+}
+
+/**
+ * @brief Frees all leaves directly attached to a Node and empties its leaf list.
+ * @param node Pointer to the Node.
+ */
+static void free_leaves(Node *node)
+{
+    // Leaves and private values live in the file's region and go away with it. Only values
+    // that hold something outside the region (shared entries, compression counters) or MVCC
+    // state (versions, tombstones in the GC list) need each leaf to be released.
+    bool fast = node->npinned == 0 && mvcc_idle();
+    if (!fast)
+    {
+        Leaf *current_leaf = node->east;
+        while (current_leaf != NULL)
         {
-            free(leaf->value); // Free the dynamically allocated value.
+            Leaf *next_leaf = current_leaf->east; // Store next leaf before freeing current.
+            free_leaf(current_leaf);              // Free the current leaf.
+            current_leaf = next_leaf;             // Move to the next leaf.
         }
-        free(leaf); // Free the Leaf structure itself.
     }
+    if (node->region != NULL)
+    {
+        region_note_drop(fast);
+        region_destroy(&node->region);
+    }
+    hindex_free(&node->keys);
+    packed_free(node);
+    node->east = NULL;
+    node->last_leaf = NULL;
+    node->nleaves = 0;
 }
 
 /**
- * @brief Recursively frees a Node and all leaves directly attached to it.
- * This function does NOT traverse to child nodes (west-linked branches),
- * only the leaves linked via 'east' from the current node.
- * This is meant to be called for individual nodes after they've been
- * removed from their parent's 'west' list.
+ * @brief Frees a single Node and all leaves directly attached to it.
+ * This function does NOT traverse to child nodes; it is meant to be called for
+ * nodes whose children are already gone (see drop_subtree).
  *
  * @param node Pointer to the Node to free.
  */
@@ -428,68 +870,430 @@ void free_node_and_leaves(Node *node)
     if (node == NULL)
         return;
 
-    // Free all leaves attached to this node (linked via 'east' pointer).
-    Leaf *current_leaf = node->east;
-    while (current_leaf != NULL)
+    free_leaves(node);                       // Free all leaves attached to this node.
+    hindex_free(&node->children);            // Free the (now empty) child index.
+    arena_free(node, sizeof(struct s_node)); // Free the Node structure itself.
+}
+
+/**
+ * @brief Starts dropping a subtree: detaches it from the tree at once, so no lookup can
+ * reach it any more, and leaves the freeing to reaper_step. Nothing else points into a
+ * detached subtree (saved walks check tree_generation), so it can be freed a slice at a time.
+ * The root itself is never freed (it is a static): dropping it empties the tree, with the
+ * root's own leaves released right away and its children detached for the reaper.
+ *
+ * @param r The reaper to initialize.
+ * @param node The subtree root to drop.
+ */
+void reaper_init(reaper_t *r, Node *node)
+{
+    r->nodes = 0;
+    r->keys = 0;
+    r->rest = NULL;
+    node_iter_init(&r->it, NULL, true);
+    if (node == NULL)
+        return;
+
+    tree_generation++; // Node pointers held across commands may now dangle.
+
+    if (node->tag == TagRoot)
     {
-        Leaf *next_leaf = current_leaf->east; // Store next leaf before freeing current.
-        free_leaf(current_leaf);              // Free the current leaf.
-        current_leaf = next_leaf;             // Move to the next leaf.
+        r->rest = node->first_child;
+        r->nodes = 1;
+        r->keys = node->nleaves;
+        free_leaves(node);
+        hindex_free(&node->children);
+        node->first_child = NULL;
+        node->nchildren = 0;
+        return;
     }
 
-    free(node); // Free the Node structure itself.
+    // Unlink from the parent's list of children first (O(1) through the sibling links).
+    Node *parent = node->north;
+    if (parent != NULL)
+    {
+        unlink_child(parent, node);
+        hindex_remove(&parent->children, &node->link);
+    }
+    r->rest = node;
 }
 
 /**
- * @brief Frees the entire tree structure starting from the given root.
- * This function traverses the tree (both 'west' child nodes and 'east' leaves)
- * and deallocates all dynamically allocated memory.
- * This is a depth-first traversal for nodes, then cleans up leaves.
+ * @brief Frees part of a detached subtree, children before their parents.
  *
- * @param root Pointer to the root of the tree to free.
+ * @param r The reaper.
+ * @param budget Work allowed: each node costs one unit plus one per key it holds
+ * (the node in progress is always finished, so a step may overrun by one node).
+ * @return True once everything is freed (`nodes` and `keys` then hold the totals).
  */
-void free_tree(Tree *root_union)
+bool reaper_step(reaper_t *r, uint64_t budget)
 {
-    if (root_union == NULL)
-        return;
+    uint64_t work = 0;
+
+    while (work < budget)
+    {
+        Node *n = node_iter_next(&r->it);
+        if (n == NULL)
+        {
+            if (r->rest == NULL)
+            {
+                return true;
+            }
+            // Next detached subtree (several only when the root was dropped).
+            Node *top = r->rest;
+            r->rest = top->next_sibling;
+            top->next_sibling = NULL;
+            node_iter_init(&r->it, top, true);
+            continue;
+        }
+        r->nodes++;
+        r->keys += n->nleaves;
+        work += 1 + n->nleaves;
+        free_node_and_leaves(n);
+    }
+    return r->it.next == NULL && r->rest == NULL;
+}
+
+/**
+ * @brief Detaches a Node from its parent and frees it together with its whole subtree.
+ * Runs in O(subtree) with no recursion or allocation, so it is safe at any depth.
+ * The root itself is never freed (it is a static): dropping it empties the tree.
+ *
+ * @param node The subtree root to drop.
+ */
+void drop_subtree(Node *node)
+{
+    reaper_t r;
+
+    reaper_init(&r, node);
+    reaper_step(&r, UINT64_MAX); // An unlimited budget frees everything in one call.
+}
+
+/**
+ * @brief Moves a Node, with its whole subtree, under another parent and/or to another
+ * name. Only the node itself is touched (its parent links, child index entry and path
+ * segment): its keys, regions and descendants move with it as they are.
+ *
+ * @param node The node to move (not the root).
+ * @param parent The new parent (must not be `node` or one of its descendants).
+ * @param name The new path segment (no slashes; no sibling under `parent` may have it).
+ * @return 0 on success, -1 with errno EINVAL (root or cycle), EEXIST (name taken) or
+ * ENOMEM (the tree is then unchanged).
+ */
+int move_node(Node *node, Node *parent, const char *name)
+{
+    Node *old_parent = node->north;
+    size_t len = strlen(name);
+    uint64_t hash = hash_bytes(name, len);
+
+    if (old_parent == NULL || len == 0 || len >= sizeof(node->path))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for (Node *n = parent; n != NULL; n = n->north)
+    {
+        if (n == node)
+        {
+            errno = EINVAL; // A subtree cannot move into itself.
+            return -1;
+        }
+    }
+    if (find_child_hashed(parent, name, len, hash) != NULL)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+
+    // Re-index first: it is the only step that can fail, and it can be undone.
+    uint64_t old_hash = node->link.hash;
+    hindex_remove(&old_parent->children, &node->link);
+    node->link.hash = hash;
+    if (hindex_insert(&parent->children, &node->link) != 0)
+    {
+        node->link.hash = old_hash;
+        hindex_insert(&old_parent->children, &node->link); // Its bucket array is still there.
+        errno = ENOMEM;
+        return -1;
+    }
+
+    unlink_child(old_parent, node); // O(1), so a move costs O(depth) whatever the fan-out.
+    link_child(parent, node);
+    node->north = parent;
+    memcpy(node->path, name, len + 1);
+
+    tree_generation++; // Saved walks may be positioned inside the moved subtree.
+    return 0;
+}
+
+/**
+ * @brief Moves a key to another file. The destination gets a new Leaf from its own
+ * region (leaves are allocated per file); the value follows it without being copied
+ * when it is shared or compressed (see value_move), and the old leaf is freed.
+ * Only for a leaf without MVCC state that no snapshot can see, into a file using leaves
+ * that has no live key of that name.
+ *
+ * @param from The file holding the leaf.
+ * @param leaf The leaf to move.
+ * @param to The destination file.
+ * @return The leaf in its new place, or NULL on allocation failure (nothing changed then).
+ */
+Leaf *move_leaf(Node *from, Leaf *leaf, Node *to)
+{
+    Leaf *moved = (Leaf *)region_alloc(&to->region, sizeof(struct s_leaf));
+    if (moved == NULL)
+    {
+        reterr(ENOMEM);
+    }
+    memcpy(moved, leaf, sizeof(struct s_leaf)); // Key, key hash, sequence number, flags.
+    moved->west = (Tree *)to;
+    moved->value = NULL;
+    moved->flags &= ~(LeafCompressed | LeafShared | LeafCold);
 
-    // Start with the main root node.
-    Node *current_node = &(root_union->node);
+    if (hindex_insert(&to->keys, &moved->link) != 0)
+    {
+        region_free(to->region, moved, sizeof(struct s_leaf));
+        reterr(ENOMEM);
+    }
+    if (value_move(moved, leaf) != 0)
+    {
+        hindex_remove(&to->keys, &moved->link);
+        region_free(to->region, moved, sizeof(struct s_leaf));
+        reterr(ENOMEM);
+    }
+
+    moved->east = NULL;
+    moved->prev = to->last_leaf;
+    if (to->last_leaf != NULL)
+    {
+        to->last_leaf->east = moved;
+    }
+    else
+    {
+        to->east = moved;
+    }
+    to->last_leaf = moved;
+    to->nleaves++;
 
-    // Recursively free all child nodes (west-linked) first in a depth-first manner.
-    // This part is crucial for correctly freeing the nested node structure.
-    Node *node_to_free = current_node->west; // Get the first child node.
-    current_node->west = NULL;               // Sever the link to children from the root before freeing them, to prevent double freeing.
+    unlink_leaf(from, leaf);
+    free_leaf(leaf); // Only the Leaf structure is left to free.
+    return moved;
+}
 
-    while (node_to_free != NULL)
+/**
+ * @brief Copies the latest keys of one file into another file that has no keys yet.
+ * Leaves get new metadata (from the destination's region, indexed in its key index);
+ * values are shared, not copied (see value_share).
+ *
+ * @param to The new file.
+ * @param from The file copied.
+ * @param seq Commit sequence number of the copy.
+ * @return Number of keys copied, or -1 on allocation failure (`to` may hold some of them).
+ */
+static int64_t clone_keys(Node *to, Node *from, uint64_t seq)
+{
+    if (packed_copy(to, from, seq) != 0)
     {
-        Node *next_node_sibling = node_to_free->west; // Store the next sibling.
-        // Recursively call free_tree on the child. Note: this will free its own children, and its leaves.
-        // The current tree structure uses `west` as a sibling list, not a direct child pointer.
-        // To free entire branches, you'd recursively call on the children nodes.
-        // Given the 'west' link creates a "linear" branch from the root, we'll free them iteratively.
-        // For a true "tree," you'd need a different linking mechanism (e.g., 'children' array or a list of children).
-        // For *this* specific `west` as sibling chain:
-        free_node_and_leaves(node_to_free); // Free the current node in this linear chain and its leaves.
-        node_to_free = next_node_sibling;   // Move to the next sibling in the chain.
+        return -1;
     }
 
-    // After all child nodes (west-linked) are freed, free leaves directly attached to the root.
-    Leaf *current_leaf = current_node->east;
-    current_node->east = NULL; // Sever the link to leaves from the root.
-    while (current_leaf != NULL)
+    int64_t keys = to->nleaves;
+    for (Leaf *leaf = from->east; leaf != NULL; leaf = leaf->east)
     {
-        Leaf *next_leaf = current_leaf->east; // Store next leaf before freeing current.
-        free_leaf(current_leaf);              // Free the current leaf.
-        current_leaf = next_leaf;             // Move to the next leaf.
+        if (leaf->flags & LeafDeleted)
+        {
+            continue; // Tombstones only exist for snapshots of the source.
+        }
+
+        Leaf *copy = (Leaf *)region_alloc(&to->region, sizeof(struct s_leaf));
+        if (copy == NULL)
+        {
+            return -1;
+        }
+        zero((uint8_t *)copy, sizeof(struct s_leaf));
+        copy->tag = TagLeaf;
+        copy->west = (Tree *)to;
+        memcpy(copy->key, leaf->key, sizeof(copy->key));
+        copy->link.hash = leaf->link.hash;
+        copy->seq = seq;
+
+        if (value_share(copy, leaf) != 0 || hindex_insert(&to->keys, &copy->link) != 0)
+        {
+            value_release(copy);
+            region_free(to->region, copy, sizeof(struct s_leaf));
+            return -1;
+        }
+        copy->prev = to->last_leaf;
+        if (to->last_leaf != NULL)
+        {
+            to->last_leaf->east = copy;
+        }
+        else
+        {
+            to->east = copy;
+        }
+        to->last_leaf = copy;
+        to->nleaves++;
+        keys++;
     }
+    return keys;
+}
+
+/**
+ * @brief Copies a Node with its whole subtree under a new parent, for CLONE. Only
+ * metadata is copied (nodes, leaves, indexes): values are shared between both copies
+ * and diverge on the next write to either (copy-on-write, see value_share).
+ * Runs in O(nodes + keys) with no recursion (the clones of the current node's ancestors
+ * are kept by depth).
+ *
+ * @param node The subtree to copy.
+ * @param parent The parent of the copy (must not be inside `node`).
+ * @param name Path segment of the copy (no sibling under `parent` may have it).
+ * @param seq Commit sequence number of the copy.
+ * @param nodes Receives the number of nodes copied.
+ * @param keys Receives the number of keys copied.
+ * @return The copy, or NULL with errno EINVAL, EEXIST or ENOMEM (nothing is left behind).
+ */
+Node *clone_subtree(Node *node, Node *parent, const char *name, uint64_t seq, uint64_t *nodes, uint64_t *keys)
+{
+    Node *copies[PATH_MAX_SEGMENTS + 1]; // copies[d]: clone of the node last visited at depth d
+    node_iter_t it;
+    Node *n;
+
+    for (Node *p = parent; p != NULL; p = p->north)
+    {
+        if (p == node)
+        {
+            reterr(EINVAL); // The walk would run into the copy.
+        }
+    }
+    if (find_child(parent, name) != NULL)
+    {
+        reterr(EEXIST);
+    }
+
+    *nodes = 0;
+    *keys = 0;
+    node_iter_init(&it, node, false);
+    while ((n = node_iter_next(&it)) != NULL)
+    {
+        Node *up = it.depth ? copies[it.depth - 1] : parent;
+        Node *copy = (it.depth < PATH_MAX_SEGMENTS) ? create_node(up, it.depth ? (int8_t *)n->path : (int8_t *)name) : NULL;
+        int64_t copied = copy ? clone_keys(copy, n, seq) : -1;
+        if (copied < 0)
+        {
+            if (*nodes > 0 || copy != NULL)
+            {
+                drop_subtree(*nodes > 0 ? copies[0] : copy);
+            }
+            reterr(ENOMEM);
+        }
+        copies[it.depth] = copy;
+        (*nodes)++;
+        *keys += (uint64_t)copied;
+    }
+    return copies[0];
+}
+
+/**
+ * @brief Rebuilds a file's region: every leaf and private value is copied, in list order,
+ * into one exactly sized block, and the old region is released in one piece. Besides
+ * returning memory this puts the keys back in scan order.
+ * Runs between commands only (it moves leaves), and only while no MVCC versions,
+ * tombstones or snapshots exist, so the leaf list and key index are the only pointers
+ * to fix (a suspended KEYS keeps a leaf pointer under its snapshot).
+ *
+ * @param node The file's Node.
+ * @return 1 if the region was rebuilt, 0 if it couldn't be (MVCC state), -1 on allocation failure.
+ */
+int relocate_leaves(Node *node)
+{
+    if (node->region == NULL || !mvcc_idle() || mvcc_snapshots_open())
+    {
+        return 0;
+    }
+
+    size_t total = 0;
+    for (Leaf *l = node->east; l != NULL; l = l->east)
+    {
+        total += region_class_size(sizeof(struct s_leaf));
+        if (l->value != NULL && !(l->flags & (LeafShared | LeafCold)))
+        {
+            total += region_class_size((uint16_t)l->stored_size + 1);
+        }
+    }
+
+    // One block of exactly `total` bytes: none of the allocations below can fail.
+    struct region *fresh = NULL;
+    if (total > 0 && ((fresh = region_create(total)) == NULL || region_reserve(fresh, total) != 0))
+    {
+        region_destroy(&fresh);
+        return -1;
+    }
+
+    for (Leaf *l = node->east; l != NULL;)
+    {
+        Leaf *moved = (Leaf *)region_alloc(&fresh, sizeof(struct s_leaf));
+        memcpy(moved, l, sizeof(struct s_leaf));
+        if (moved->value != NULL && !(moved->flags & (LeafShared | LeafCold)))
+        {
+            size_t bytes = (uint16_t)moved->stored_size + 1;
+            moved->value = (int8_t *)region_alloc(&fresh, bytes);
+            memcpy(moved->value, l->value, bytes);
+        }
+
+        // Relink: the previous leaf has already moved; the next one still points back at `l`.
+        if (moved->prev != NULL)
+        {
+            moved->prev->east = moved;
+        }
+        else
+        {
+            node->east = moved;
+        }
+        if (moved->east != NULL)
+        {
+            moved->east->prev = moved;
+        }
+        else
+        {
+            node->last_leaf = moved;
+        }
+        hindex_replace(&node->keys, &l->link, &moved->link);
+        l = moved->east;
+    }
+
+    region_destroy(&node->region);
+    node->region = fresh;
+    region_note_compaction();
+    return 1;
+}
+
+/**
+ * @brief Rebuilds a file's region (see relocate_leaves) once most of it is free.
+ * Called after every write that frees memory in the file.
+ *
+ * @param node The file's Node.
+ * @return 1 if the region was compacted, 0 if it didn't need it, -1 on allocation failure.
+ */
+int compact_leaves(Node *node)
+{
+    return region_wasteful(node->region) ? relocate_leaves(node) : 0;
+}
+
+/**
+ * @brief Frees the entire tree structure starting from the given root.
+ * Every node below the root and every leaf is deallocated; the root itself
+ * (a static, see tree.c) is only emptied.
+ *
+ * @param root Pointer to the root of the tree to free.
+ */
+void free_tree(Tree *root_union)
+{
+    if (root_union == NULL)
+        return;
 
-    // IMPORTANT: The `root` itself is a global static variable and is not dynamically allocated
-    // with malloc. Therefore, it should NOT be `free`d.
-    // The `free_node_and_leaves` and `free_leaf` functions are designed for dynamically allocated
-    // Node and Leaf structures.
-    // The initial global `root` variable's memory is managed by the program's static data segment.
-    // We only need to free its dynamically allocated children (nodes and leaves).
+    drop_subtree(&root_union->node);
 }
 
 // int main(int argc, const char *argv[])
@@ -515,7 +1319,7 @@ void free_tree(Tree *root_union)
 //     // Initialize the root
 //     rootNodeAddress = &(root.node);
 //     root.node.north = NULL;
-//     root.node.west = NULL;
+//     root.node.first_child = NULL;
 //     root.node.east = NULL;
 //     root.node.tag = TagRoot;
 //     strcpy((char *)root.node.path, "root");
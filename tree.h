@@ -12,11 +12,21 @@
 #include <stdbool.h> // boolean
 #include <time.h>    // timing functions
 
+#include "path.h"  // path_t (parsed paths with precomputed hashes)
+#include "index.h" // struct hindex (salted child and key indexes)
+
 // Runtime type tags for Tree union discrimination
 #define TagRoot 1 // Root of database tree
 #define TagNode 2 // Internal tree node
 #define TagLeaf 3 // Data-holding leaf node
 
+// Leaf flag bits (Leaf.flags)
+#define LeafCompressed 0x01 // `value` holds an LZ-compressed stream of `stored_size` bytes
+#define LeafShared 0x02     // `value` points into a refcounted, deduplicated entry (value.c)
+#define LeafDeleted 0x04    // Tombstone kept for snapshot readers; invisible to latest reads (mvcc.c)
+#define LeafInGc 0x08       // Leaf has old versions or is a tombstone and sits in the MVCC GC list
+#define LeafCold 0x10       // The stored bytes live in the value log: `cold_ref` replaces `value` (vlog.c)
+
 // Convenience macros
 // These currently use linear search; consider optimizing with more complex tree logic later.
 #define find_node(path) find_node_linear(path)
@@ -26,6 +36,8 @@
 
 #define NoError 0 // Generic success return code.
 
+#define LOOKUP_BATCH_GROUP 16 // Keys whose cache misses find_leaves_batch overlaps at a time
+
 // Return NULL and set errno safely in any context. This macro is
 // used by the tree functions (e.g., create_node, create_leaf) when they return a pointer.
 #define reterr(x)    \
@@ -59,28 +71,79 @@ typedef unsigned char Tag;
 struct s_node;
 struct s_leaf;
 union u_tree;
+struct packed;
+struct region;
 
 struct s_leaf
 {
-    union u_tree *west;  // Link to preceding Tree element (usually its parent Node)
-    struct s_leaf *east; // Next leaf in chain (forms a singly linked list of leaves)
-    int8_t key[128];     // Fixed 128-byte key
-    int8_t *value;       // Dynamic value data (allocated on heap)
-    int16_t size;        // Value size in bytes
-    Tag tag;             // Type discriminator (TagLeaf)
+    union u_tree *west;   // Link to preceding Tree element (usually its parent Node)
+    struct s_leaf *east;  // Next leaf in chain (forms a doubly linked list of leaves with `prev`)
+    struct s_leaf *prev;  // Previous leaf in chain (NULL for the first), for O(1) unlinking
+    struct hlink link;    // Entry in the parent Node's key index (hash of `key`)
+    int8_t key[128];      // Fixed 128-byte key
+    union
+    {
+        int8_t *value;     // Dynamic value data as stored (allocated on heap, see value.c)
+        uint64_t cold_ref; // Location of the stored bytes in the value log (LeafCold, never 0)
+    };
+    int16_t size;         // Value size in bytes (uncompressed)
+    int16_t stored_size;  // Bytes held at `value` (differs from `size` when compressed)
+    uint8_t flags;        // Leaf flag bits (LeafCompressed, LeafShared, LeafDeleted, ...)
+    Tag tag;              // Type discriminator (TagLeaf)
+    uint16_t atime;       // tier_clock when the key was last looked up (value tiering, see vlog.h)
+    uint32_t gc_slot;     // Position in the MVCC GC list (valid while LeafInGc is set)
+    uint64_t seq;         // Commit sequence number of the current value (or of the deletion)
+    struct s_leaf *older; // Older versions still needed by snapshots, newest first (mvcc.c)
 };
 typedef struct s_leaf Leaf;
 
 struct s_node
 {
-    struct s_node *north; // Parent node (if not root)
-    struct s_node *west;  // Child node for sub-paths (forms a linked list of sibling nodes)
-    struct s_leaf *east;  // First associated leaf (head of a linked list of leaves for this node)
-    uint8_t path[256];    // Path segment (256 bytes)
-    Tag tag;              // Type discriminator (TagNode/TagRoot)
+    struct s_node *north;        // Parent node (NULL for the root)
+    struct s_node *first_child;  // First child node (head of this node's list of sub-paths)
+    struct s_node *next_sibling; // Next node with the same parent
+    struct s_node *prev_sibling; // Previous node with the same parent (NULL for the first), for O(1) unlinking
+    struct s_leaf *east;         // First associated leaf (head of a linked list of leaves for this node)
+    struct s_leaf *last_leaf;    // Last leaf of that list (new leaves are appended here)
+    struct packed *packed;       // Keys of a small file packed into one buffer (packed.c), or NULL
+    struct region *region;       // Allocator for this file's leaves and values (region.c), or NULL
+    uint32_t npinned;            // Values needing value_release on teardown (compressed or shared)
+    struct hindex children;      // Salted hash index over the children by path segment
+    struct hindex keys;          // Salted hash index over the leaves by key
+    struct hlink link;           // Entry in the parent's `children` index (hash of `path`)
+    uint32_t nchildren;          // Number of direct child nodes
+    uint32_t nleaves;            // Number of leaves linked at `east` (including MVCC tombstones) or packed keys
+    uint8_t path[256];           // Path segment (256 bytes)
+    Tag tag;                     // Type discriminator (TagNode/TagRoot)
 };
 typedef struct s_node Node;
 
+/**
+ * @brief Iterative, allocation-free walk over a subtree (the parent links are the stack).
+ * Pre-order visits a node before its children; post-order visits it after them and
+ * allows the caller to free each node as it is returned.
+ */
+typedef struct
+{
+    Node *top;           // Subtree root; the walk never leaves it
+    Node *next;          // Node returned by the next call, NULL when done
+    uint16_t depth;      // Depth of the node most recently returned (0 = `top`)
+    uint16_t next_depth; // Depth of `next`
+    bool post;           // Post-order instead of pre-order
+} node_iter_t;
+
+/**
+ * @brief Incremental teardown of a dropped subtree (see reaper_init): the detached
+ * subtrees still to free and the post-order walk over the current one.
+ */
+typedef struct
+{
+    node_iter_t it; // Post-order walk over the subtree being freed
+    Node *rest;     // Detached subtrees not started yet (chained through next_sibling)
+    uint64_t nodes; // Nodes freed so far (the root counts when it is the one dropped)
+    uint64_t keys;  // Keys freed so far (including MVCC tombstones)
+} reaper_t;
+
 union u_tree
 {
     Node node; // Represents an internal node or the root of the tree
@@ -89,7 +152,9 @@ union u_tree
 typedef union u_tree Tree;
 
 // Global declarations
-extern Tree root; // The global root of the in-memory database tree
+extern Tree root;                // The global root of the in-memory database tree
+extern uint64_t tree_generation; // Bumped whenever nodes are freed or moved (invalidates saved Node pointers)
+extern uint16_t tier_clock;      // Coarse clock in seconds (wraps) stamped into Leaf.atime on lookups
 
 // Function prototypes for tree operations (implemented in tree.c)
 uint8_t *indent(uint8_t);
@@ -97,14 +162,37 @@ void zero(uint8_t *ptr, uint16_t size);
 Node *create_node(Node *parent, int8_t *path);
 Leaf *create_leaf(Tree *west, uint8_t *key, uint8_t *value, uint16_t size);
 Leaf *find_leaf_linear(int8_t *path, int8_t *key);
+Leaf *find_leaf_at(Node *node, const char *key, uint64_t snapshot);
+Leaf *node_read(Node *node, const char *key, uint64_t snapshot, Leaf *view);
+void find_leaves_batch(Node *node, const char *const *keys, size_t n, uint64_t snapshot, Leaf **out,
+                       Leaf *views);
 Node *find_node_linear(int8_t *path);
+Node *find_child(Node *parent, const char *name);
+Node *find_child_hashed(Node *parent, const char *name, size_t len, uint64_t hash);
+Node *find_node_path(const path_t *path);
+Leaf *find_leaf_path(const path_t *path, const char *key, Leaf *view);
+int node_path(Node *node, char *buf, size_t cap);
+uint64_t scan_children(Node *parent, uint64_t cursor, uint32_t count, void (*emit)(Node *child, void *ctx),
+                       void *ctx);
 Leaf *find_last_linear(Node *parent);
 int8_t *lookup_linear(int8_t *path, int8_t *key);
 void print_tree(uint8_t fd, Tree *root);
+void node_iter_init(node_iter_t *it, Node *top, bool post);
+Node *node_iter_next(node_iter_t *it);
+void count_subtree(Node *top, uint64_t *nodes, uint64_t *leaves);
 
 // --- NEW: Prototypes for memory management functions ---
 void free_leaf(Leaf *leaf);
+void unlink_leaf(Node *node, Leaf *leaf);
 void free_node_and_leaves(Node *node);
+void reaper_init(reaper_t *r, Node *node);
+bool reaper_step(reaper_t *r, uint64_t budget);
+void drop_subtree(Node *node);
+int move_node(Node *node, Node *parent, const char *name);
+Leaf *move_leaf(Node *from, Leaf *leaf, Node *to);
+Node *clone_subtree(Node *node, Node *parent, const char *name, uint64_t seq, uint64_t *nodes, uint64_t *keys);
+int relocate_leaves(Node *node);
+int compact_leaves(Node *node);
 void free_tree(Tree *root);
 
 #endif /* TREE_H */
@@ -0,0 +1,33 @@
+/* util.c - Small helpers shared by the server modules */
+#include "util.h" // Own header for the prototypes
+
+#include <errno.h>  // errno, EINTR, EIO
+#include <unistd.h> // write
+
+/**
+ * @brief Writes all of `len` bytes, retrying short writes and EINTR.
+ * @return 0 on success, -1 with errno set (EIO if the descriptor stopped accepting data).
+ */
+int write_all(int fd, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            if (n == 0)
+            {
+                errno = EIO;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
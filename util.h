@@ -0,0 +1,22 @@
+/* util.h - Small helpers shared by the server modules */
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+#include <time.h>   // clock_gettime
+
+/**
+ * @brief Monotonic clock in nanoseconds (vDSO, so cheap enough to wrap each codec call
+ * or to check a time budget every few iterations).
+ */
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int write_all(int fd, const void *data, size_t len);
+
+#endif /* UTIL_H */
@@ -0,0 +1,574 @@
+/* value.c - Value storage path for Leaf values (compression, deduplication and tiering) */
+#include "value.h" // Own header for configuration and prototypes
+#include "lz.h"    // In-tree LZ codec
+#include "hash.h"  // hash_bytes
+#include "arena.h" // arena_alloc, arena_free
+#include "index.h" // Salted hash index (dedup table)
+#include "region.h" // Per-file allocation of private values
+#include "vlog.h"   // Value log for cold values
+#include "util.h"   // now_ns
+
+#include <stddef.h> // offsetof
+#include <stdio.h>  // snprintf, perror
+
+struct value_config value_config = {
+    .compress_min = VALUE_COMPRESS_MIN_DEFAULT,
+    .dedup_min = 0,
+};
+
+/**
+ * @brief A stored value shared by every Leaf holding identical bytes.
+ * Shared leaves (LeafShared) point their `value` at `data`, so readers don't care
+ * whether a value is shared; only value_store/value_release look at the header.
+ */
+struct value_ref
+{
+    struct hlink link;      // Entry in the dedup table (hash of the stored bytes)
+    uint32_t refs;          // Number of leaves pointing at `data`
+    uint16_t size;          // Uncompressed size
+    uint16_t stored_size;   // Bytes in `data` (excluding the terminator)
+    uint8_t flags;          // LeafCompressed if `data` is an LZ stream
+    int8_t data[];          // Stored bytes, null-terminated
+};
+
+/**
+ * @brief Content-addressed table of shared values (chained, grows by doubling).
+ */
+static struct
+{
+    struct hindex table;        // Shared values by content hash
+    uint64_t refs;              // Leaves pointing at shared values
+    uint64_t logical_bytes;     // Stored bytes as seen by the leaves (refs * stored_size)
+    uint64_t unique_bytes;      // Stored bytes actually held by the table
+} dedup;
+
+/**
+ * @brief Counters reported by the `stats` command.
+ */
+static struct
+{
+    uint64_t compressed;    // Live values currently stored compressed
+    uint64_t raw_bytes;     // Uncompressed size of those values
+    uint64_t stored_bytes;  // Bytes actually held for those values
+    uint64_t rejected;      // Compression attempts that didn't save enough
+    uint64_t compress_ns;   // Time spent compressing
+    uint64_t decompress_ns; // Time spent decompressing
+} stats;
+
+/**
+ * @brief Returns the file (Node) a leaf or old version belongs to; its region holds the
+ * leaf's private value.
+ */
+static inline Node *owner(const Leaf *leaf)
+{
+    return (Node *)leaf->west;
+}
+
+/**
+ * @brief Tries to compress a value into a freshly allocated region buffer of `*out_size + 1` bytes.
+ *
+ * @param region The owning file's region.
+ * @param data The value bytes.
+ * @param size The value size.
+ * @param out_size Receives the compressed size on success.
+ * @return The compressed buffer, or NULL if compression is disabled, didn't pay off, or failed.
+ */
+static int8_t *try_compress(struct region **region, const uint8_t *data, uint16_t size, uint16_t *out_size)
+{
+    if (value_config.compress_min == 0 || size < value_config.compress_min)
+    {
+        return NULL;
+    }
+
+    size_t cap = size - size / VALUE_COMPRESS_MIN_SAVING; // Largest size still worth keeping.
+    int8_t *buf = (int8_t *)malloc(cap);
+    if (buf == NULL)
+    {
+        return NULL; // Fall back to storing the value as is.
+    }
+
+    uint64_t start = now_ns();
+    size_t n = lz_compress(data, size, (uint8_t *)buf, cap);
+    stats.compress_ns += now_ns() - start;
+
+    if (n == 0)
+    {
+        stats.rejected++;
+        free(buf);
+        return NULL;
+    }
+
+    // Move the stream into an exactly sized region block (+1 keeps sizes uniform with plain values).
+    int8_t *stored = (int8_t *)region_alloc(region, n + 1);
+    if (stored != NULL)
+    {
+        memcpy(stored, buf, n);
+        *out_size = (uint16_t)n;
+    }
+    free(buf);
+    return stored;
+}
+
+/**
+ * @brief Recovers the table entry that owns a shared leaf's value buffer.
+ */
+static inline struct value_ref *ref_of(const Leaf *leaf)
+{
+    return (struct value_ref *)((char *)leaf->value - offsetof(struct value_ref, data));
+}
+
+/**
+ * @brief Finds or creates the shared entry for a stored value and takes a reference on it.
+ *
+ * @param stored The stored bytes (compressed or plain).
+ * @param stored_size Number of stored bytes.
+ * @param size Uncompressed size.
+ * @param flags LeafCompressed if `stored` is an LZ stream.
+ * @return The entry, or NULL on allocation failure.
+ */
+static struct value_ref *dedup_acquire(const int8_t *stored, uint16_t stored_size, uint16_t size,
+                                       uint8_t flags)
+{
+    uint64_t h = hash_bytes(stored, stored_size);
+
+    for (struct hlink *l = hindex_head(&dedup.table, h); l != NULL; l = l->next)
+    {
+        struct value_ref *ref = hlink_entry(l, struct value_ref, link);
+        if (l->hash == h && ref->stored_size == stored_size && ref->flags == flags &&
+            memcmp(ref->data, stored, stored_size) == 0)
+        {
+            ref->refs++;
+            dedup.refs++;
+            dedup.logical_bytes += stored_size;
+            return ref;
+        }
+    }
+
+    struct value_ref *ref = (struct value_ref *)arena_alloc(sizeof(struct value_ref) + stored_size + 1);
+    if (ref == NULL)
+    {
+        return NULL;
+    }
+    ref->link.hash = h;
+    ref->refs = 1;
+    ref->size = size;
+    ref->stored_size = stored_size;
+    ref->flags = flags;
+    memcpy(ref->data, stored, stored_size);
+    ref->data[stored_size] = '\0';
+
+    if (hindex_insert(&dedup.table, &ref->link) != 0)
+    {
+        arena_free(ref, sizeof(struct value_ref) + stored_size + 1); // Couldn't even create the table.
+        return NULL;
+    }
+
+    dedup.refs++;
+    dedup.logical_bytes += stored_size;
+    dedup.unique_bytes += stored_size;
+    return ref;
+}
+
+/**
+ * @brief Drops a reference on a shared entry, freeing it with the last reference.
+ * @return True if the entry was freed.
+ */
+static bool dedup_release(struct value_ref *ref)
+{
+    dedup.refs--;
+    dedup.logical_bytes -= ref->stored_size;
+    if (--ref->refs > 0)
+    {
+        return false;
+    }
+
+    hindex_remove(&dedup.table, &ref->link);
+    dedup.unique_bytes -= ref->stored_size;
+    arena_free(ref, sizeof(struct value_ref) + ref->stored_size + 1);
+    return true;
+}
+
+/**
+ * @brief Stores a value in a Leaf, replacing (and freeing) any previous value.
+ * Values above the configured threshold are compressed when that actually saves space;
+ * the leaf's `size` always holds the uncompressed size, `stored_size` the bytes kept.
+ * With deduplication enabled, values of at least `dedup_min` bytes are stored once in a
+ * refcounted table and shared between leaves (LeafShared). Shared buffers are never
+ * modified in place: overwriting one stores a new value and drops the old reference,
+ * which is what makes the sharing copy-on-write.
+ *
+ * @param leaf The leaf that owns the value.
+ * @param data The value bytes.
+ * @param size The value size in bytes.
+ * @return 0 on success, -1 on allocation failure (the old value is then left untouched).
+ */
+int value_store(Leaf *leaf, const uint8_t *data, uint16_t size)
+{
+    uint16_t stored_size = size;
+    uint8_t flags = 0;
+    struct region **region = &owner(leaf)->region;
+    int8_t *stored = try_compress(region, data, size, &stored_size);
+
+    if (stored != NULL)
+    {
+        flags |= LeafCompressed;
+    }
+    else
+    {
+        // Plain values keep a null terminator so they can be used as C strings.
+        stored = (int8_t *)region_alloc(region, size + 1);
+        if (stored == NULL)
+        {
+            perror("ERROR: Failed to allocate memory for Leaf value");
+            return -1;
+        }
+        memcpy(stored, data, size);
+        stored[size] = '\0';
+        stored_size = size;
+    }
+
+    bool fresh = true; // False when the bytes are already held by a shared entry.
+    if (value_config.dedup_min != 0 && size >= value_config.dedup_min)
+    {
+        struct value_ref *ref = dedup_acquire(stored, stored_size, size, flags);
+        if (ref != NULL)
+        {
+            fresh = (ref->refs == 1);
+            region_free(*region, stored, stored_size + 1);
+            stored = ref->data;
+            flags |= LeafShared;
+        }
+        // On allocation failure the value is simply kept private.
+    }
+
+    value_release(leaf); // Free the previous value only once the new one is in hand.
+
+    leaf->value = stored;
+    leaf->size = (int16_t)size;
+    leaf->stored_size = (int16_t)stored_size;
+    leaf->flags = (leaf->flags & ~(LeafCompressed | LeafShared)) | flags;
+    leaf->atime = tier_clock; // A fresh value starts hot.
+    if (flags != 0)
+    {
+        owner(leaf)->npinned++; // The file can no longer be dropped without visiting this leaf.
+    }
+
+    if ((flags & LeafCompressed) && fresh)
+    {
+        // Compression is accounted once per stored buffer, not once per sharing leaf.
+        stats.compressed++;
+        stats.raw_bytes += size;
+        stats.stored_bytes += stored_size;
+    }
+    return 0;
+}
+
+/**
+ * @brief Frees the value held by a Leaf (the Leaf itself is left alone).
+ * @param leaf The leaf whose value should be released.
+ */
+void value_release(Leaf *leaf)
+{
+    if (leaf->value == NULL)
+    {
+        return;
+    }
+
+    // A shared buffer only goes away with its last reference.
+    bool freed = (leaf->flags & LeafShared) ? dedup_release(ref_of(leaf)) : true;
+
+    if ((leaf->flags & LeafCompressed) && freed)
+    {
+        stats.compressed--;
+        stats.raw_bytes -= (uint16_t)leaf->size;
+        stats.stored_bytes -= (uint16_t)leaf->stored_size;
+    }
+
+    if (leaf->flags & LeafCold)
+    {
+        vlog_release(leaf->cold_ref, (uint16_t)leaf->stored_size); // The log record is now dead.
+    }
+    else if (!(leaf->flags & LeafShared))
+    {
+        region_free(owner(leaf)->region, leaf->value, (uint16_t)leaf->stored_size + 1);
+    }
+    if (leaf->flags & (LeafCompressed | LeafShared | LeafCold))
+    {
+        owner(leaf)->npinned--;
+    }
+    leaf->flags &= ~(LeafCompressed | LeafShared | LeafCold);
+    leaf->value = NULL;
+    leaf->size = 0;
+    leaf->stored_size = 0;
+}
+
+/**
+ * @brief Moves a value from one leaf to another, possibly in another file. Shared and
+ * compressed buffers and log records change hands as they are (no refcount change, no
+ * recompression); private bytes are copied into the destination file's region, as
+ * regions are per file.
+ *
+ * @param to The leaf receiving the value (its own `value` fields are overwritten).
+ * @param from The leaf giving it up (left without a value).
+ * @return 0 on success, -1 on allocation failure (`from` is then left untouched).
+ */
+int value_move(Leaf *to, Leaf *from)
+{
+    int8_t *stored = from->value;
+    uint8_t flags = from->flags & (LeafCompressed | LeafShared | LeafCold);
+
+    if (stored != NULL && !(flags & (LeafShared | LeafCold)))
+    {
+        stored = (int8_t *)region_alloc(&owner(to)->region, (uint16_t)from->stored_size + 1);
+        if (stored == NULL)
+        {
+            return -1;
+        }
+        memcpy(stored, from->value, (uint16_t)from->stored_size + 1);
+        region_free(owner(from)->region, from->value, (uint16_t)from->stored_size + 1);
+    }
+
+    to->value = stored;
+    to->size = from->size;
+    to->stored_size = from->stored_size;
+    to->flags = (to->flags & ~(LeafCompressed | LeafShared | LeafCold)) | flags;
+    if (flags != 0)
+    {
+        owner(to)->npinned++;
+        owner(from)->npinned--;
+    }
+
+    from->flags &= ~(LeafCompressed | LeafShared | LeafCold);
+    from->value = NULL;
+    from->size = 0;
+    from->stored_size = 0;
+    return 0;
+}
+
+/**
+ * @brief Gives a leaf the same value as another, for CLONE. Values of VALUE_SHARE_MIN
+ * stored bytes or more are shared through the dedup table: a private value is first
+ * turned into a shared entry, then both leaves hold a reference, and a later write to
+ * either one replaces only that leaf's value (see value_store). Smaller values, and cold
+ * ones (read back from the value log), are copied into the destination file's region.
+ *
+ * @param to The new leaf (its own `value` fields are overwritten).
+ * @param from The leaf whose value is shared.
+ * @return 0 on success, -1 on allocation failure (`to` is then left without a value).
+ */
+int value_share(Leaf *to, Leaf *from)
+{
+    uint16_t stored_size = (uint16_t)from->stored_size;
+    uint8_t compressed = from->flags & LeafCompressed;
+
+    to->value = NULL;
+    to->size = 0;
+    to->stored_size = 0;
+    to->flags &= ~(LeafCompressed | LeafShared | LeafCold);
+    if (from->value == NULL)
+    {
+        return 0;
+    }
+
+    if ((from->flags & LeafCold) || (!(from->flags & LeafShared) && stored_size < VALUE_SHARE_MIN))
+    {
+        int8_t *copy = (int8_t *)region_alloc(&owner(to)->region, stored_size + 1);
+        if (copy == NULL)
+        {
+            return -1;
+        }
+        if (value_read(from, copy) != 0)
+        {
+            region_free(owner(to)->region, copy, stored_size + 1);
+            return -1;
+        }
+        copy[stored_size] = '\0';
+        to->value = copy;
+        if (compressed)
+        {
+            owner(to)->npinned++;
+            stats.compressed++;
+            stats.raw_bytes += (uint16_t)from->size;
+            stats.stored_bytes += stored_size;
+        }
+    }
+    else
+    {
+        if (!(from->flags & LeafShared))
+        {
+            // Promote the private value to a shared entry (or join an identical one).
+            struct value_ref *ref = dedup_acquire(from->value, stored_size, (uint16_t)from->size, compressed);
+            if (ref == NULL)
+            {
+                return -1;
+            }
+            if (compressed && ref->refs > 1)
+            {
+                stats.compressed--; // The entry's buffer was already counted.
+                stats.raw_bytes -= (uint16_t)from->size;
+                stats.stored_bytes -= stored_size;
+            }
+            region_free(owner(from)->region, from->value, stored_size + 1);
+            from->value = ref->data;
+            if (!compressed)
+            {
+                owner(from)->npinned++;
+            }
+            from->flags |= LeafShared;
+        }
+
+        struct value_ref *ref = ref_of(from);
+        ref->refs++;
+        dedup.refs++;
+        dedup.logical_bytes += stored_size;
+        to->value = from->value;
+        to->flags |= LeafShared;
+        owner(to)->npinned++;
+    }
+
+    to->size = from->size;
+    to->stored_size = from->stored_size;
+    to->flags |= compressed;
+    return 0;
+}
+
+/**
+ * @brief Moves a value to the value log: the region copy is freed and the leaf keeps the
+ * record's location. The caller has written the stored bytes to the log.
+ *
+ * @param leaf A leaf with a private value in memory.
+ * @param ref Where the stored bytes now are (see vlog.h).
+ */
+void value_chill(Leaf *leaf, uint64_t ref)
+{
+    region_free(owner(leaf)->region, leaf->value, (uint16_t)leaf->stored_size + 1);
+    leaf->cold_ref = ref;
+    if (!(leaf->flags & LeafCompressed))
+    {
+        owner(leaf)->npinned++; // Its log record must be released on teardown.
+    }
+    leaf->flags |= LeafCold;
+}
+
+/**
+ * @brief Brings a cold value back into memory, from bytes already read from the log.
+ *
+ * @param leaf A cold leaf.
+ * @param stored Its stored bytes (`stored_size` of them).
+ * @return 0 on success, -1 on allocation failure (the leaf stays cold).
+ */
+int value_warm(Leaf *leaf, const int8_t *stored)
+{
+    uint16_t stored_size = (uint16_t)leaf->stored_size;
+    int8_t *copy = (int8_t *)region_alloc(&owner(leaf)->region, stored_size + 1);
+    if (copy == NULL)
+    {
+        return -1;
+    }
+    memcpy(copy, stored, stored_size);
+    copy[stored_size] = '\0';
+
+    vlog_release(leaf->cold_ref, stored_size);
+    leaf->value = copy;
+    leaf->flags &= ~LeafCold;
+    if (!(leaf->flags & LeafCompressed))
+    {
+        owner(leaf)->npinned--;
+    }
+    leaf->atime = tier_clock;
+    return 0;
+}
+
+/**
+ * @brief Copies a leaf's stored bytes (`stored_size` of them, compressed or not) into
+ * `buf`, from memory or, for a cold value, from the value log.
+ * @return 0 on success, -1 if the log could not be read (errno is set).
+ */
+int value_read(const Leaf *leaf, int8_t *buf)
+{
+    if (leaf->flags & LeafCold)
+    {
+        return vlog_read(leaf->cold_ref, buf, (uint16_t)leaf->stored_size);
+    }
+    memcpy(buf, leaf->value, (uint16_t)leaf->stored_size);
+    return 0;
+}
+
+/**
+ * @brief Returns a null-terminated, uncompressed copy of a Leaf's value.
+ * @param leaf The leaf to read.
+ * @return A heap-allocated copy the caller must free, or NULL on error.
+ */
+char *value_dup(const Leaf *leaf)
+{
+    uint16_t size = (uint16_t)leaf->size;
+    char *copy = (char *)malloc(size + 1);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    if (leaf->flags & LeafCompressed)
+    {
+        const int8_t *stored = leaf->value;
+        int8_t *cold = NULL;
+        if (leaf->flags & LeafCold)
+        {
+            // Read the stream back from the value log first.
+            cold = (int8_t *)malloc((uint16_t)leaf->stored_size);
+            if (cold == NULL || value_read(leaf, cold) != 0)
+            {
+                free(cold);
+                free(copy);
+                return NULL;
+            }
+            stored = cold;
+        }
+
+        uint64_t start = now_ns();
+        size_t n = lz_decompress((const uint8_t *)stored, (uint16_t)leaf->stored_size, (uint8_t *)copy, size);
+        stats.decompress_ns += now_ns() - start;
+        free(cold);
+        if (n != size)
+        {
+            free(copy); // Corrupt stream; should never happen.
+            errno = EIO;
+            return NULL;
+        }
+    }
+    else if (value_read(leaf, (int8_t *)copy) != 0)
+    {
+        free(copy);
+        return NULL;
+    }
+
+    copy[size] = '\0';
+    return copy;
+}
+
+/**
+ * @brief Formats compression and deduplication counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int value_stats(char *buf, size_t cap)
+{
+    int len = snprintf(buf, cap,
+                       "  Dedup: %s entries=%u refs=%llu logical=%llu unique=%llu bytes ratio=%.2fx\n",
+                       value_config.dedup_min ? "on" : "off", dedup.table.count,
+                       (unsigned long long)dedup.refs, (unsigned long long)dedup.logical_bytes,
+                       (unsigned long long)dedup.unique_bytes,
+                       dedup.unique_bytes ? (double)dedup.logical_bytes / (double)dedup.unique_bytes : 1.0);
+    if (len < 0 || (size_t)len >= cap)
+    {
+        return len;
+    }
+
+    return len + snprintf(buf + len, cap - len,
+                    "  Compression: values=%llu raw=%llu stored=%llu saved=%llu bytes rejected=%llu "
+                    "compress_cpu=%.3f ms decompress_cpu=%.3f ms\n",
+                    (unsigned long long)stats.compressed, (unsigned long long)stats.raw_bytes,
+                    (unsigned long long)stats.stored_bytes,
+                    (unsigned long long)(stats.raw_bytes - stats.stored_bytes),
+                    (unsigned long long)stats.rejected,
+                    (double)stats.compress_ns / 1e6, (double)stats.decompress_ns / 1e6);
+}
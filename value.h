@@ -0,0 +1,35 @@
+/* value.h - Value storage path for Leaf values (compression, deduplication and tiering) */
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "tree.h" // Leaf definition and value flags
+
+#include <stddef.h> // size_t
+
+// Configuration defaults
+#define VALUE_COMPRESS_MIN_DEFAULT 256 // Values at least this large are compression candidates
+#define VALUE_COMPRESS_MIN_SAVING 8    // Keep compressed form only if it saves >= 1/N of the size
+#define VALUE_SHARE_MIN 32             // CLONE copies smaller values (a shared entry's header costs as much)
+
+/**
+ * @brief Runtime tunables of the value storage path (set from command-line options).
+ */
+struct value_config
+{
+    uint16_t compress_min; // Compression threshold in bytes, 0 disables compression
+    uint16_t dedup_min;    // Deduplication threshold in bytes, 0 disables deduplication
+};
+
+extern struct value_config value_config;
+
+int value_store(Leaf *leaf, const uint8_t *data, uint16_t size);
+void value_release(Leaf *leaf);
+int value_move(Leaf *to, Leaf *from);
+int value_share(Leaf *to, Leaf *from);
+void value_chill(Leaf *leaf, uint64_t ref);
+int value_warm(Leaf *leaf, const int8_t *stored);
+int value_read(const Leaf *leaf, int8_t *buf);
+char *value_dup(const Leaf *leaf);
+int value_stats(char *buf, size_t cap);
+
+#endif /* VALUE_H */
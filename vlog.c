@@ -0,0 +1,546 @@
+/* vlog.c - Value log: cold values spilled to local disk */
+#include "vlog.h"  // Own header for configuration and prototypes
+#include "main.h"  // Logging macros
+#include "tree.h"  // root, node_iter_t, tier_clock, LeafCold
+#include "value.h" // value_chill
+#include "util.h"  // now_ns
+
+const char *vlog_dir;
+uint32_t vlog_cold = VLOG_COLD_DEFAULT;
+bool vlog_promote = true;
+
+#define REF_SHIFT 40 // Bits of a ref holding the offset; the slot is above them
+
+/**
+ * @brief One segment file. Only the event loop touches this table; worker threads get a
+ * descriptor from vlog_pin and keep the segment alive until vlog_unpin.
+ */
+struct segment
+{
+    int fd;          // Open file (-1 if the slot is free)
+    uint64_t size;   // Bytes written
+    uint64_t live;   // Bytes of records still referenced by some leaf
+    uint32_t pinned; // Reads in flight on worker threads
+    bool victim;     // The current pass moves its live records away
+    char path[PATH_MAX_LEN + 64]; // File name (for unlink)
+};
+
+/**
+ * @brief A record gathered for the next write: a value to spill or a record to move.
+ */
+struct pending
+{
+    Leaf *leaf;       // The leaf (or old version) to update once the write succeeded
+    uint64_t ref;     // Where its bytes will be
+    bool relocate;    // The leaf is already cold (GC) rather than being spilled
+};
+
+static struct
+{
+    struct segment segs[VLOG_MAX_SEGMENTS];                 // Slot 0 stays unused
+    unsigned active;                                        // Slot appended to (0 = none, log unusable)
+    uint64_t file_no;                                       // Number of the next segment file
+    int8_t *batch;                                          // Records gathered for one write
+    size_t batch_len;                                       // Bytes in `batch`
+    struct pending items[VLOG_BATCH_BYTES / VLOG_MIN_VALUE]; // The leaves behind those bytes
+    unsigned nitems;                                        // Entries in `items`
+    node_iter_t it;                                         // Position of the current pass
+    uint64_t generation;                                    // tree_generation the position is valid for
+    bool running;                                           // A pass has started and not finished yet
+    uint64_t pass_start_ns;                                 // When the last pass started
+    uint64_t cold_values;                                   // Leaves (and versions) holding a ref
+    uint64_t spilled;                                       // Values moved to the log
+    uint64_t relocated;                                     // Records moved by GC
+    uint64_t promoted;                                      // Values brought back by GET
+    uint64_t async_reads;                                   // Reads handed to worker threads
+    uint64_t sync_reads;                                    // Reads done in place
+    uint64_t freed_segments;                                // Segment files deleted
+    uint64_t passes;                                        // Passes finished
+    uint64_t write_errors;                                  // Failed writes (the batch stays in memory)
+} vlog;
+
+static inline unsigned ref_slot(uint64_t ref)
+{
+    return (unsigned)(ref >> REF_SHIFT);
+}
+
+static inline uint64_t ref_offset(uint64_t ref)
+{
+    return ref & ((1ULL << REF_SHIFT) - 1);
+}
+
+/**
+ * @brief Starts a new segment file in a free slot and makes it the one appended to.
+ * @return 0 on success, -1 if no slot is free or the file can't be created.
+ */
+static int open_segment(void)
+{
+    unsigned slot = vlog.active;
+    for (unsigned tries = 1; tries < VLOG_MAX_SEGMENTS; tries++)
+    {
+        slot = slot % (VLOG_MAX_SEGMENTS - 1) + 1; // 1 .. VLOG_MAX_SEGMENTS - 1, after the current one
+        if (vlog.segs[slot].fd == -1)
+        {
+            break;
+        }
+    }
+    struct segment *seg = &vlog.segs[slot];
+    if (seg->fd != -1)
+    {
+        error_log("Vlog: all %d segments in use, values stay in memory", VLOG_MAX_SEGMENTS - 1);
+        vlog.active = 0;
+        return -1;
+    }
+
+    snprintf(seg->path, sizeof(seg->path), "%s/memodb-%d-%llu.vlog", vlog_dir, (int)getpid(),
+             (unsigned long long)vlog.file_no++);
+    seg->fd = open(seg->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (seg->fd == -1)
+    {
+        error_log("Vlog: cannot create %s: %s", seg->path, strerror(errno));
+        vlog.active = 0;
+        return -1;
+    }
+    seg->size = 0;
+    seg->live = 0;
+    seg->pinned = 0;
+    seg->victim = false;
+    vlog.active = slot;
+    return 0;
+}
+
+/**
+ * @brief Deletes the full segments nothing refers to any more.
+ */
+static void free_segments(void)
+{
+    for (unsigned slot = 1; slot < VLOG_MAX_SEGMENTS; slot++)
+    {
+        struct segment *seg = &vlog.segs[slot];
+        if (seg->fd != -1 && slot != vlog.active && seg->live == 0 && seg->pinned == 0)
+        {
+            close(seg->fd);
+            unlink(seg->path);
+            seg->fd = -1;
+            vlog.freed_segments++;
+        }
+    }
+}
+
+/**
+ * @brief Opens the first segment under --vlog-dir.
+ * @return 0 on success (or if tiering is off), -1 if the directory is unusable (tiering is then off).
+ */
+int vlog_init(void)
+{
+    for (unsigned slot = 0; slot < VLOG_MAX_SEGMENTS; slot++)
+    {
+        vlog.segs[slot].fd = -1;
+    }
+    if (vlog_dir == NULL)
+    {
+        return 0;
+    }
+    if (vlog_cold > UINT16_MAX)
+    {
+        vlog_cold = UINT16_MAX; // Ages are measured on the 16-bit tier_clock.
+    }
+    tier_clock = (uint16_t)(now_ns() / 1000000000ULL);
+
+    vlog.batch = (int8_t *)malloc(VLOG_BATCH_BYTES);
+    if (vlog.batch == NULL || open_segment() != 0)
+    {
+        error_log("Vlog: tiering disabled");
+        free(vlog.batch);
+        vlog.batch = NULL;
+        vlog_dir = NULL;
+        return -1;
+    }
+    info_log("Vlog: values idle for %u s move to %s (promote on read: %s)", vlog_cold, vlog_dir,
+             vlog_promote ? "on" : "off");
+    return 0;
+}
+
+/**
+ * @brief Returns true if tiering is on.
+ */
+bool vlog_enabled(void)
+{
+    return vlog_dir != NULL;
+}
+
+/**
+ * @brief Reads a record through a descriptor (safe on any thread).
+ * @return 0 on success, -1 with errno set (EIO for a short read).
+ */
+int vlog_read_fd(int fd, uint64_t ref, int8_t *buf, uint16_t n)
+{
+    size_t done = 0;
+    while (done < n)
+    {
+        ssize_t got = pread(fd, buf + done, n - done, (off_t)(ref_offset(ref) + done));
+        if (got <= 0)
+        {
+            if (got == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got == 0)
+            {
+                errno = EIO; // The record is shorter than the leaf says; should never happen.
+            }
+            return -1;
+        }
+        done += (size_t)got;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a record in place (blocking the caller).
+ * @return 0 on success, -1 with errno set.
+ */
+int vlog_read(uint64_t ref, int8_t *buf, uint16_t n)
+{
+    vlog.sync_reads++;
+    if (vlog_read_fd(vlog.segs[ref_slot(ref)].fd, ref, buf, n) != 0)
+    {
+        error_log("Vlog: read of %u bytes at %u:%llu failed: %s", n, ref_slot(ref),
+                  (unsigned long long)ref_offset(ref), strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Keeps a record's segment open for a read on a worker thread.
+ * @return The descriptor to pass to vlog_read_fd.
+ */
+int vlog_pin(uint64_t ref)
+{
+    vlog.async_reads++;
+    vlog.segs[ref_slot(ref)].pinned++;
+    return vlog.segs[ref_slot(ref)].fd;
+}
+
+/**
+ * @brief Ends a read started with vlog_pin.
+ * @param promoted Whether the value read went back into memory.
+ */
+void vlog_unpin(uint64_t ref, bool promoted)
+{
+    vlog.segs[ref_slot(ref)].pinned--;
+    vlog.promoted += promoted;
+}
+
+/**
+ * @brief Marks a record dead (its leaf was overwritten, deleted, freed or promoted).
+ */
+void vlog_release(uint64_t ref, uint16_t n)
+{
+    vlog.segs[ref_slot(ref)].live -= n;
+    vlog.cold_values--;
+}
+
+/**
+ * @brief Writes the gathered records at the end of the active segment, then points
+ * their leaves at them. If the write fails nothing changes (the values stay where they are).
+ */
+static void flush_batch(void)
+{
+    if (vlog.batch_len == 0)
+    {
+        return;
+    }
+
+    struct segment *seg = &vlog.segs[vlog.active];
+    size_t done = 0;
+    while (done < vlog.batch_len)
+    {
+        ssize_t n = pwrite(seg->fd, vlog.batch + done, vlog.batch_len - done, (off_t)(seg->size + done));
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            error_log("Vlog: write to %s failed: %s", seg->path, n == 0 ? "no progress" : strerror(errno));
+            vlog.write_errors++;
+            vlog.batch_len = 0;
+            vlog.nitems = 0;
+            return;
+        }
+        done += (size_t)n;
+    }
+
+    for (unsigned i = 0; i < vlog.nitems; i++)
+    {
+        struct pending *p = &vlog.items[i];
+        uint16_t bytes = (uint16_t)p->leaf->stored_size;
+        if (p->relocate)
+        {
+            vlog.segs[ref_slot(p->leaf->cold_ref)].live -= bytes;
+            p->leaf->cold_ref = p->ref;
+            vlog.relocated++;
+        }
+        else
+        {
+            value_chill(p->leaf, p->ref);
+            vlog.cold_values++;
+            vlog.spilled++;
+        }
+        seg->live += bytes;
+    }
+    seg->size += vlog.batch_len;
+    vlog.batch_len = 0;
+    vlog.nitems = 0;
+}
+
+/**
+ * @brief Adds a leaf's stored bytes to the batch (writing the batch first if it is full,
+ * and moving on to a new segment if the active one is).
+ * @return 0 on success, -1 if the log can't take it.
+ */
+static int gather(Leaf *leaf, bool relocate)
+{
+    uint16_t n = (uint16_t)leaf->stored_size;
+
+    if (vlog.batch_len + n > VLOG_BATCH_BYTES || vlog.nitems == sizeof(vlog.items) / sizeof(vlog.items[0]))
+    {
+        flush_batch();
+    }
+    if (vlog.active == 0 || vlog.segs[vlog.active].size + vlog.batch_len + n > VLOG_SEGMENT_BYTES)
+    {
+        flush_batch();
+        if (open_segment() != 0)
+        {
+            return -1;
+        }
+    }
+
+    int8_t *dst = vlog.batch + vlog.batch_len;
+    if (!relocate)
+    {
+        memcpy(dst, leaf->value, n);
+    }
+    else if (vlog_read_fd(vlog.segs[ref_slot(leaf->cold_ref)].fd, leaf->cold_ref, dst, n) != 0)
+    {
+        error_log("Vlog: relocation read at %u:%llu failed: %s", ref_slot(leaf->cold_ref),
+                  (unsigned long long)ref_offset(leaf->cold_ref), strerror(errno));
+        return 0; // Unreadable record: leave it where it is.
+    }
+    struct pending *p = &vlog.items[vlog.nitems++];
+    p->leaf = leaf;
+    p->ref = ((uint64_t)vlog.active << REF_SHIFT) | (vlog.segs[vlog.active].size + vlog.batch_len);
+    p->relocate = relocate;
+    vlog.batch_len += n;
+    return 0;
+}
+
+/**
+ * @brief Returns true if the value of a current leaf should move to the log.
+ */
+static bool spillable(const Leaf *leaf)
+{
+    return leaf->value != NULL && !(leaf->flags & (LeafShared | LeafCold | LeafDeleted)) &&
+           (uint16_t)leaf->stored_size >= VLOG_MIN_VALUE && (uint16_t)(tier_clock - leaf->atime) >= vlog_cold;
+}
+
+/**
+ * @brief Spills the cold values of one file and moves its records out of GC victims
+ * (old versions included).
+ * @return -1 if the log stopped taking records, 0 otherwise.
+ */
+static int visit_file(Node *node)
+{
+    for (Leaf *l = node->east; l != NULL; l = l->east)
+    {
+        if (spillable(l) && gather(l, false) != 0)
+        {
+            return -1;
+        }
+        for (Leaf *v = l; v != NULL; v = v->older)
+        {
+            if ((v->flags & LeafCold) && vlog.segs[ref_slot(v->cold_ref)].victim && gather(v, true) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Starts a pass: picks the full segments worth compacting.
+ */
+static void start_pass(uint64_t now)
+{
+    vlog.running = true;
+    vlog.pass_start_ns = now;
+    vlog.generation = tree_generation - 1; // Forces the walk to start below.
+    for (unsigned slot = 1; slot < VLOG_MAX_SEGMENTS; slot++)
+    {
+        struct segment *seg = &vlog.segs[slot];
+        seg->victim = seg->fd != -1 && slot != vlog.active &&
+                      (seg->size - seg->live) * 100 >= seg->size * VLOG_GC_PERCENT;
+    }
+}
+
+/**
+ * @brief Returns true if a pass is under way.
+ */
+bool vlog_pending(void)
+{
+    return vlog.running;
+}
+
+/**
+ * @brief Background task: advances tier_clock and runs a slice of the current pass
+ * (starting one every VLOG_PASS_MS). The batch is written before the slice returns, so
+ * no leaf points at bytes that aren't in the log yet.
+ *
+ * @param budget_ns Time the slice may take.
+ * @return Number of records written.
+ */
+int vlog_cycle(uint64_t budget_ns)
+{
+    uint64_t start = now_ns();
+    tier_clock = (uint16_t)(start / 1000000000ULL);
+    if (vlog_dir == NULL)
+    {
+        return 0;
+    }
+
+    free_segments();
+    if (!vlog.running)
+    {
+        if (vlog.pass_start_ns != 0 && start - vlog.pass_start_ns < VLOG_PASS_MS * 1000000ULL)
+        {
+            return 0;
+        }
+        start_pass(start);
+    }
+    if (vlog.generation != tree_generation)
+    {
+        // First slice, or a DROP or RENAME moved nodes the saved position may point into.
+        node_iter_init(&vlog.it, &root.node, false);
+        vlog.generation = tree_generation;
+    }
+
+    uint64_t before = vlog.spilled + vlog.relocated;
+    unsigned visited = 0;
+    Node *n;
+    while ((n = node_iter_next(&vlog.it)) != NULL)
+    {
+        if (visit_file(n) != 0)
+        {
+            break; // The log is full or unusable: finish the pass early.
+        }
+        if (++visited >= VLOG_CHECK_NODES)
+        {
+            visited = 0;
+            if (now_ns() - start >= budget_ns)
+            {
+                flush_batch();
+                return (int)(vlog.spilled + vlog.relocated - before); // Resume from here.
+            }
+        }
+    }
+
+    flush_batch();
+    vlog.running = false;
+    vlog.passes++;
+    for (unsigned slot = 1; slot < VLOG_MAX_SEGMENTS; slot++)
+    {
+        vlog.segs[slot].victim = false;
+    }
+    free_segments();
+    return (int)(vlog.spilled + vlog.relocated - before);
+}
+
+/**
+ * @brief In a forked child (see admin.c): closes every descriptor from `first` up except
+ * the segment files, which the child's copy of the tree still reads cold values from.
+ */
+void vlog_close_fds(unsigned first)
+{
+    // Segment descriptors at or above `first`, in increasing order.
+    unsigned keep[VLOG_MAX_SEGMENTS];
+    unsigned nkeep = 0;
+    for (unsigned slot = 1; slot < VLOG_MAX_SEGMENTS; slot++)
+    {
+        int fd = vlog.segs[slot].fd;
+        if (fd != -1 && (unsigned)fd >= first)
+        {
+            unsigned pos = nkeep++;
+            while (pos > 0 && keep[pos - 1] > (unsigned)fd)
+            {
+                keep[pos] = keep[pos - 1];
+                pos--;
+            }
+            keep[pos] = (unsigned)fd;
+        }
+    }
+
+    for (unsigned i = 0; i < nkeep; i++)
+    {
+        if (keep[i] > first)
+        {
+            close_range(first, keep[i] - 1, 0);
+        }
+        first = keep[i] + 1;
+    }
+    close_range(first, ~0U, 0);
+}
+
+/**
+ * @brief Closes and deletes the log files. Runs after the tree is freed.
+ */
+void vlog_shutdown(void)
+{
+    for (unsigned slot = 1; slot < VLOG_MAX_SEGMENTS; slot++)
+    {
+        struct segment *seg = &vlog.segs[slot];
+        if (seg->fd != -1)
+        {
+            close(seg->fd);
+            unlink(seg->path);
+            seg->fd = -1;
+        }
+    }
+    vlog.active = 0;
+    free(vlog.batch);
+    vlog.batch = NULL;
+}
+
+/**
+ * @brief Formats value log counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int vlog_stats(char *buf, size_t cap)
+{
+    if (vlog_dir == NULL)
+    {
+        return snprintf(buf, cap, "  Vlog: off\n");
+    }
+
+    unsigned segments = 0;
+    uint64_t disk = 0, live = 0;
+    for (unsigned slot = 1; slot < VLOG_MAX_SEGMENTS; slot++)
+    {
+        if (vlog.segs[slot].fd != -1)
+        {
+            segments++;
+            disk += vlog.segs[slot].size;
+            live += vlog.segs[slot].live;
+        }
+    }
+    return snprintf(buf, cap,
+                    "  Vlog: cold=%llu segments=%u disk=%llu live=%llu bytes spilled=%llu relocated=%llu "
+                    "promoted=%llu reads: async=%llu sync=%llu freed_segments=%llu passes=%llu errors=%llu\n",
+                    (unsigned long long)vlog.cold_values, segments, (unsigned long long)disk,
+                    (unsigned long long)live, (unsigned long long)vlog.spilled, (unsigned long long)vlog.relocated,
+                    (unsigned long long)vlog.promoted, (unsigned long long)vlog.async_reads,
+                    (unsigned long long)vlog.sync_reads, (unsigned long long)vlog.freed_segments,
+                    (unsigned long long)vlog.passes, (unsigned long long)vlog.write_errors);
+}
@@ -0,0 +1,58 @@
+/* vlog.h - Value log: cold values spilled to local disk */
+#ifndef VLOG_H
+#define VLOG_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint16_t, uint32_t, uint64_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define VLOG_SEGMENT_BYTES (64ULL << 20) // Size at which the log moves on to a new segment file
+#define VLOG_MAX_SEGMENTS 1024           // Segment slots (slot 0 is never used, so no ref is 0)
+#define VLOG_MIN_VALUE 64                // Smaller stored values stay in memory (the ref saves too little)
+#define VLOG_COLD_DEFAULT 300            // Seconds without a lookup before a value is cold (--vlog-cold)
+#define VLOG_GC_PERCENT 50               // Full segments at least this dead have their live records moved
+#define VLOG_BATCH_BYTES (256 * 1024)    // Records gathered per write
+#define VLOG_BUDGET_NS 1000000           // Time spent per slice (1 ms)
+#define VLOG_PASS_MS 10000               // A new pass over the tree starts at most this often
+#define VLOG_CHECK_NODES 64              // Nodes visited between two clock reads
+
+/*
+ * Keys and metadata always stay in memory; only the stored bytes of cold values move.
+ * Every lookup stamps the leaf with tier_clock (see tree.h), and a normal-priority
+ * background task walks the tree a slice at a time: private values not looked up for
+ * --vlog-cold seconds are appended to the current segment of an append-only log under
+ * --vlog-dir, and the leaf keeps a 64-bit ref (segment slot << 40 | offset) in place of
+ * its `value` pointer (LeafCold). Compressed values are spilled as stored. Shared
+ * (deduplicated) values and packed files stay in memory.
+ *
+ * Reading a cold value: GET hands the read to the worker pool (see workers.h) and the
+ * client waits as for DUMP, then the value is promoted back into memory unless
+ * --vlog-promote is off. Every other reader (MGET, GETGLOB, DUMP, ...) and GETs the
+ * pool can't take read synchronously.
+ *
+ * Garbage collection: overwriting, deleting or promoting a cold value marks its record
+ * dead. Each pass moves the live records of full segments that are at least
+ * VLOG_GC_PERCENT dead to the end of the log (old MVCC versions included), and a
+ * segment with no live record left, and no read in flight, is deleted.
+ * The log is scratch space: its files are truncated at startup and deleted on exit.
+ */
+
+extern const char *vlog_dir; // Directory of the log files (--vlog-dir; NULL = tiering off)
+extern uint32_t vlog_cold;   // Seconds without a lookup before a value is spilled (--vlog-cold)
+extern bool vlog_promote;    // Bring values read by GET back into memory (--vlog-promote)
+
+int vlog_init(void);
+bool vlog_enabled(void);
+int vlog_read(uint64_t ref, int8_t *buf, uint16_t n);
+int vlog_read_fd(int fd, uint64_t ref, int8_t *buf, uint16_t n);
+int vlog_pin(uint64_t ref);
+void vlog_unpin(uint64_t ref, bool promoted);
+void vlog_release(uint64_t ref, uint16_t n);
+bool vlog_pending(void);
+int vlog_cycle(uint64_t budget_ns);
+void vlog_close_fds(unsigned first);
+void vlog_shutdown(void);
+int vlog_stats(char *buf, size_t cap);
+
+#endif /* VLOG_H */
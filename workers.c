@@ -0,0 +1,255 @@
+/* workers.c - Worker threads for heavyweight administrative commands */
+#include "workers.h" // Own header for configuration and prototypes
+#include "main.h"    // struct client, resume_client_later, logging macros
+#include "numa.h"    // numa_pin_thread, numa_thread_node
+#include "util.h"    // now_ns
+
+#include <pthread.h>     // pthread_create, mutexes, condition variables
+#include <sys/eventfd.h> // eventfd
+
+/**
+ * @brief Pool state. `lock` protects the two queues, `stopping` and `busy_ns`; the rest
+ * belongs to the event loop.
+ */
+static struct
+{
+    pthread_t threads[WORKER_THREADS]; // The workers
+    int nthreads;                      // Workers started
+    pthread_mutex_t lock;              // Protects the queues
+    pthread_cond_t wake;               // Signalled when a job is queued or the pool stops
+    struct job *todo, *todo_tail;      // Jobs waiting for a worker (FIFO)
+    struct job *done, *done_tail;      // Jobs finished, waiting for the event loop (FIFO)
+    bool stopping;                     // Workers exit once `todo` is empty
+    int event_fd;                      // eventfd a worker bumps after finishing a job
+    size_t outstanding;                // Jobs submitted and not completed yet
+    uint64_t submitted;                // Jobs accepted
+    uint64_t completed;                // Jobs whose `done` ran
+    uint64_t refused;                  // Jobs turned away (pool full or unavailable)
+    uint64_t busy_ns;                  // Time spent in `run`, over all workers
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .event_fd = -1};
+
+static void push(struct job **head, struct job **tail, struct job *job)
+{
+    job->next = NULL;
+    if (*tail != NULL)
+    {
+        (*tail)->next = job;
+    }
+    else
+    {
+        *head = job;
+    }
+    *tail = job;
+}
+
+/**
+ * @brief Worker thread: runs queued jobs and posts each one back to the event loop.
+ * @param arg The event loop's NUMA node (as intptr_t), -1 if it isn't pinned.
+ */
+static void *worker_main(void *arg)
+{
+    // Same node as the event loop: the buffers a job fills are read there afterwards.
+    int node = (int)(intptr_t)arg;
+    if (node >= 0)
+    {
+        numa_pin_thread(node);
+    }
+    pthread_mutex_lock(&pool.lock);
+    for (;;)
+    {
+        while (pool.todo == NULL && !pool.stopping)
+        {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+        struct job *job = pool.todo;
+        if (job == NULL)
+        {
+            break; // Stopping and nothing left to do.
+        }
+        pool.todo = job->next;
+        if (pool.todo == NULL)
+        {
+            pool.todo_tail = NULL;
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        uint64_t start = now_ns();
+        job->run(job);
+        job->run_ns = now_ns() - start;
+
+        pthread_mutex_lock(&pool.lock);
+        push(&pool.done, &pool.done_tail, job);
+        pool.busy_ns += job->run_ns;
+
+        uint64_t one = 1;
+        if (write(pool.event_fd, &one, sizeof(one)) != (ssize_t)sizeof(one))
+        {
+            error_log("Worker: eventfd write failed: %s", strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/**
+ * @brief Creates the completion eventfd (watched by the event loop) and starts the workers.
+ * @param epoll_fd The event loop's epoll descriptor.
+ * @return 0 on success, -1 if the pool is unavailable (heavyweight commands are then refused).
+ */
+int workers_init(int epoll_fd)
+{
+    pool.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool.event_fd == -1)
+    {
+        error_log("eventfd failed: %s", strerror(errno));
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = pool.event_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pool.event_fd, &ev) == -1)
+    {
+        error_log("epoll_ctl ADD (workers) failed: %s", strerror(errno));
+        close(pool.event_fd);
+        pool.event_fd = -1;
+        return -1;
+    }
+
+    void *node = (void *)(intptr_t)numa_thread_node();
+    for (int i = 0; i < WORKER_THREADS; i++)
+    {
+        int err = pthread_create(&pool.threads[i], NULL, worker_main, node);
+        if (err != 0)
+        {
+            error_log("pthread_create failed: %s", strerror(err));
+            break;
+        }
+        pool.nthreads++;
+    }
+    info_log("Worker pool: %d threads", pool.nthreads);
+    return pool.nthreads > 0 ? 0 : -1;
+}
+
+/**
+ * @brief Returns true if the pool can take another job right now.
+ */
+bool workers_accepting(void)
+{
+    return pool.nthreads > 0 && pool.outstanding < WORKER_MAX_JOBS;
+}
+
+/**
+ * @brief Hands a job to the pool on behalf of a client. The client reads no further
+ * commands until the job's reply is sent, so its replies keep their order.
+ *
+ * @param job The job (`run` and `done` set).
+ * @param client The connection awaiting the reply.
+ * @return 0 if queued, -1 if the pool is full or unavailable (the caller still owns the job).
+ */
+int workers_submit(struct job *job, struct client *client)
+{
+    if (!workers_accepting())
+    {
+        pool.refused++;
+        return -1;
+    }
+
+    job->client = client;
+    client->job = job;
+    pool.outstanding++;
+    pool.submitted++;
+
+    pthread_mutex_lock(&pool.lock);
+    push(&pool.todo, &pool.todo_tail, job);
+    pthread_cond_signal(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    return 0;
+}
+
+/**
+ * @brief Returns the completion eventfd (to recognize its events), or -1 if there is none.
+ */
+int workers_event_fd(void)
+{
+    return pool.event_fd;
+}
+
+/**
+ * @brief Finishes the jobs the workers are done with: runs each `done` on the event loop
+ * and lets the waiting client continue with the commands queued behind the job.
+ */
+void workers_complete(void)
+{
+    uint64_t count;
+    if (read(pool.event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        error_log("Worker: eventfd read failed: %s", strerror(errno));
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    struct job *job = pool.done;
+    pool.done = pool.done_tail = NULL;
+    pthread_mutex_unlock(&pool.lock);
+
+    while (job != NULL)
+    {
+        struct job *next = job->next;
+        struct client *client = job->client;
+
+        pool.outstanding--;
+        pool.completed++;
+        if (client != NULL)
+        {
+            client->job = NULL;
+        }
+        job->done(job);
+        if (client != NULL)
+        {
+            resume_client_later(client); // Not inside the event batch (see resume_client_later).
+        }
+        job = next;
+    }
+}
+
+/**
+ * @brief Stops the pool: workers finish the queued jobs and exit, then the remaining
+ * completions are delivered.
+ */
+void workers_shutdown(void)
+{
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = true;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < pool.nthreads; i++)
+    {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pool.nthreads = 0;
+
+    if (pool.event_fd >= 0)
+    {
+        workers_complete();
+        close(pool.event_fd);
+        pool.event_fd = -1;
+    }
+}
+
+/**
+ * @brief Formats pool counters for the `stats` command.
+ * @return Number of characters written (as snprintf).
+ */
+int workers_stats(char *buf, size_t cap)
+{
+    pthread_mutex_lock(&pool.lock);
+    uint64_t busy_ns = pool.busy_ns;
+    pthread_mutex_unlock(&pool.lock);
+
+    return snprintf(buf, cap,
+                    "  Workers: threads=%d outstanding=%zu submitted=%llu completed=%llu refused=%llu "
+                    "busy=%.3f ms\n",
+                    pool.nthreads, pool.outstanding, (unsigned long long)pool.submitted,
+                    (unsigned long long)pool.completed, (unsigned long long)pool.refused, busy_ns / 1e6);
+}
@@ -0,0 +1,39 @@
+/* workers.h - Worker threads for heavyweight administrative commands */
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <stdbool.h> // boolean
+
+// Configuration constants
+#define WORKER_THREADS 2  // Threads in the pool
+#define WORKER_MAX_JOBS 8 // Jobs queued or running at once (more are refused)
+
+struct client;
+
+/**
+ * @brief A job handed to the pool. The state lives in a structure embedding `struct job`
+ * as its first member. `run` executes on a worker thread and must not touch the tree,
+ * the allocators or any client: everything it needs is prepared by the event loop (for
+ * a consistent view of the tree, see admin.c). `done` then runs on the event loop,
+ * sends the reply if `client` is still connected, and frees the job.
+ */
+struct job
+{
+    void (*run)(struct job *job);  // Runs on a worker thread
+    void (*done)(struct job *job); // Runs on the event loop afterwards; frees the job
+    struct client *client;         // Connection awaiting the reply (NULL once it closed); event loop only
+    struct job *next;              // Queue link
+    uint64_t run_ns;               // Time `run` took (set by the worker)
+};
+
+int workers_init(int epoll_fd);
+bool workers_accepting(void);
+int workers_submit(struct job *job, struct client *client);
+int workers_event_fd(void);
+void workers_complete(void);
+void workers_shutdown(void);
+int workers_stats(char *buf, size_t cap);
+
+#endif /* WORKERS_H */